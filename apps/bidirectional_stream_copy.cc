@@ -9,7 +9,7 @@
 
 using namespace std;
 
-void bidirectional_stream_copy(Socket &socket) {
+void bidirectional_stream_copy(Socket &socket, const bool copy_input) {
     constexpr size_t max_copy_length = 65536;
     constexpr size_t buffer_size = 1048576;
 
@@ -26,17 +26,21 @@ void bidirectional_stream_copy(Socket &socket) {
     _output.set_blocking(false);
 
     // rule 1: read from stdin into outbound byte stream
-    _eventloop.add_rule(
-        _input,
-        Direction::In,
-        [&] {
-            _outbound.write(_input.read(_outbound.remaining_capacity()));
-            if (_input.eof()) {
-                _outbound.end_input();
-            }
-        },
-        [&] { return (not _outbound.error()) and (_outbound.remaining_capacity() > 0) and (not _inbound.error()); },
-        [&] { _outbound.end_input(); });
+    if (copy_input) {
+        _eventloop.add_rule(
+            _input,
+            Direction::In,
+            [&] {
+                _outbound.write(_input.read(_outbound.remaining_capacity()));
+                if (_input.eof()) {
+                    _outbound.end_input();
+                }
+            },
+            [&] { return (not _outbound.error()) and (_outbound.remaining_capacity() > 0) and (not _inbound.error()); },
+            [&] { _outbound.end_input(); });
+    } else {
+        _outbound.end_input();
+    }
 
     // rule 2: read from outbound byte stream into socket
     _eventloop.add_rule(socket,
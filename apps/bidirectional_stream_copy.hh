@@ -3,7 +3,9 @@
 
 #include "socket.hh"
 
-//! Copy socket input/output to stdin/stdout until finished
-void bidirectional_stream_copy(Socket &socket);
+//! \brief Copy socket input/output to stdin/stdout until finished
+//! \param[in] copy_input is `false` to leave stdin alone and just shut down the socket's output (e.g.
+//! when a file has already been sent with TCPSpongeSocket::send_file())
+void bidirectional_stream_copy(Socket &socket, const bool copy_input = true);
 
 #endif  // SPONGE_APPS_BIDIRECTIONAL_STREAM_COPY_HH
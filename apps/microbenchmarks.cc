@@ -0,0 +1,537 @@
+#include "alloc_tracker.hh"
+#include "buffer.hh"
+#include "byte_stream.hh"
+#include "ipv4_datagram.hh"
+#include "parser.hh"
+#include "perf_counters.hh"
+#include "stream_reassembler.hh"
+#include "tcp_header.hh"
+#include "util.hh"
+#include "wrapping_integers.hh"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <numeric>
+#include <optional>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+using namespace std;
+using namespace std::chrono;
+
+//! One operation to be timed
+struct Benchmark {
+    string name;               //!< e.g. "bytestream_write/1460"
+    size_t bytes_per_op;       //!< Bytes each operation handles (0 if that isn't meaningful)
+    function<void()> setup;    //!< Untimed preparation before each batch
+    function<size_t()> batch;  //!< Timed; performs some operations and returns how many
+};
+
+//! Statistics over the samples of one Benchmark, in nanoseconds per operation
+struct Summary {
+    size_t samples = 0;
+    double median = 0;
+    double mean = 0;
+    double min = 0;
+    double max = 0;
+    double stddev = 0;
+    double allocations_per_op = 0;      //!< Heap allocations per operation, over all the samples
+    double allocated_bytes_per_op = 0;  //!< Bytes of those allocations per operation
+    PerfCounters::Values per_op{};      //!< Hardware events per operation, over all the samples (if counted)
+};
+
+//! What batch() did, summed over the batches of a run
+struct Totals {
+    size_t ops = 0;
+    AllocationCounts allocations{};
+};
+
+//! How long to run each Benchmark
+struct Timing {
+    milliseconds warmup{100};  //!< Untimed running before the first sample
+    milliseconds sample{20};   //!< Least time that each sample covers
+    size_t samples = 10;       //!< Samples per Benchmark
+};
+
+//! Results are folded in here, so that the compiler can't discard the work that produced them
+static volatile size_t sink = 0;
+
+//! Run setup() and batch() until `least` has been spent in batch(), counting hardware events in batch()
+//! with `counters` (if given)
+//! \returns the nanoseconds per operation, and adds the operations and allocations to `totals`
+static double run_for(const Benchmark &b, const nanoseconds least, PerfCounters *counters, Totals &totals) {
+    nanoseconds elapsed{0};
+    size_t ops = 0;
+    do {
+        b.setup();
+        if (counters) {
+            counters->start();  // outside the timed region, which the ioctl would slow
+        }
+        const AllocationScope allocations;
+        const auto start = steady_clock::now();
+        ops += b.batch();
+        elapsed += steady_clock::now() - start;
+        const AllocationCounts batch_allocations = allocations.counts();
+        if (counters) {
+            counters->stop();
+        }
+        totals.allocations.allocations += batch_allocations.allocations;
+        totals.allocations.bytes += batch_allocations.bytes;
+    } while (elapsed < least);
+    totals.ops += ops;
+    return double(elapsed.count()) / max<size_t>(ops, 1);
+}
+
+static Summary measure(const Benchmark &b, const Timing &timing, PerfCounters *counters) {
+    Totals warmup;
+    run_for(b, timing.warmup, nullptr, warmup);
+
+    vector<double> ns_per_op;
+    Totals totals;
+    if (counters) {
+        counters->reset();
+    }
+    for (size_t i = 0; i < timing.samples; ++i) {
+        ns_per_op.push_back(run_for(b, timing.sample, counters, totals));
+    }
+    sort(ns_per_op.begin(), ns_per_op.end());
+
+    Summary s;
+    s.samples = ns_per_op.size();
+    const size_t mid = s.samples / 2;
+    s.median = s.samples % 2 ? ns_per_op[mid] : (ns_per_op[mid - 1] + ns_per_op[mid]) / 2;
+    s.mean = accumulate(ns_per_op.begin(), ns_per_op.end(), 0.0) / s.samples;
+    s.min = ns_per_op.front();
+    s.max = ns_per_op.back();
+    double sum_of_squares = 0;
+    for (const double x : ns_per_op) {
+        sum_of_squares += (x - s.mean) * (x - s.mean);
+    }
+    s.stddev = s.samples > 1 ? sqrt(sum_of_squares / (s.samples - 1)) : 0;
+
+    const size_t ops = max<size_t>(totals.ops, 1);
+    s.allocations_per_op = double(totals.allocations.allocations) / ops;
+    s.allocated_bytes_per_op = double(totals.allocations.bytes) / ops;
+
+    if (counters) {
+        s.per_op = counters->read();
+        for (auto &value : s.per_op) {
+            if (value.has_value()) {
+                value = value.value() / ops;
+            }
+        }
+    }
+    return s;
+}
+
+//! `n` random bytes
+static string random_bytes(const size_t n, mt19937 &rng) {
+    string ret(n, 0);
+    generate(ret.begin(), ret.end(), [&] { return static_cast<char>(rng()); });
+    return ret;
+}
+
+//! ByteStream::write() (copying and sharing), peek_output() and pop_output(), `chunk` bytes at a time
+static void byte_stream_benchmarks(vector<Benchmark> &out, const size_t chunk, mt19937 &rng) {
+    const size_t capacity = max<size_t>(64 * 1024, chunk);
+    const size_t chunks = capacity / chunk;
+    const string data = random_bytes(chunk, rng);
+    const Buffer shared{string(data)};
+    auto stream = make_shared<ByteStream>(capacity);
+    const string suffix = "/" + to_string(chunk);
+
+    const auto empty = [=] { *stream = ByteStream{capacity}; };
+    const auto full = [=] {
+        *stream = ByteStream{capacity};
+        for (size_t i = 0; i < chunks; ++i) {
+            stream->write(shared);
+        }
+    };
+
+    out.push_back({"bytestream_write" + suffix, chunk, empty, [=] {
+                       for (size_t i = 0; i < chunks; ++i) {
+                           sink += stream->write(string_view(data));
+                       }
+                       return chunks;
+                   }});
+    out.push_back({"bytestream_write_buffer" + suffix, chunk, empty, [=] {
+                       for (size_t i = 0; i < chunks; ++i) {
+                           sink += stream->write(shared);
+                       }
+                       return chunks;
+                   }});
+    out.push_back({"bytestream_peek" + suffix, chunk, full, [=] {
+                       for (size_t i = 0; i < chunks; ++i) {
+                           sink += stream->peek_output(chunk).size();
+                       }
+                       return chunks;
+                   }});
+    out.push_back({"bytestream_pop" + suffix, chunk, full, [=] {
+                       for (size_t i = 0; i < chunks; ++i) {
+                           stream->pop_output(chunk);
+                       }
+                       return chunks;
+                   }});
+}
+
+//! StreamReassembler::push_substring() of a 64 KiB stream in `chunk`-byte pieces, in several orders
+static void reassembler_benchmarks(vector<Benchmark> &out, const size_t chunk, mt19937 &rng) {
+    const size_t size = max<size_t>(64 * 1024, chunk);
+    const auto stream = make_shared<const string>(random_bytes(size, rng));
+    const string suffix = "/" + to_string(chunk);
+
+    //! Each piece is {index, length}
+    using Pieces = vector<pair<size_t, size_t>>;
+    Pieces in_order;
+    for (size_t i = 0; i < size; i += chunk) {
+        in_order.emplace_back(i, min(chunk, size - i));
+    }
+    Pieces reversed{in_order.rbegin(), in_order.rend()};
+    Pieces shuffled = in_order;
+    shuffle(shuffled.begin(), shuffled.end(), rng);
+    Pieces overlapping;  // each piece also covers half of the next one
+    for (size_t i = 0; i < size; i += chunk) {
+        overlapping.emplace_back(i, min(chunk + chunk / 2, size - i));
+    }
+
+    auto reassembler = make_shared<StreamReassembler>(size);
+    const auto add = [&](const string &workload, Pieces pieces) {
+        const auto substrings = make_shared<vector<pair<size_t, string>>>();
+        for (const auto &[index, length] : pieces) {
+            substrings->emplace_back(index, stream->substr(index, length));
+        }
+        out.push_back({"reassembler_" + workload + suffix,
+                       chunk,
+                       [=] { *reassembler = StreamReassembler{size}; },
+                       [=] {
+                           for (const auto &[index, data] : *substrings) {
+                               reassembler->push_substring(data, index, index + data.size() == size);
+                           }
+                           sink += reassembler->stream_out().buffer_size();
+                           return substrings->size();
+                       }});
+    };
+    add("in_order", in_order);
+    add("reverse", reversed);
+    add("random", shuffled);
+    add("overlap", overlapping);
+}
+
+//! InternetChecksum::add() (and value()) over `chunk` bytes
+static void checksum_benchmark(vector<Benchmark> &out, const size_t chunk, mt19937 &rng) {
+    const auto data = make_shared<const string>(random_bytes(chunk, rng));
+    const size_t ops = max<size_t>(1, (64 * 1024) / chunk);
+    out.push_back({"checksum/" + to_string(chunk), chunk, [] {}, [=] {
+                       for (size_t i = 0; i < ops; ++i) {
+                           InternetChecksum check;
+                           check.add(*data);
+                           sink += check.value();
+                       }
+                       return ops;
+                   }});
+}
+
+//! Each BufferList operation on `chunk`-byte Buffers
+static void buffer_list_benchmarks(vector<Benchmark> &out, const size_t chunk, mt19937 &rng) {
+    static constexpr size_t BUFFERS = 8;  // more than fit inline
+    static constexpr size_t OPS = 1024;
+    const Buffer buffer{random_bytes(chunk, rng)};
+    const auto list = make_shared<BufferList>();
+    for (size_t i = 0; i < BUFFERS; ++i) {
+        list->push_back(buffer);
+    }
+    const string suffix = "/" + to_string(chunk);
+
+    // one push_back() and one remove_prefix() of a whole Buffer, with BUFFERS Buffers queued
+    out.push_back({"bufferlist_push_pop" + suffix, chunk, [] {}, [=] {
+                       BufferList queue = *list;
+                       for (size_t i = 0; i < OPS; ++i) {
+                           queue.push_back(buffer);
+                           queue.remove_prefix(chunk);
+                       }
+                       sink += queue.size();
+                       return OPS;
+                   }});
+    out.push_back({"bufferlist_concatenate" + suffix, BUFFERS * chunk, [] {}, [=] {
+                       for (size_t i = 0; i < OPS; ++i) {
+                           sink += list->concatenate().size();
+                       }
+                       return OPS;
+                   }});
+    out.push_back({"bufferviewlist_from_bufferlist" + suffix, BUFFERS * chunk, [] {}, [=] {
+                       for (size_t i = 0; i < OPS; ++i) {
+                           sink += BufferViewList{*list}.iovec_count();
+                       }
+                       return OPS;
+                   }});
+}
+
+//! Parsing and serializing headers, and wrapping and unwrapping sequence numbers
+static void header_benchmarks(vector<Benchmark> &out, mt19937 &rng) {
+    static constexpr size_t OPS = 1024;
+
+    TCPHeader tcp;
+    tcp.sport = 1234;
+    tcp.dport = 5678;
+    tcp.seqno = WrappingInt32{static_cast<uint32_t>(rng())};
+    tcp.ackno = WrappingInt32{static_cast<uint32_t>(rng())};
+    tcp.ack = true;
+    tcp.win = 65535;
+    const Buffer tcp_serialized{tcp.serialize()};
+
+    out.push_back({"tcp_header_parse", TCPHeader::LENGTH, [] {}, [=] {
+                       for (size_t i = 0; i < OPS; ++i) {
+                           NetParser p{tcp_serialized};
+                           TCPHeader h;
+                           if (h.parse(p) != ParseResult::NoError) {
+                               throw runtime_error("TCPHeader::parse failed");
+                           }
+                           sink += h.win;
+                       }
+                       return OPS;
+                   }});
+    out.push_back({"tcp_header_serialize", TCPHeader::LENGTH, [] {}, [=] {
+                       for (size_t i = 0; i < OPS; ++i) {
+                           sink += tcp.serialize().size();
+                       }
+                       return OPS;
+                   }});
+
+    IPv4Datagram datagram;
+    datagram.payload() = BufferList{random_bytes(1000, rng)};
+    datagram.header().len = IPv4Header::LENGTH + datagram.payload().size();
+    datagram.header().src = 0x0a000001;
+    datagram.header().dst = 0x0a000002;
+    const Buffer ip_serialized{datagram.serialize().concatenate()};
+
+    out.push_back({"ipv4_header_parse", IPv4Header::LENGTH, [] {}, [=] {
+                       for (size_t i = 0; i < OPS; ++i) {
+                           NetParser p{ip_serialized};
+                           IPv4Header h;
+                           if (h.parse(p) != ParseResult::NoError) {
+                               throw runtime_error("IPv4Header::parse failed");
+                           }
+                           sink += h.len;
+                       }
+                       return OPS;
+                   }});
+
+    // absolute sequence numbers near random checkpoints, so that unwrap() takes every branch
+    const WrappingInt32 isn{static_cast<uint32_t>(rng())};
+    const auto absolutes = make_shared<vector<uint64_t>>(), checkpoints = make_shared<vector<uint64_t>>();
+    const auto wrapped = make_shared<vector<WrappingInt32>>();
+    uniform_int_distribution<uint64_t> checkpoint_dist{0, uint64_t{1} << 40};
+    uniform_int_distribution<int64_t> offset_dist{-(int64_t{1} << 30), int64_t{1} << 30};
+    for (size_t i = 0; i < OPS; ++i) {
+        checkpoints->push_back(checkpoint_dist(rng) + (uint64_t{1} << 31));
+        absolutes->push_back(checkpoints->back() + offset_dist(rng));
+        wrapped->push_back(wrap(absolutes->back(), isn));
+    }
+
+    out.push_back({"wrap", 0, [] {}, [=] {
+                       for (const uint64_t n : *absolutes) {
+                           sink += wrap(n, isn).raw_value();
+                       }
+                       return OPS;
+                   }});
+    out.push_back({"unwrap", 0, [] {}, [=] {
+                       for (size_t i = 0; i < OPS; ++i) {
+                           sink += unwrap((*wrapped)[i], isn, (*checkpoints)[i]);
+                       }
+                       return OPS;
+                   }});
+}
+
+//! Print `count` / `divisor` as a CSV field or a JSON member (empty or null if there's no count or divisor)
+static void print_count(ostream &out,
+                        const bool json,
+                        const string &name,
+                        const optional<double> &count,
+                        const size_t divisor) {
+    if (json) {
+        out << ", \"" << name << "\": ";
+    } else {
+        out << ",";
+    }
+    if (count.has_value() and divisor > 0) {
+        out << count.value() / divisor;
+    } else if (json) {
+        out << "null";
+    }
+}
+
+static void show_usage(const char *argv0, const char *msg) {
+    cout << "Usage: " << argv0 << " [options]\n\n"
+         << "Times the operations that the TCP implementation is built from, and prints one line (or object)\n"
+         << "per benchmark, in nanoseconds per operation. Lists are comma-separated.\n\n"
+
+         << "   Option                                                          Default\n"
+         << "   --                                                              --\n\n"
+
+         << "   -c <sizes>      Chunk sizes, in bytes                           16,256,1460,16384\n"
+         << "   -b <names>      Run only benchmarks whose names contain one     (all)\n"
+         << "   -n <samples>    Timed samples per benchmark                     10\n"
+         << "   -s <ms>         Least time per sample, in milliseconds          20\n"
+         << "   -w <ms>         Warmup per benchmark, in milliseconds           100\n"
+         << "   -f <format>     Output format: csv or json                      csv\n"
+         << "   -p <on|off>     Also count cycles, instructions, LLC misses     off\n"
+         << "                   and branch misses per op and per byte (with\n"
+         << "                   perf_event_open; left blank if not permitted)\n\n"
+
+         << "   -h              Show this message and quit.\n\n";
+
+    if (msg != nullptr) {
+        cout << msg;
+    }
+    cout << endl;
+}
+
+//! The comma-separated items of `list`
+static vector<string> split(const string &list) {
+    vector<string> ret;
+    stringstream ss{list};
+    for (string item; getline(ss, item, ',');) {
+        ret.push_back(item);
+    }
+    if (ret.empty()) {
+        throw runtime_error("empty list");
+    }
+    return ret;
+}
+
+int main(int argc, char **argv) {
+    try {
+        vector<size_t> chunks{16, 256, 1460, 16384};
+        vector<string> filters;
+        Timing timing;
+        bool json = false;
+        bool count_events = false;
+
+        for (int curr = 1; curr < argc; curr += 2) {
+            if (strncmp("-h", argv[curr], 3) == 0) {
+                show_usage(argv[0], nullptr);
+                return EXIT_SUCCESS;
+            }
+            if (curr + 1 >= argc) {
+                show_usage(argv[0], (string("ERROR: ") + argv[curr] + " requires one argument.").c_str());
+                return EXIT_FAILURE;
+            }
+
+            const string arg = argv[curr + 1];
+            if (strncmp("-c", argv[curr], 3) == 0) {
+                chunks.clear();
+                for (const string &item : split(arg)) {
+                    chunks.push_back(stoul(item));
+                    if (chunks.back() == 0) {
+                        throw runtime_error("chunk sizes must be positive");
+                    }
+                }
+            } else if (strncmp("-b", argv[curr], 3) == 0) {
+                filters = split(arg);
+            } else if (strncmp("-n", argv[curr], 3) == 0 and stoul(arg) > 0) {
+                timing.samples = stoul(arg);
+            } else if (strncmp("-s", argv[curr], 3) == 0) {
+                timing.sample = milliseconds{stoul(arg)};
+            } else if (strncmp("-w", argv[curr], 3) == 0) {
+                timing.warmup = milliseconds{stoul(arg)};
+            } else if (strncmp("-f", argv[curr], 3) == 0 and (arg == "csv" or arg == "json")) {
+                json = arg == "json";
+            } else if (strncmp("-p", argv[curr], 3) == 0 and (arg == "on" or arg == "off")) {
+                count_events = arg == "on";
+            } else {
+                show_usage(argv[0], (string("ERROR: bad option ") + argv[curr] + " " + arg).c_str());
+                return EXIT_FAILURE;
+            }
+        }
+
+        mt19937 rng{12345};
+        vector<Benchmark> benchmarks;
+        for (const size_t chunk : chunks) {
+            byte_stream_benchmarks(benchmarks, chunk, rng);
+        }
+        for (const size_t chunk : chunks) {
+            reassembler_benchmarks(benchmarks, chunk, rng);
+        }
+        for (const size_t chunk : chunks) {
+            checksum_benchmark(benchmarks, chunk, rng);
+        }
+        for (const size_t chunk : chunks) {
+            buffer_list_benchmarks(benchmarks, chunk, rng);
+        }
+        header_benchmarks(benchmarks, rng);
+
+        if (not filters.empty()) {
+            const auto unwanted = [&](const Benchmark &b) {
+                return none_of(filters.begin(), filters.end(), [&](const string &f) {
+                    return b.name.find(f) != string::npos;
+                });
+            };
+            benchmarks.erase(remove_if(benchmarks.begin(), benchmarks.end(), unwanted), benchmarks.end());
+        }
+
+        optional<PerfCounters> counters{};
+        if (count_events) {
+            counters.emplace();
+            if (not counters->error().empty()) {
+                cerr << "DEBUG: some hardware counters are unavailable: " << counters->error() << "\n";
+            }
+        }
+
+        cout << fixed << setprecision(2);
+        if (json) {
+            cout << "[";
+        } else {
+            cout << "benchmark,bytes_per_op,samples,median_ns,mean_ns,min_ns,max_ns,stddev_ns,bytes_per_second,"
+                    "allocations_per_op,allocated_bytes_per_op";
+            for (size_t c = 0; counters and c < PerfCounters::COUNT; ++c) {
+                const string name = PerfCounters::name(static_cast<PerfCounters::Counter>(c));
+                cout << "," << name << "_per_op," << name << "_per_byte";
+            }
+            cout << "\n";
+        }
+
+        for (size_t i = 0; i < benchmarks.size(); ++i) {
+            const Benchmark &b = benchmarks[i];
+            const Summary s = measure(b, timing, counters ? &counters.value() : nullptr);
+            const double bytes_per_second = b.bytes_per_op * 1e9 / s.median;
+            if (json) {
+                cout << (i == 0 ? "\n" : ",\n") << "  {\"benchmark\": \"" << b.name
+                     << "\", \"bytes_per_op\": " << b.bytes_per_op << ", \"samples\": " << s.samples
+                     << ", \"median_ns\": " << s.median << ", \"mean_ns\": " << s.mean << ", \"min_ns\": " << s.min
+                     << ", \"max_ns\": " << s.max << ", \"stddev_ns\": " << s.stddev
+                     << ", \"bytes_per_second\": " << bytes_per_second
+                     << ", \"allocations_per_op\": " << s.allocations_per_op
+                     << ", \"allocated_bytes_per_op\": " << s.allocated_bytes_per_op;
+            } else {
+                cout << b.name << "," << b.bytes_per_op << "," << s.samples << "," << s.median << "," << s.mean
+                     << "," << s.min << "," << s.max << "," << s.stddev << "," << bytes_per_second << ","
+                     << s.allocations_per_op << "," << s.allocated_bytes_per_op;
+            }
+            for (size_t c = 0; counters and c < PerfCounters::COUNT; ++c) {
+                const string name = PerfCounters::name(static_cast<PerfCounters::Counter>(c));
+                print_count(cout, json, name + "_per_op", s.per_op[c], 1);
+                print_count(cout, json, name + "_per_byte", s.per_op[c], b.bytes_per_op);
+            }
+            cout << (json ? "}" : "\n");
+            cout.flush();
+        }
+        if (json) {
+            cout << "\n]\n";
+        }
+    } catch (const exception &e) {
+        cerr << e.what() << "\n";
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,379 @@
+#include "address.hh"
+#include "ipv4_header.hh"
+#include "latency_histogram.hh"
+#include "parser.hh"
+#include "pcap_reader.hh"
+#include "stream_reassembler.hh"
+#include "tcp_config.hh"
+#include "tcp_connection.hh"
+#include "tcp_receiver.hh"
+#include "tcp_segment.hh"
+#include "util.hh"
+#include "wrapping_integers.hh"
+
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace std;
+using namespace std::chrono;
+
+static constexpr uint8_t PROTO_UDP = 17;
+static constexpr size_t UDP_HEADER_LENGTH = 8;
+
+//! One end of a TCP connection
+struct Endpoint {
+    uint32_t address = 0;
+    uint16_t port = 0;
+
+    bool operator==(const Endpoint &other) const { return address == other.address and port == other.port; }
+    string to_string() const { return Address::from_ipv4_numeric(address).ip() + ":" + std::to_string(port); }
+};
+
+//! A TCP segment from the capture
+struct CapturedSegment {
+    uint64_t timestamp_ns = 0;
+    Endpoint src{};
+    Endpoint dst{};
+    TCPSegment segment{};
+};
+
+//! \brief The TCP segment in an IPv4 datagram: directly, or (as tcp_udp sends them) in a UDP datagram
+//! \details Checksums aren't checked, because a capture taken on the sending host holds whatever was in
+//! the checksum field before the NIC filled it in.
+static optional<CapturedSegment> decode(const PcapPacket &packet, const Buffer &datagram) {
+    NetParser p{datagram};
+    IPv4Header ip;
+    if (ip.parse(p) != ParseResult::NoError or ip.mf or ip.offset != 0) {
+        return {};
+    }
+    Buffer payload = p.buffer();
+
+    CapturedSegment captured;
+    uint32_t pseudo_cksum = 0;
+    if (ip.proto == IPv4Header::PROTO_TCP) {
+        pseudo_cksum = ip.pseudo_cksum();
+    } else if (ip.proto == PROTO_UDP and payload.size() >= UDP_HEADER_LENGTH) {
+        payload.remove_prefix(UDP_HEADER_LENGTH);
+    } else {
+        return {};
+    }
+    if (captured.segment.parse(payload, pseudo_cksum, false) != ParseResult::NoError) {
+        return {};
+    }
+    captured.timestamp_ns = packet.timestamp_ns;
+    captured.src = {ip.src, captured.segment.header().sport};
+    captured.dst = {ip.dst, captured.segment.header().dport};
+    return captured;
+}
+
+//! What to feed the segments into
+enum class Mode { Connection, Receiver, Reassembler };
+
+//! One direction of one connection in the capture, to replay
+struct Flow {
+    Endpoint sender{};
+    Endpoint receiver{};
+    vector<CapturedSegment> segments{};      //!< From `sender` to `receiver`, in the order captured
+    optional<WrappingInt32> sender_isn{};    //!< From the sender's SYN, if captured
+    optional<WrappingInt32> receiver_isn{};  //!< From the receiver's SYN, if captured
+    size_t packets = 0;                      //!< Packets in the whole capture
+};
+
+//! \brief Pick a flow from the capture and collect its segments
+//! \details The flow is the first connection whose opening SYN was captured (or, failing that, the first
+//! segment with a payload), restricted to those with an endpoint on `port` if that isn't 0. `server` picks
+//! the direction: towards the end that received the SYN, or away from it.
+static Flow read_flow(const string &path, const uint16_t port, const bool server) {
+    PcapReader reader = PcapReader::open(path);
+    vector<CapturedSegment> all;
+    optional<size_t> syn{}, first_payload{};
+    Flow flow;
+    while (const auto packet = reader.next()) {
+        flow.packets++;
+        const auto datagram = reader.ipv4_datagram(packet.value());
+        if (not datagram.has_value()) {
+            continue;
+        }
+        auto captured = decode(packet.value(), datagram.value());
+        if (not captured.has_value() or (port != 0 and captured->src.port != port and captured->dst.port != port)) {
+            continue;
+        }
+        const TCPHeader &header = captured->segment.header();
+        if (not syn.has_value() and header.syn and not header.ack) {
+            syn = all.size();
+        }
+        if (not first_payload.has_value() and captured->segment.payload().size() > 0) {
+            first_payload = all.size();
+        }
+        all.push_back(move(captured.value()));
+    }
+
+    if (not syn.has_value() and not first_payload.has_value()) {
+        throw runtime_error("no TCP connection (with a SYN or any payload) in " + path);
+    }
+    const CapturedSegment &opening = all.at(syn.value_or(first_payload.value_or(0)));
+    flow.sender = server ? opening.src : opening.dst;
+    flow.receiver = server ? opening.dst : opening.src;
+
+    for (auto &captured : all) {
+        const bool forward = captured.src == flow.sender and captured.dst == flow.receiver;
+        const bool backward = captured.src == flow.receiver and captured.dst == flow.sender;
+        if (captured.segment.header().syn and (forward or backward)) {
+            (forward ? flow.sender_isn : flow.receiver_isn) = captured.segment.header().seqno;
+        }
+        if (forward) {
+            flow.segments.push_back(move(captured));
+        }
+    }
+    if (flow.segments.empty()) {
+        throw runtime_error("no segments from " + flow.sender.to_string() + " to " + flow.receiver.to_string());
+    }
+    return flow;
+}
+
+//! The thing a Flow is replayed into
+struct Target {
+    function<void(const TCPSegment &)> deliver{};  //!< Hand it a segment, and read whatever it makes of it
+    function<void(size_t)> tick{};                 //!< Let this many milliseconds pass
+    uint64_t bytes_delivered = 0;                  //!< Bytes of the stream read out in order
+};
+
+//! A new Target of the given Mode, ready for the first of the Flow's segments
+static shared_ptr<Target> make_target(const Mode mode, const Flow &flow, const size_t capacity, const bool server) {
+    auto target = make_shared<Target>();
+    Target &t = *target;
+    const auto read = [&t](ByteStream &stream) {
+        if (not stream.buffer_empty()) {
+            t.bytes_delivered += stream.read_buffer(stream.buffer_size()).size();
+        }
+    };
+    t.tick = [](size_t) {};
+
+    switch (mode) {
+        case Mode::Connection: {
+            TCPConfig config;
+            config.recv_capacity = capacity;
+            config.fixed_isn = flow.receiver_isn;  // so the captured acknowledgments acknowledge what it sends
+            auto connection = make_shared<TCPConnection>(config);
+            if (not server) {
+                connection->connect();
+            }
+            t.deliver = [connection, read](const TCPSegment &seg) {
+                connection->segment_received(seg);
+                read(connection->inbound_stream());
+                while (not connection->segments_out().empty()) {
+                    connection->segments_out().pop();
+                }
+            };
+            t.tick = [connection](const size_t ms) { connection->tick(ms); };
+        } break;
+        case Mode::Receiver: {
+            auto receiver = make_shared<TCPReceiver>(capacity);
+            t.deliver = [receiver, read](const TCPSegment &seg) {
+                receiver->segment_received(seg);
+                read(receiver->stream_out());
+            };
+        } break;
+        case Mode::Reassembler: {
+            // without the SYN, the stream is taken to start at the first segment's sequence number
+            const WrappingInt32 isn = flow.sender_isn.value_or(flow.segments.front().segment.header().seqno - 1);
+            auto reassembler = make_shared<StreamReassembler>(capacity);
+            t.deliver = [reassembler, read, isn](const TCPSegment &seg) {
+                const TCPHeader &header = seg.header();
+                const uint64_t checkpoint = reassembler->stream_out().bytes_written();
+                const uint64_t absolute_seqno = unwrap(header.seqno, isn, checkpoint) + (header.syn ? 1 : 0);
+                if (absolute_seqno > 0) {
+                    reassembler->push_substring(seg.payload().copy(), absolute_seqno - 1, header.fin);
+                }
+                read(reassembler->stream_out());
+            };
+        } break;
+    }
+    return target;
+}
+
+//! What one replay measured
+struct Result {
+    uint64_t payload_bytes = 0;    //!< Bytes of payload in the segments replayed
+    uint64_t bytes_delivered = 0;  //!< Bytes of the stream read out in order
+    double busy_seconds = 0;       //!< Time spent in the Target, summed over the segments
+    double wall_seconds = 0;       //!< Time from the first segment to the last
+    LatencyHistogram latency{};    //!< Time spent in the Target on each segment, in nanoseconds
+};
+
+//! Replay `flow` into a new Target, as fast as possible or (if `original_timing`) with the captured gaps
+static Result replay(const Flow &flow,
+                     const Mode mode,
+                     const size_t capacity,
+                     const bool server,
+                     const bool original_timing) {
+    const shared_ptr<Target> target = make_target(mode, flow, capacity, server);
+    Result result;
+    const uint64_t first_capture_ns = flow.segments.front().timestamp_ns;
+    uint64_t last_capture_ns = first_capture_ns;
+    uint64_t untick_ns = 0;  //!< Capture time that has passed, but not yet been ticked
+    uint64_t busy_ns = 0;
+
+    const auto start = steady_clock::now();
+    for (const CapturedSegment &captured : flow.segments) {
+        if (original_timing) {
+            this_thread::sleep_until(start + nanoseconds(captured.timestamp_ns - first_capture_ns));
+        }
+        // the Target's clock follows the capture's, whether or not the replay keeps to it
+        if (captured.timestamp_ns > last_capture_ns) {
+            untick_ns += captured.timestamp_ns - last_capture_ns;
+            last_capture_ns = captured.timestamp_ns;
+        }
+        if (untick_ns >= 1'000'000) {
+            target->tick(untick_ns / 1'000'000);
+            untick_ns %= 1'000'000;
+        }
+
+        const uint64_t begin = timestamp_ns();
+        target->deliver(captured.segment);
+        const uint64_t elapsed = timestamp_ns() - begin;
+        result.latency.record(elapsed);
+        busy_ns += elapsed;
+        result.payload_bytes += captured.segment.payload().size();
+    }
+    result.wall_seconds = duration_cast<duration<double>>(steady_clock::now() - start).count();
+    result.busy_seconds = static_cast<double>(busy_ns) / 1e9;
+    result.bytes_delivered = target->bytes_delivered;
+    return result;
+}
+
+static void show_usage(const char *argv0, const char *msg) {
+    cout << "Usage: " << argv0 << " [options] <capture.pcap>\n\n"
+         << "Replays one direction of a TCP connection from a capture (TCP in IPv4, or TCP in UDP as\n"
+         << "tcp_udp sends it) into a TCPConnection, TCPReceiver or StreamReassembler, and prints the\n"
+         << "time spent processing the segments, as one line (or object) per run.\n\n"
+
+         << "   Option                                                          Default\n"
+         << "   --                                                              --\n\n"
+
+         << "   -m <mode>       connection, receiver or reassembler             connection\n"
+         << "   -t <timing>     fast (back to back) or original (as captured)   fast\n"
+         << "   -d <side>       Replay into the server (the end that got the    server\n"
+         << "                   SYN) or the client\n"
+         << "   -p <port>       Only consider connections with this port        any\n"
+         << "   -c <capacity>   Receive capacity, in bytes                      " << (16 << 20) << "\n"
+         << "   -n <runs>       Number of replays                               1\n"
+         << "   -f <format>     Output format: csv or json                      csv\n\n"
+
+         << "   -h              Show this message and quit.\n\n";
+
+    if (msg != nullptr) {
+        cout << msg;
+    }
+    cout << endl;
+}
+
+int main(int argc, char **argv) {
+    try {
+        Mode mode = Mode::Connection;
+        string mode_name = "connection";
+        bool original_timing = false;
+        bool server = true;
+        uint16_t port = 0;
+        size_t capacity = 16 << 20;
+        unsigned runs = 1;
+        bool json = false;
+
+        int curr = 1;
+        for (; curr < argc and argv[curr][0] == '-'; curr += 2) {
+            if (strncmp("-h", argv[curr], 3) == 0) {
+                show_usage(argv[0], nullptr);
+                return EXIT_SUCCESS;
+            }
+            if (curr + 1 >= argc) {
+                show_usage(argv[0], (string("ERROR: ") + argv[curr] + " requires one argument.").c_str());
+                return EXIT_FAILURE;
+            }
+
+            const string arg = argv[curr + 1];
+            if (strncmp("-m", argv[curr], 3) == 0 and (arg == "connection" or arg == "receiver" or
+                                                         arg == "reassembler")) {
+                mode = arg == "connection" ? Mode::Connection : arg == "receiver" ? Mode::Receiver : Mode::Reassembler;
+                mode_name = arg;
+            } else if (strncmp("-t", argv[curr], 3) == 0 and (arg == "fast" or arg == "original")) {
+                original_timing = arg == "original";
+            } else if (strncmp("-d", argv[curr], 3) == 0 and (arg == "server" or arg == "client")) {
+                server = arg == "server";
+            } else if (strncmp("-p", argv[curr], 3) == 0) {
+                port = static_cast<uint16_t>(stoul(arg));
+            } else if (strncmp("-c", argv[curr], 3) == 0) {
+                capacity = stoul(arg);
+            } else if (strncmp("-n", argv[curr], 3) == 0) {
+                runs = stoul(arg);
+            } else if (strncmp("-f", argv[curr], 3) == 0 and (arg == "csv" or arg == "json")) {
+                json = arg == "json";
+            } else {
+                show_usage(argv[0], (string("ERROR: bad option ") + argv[curr] + " " + arg).c_str());
+                return EXIT_FAILURE;
+            }
+        }
+        if (curr + 1 != argc) {
+            show_usage(argv[0], "ERROR: expected one capture file.");
+            return EXIT_FAILURE;
+        }
+
+        const Flow flow = read_flow(argv[curr], port, server);
+        cerr << "DEBUG: replaying " << flow.segments.size() << " segments (of " << flow.packets << " packets) from "
+             << flow.sender.to_string() << " to " << flow.receiver.to_string() << "\n";
+        if (mode != Mode::Reassembler and not flow.sender_isn.has_value()) {
+            cerr << "DEBUG: the capture doesn't start with the SYN, so the " << mode_name
+                 << " will ignore the segments; try -m reassembler\n";
+        }
+
+        cout << fixed << setprecision(4);
+        if (json) {
+            cout << "[";
+        } else {
+            cout << "mode,timing,run,segments,payload_bytes,bytes_delivered,busy_seconds,wall_seconds,"
+                    "segments_per_second,goodput_gbps,latency_p50_ns,latency_p90_ns,latency_p99_ns,latency_p999_ns,"
+                    "latency_max_ns\n";
+        }
+        const string timing = original_timing ? "original" : "fast";
+        for (unsigned i = 0; i < runs; ++i) {
+            const Result r = replay(flow, mode, capacity, server, original_timing);
+            const double segments_per_second = flow.segments.size() / r.busy_seconds;
+            const double goodput = r.bytes_delivered * 8.0 / r.busy_seconds / 1e9;
+            const LatencyHistogram &l = r.latency;
+            if (json) {
+                cout << (i == 0 ? "\n" : ",\n") << "  {\"mode\": \"" << mode_name << "\", \"timing\": \"" << timing
+                     << "\", \"run\": " << i << ", \"segments\": " << flow.segments.size()
+                     << ", \"payload_bytes\": " << r.payload_bytes << ", \"bytes_delivered\": " << r.bytes_delivered
+                     << ", \"busy_seconds\": " << r.busy_seconds << ", \"wall_seconds\": " << r.wall_seconds
+                     << ", \"segments_per_second\": " << segments_per_second << ", \"goodput_gbps\": " << goodput
+                     << ", \"latency_p50_ns\": " << l.percentile(50) << ", \"latency_p90_ns\": " << l.percentile(90)
+                     << ", \"latency_p99_ns\": " << l.percentile(99)
+                     << ", \"latency_p999_ns\": " << l.percentile(99.9) << ", \"latency_max_ns\": " << l.max() << "}";
+            } else {
+                cout << mode_name << "," << timing << "," << i << "," << flow.segments.size() << ","
+                     << r.payload_bytes << "," << r.bytes_delivered << "," << r.busy_seconds << ","
+                     << r.wall_seconds << "," << segments_per_second << "," << goodput << "," << l.percentile(50)
+                     << "," << l.percentile(90) << "," << l.percentile(99) << "," << l.percentile(99.9) << ","
+                     << l.max() << "\n";
+            }
+            cout.flush();
+        }
+        if (json) {
+            cout << "\n]\n";
+        }
+    } catch (const exception &e) {
+        cerr << e.what() << "\n";
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
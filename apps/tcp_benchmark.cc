@@ -1,112 +1,395 @@
+#include "alloc_tracker.hh"
+#include "perf_counters.hh"
+#include "tcp_config.hh"
 #include "tcp_connection.hh"
 
+#include <algorithm>
 #include <chrono>
 #include <cstdlib>
+#include <cstring>
+#include <ctime>
 #include <iomanip>
 #include <iostream>
+#include <optional>
+#include <random>
+#include <sstream>
+#include <stdexcept>
 #include <string>
+#include <vector>
 
 using namespace std;
 using namespace std::chrono;
 
-constexpr size_t len = 100 * 1024 * 1024;
+//! One point in the matrix of scenarios
+struct Scenario {
+    size_t size;         //!< Bytes to transfer
+    size_t window;       //!< Send and receive capacity, in bytes
+    size_t mss;          //!< Largest payload per segment
+    double loss;         //!< Probability that a segment is dropped (in either direction)
+    size_t reorder;      //!< The sender's segments arrive in reversed runs of this many (0 or 1 for in order)
+    double duplication;  //!< Probability that a segment is delivered twice
+    size_t tick_ms;      //!< Milliseconds that pass each time the segments in flight are delivered
+};
 
-void move_segments(TCPConnection &x, TCPConnection &y, vector<TCPSegment> &segments, const bool reorder) {
-    while (not x.segments_out().empty()) {
-        segments.emplace_back(move(x.segments_out().front()));
-        x.segments_out().pop();
-    }
-    if (reorder) {
-        for (auto it = segments.rbegin(); it != segments.rend(); ++it) {
-            y.segment_received(move(*it));
+//! What one run of a Scenario measured
+struct Result {
+    double seconds = 0;              //!< Wall-clock time until the receiver saw the whole stream
+    double cpu_seconds = 0;          //!< CPU time over the same interval
+    uint64_t segments = 0;           //!< Segments delivered, in both directions (duplicates included)
+    uint64_t retransmissions = 0;    //!< Segments from the sender that repeated sequence numbers already sent
+    PerfCounters::Values events{};   //!< Hardware events over the same interval (if counted)
+    AllocationCounts allocations{};  //!< Heap allocations over the same interval
+};
+
+//! The CPU time used so far by the calling thread, in seconds
+static double cpu_time() {
+    timespec ts{};
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return double(ts.tv_sec) + double(ts.tv_nsec) / 1e9;
+}
+
+//! Carries segments from one TCPConnection to another, impaired as the Scenario says
+class Link {
+    const Scenario &_scenario;
+    mt19937 &_rng;
+    vector<TCPSegment> _batch{};
+    bool _forward;  //!< Carries the sender's segments (which are counted and reordered), not the receiver's
+    optional<WrappingInt32> _next_new_seqno{};  //!< One past the highest sequence number sent so far
+
+  public:
+    uint64_t delivered = 0;        //!< Segments handed to the receiving end
+    uint64_t retransmissions = 0;  //!< Segments (with a payload or FIN) that were sent before
+
+    Link(const Scenario &scenario, mt19937 &rng, const bool forward)
+        : _scenario(scenario), _rng(rng), _forward(forward) {}
+
+    //! Move every segment that `from` has queued to `to`
+    void carry(TCPConnection &from, TCPConnection &to) {
+        bernoulli_distribution lose{_scenario.loss}, duplicate{_scenario.duplication};
+        for (; not from.segments_out().empty(); from.segments_out().pop()) {
+            TCPSegment &seg = from.segments_out().front();
+            if (_forward and seg.length_in_sequence_space() > 0) {
+                const WrappingInt32 end = seg.header().seqno + seg.length_in_sequence_space();
+                if (_next_new_seqno.has_value() and seg.header().seqno - _next_new_seqno.value() < 0) {
+                    ++retransmissions;
+                }
+                if (not _next_new_seqno.has_value() or end - _next_new_seqno.value() > 0) {
+                    _next_new_seqno = end;
+                }
+            }
+            if (_scenario.loss > 0 and lose(_rng)) {
+                continue;
+            }
+            if (_scenario.duplication > 0 and duplicate(_rng)) {
+                _batch.push_back(seg);
+            }
+            _batch.push_back(move(seg));
         }
-    } else {
-        for (auto it = segments.begin(); it != segments.end(); ++it) {
-            y.segment_received(move(*it));
+
+        if (_forward and _scenario.reorder > 1) {
+            for (size_t i = 0; i < _batch.size(); i += _scenario.reorder) {
+                reverse(_batch.begin() + i, _batch.begin() + min(i + _scenario.reorder, _batch.size()));
+            }
         }
+        for (auto &seg : _batch) {
+            to.segment_received(seg);
+        }
+        delivered += _batch.size();
+        _batch.clear();
     }
-    segments.clear();
-}
+};
 
-void main_loop(const bool reorder) {
+//! Transfer `data` (of which the Scenario's `size` bytes are sent) from one TCPConnection to another, counting
+//! hardware events with `counters` (if given)
+static Result run(const Scenario &scenario, const Buffer &data, const unsigned seed, PerfCounters *counters) {
     TCPConfig config;
+    config.send_capacity = config.recv_capacity = scenario.window;
+    config.max_payload_size = scenario.mss;
     TCPConnection x{config}, y{config};
 
-    string string_to_send(len, 'x');
-    for (auto &ch : string_to_send) {
-        ch = rand();
-    }
+    mt19937 rng{seed};
+    Link forward{scenario, rng, true}, backward{scenario, rng, false};
 
-    Buffer bytes_to_send{string(string_to_send)};
+    Buffer bytes_to_send = data.substr(0, scenario.size);
     x.connect();
     y.end_input_stream();
 
     bool x_closed = false;
-
-    string string_received;
-    string_received.reserve(len);
-
-    const auto first_time = high_resolution_clock::now();
+    size_t bytes_received = 0;
 
     auto loop = [&] {
-        // write input into x
-        while (bytes_to_send.size() and x.remaining_outbound_capacity()) {
-            const auto want = min(x.remaining_outbound_capacity(), bytes_to_send.size());
-            const auto written = x.write(string(bytes_to_send.str().substr(0, want)));
-            if (want != written) {
-                throw runtime_error("want = " + to_string(want) + ", written = " + to_string(written));
-            }
-            bytes_to_send.remove_prefix(written);
+        // hand the input to x, without copying it
+        if (bytes_to_send.size() > 0) {
+            bytes_to_send.remove_prefix(x.write(bytes_to_send));
         }
-
         if (bytes_to_send.size() == 0 and not x_closed) {
             x.end_input_stream();
             x_closed = true;
         }
 
-        // exchange segments between x and y but in reverse order
-        vector<TCPSegment> segments;
-        move_segments(x, y, segments, reorder);
-        move_segments(y, x, segments, false);
+        forward.carry(x, y);
+        backward.carry(y, x);
 
-        // read output from y
-        const auto available_output = y.inbound_stream().buffer_size();
-        if (available_output > 0) {
-            string_received.append(y.inbound_stream().read(available_output));
+        // check the output from y against what was sent
+        ByteStream &inbound = y.inbound_stream();
+        while (not inbound.buffer_empty()) {
+            const Buffer chunk = inbound.read_buffer(inbound.buffer_size());
+            if (chunk.str() != data.str().substr(bytes_received, chunk.size())) {
+                throw runtime_error("bytes received at offset " + to_string(bytes_received) + " don't match");
+            }
+            bytes_received += chunk.size();
         }
 
         // time passes
-        x.tick(1000);
-        y.tick(1000);
+        x.tick(scenario.tick_ms);
+        y.tick(scenario.tick_ms);
+
+        if (not x.active() and not y.inbound_stream().eof()) {
+            throw runtime_error("the connection died (" + x.state().name() + ")");
+        }
     };
 
+    if (counters) {
+        counters->reset();
+        counters->start();
+    }
+    const AllocationScope allocations;
+    const auto first_time = steady_clock::now();
+    const double first_cpu_time = cpu_time();
+
     while (not y.inbound_stream().eof()) {
         loop();
     }
 
-    if (string_received != string_to_send) {
-        throw runtime_error("strings sent vs. received don't match");
+    Result result;
+    result.seconds = duration_cast<duration<double>>(steady_clock::now() - first_time).count();
+    result.cpu_seconds = cpu_time() - first_cpu_time;
+    result.allocations = allocations.counts();
+    if (counters) {
+        counters->stop();
+        result.events = counters->read();
+    }
+    result.segments = forward.delivered + backward.delivered;
+    result.retransmissions = forward.retransmissions;
+
+    if (bytes_received != scenario.size) {
+        throw runtime_error("received " + to_string(bytes_received) + " of " + to_string(scenario.size) + " bytes");
+    }
+
+    // let both ends finish closing (untimed), which takes 10 retransmission timeouts
+    const size_t rounds = 20 * TCPConfig::TIMEOUT_DFLT / max<size_t>(scenario.tick_ms, 1);
+    for (size_t i = 0; (x.active() or y.active()) and i < rounds; ++i) {
+        loop();
+    }
+
+    return result;
+}
+
+//! Print `count` / `divisor` as a CSV field or a JSON member (empty or null if there's no count or divisor)
+static void print_count(ostream &out,
+                        const bool json,
+                        const string &name,
+                        const optional<double> &count,
+                        const uint64_t divisor) {
+    if (json) {
+        out << ", \"" << name << "\": ";
+    } else {
+        out << ",";
+    }
+    if (count.has_value() and divisor > 0) {
+        out << count.value() / divisor;
+    } else if (json) {
+        out << "null";
     }
+}
 
-    const auto final_time = high_resolution_clock::now();
+static void show_usage(const char *argv0, const char *msg) {
+    cout << "Usage: " << argv0 << " [options]\n\n"
+         << "Transfers a stream between two TCPConnections in memory, for every combination of the\n"
+         << "listed values, and prints one line (or object) per run. Lists are comma-separated.\n\n"
 
-    const auto duration = duration_cast<nanoseconds>(final_time - first_time).count();
+         << "   Option                                                          Default\n"
+         << "   --                                                              --\n\n"
 
-    const auto gigabits_per_second = len * 8.0 / double(duration);
+         << "   -s <sizes>      Bytes to transfer (suffixes K, M and G allowed) 16M\n"
+         << "   -w <windows>    Send and receive capacity, in bytes             " << TCPConfig::DEFAULT_CAPACITY << "\n"
+         << "   -m <mss>        Largest payload per segment, in bytes           " << TCPConfig::MAX_PAYLOAD_SIZE << "\n"
+         << "   -l <rates>      Loss rate in each direction (0..1)              0,0.01\n"
+         << "   -r <depths>     Reverse runs of this many data segments         0,64\n"
+         << "   -d <rates>      Duplication rate (0..1)                         0\n"
+         << "   -t <ticks>      Milliseconds that pass per round trip           10\n"
+         << "   -n <runs>       Runs per scenario                               3\n"
+         << "   -f <format>     Output format: csv or json                      csv\n"
+         << "   -p <on|off>     Also count cycles, instructions, LLC misses     off\n"
+         << "                   and branch misses per segment and per byte\n"
+         << "                   (with perf_event_open; blank if not permitted)\n\n"
 
-    cout << fixed << setprecision(2);
-    cout << "CPU-limited throughput" << (reorder ? " with reordering: " : "                : ") << gigabits_per_second
-         << " Gbit/s\n";
+         << "   -h              Show this message and quit.\n\n";
 
-    while (x.active() or y.active()) {
-        loop();
+    if (msg != nullptr) {
+        cout << msg;
     }
+    cout << endl;
 }
 
-int main() {
+//! A byte count such as "100", "64K" or "1M"
+static size_t parse_size(const string &s) {
+    size_t pos = 0;
+    const size_t n = stoul(s, &pos, 0);
+    const string suffix = s.substr(pos);
+    if (suffix.empty()) {
+        return n;
+    } else if (suffix == "K" or suffix == "k") {
+        return n << 10;
+    } else if (suffix == "M" or suffix == "m") {
+        return n << 20;
+    } else if (suffix == "G" or suffix == "g") {
+        return n << 30;
+    }
+    throw runtime_error("bad size: " + s);
+}
+
+//! The comma-separated items of `list`, each parsed by `parse`
+template <typename T, typename F>
+static vector<T> parse_list(const string &list, F &&parse) {
+    vector<T> ret;
+    stringstream ss{list};
+    for (string item; getline(ss, item, ',');) {
+        ret.push_back(parse(item));
+    }
+    if (ret.empty()) {
+        throw runtime_error("empty list");
+    }
+    return ret;
+}
+
+int main(int argc, char **argv) {
     try {
-        main_loop(false);
-        main_loop(true);
+        vector<size_t> sizes{16 << 20}, windows{TCPConfig::DEFAULT_CAPACITY}, mss{TCPConfig::MAX_PAYLOAD_SIZE};
+        vector<double> losses{0, 0.01}, duplications{0};
+        vector<size_t> reorders{0, 64}, ticks{10};
+        unsigned runs = 3;
+        bool json = false;
+        bool count_events = false;
+
+        const auto to_size = [](const string &s) { return parse_size(s); };
+        const auto to_rate = [](const string &s) { return stod(s); };
+        for (int curr = 1; curr < argc; curr += 2) {
+            if (strncmp("-h", argv[curr], 3) == 0) {
+                show_usage(argv[0], nullptr);
+                return EXIT_SUCCESS;
+            }
+            if (curr + 1 >= argc) {
+                show_usage(argv[0], (string("ERROR: ") + argv[curr] + " requires one argument.").c_str());
+                return EXIT_FAILURE;
+            }
+
+            const string arg = argv[curr + 1];
+            if (strncmp("-s", argv[curr], 3) == 0) {
+                sizes = parse_list<size_t>(arg, to_size);
+            } else if (strncmp("-w", argv[curr], 3) == 0) {
+                windows = parse_list<size_t>(arg, to_size);
+            } else if (strncmp("-m", argv[curr], 3) == 0) {
+                mss = parse_list<size_t>(arg, to_size);
+            } else if (strncmp("-l", argv[curr], 3) == 0) {
+                losses = parse_list<double>(arg, to_rate);
+            } else if (strncmp("-r", argv[curr], 3) == 0) {
+                reorders = parse_list<size_t>(arg, to_size);
+            } else if (strncmp("-d", argv[curr], 3) == 0) {
+                duplications = parse_list<double>(arg, to_rate);
+            } else if (strncmp("-t", argv[curr], 3) == 0) {
+                ticks = parse_list<size_t>(arg, to_size);
+            } else if (strncmp("-n", argv[curr], 3) == 0) {
+                runs = stoul(arg);
+            } else if (strncmp("-f", argv[curr], 3) == 0 and (arg == "csv" or arg == "json")) {
+                json = arg == "json";
+            } else if (strncmp("-p", argv[curr], 3) == 0 and (arg == "on" or arg == "off")) {
+                count_events = arg == "on";
+            } else {
+                show_usage(argv[0], (string("ERROR: bad option ") + argv[curr] + " " + arg).c_str());
+                return EXIT_FAILURE;
+            }
+        }
+
+        // every scenario sends a prefix of the same random data
+        string random_bytes(*max_element(sizes.begin(), sizes.end()), 0);
+        mt19937 rng{12345};
+        generate(random_bytes.begin(), random_bytes.end(), [&] { return static_cast<char>(rng()); });
+        const Buffer data{move(random_bytes)};
+
+        optional<PerfCounters> counters{};
+        if (count_events) {
+            counters.emplace();
+            if (not counters->error().empty()) {
+                cerr << "DEBUG: some hardware counters are unavailable: " << counters->error() << "\n";
+            }
+        }
+
+        cout << fixed << setprecision(4);
+        if (json) {
+            cout << "[";
+        } else {
+            cout << "size,window,mss,loss,reorder,duplication,tick_ms,run,seconds,cpu_seconds,goodput_gbps,segments,"
+                    "segments_per_second,retransmissions,allocations_per_segment,allocated_bytes_per_segment";
+            for (size_t c = 0; counters and c < PerfCounters::COUNT; ++c) {
+                const string name = PerfCounters::name(static_cast<PerfCounters::Counter>(c));
+                cout << "," << name << "_per_segment," << name << "_per_byte";
+            }
+            cout << "\n";
+        }
+
+        vector<Scenario> scenarios;
+        for (const size_t size : sizes) {
+            for (const size_t window : windows) {
+                for (const size_t m : mss) {
+                    for (const double loss : losses) {
+                        for (const size_t reorder : reorders) {
+                            for (const double duplication : duplications) {
+                                for (const size_t tick : ticks) {
+                                    scenarios.push_back({size, window, m, loss, reorder, duplication, tick});
+                                }
+                            }
+                        }
+                    }
+                }
+            }
+        }
+
+        for (size_t n = 0; n < scenarios.size() * runs; ++n) {
+            const Scenario &s = scenarios[n / runs];
+            const unsigned i = n % runs;
+            const Result r = run(s, data, i, counters ? &counters.value() : nullptr);
+            const double goodput = s.size * 8.0 / r.seconds / 1e9;
+            const double segments_per_second = r.segments / r.seconds;
+            const double allocations_per_segment = double(r.allocations.allocations) / max<uint64_t>(r.segments, 1);
+            const double allocated_bytes_per_segment = double(r.allocations.bytes) / max<uint64_t>(r.segments, 1);
+            if (json) {
+                cout << (n == 0 ? "\n" : ",\n") << "  {\"size\": " << s.size << ", \"window\": " << s.window
+                     << ", \"mss\": " << s.mss << ", \"loss\": " << s.loss << ", \"reorder\": " << s.reorder
+                     << ", \"duplication\": " << s.duplication << ", \"tick_ms\": " << s.tick_ms << ", \"run\": " << i
+                     << ", \"seconds\": " << r.seconds << ", \"cpu_seconds\": " << r.cpu_seconds
+                     << ", \"goodput_gbps\": " << goodput << ", \"segments\": " << r.segments
+                     << ", \"segments_per_second\": " << segments_per_second
+                     << ", \"retransmissions\": " << r.retransmissions
+                     << ", \"allocations_per_segment\": " << allocations_per_segment
+                     << ", \"allocated_bytes_per_segment\": " << allocated_bytes_per_segment;
+            } else {
+                cout << s.size << "," << s.window << "," << s.mss << "," << s.loss << "," << s.reorder << ","
+                     << s.duplication << "," << s.tick_ms << "," << i << "," << r.seconds << "," << r.cpu_seconds
+                     << "," << goodput << "," << r.segments << "," << segments_per_second << ","
+                     << r.retransmissions << "," << allocations_per_segment << "," << allocated_bytes_per_segment;
+            }
+            for (size_t c = 0; counters and c < PerfCounters::COUNT; ++c) {
+                const string name = PerfCounters::name(static_cast<PerfCounters::Counter>(c));
+                print_count(cout, json, name + "_per_segment", r.events[c], r.segments);
+                print_count(cout, json, name + "_per_byte", r.events[c], s.size);
+            }
+            cout << (json ? "}" : "\n");
+            cout.flush();
+        }
+        if (json) {
+            cout << "\n]\n";
+        }
     } catch (const exception &e) {
         cerr << e.what() << "\n";
         return EXIT_FAILURE;
@@ -0,0 +1,92 @@
+#include "tcp_config.hh"
+#include "tcp_engine.hh"
+#include "util.hh"
+
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <sys/socket.h>
+#include <thread>
+#include <vector>
+
+using namespace std;
+using namespace std::chrono;
+
+constexpr uint16_t SERVER_PORT = 80;
+
+//! transfer `bytes_per_conn` on each of `nconns` connections between two engines with `nworkers` workers each
+void main_loop(const size_t nworkers, const size_t nconns, const size_t bytes_per_conn) {
+    int fds[2];
+    SystemCall("socketpair", ::socketpair(AF_UNIX, SOCK_SEQPACKET, 0, static_cast<int *>(fds)));
+    FileDescriptor client_end{fds[0]}, server_end{fds[1]};
+
+    TCPEngine server{server_end.duplicate(), server_end.duplicate(), nworkers};
+    TCPEngine client{client_end.duplicate(), client_end.duplicate(), nworkers};
+
+    atomic<uint64_t> bytes_received{0};
+    server.set_handler([&](TCPHandle h) {
+        bytes_received += h.read().size();
+        if (h.connection().inbound_stream().eof() and not h.connection().outbound_stream().input_ended()) {
+            h.end_input_stream();
+        }
+    });
+    server.listen(TCPConfig{}, SERVER_PORT, nconns);
+
+    string data(bytes_per_conn, 'x');
+    for (auto &ch : data) {
+        ch = rand();
+    }
+
+    const auto first_time = steady_clock::now();
+
+    for (size_t i = 0; i < nconns; ++i) {
+        FdAdapterConfig c_ad{};
+        c_ad.source = {"10.0.0.2", static_cast<uint16_t>(10000 + i)};
+        c_ad.destination = {"10.0.0.1", SERVER_PORT};
+        const TCPFlow flow = client.connect(TCPConfig{}, c_ad);
+        client.write(flow, string(data));
+        client.end_input_stream(flow);
+    }
+
+    const uint64_t total = nconns * bytes_per_conn;
+    while (bytes_received < total) {
+        this_thread::sleep_for(milliseconds(1));
+        if (steady_clock::now() - first_time > seconds(120)) {
+            throw runtime_error("timed out after receiving " + to_string(bytes_received) + " of " +
+                                to_string(total) + " bytes");
+        }
+    }
+
+    const auto duration = duration_cast<nanoseconds>(steady_clock::now() - first_time).count();
+    const auto gigabits_per_second = total * 8.0 / double(duration);
+
+    cout << fixed << setprecision(2);
+    cout << setw(3) << nworkers << " worker(s), " << nconns << " connections: " << gigabits_per_second
+         << " Gbit/s (" << client.steering_drops() + server.steering_drops() << " datagrams dropped)\n";
+}
+
+int main(int argc, char **argv) {
+    try {
+        if (argc > 4) {
+            cerr << "Usage: " << argv[0] << " [max_workers] [connections] [bytes_per_connection]\n";
+            return EXIT_FAILURE;
+        }
+
+        // each engine gets `nworkers` threads plus a steering thread, and there are two engines
+        const size_t max_workers = argc > 1 ? stoul(argv[1]) : max(1u, thread::hardware_concurrency() / 2);
+        const size_t nconns = argc > 2 ? stoul(argv[2]) : 64;
+        const size_t bytes_per_conn = argc > 3 ? stoul(argv[3]) : 1024 * 1024;
+
+        for (size_t nworkers = 1; nworkers <= max_workers; nworkers *= 2) {
+            main_loop(nworkers, nconns, bytes_per_conn);
+        }
+    } catch (const exception &e) {
+        cerr << e.what() << "\n";
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
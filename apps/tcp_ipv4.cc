@@ -8,6 +8,7 @@
 #include <cstring>
 #include <iostream>
 #include <random>
+#include <stdexcept>
 #include <string>
 #include <tuple>
 
@@ -32,10 +33,20 @@ static void show_usage(const char *argv0, const char *msg) {
 
          << "   -t <tmout>      Set rt_timeout to tmout                         " << TCPConfig::TIMEOUT_DFLT << "\n\n"
 
-         << "   -d <tundev>     Connect to tun <tundev>                         " << TUN_DFLT << "\n\n"
+         << "   -d <tundev>     Connect to tun <tundev>                         " << TUN_DFLT << "\n"
+         << "   -V              Use virtio_net_hdr checksum/TSO offloads        (off)\n\n"
+
+         << "   -f <file>       Send <file> (memory-mapped) instead of stdin    (stdin)\n\n"
 
          << "   -Lu <loss>      Set uplink loss to <rate> (float in 0..1)       (no loss)\n"
-         << "   -Ld <loss>      Set downlink loss to <rate> (float in 0..1)     (no loss)\n\n"
+         << "   -Ld <loss>      Set downlink loss to <rate> (float in 0..1)     (no loss)\n"
+         << "   -Du, -Dd <ms>   Delay up/downlink segments by <ms> ms           0\n"
+         << "   -Ju, -Jd <ms>   Vary each delay by up to +/- <ms> ms            0\n"
+         << "   -Bu, -Bd <kbps> Limit the link rate to <kbps> kbit/s            (unlimited)\n"
+         << "   -Qu, -Qd <n>    Queue at most <n> segments at that rate         (unlimited)\n"
+         << "   -Ou, -Od <rate> Reorder segments at <rate> (float in 0..1)      0\n"
+         << "   -Ru, -Rd <rate> Duplicate segments at <rate> (float in 0..1)    0\n"
+         << "   -Cu, -Cd <rate> Corrupt segments at <rate> (float in 0..1)      0\n\n"
 
          << "   -h              Show this message.\n\n";
 
@@ -52,13 +63,15 @@ static void check_argc(int argc, char **argv, int curr, const char *err) {
     }
 }
 
-static tuple<TCPConfig, FdAdapterConfig, bool, char *> get_config(int argc, char **argv) {
+static tuple<TCPConfig, FdAdapterConfig, bool, char *, bool, char *> get_config(int argc, char **argv) {
     TCPConfig c_fsm{};
     FdAdapterConfig c_filt{};
     char *tundev = nullptr;
+    char *file = nullptr;
 
     int curr = 1;
     bool listen = false;
+    bool vnet_hdr = false;
 
     string source_address = LOCAL_ADDRESS_DFLT;
     string source_port = to_string(uint16_t(random_device()()));
@@ -93,6 +106,15 @@ static tuple<TCPConfig, FdAdapterConfig, bool, char *> get_config(int argc, char
             tundev = argv[curr + 1];
             curr += 2;
 
+        } else if (strncmp("-V", argv[curr], 3) == 0) {
+            vnet_hdr = true;
+            curr += 1;
+
+        } else if (strncmp("-f", argv[curr], 3) == 0) {
+            check_argc(argc, argv, curr, "ERROR: -f requires one argument.");
+            file = argv[curr + 1];
+            curr += 2;
+
         } else if (strncmp("-Lu", argv[curr], 3) == 0) {
             check_argc(argc, argv, curr, "ERROR: -Lu requires one argument.");
             float lossrate = strtof(argv[curr + 1], nullptr);
@@ -109,6 +131,18 @@ static tuple<TCPConfig, FdAdapterConfig, bool, char *> get_config(int argc, char
                 static_cast<LossRateDnT>(static_cast<float>(numeric_limits<LossRateDnT>::max()) * lossrate);
             curr += 2;
 
+        } else if (strlen(argv[curr]) == 3 and argv[curr][0] == '-' and
+                   (argv[curr][2] == 'u' or argv[curr][2] == 'd')) {
+            check_argc(argc, argv, curr, (string("ERROR: ") + argv[curr] + " requires one argument.").c_str());
+            LinkConfig &link = argv[curr][2] == 'u' ? c_filt.impairment_up : c_filt.impairment_dn;
+            try {
+                link.set_option(argv[curr][1], argv[curr + 1]);
+            } catch (const runtime_error &) {
+                show_usage(argv[0], (string("ERROR: unrecognized option ") + argv[curr]).c_str());
+                exit(1);
+            }
+            curr += 2;
+
         } else if (strncmp("-h", argv[curr], 3) == 0) {
             show_usage(argv[0], nullptr);
             exit(0);
@@ -131,7 +165,7 @@ static tuple<TCPConfig, FdAdapterConfig, bool, char *> get_config(int argc, char
         c_filt.source = {source_address, source_port};
     }
 
-    return make_tuple(c_fsm, c_filt, listen, tundev);
+    return make_tuple(c_fsm, c_filt, listen, tundev, vnet_hdr, file);
 }
 
 int main(int argc, char **argv) {
@@ -141,9 +175,9 @@ int main(int argc, char **argv) {
             return EXIT_FAILURE;
         }
 
-        auto [c_fsm, c_filt, listen, tun_dev_name] = get_config(argc, argv);
+        auto [c_fsm, c_filt, listen, tun_dev_name, vnet_hdr, file] = get_config(argc, argv);
         LossyTCPOverIPv4SpongeSocket tcp_socket(LossyTCPOverIPv4OverTunFdAdapter(
-            TCPOverIPv4OverTunFdAdapter(TunFD(tun_dev_name == nullptr ? TUN_DFLT : tun_dev_name))));
+            TCPOverIPv4OverTunFdAdapter(TunFD(tun_dev_name == nullptr ? TUN_DFLT : tun_dev_name, false, vnet_hdr))));
 
         if (listen) {
             tcp_socket.listen_and_accept(c_fsm, c_filt);
@@ -151,8 +185,13 @@ int main(int argc, char **argv) {
             tcp_socket.connect(c_fsm, c_filt);
         }
 
-        bidirectional_stream_copy(tcp_socket);
+        if (file != nullptr) {
+            tcp_socket.send_file(file);
+        }
+        bidirectional_stream_copy(tcp_socket, file == nullptr);
         tcp_socket.wait_until_closed();
+        cerr << "DEBUG: " << tcp_socket.stats().to_string() << ".\n";
+        cerr << "DEBUG: latencies:\n" << tcp_socket.latencies().to_string() << "\n";
     } catch (const exception &e) {
         cerr << "Exception: " << e.what() << endl;
         return EXIT_FAILURE;
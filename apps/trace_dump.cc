@@ -0,0 +1,68 @@
+#include "tracer.hh"
+
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <fstream>
+#include <iostream>
+#include <string>
+
+using namespace std;
+
+static void show_usage(const char *argv0, const char *msg) {
+    cout << "Usage: " << argv0 << " [-o <output>] <trace>\n\n"
+         << "Converts a trace saved by the tracer (e.g. by running a program built with -DTRACING=ON and\n"
+         << "SPONGE_TRACE=<trace> in its environment) to Chrome/Perfetto trace JSON, which chrome://tracing\n"
+         << "and ui.perfetto.dev display as a timeline with one track per thread.\n\n"
+
+         << "   -o <output>     Write the JSON to <output> instead of stdout\n"
+         << "   -h              Show this message.\n\n";
+
+    if (msg != nullptr) {
+        cout << msg;
+    }
+    cout << endl;
+}
+
+int main(int argc, char **argv) {
+    try {
+        string output;
+        int curr = 1;
+        for (; curr < argc and argv[curr][0] == '-'; curr += 2) {
+            if (strncmp("-h", argv[curr], 3) == 0) {
+                show_usage(argv[0], nullptr);
+                return EXIT_SUCCESS;
+            }
+            if (strncmp("-o", argv[curr], 3) != 0) {
+                show_usage(argv[0], (string("ERROR: bad option ") + argv[curr]).c_str());
+                return EXIT_FAILURE;
+            }
+            if (curr + 1 >= argc) {
+                show_usage(argv[0], "ERROR: -o requires one argument.");
+                return EXIT_FAILURE;
+            }
+            output = argv[curr + 1];
+        }
+        if (curr + 1 != argc) {
+            show_usage(argv[0], "ERROR: expected one trace file.");
+            return EXIT_FAILURE;
+        }
+
+        const auto events = Tracer::load(argv[curr]);
+        if (output.empty()) {
+            Tracer::write_chrome_json(cout, events);
+        } else {
+            ofstream out{output};
+            Tracer::write_chrome_json(out, events);
+            if (not out.flush()) {
+                throw runtime_error("cannot write " + output);
+            }
+        }
+        cerr << "DEBUG: converted " << events.size() << " events.\n";
+    } catch (const exception &e) {
+        cerr << "Exception: " << e.what() << endl;
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
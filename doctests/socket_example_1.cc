@@ -15,6 +15,6 @@ sock1.send("hi yourself");
 
 auto recvd2 = sock2.recv();
 
-if (recvd.payload != "hi there" || recvd2.payload != "hi yourself") {
+if (recvd.payload.str() != "hi there" || recvd2.payload.str() != "hi yourself") {
     throw std::runtime_error("wrong data received");
 }
@@ -18,3 +18,9 @@ endif ()
 set (CMAKE_CXX_FLAGS_DEBUG "${CMAKE_CXX_FLAGS_DEBUG} -ggdb3 -Og")
 set (CMAKE_CXX_FLAGS_DEBUGASAN "${CMAKE_CXX_FLAGS_DEBUG} -fsanitize=undefined -fsanitize=address")
 set (CMAKE_CXX_FLAGS_RELASAN "${CMAKE_CXX_FLAGS_RELEASE} -fsanitize=undefined -fsanitize=address")
+
+# compile in the tracer's instrumentation (see libsponge/util/tracer.hh)
+option (TRACING "Record trace events in the TCP hot paths" OFF)
+if (TRACING)
+    add_definitions (-DSPONGE_TRACING)
+endif ()
@@ -22,6 +22,27 @@ add_test(NAME t_send_ack             COMMAND send_ack)
 add_test(NAME t_send_close           COMMAND send_close)
 add_test(NAME t_send_extra           COMMAND send_extra)
 
+add_test(NAME t_stack_many           COMMAND tcp_stack_many)
+add_test(NAME t_stack_listen         COMMAND tcp_stack_listen)
+add_test(NAME t_stack_syncookies     COMMAND tcp_stack_syncookies)
+add_test(NAME t_stack_vnet_hdr       COMMAND tcp_stack_vnet_hdr)
+add_test(NAME t_engine_echo          COMMAND tcp_engine_echo)
+add_test(NAME t_byte_channel         COMMAND byte_channel)
+add_test(NAME t_udp_batch            COMMAND udp_batch)
+add_test(NAME t_eventloop            COMMAND eventloop)
+add_test(NAME t_buffer_pool          COMMAND buffer_pool)
+add_test(NAME t_buffer_arena         COMMAND buffer_arena)
+add_test(NAME t_buffer_list          COMMAND buffer_list)
+add_test(NAME t_mapped_file          COMMAND mapped_file)
+add_test(NAME t_network_emulator     COMMAND network_emulator)
+add_test(NAME t_lossy_fd_adapter     COMMAND lossy_fd_adapter)
+add_test(NAME t_tcp_connection_stats COMMAND tcp_connection_stats)
+add_test(NAME t_tracer               COMMAND tracer)
+add_test(NAME t_latency_histogram    COMMAND latency_histogram)
+add_test(NAME t_perf_counters        COMMAND perf_counters)
+add_test(NAME t_alloc_budget         COMMAND alloc_budget)
+add_test(NAME t_pcap_reader          COMMAND pcap_reader)
+
 add_test(NAME t_strm_reassem_single      COMMAND fsm_stream_reassembler_single)
 add_test(NAME t_strm_reassem_seq         COMMAND fsm_stream_reassembler_seq)
 add_test(NAME t_strm_reassem_dup         COMMAND fsm_stream_reassembler_dup)
@@ -11,18 +11,27 @@ using namespace std;
 
 ByteStream::ByteStream(const size_t capacity) : mxSize(capacity){
 }
-size_t ByteStream::write(const string &data) {
-    string copy = data;
-    size_t len = data.length();
-    size_t acceptedNum = min(len, mxSize - size);
-    if(len > mxSize - size)
-        myStream.push_back(Buffer(copy.substr(0, acceptedNum)));
-    else myStream.push_back(Buffer(move(copy)));
+size_t ByteStream::write(Buffer data) {
+    size_t acceptedNum = min(data.size(), remaining_capacity());
+    if (acceptedNum < data.size())
+        data = data.substr(0, acceptedNum);
+    myStream.push_back(move(data));
     size += acceptedNum;
     totWritten += acceptedNum;
     return acceptedNum;
 }
 
+size_t ByteStream::write(string &&data) {
+    if (data.size() > remaining_capacity())
+        return write(string_view(data));
+    return write(Buffer(move(data)));
+}
+
+//! \param[in] data only the bytes that fit are copied
+size_t ByteStream::write(const string_view data) {
+    return write(Buffer(data.substr(0, min(data.size(), remaining_capacity()))));
+}
+
 //! \param[in] len bytes will be copied from the output size of the buffer
 string ByteStream::peek_output(const size_t len) const {
     return myStream.peak_out(min(myStream.size(), len));
@@ -46,6 +55,17 @@ std::string ByteStream::read(const size_t len) {
     return move(str);
 }
 
+//! \param[in] len bytes will be popped and returned
+Buffer ByteStream::read_buffer(const size_t len) {
+    size_t acceptedNum = min(len, size);
+    if (acceptedNum == 0)
+        return {};
+    const Buffer &front = myStream.buffers().front();
+    Buffer ret = front.size() >= acceptedNum ? front.substr(0, acceptedNum) : Buffer(myStream.peak_out(acceptedNum));
+    pop_output(acceptedNum);
+    return ret;
+}
+
 void ByteStream::end_input() { _input_ended = true;}
 
 bool ByteStream::input_ended() const { return _input_ended; }
@@ -2,6 +2,7 @@
 #define SPONGE_LIBSPONGE_BYTE_STREAM_HH
 
 #include <string>
+#include <string_view>
 #include <queue>
 #include <deque>
 #include "./util/buffer.hh"
@@ -36,7 +37,20 @@ class ByteStream {
     //! Write a string of bytes into the stream. Write as many
     //! as will fit, and return how many were written.
     //! \returns the number of bytes accepted into the stream
-    size_t write(const std::string &data);
+    //! \note The accepted bytes of a Buffer are shared with the stream, not copied.
+    size_t write(Buffer data);
+
+    //! \brief Write a string of bytes into the stream, taking ownership of it if it all fits
+    //! \returns the number of bytes accepted into the stream
+    size_t write(std::string &&data);
+
+    //! \brief Write a copy of (as much as fits of) a string of bytes into the stream
+    //! \returns the number of bytes accepted into the stream
+    size_t write(const std::string_view data);
+
+    //! \brief Write a copy of a NULL-terminated string into the stream
+    //! \returns the number of bytes accepted into the stream
+    size_t write(const char *data) { return write(std::string_view(data)); }
 
     //! \returns the number of additional bytes that the stream has space for
     size_t remaining_capacity() const;
@@ -62,6 +76,12 @@ class ByteStream {
     //! \returns a string
     std::string read(const size_t len);
 
+    //! \brief Read (and pop) the next "len" bytes of the stream, sharing them rather than copying
+    //! where possible
+    //! \returns a Buffer that shares storage with what was written, if the bytes were written as
+    //! one piece, or else a copy
+    Buffer read_buffer(const size_t len);
+
     //! \returns `true` if the stream input has ended
     bool input_ended() const;
 
@@ -1,4 +1,5 @@
 #include "stream_reassembler.hh"
+#include "tracer.hh"
 #include <map>
 using namespace std;
 
@@ -50,6 +51,7 @@ void StreamReassembler::unassemble_bytes_update(){
 //! possibly out-of-order, from the logical stream, and assembles any newly
 //! contiguous substrings and writes them into the output stream in order.
 void StreamReassembler::push_substring(const string &data, const size_t index, const bool eof) {
+    SPONGE_TRACE_SCOPE(ReassemblerInsert, index);
     size_t len = data.length(), data_end_index = index + len - 1;
     max_end_index = _capacity + expected_index - _output.buffer_size() - 1;
     string effective_data = data;
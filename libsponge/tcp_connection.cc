@@ -1,5 +1,7 @@
 #include "tcp_connection.hh"
 
+#include "tracer.hh"
+
 #include <iostream>
 
 
@@ -13,8 +15,35 @@ size_t TCPConnection::unassembled_bytes() const { return _receiver.unassembled_b
 
 size_t TCPConnection::time_since_last_segment_received() const { return _time_since_last_segment_received; }
 
+TCPConnectionStats TCPConnection::stats() const {
+    TCPConnectionStats stats = _sender.stats();
+    stats.segments_sent = _stats.segments_sent;
+    stats.bytes_sent = _stats.bytes_sent;
+    stats.segments_received = _stats.segments_received;
+    stats.bytes_received = _stats.bytes_received;
+    stats.duplicate_segments = _stats.duplicate_segments;
+    stats.out_of_order_segments = _stats.out_of_order_segments;
+    stats.zero_windows_advertised = _stats.zero_windows_advertised;
+    stats.receive_window = _stats.receive_window;
+    stats.unassembled_bytes = unassembled_bytes();
+    return stats;
+}
+
+void TCPConnection::count_received(const TCPSegment &seg) {
+    _stats.segments_received ++;
+    _stats.bytes_received += seg.payload().size();
+    if (_receiver.ackno().has_value() && seg.payload().size() > 0) {
+        // where the payload starts, relative to the next byte expected
+        const int64_t offset = seg.header().seqno + seg.header().syn - _receiver.ackno().value();
+        if (offset + static_cast<int64_t>(seg.payload().size()) <= 0) _stats.duplicate_segments ++;
+        else if (offset > 0) _stats.out_of_order_segments ++;
+    }
+}
+
 void TCPConnection::segment_received(const TCPSegment &seg) { 
+    SPONGE_TRACE(SegmentReceived, SPONGE_TRACE_SEGMENT_ARG(seg));
     _time_since_last_segment_received = 0;
+    count_received(seg);
     TCPHeader header = seg.header();
 
     //! if the rst flag is set, sets both the inbound and outbound streams to the error state 
@@ -76,8 +105,13 @@ bool TCPConnection::active() const {
     return true;
  }
 
-size_t TCPConnection::write(const string &data) {
-    size_t bytes_written = outbound_stream().write(data);
+size_t TCPConnection::write(Buffer data) { return send_written(outbound_stream().write(move(data))); }
+
+size_t TCPConnection::write(string &&data) { return send_written(outbound_stream().write(move(data))); }
+
+size_t TCPConnection::write(const string_view data) { return send_written(outbound_stream().write(data)); }
+
+size_t TCPConnection::send_written(const size_t bytes_written) {
     _sender.fill_window();
     transform_segments_out();
     return bytes_written;
@@ -123,6 +157,11 @@ void TCPConnection::transform_segments_out(){
     if (_receiver.ackno().has_value())
         _sender.segments_out().front().header().ackno = _receiver.ackno().value();
     _sender.segments_out().front().header().win = min(_receiver.window_size(), static_cast<size_t>((1 << 16) - 1));
+    if (_sender.segments_out().front().header().win == 0 && _stats.receive_window != 0) _stats.zero_windows_advertised ++;
+    _stats.receive_window = _sender.segments_out().front().header().win;
+    _stats.segments_sent ++;
+    _stats.bytes_sent += _sender.segments_out().front().payload().size();
+    SPONGE_TRACE(SegmentSent, SPONGE_TRACE_SEGMENT_ARG(_sender.segments_out().front()));
     _segments_out.push(_sender.segments_out().front());
     _sender.segments_out().pop();
 }
@@ -134,5 +173,6 @@ void TCPConnection::send_rst_seg(){
         outbound_stream().set_error();
         inbound_stream().set_error();
         _segments_out.push(rst_tcp_seg);
+        _stats.segments_sent ++;
         _is_rst_set = true;
 }
\ No newline at end of file
@@ -2,6 +2,7 @@
 #define SPONGE_LIBSPONGE_TCP_FACTORED_HH
 
 #include "tcp_config.hh"
+#include "tcp_connection_stats.hh"
 #include "tcp_receiver.hh"
 #include "tcp_sender.hh"
 #include "tcp_state.hh"
@@ -11,7 +12,7 @@ class TCPConnection {
   private:
     TCPConfig _cfg;
     TCPReceiver _receiver{_cfg.recv_capacity};
-    TCPSender _sender{_cfg.send_capacity, _cfg.rt_timeout, _cfg.fixed_isn};
+    TCPSender _sender{_cfg.send_capacity, _cfg.rt_timeout, _cfg.fixed_isn, _cfg.max_payload_size};
 
     //! outbound queue of segments that the TCPConnection wants sent
     std::queue<TCPSegment> _segments_out{};
@@ -27,6 +28,16 @@ class TCPConnection {
     //! when tick is called, time increases; when receiving a segment, time is set to zero
     size_t _time_since_last_segment_received{};
 
+    //! the connection's counters (segments and bytes each way, duplicates, our zero windows)
+    TCPConnectionStats _stats{};
+
+    //! \brief Count an inbound segment, and whether it repeats or skips ahead of what was received
+    void count_received(const TCPSegment &seg);
+
+    //! \brief Send what the sender can of newly written data
+    //! \returns `bytes_written`
+    size_t send_written(const size_t bytes_written);
+
     
   public:
     //! \name "Input" interface for the writer
@@ -37,7 +48,20 @@ class TCPConnection {
 
     //! \brief Write data to the outbound byte stream, and send it over TCP if possible
     //! \returns the number of bytes from `data` that were actually written.
-    size_t write(const std::string &data);
+    //! \note The written bytes of a Buffer are shared, not copied, all the way into the segments sent.
+    size_t write(Buffer data);
+
+    //! \brief Write data to the outbound byte stream, taking ownership of it if it all fits
+    //! \returns the number of bytes from `data` that were actually written.
+    size_t write(std::string &&data);
+
+    //! \brief Write a copy of data to the outbound byte stream
+    //! \returns the number of bytes from `data` that were actually written.
+    size_t write(const std::string_view data);
+
+    //! \brief Write a copy of a NULL-terminated string to the outbound byte stream
+    //! \returns the number of bytes from `data` that were actually written.
+    size_t write(const char *data) { return write(std::string_view(data)); }
 
     //! \returns the number of `bytes` that can be written right now.
     size_t remaining_outbound_capacity() const;
@@ -70,6 +94,19 @@ class TCPConnection {
     TCPState state() const { return {_sender, _receiver, active(), _linger_after_streams_finish}; };
     //!@}
 
+    //! \brief Counters and gauges that explain how the connection is doing (like `TCP_INFO`)
+    TCPConnectionStats stats() const;
+
+    //! \name Latencies, in nanoseconds
+    //!@{
+
+    //! \brief How long outbound bytes waited in the outbound stream before they were sent
+    const LatencyHistogram &queueing_latency() const { return _sender.queueing_latency(); }
+
+    //! \brief How long segments took to be acknowledged, from when they were first sent
+    const LatencyHistogram &ack_latency() const { return _sender.ack_latency(); }
+    //!@}
+
     //! \name Methods for the owner or operating system to call
     //!@{
 
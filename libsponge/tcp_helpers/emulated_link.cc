@@ -0,0 +1,151 @@
+#include "emulated_link.hh"
+
+#include "ipv4_header.hh"
+
+#include <algorithm>
+#include <cstdlib>
+#include <stdexcept>
+#include <string>
+
+using namespace std;
+
+bool LinkConfig::impaired() const {
+    return delay_us > 0 or jitter_us > 0 or rate_bps > 0 or queue_limit > 0 or red_min > 0 or loss > 0 or
+           reorder > 0 or duplication > 0 or corruption > 0;
+}
+
+void LinkConfig::set_option(const char option, const string &arg) {
+    const char *const value = arg.c_str();
+    switch (option) {
+        case 'D':
+            delay_us = strtoull(value, nullptr, 0) * 1000;
+            break;
+        case 'J':
+            jitter_us = strtoull(value, nullptr, 0) * 1000;
+            break;
+        case 'B':
+            rate_bps = strtoull(value, nullptr, 0) * 1000;
+            break;
+        case 'Q':
+            queue_limit = strtoull(value, nullptr, 0);
+            break;
+        case 'O':
+            reorder = strtod(value, nullptr);
+            break;
+        case 'R':
+            duplication = strtod(value, nullptr);
+            break;
+        case 'C':
+            corruption = strtod(value, nullptr);
+            break;
+        default:
+            throw runtime_error(string("LinkConfig: unknown impairment option -") + option);
+    }
+}
+
+void LinkConfig::validate() const {
+    if (red_min > 0 and red_max <= red_min) {
+        throw runtime_error("LinkConfig: red_max (" + to_string(red_max) + ") must be more than red_min (" +
+                            to_string(red_min) + ")");
+    }
+}
+
+size_t EmulatedLink::wire_size(const TCPSegment &seg) {
+    return IPv4Header::LENGTH + 4 * seg.header().doff + seg.payload().size();
+}
+
+EmulatedLink::EmulatedLink(const LinkConfig &config, const unsigned seed) : _config(config), _rng(seed) {
+    _config.validate();
+}
+
+bool EmulatedLink::_admit(const uint64_t now) {
+    while (not _departures.empty() and _departures.front() <= now) {
+        _departures.pop_front();
+    }
+    const size_t queued = _departures.size();
+
+    if (_config.red_min > 0) {
+        _average_queue = (1 - RED_WEIGHT) * _average_queue + RED_WEIGHT * queued;
+        if (_average_queue >= _config.red_max) {
+            return false;
+        }
+        if (_average_queue >= _config.red_min) {
+            const double p =
+                _config.red_max_p * (_average_queue - _config.red_min) / (_config.red_max - _config.red_min);
+            if (bernoulli_distribution{p}(_rng)) {
+                return false;
+            }
+        }
+    }
+    return _config.queue_limit == 0 or queued < _config.queue_limit;
+}
+
+bool EmulatedLink::_corrupt(TCPSegment &seg) {
+    string wire = seg.serialize().concatenate();
+    const size_t bit = uniform_int_distribution<size_t>{0, 8 * wire.size() - 1}(_rng);
+    wire[bit / 8] ^= static_cast<char>(1 << (bit % 8));
+    return seg.parse(Buffer{move(wire)}) == ParseResult::NoError;
+}
+
+//! \param[in] seg is the packet
+//! \param[in] now is the time at which it is sent, in microseconds
+void EmulatedLink::send(TCPSegment seg, const uint64_t now) {
+    ++_stats.sent;
+    if (_config.loss > 0 and bernoulli_distribution{_config.loss}(_rng)) {
+        ++_stats.lost;
+        return;
+    }
+    if (_config.corruption > 0 and bernoulli_distribution{_config.corruption}(_rng) and not _corrupt(seg)) {
+        ++_stats.corrupted;
+        return;
+    }
+    if (not _admit(now)) {
+        ++_stats.queue_drops;
+        return;
+    }
+
+    // serialized once the packets ahead of it have been
+    uint64_t departure = now;
+    if (_config.rate_bps > 0) {
+        const uint64_t start = _departures.empty() ? now : max(now, _departures.back());
+        departure = start + wire_size(seg) * 8 * 1'000'000 / _config.rate_bps;
+        _departures.push_back(departure);
+        _stats.max_queue = max(_stats.max_queue, _departures.size());
+    }
+
+    uint64_t arrival = departure;
+    if (_config.reorder > 0 and bernoulli_distribution{_config.reorder}(_rng)) {
+        ++_stats.reordered;
+    } else {
+        int64_t delay = _config.delay_us;
+        if (_config.jitter_us > 0) {
+            const int64_t jitter = _config.jitter_us;
+            delay += uniform_int_distribution<int64_t>{-jitter, jitter}(_rng);
+        }
+        arrival += max<int64_t>(delay, 0);
+    }
+
+    if (_config.duplication > 0 and bernoulli_distribution{_config.duplication}(_rng)) {
+        ++_stats.duplicated;
+        _in_flight.emplace(make_pair(arrival, _serial++), seg);
+    }
+    _in_flight.emplace(make_pair(arrival, _serial++), move(seg));
+}
+
+//! \param[in] now is the current time, in microseconds
+//! \param[in] receive is called with each packet that has arrived
+void EmulatedLink::deliver(const uint64_t now, const function<void(TCPSegment &)> &receive) {
+    while (not _in_flight.empty() and _in_flight.begin()->first.first <= now) {
+        auto node = _in_flight.extract(_in_flight.begin());
+        ++_stats.delivered;
+        _stats.bytes_delivered += wire_size(node.mapped());
+        receive(node.mapped());
+    }
+}
+
+optional<uint64_t> EmulatedLink::next_arrival() const {
+    if (_in_flight.empty()) {
+        return {};
+    }
+    return _in_flight.begin()->first.first;
+}
@@ -0,0 +1,114 @@
+#ifndef SPONGE_LIBSPONGE_EMULATED_LINK_HH
+#define SPONGE_LIBSPONGE_EMULATED_LINK_HH
+
+#include "tcp_segment.hh"
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <map>
+#include <optional>
+#include <random>
+#include <string>
+#include <utility>
+
+//! \brief The impairments of one direction of an emulated link
+//! \details Times are in microseconds.
+struct LinkConfig {
+    uint64_t delay_us = 0;   //!< One-way propagation delay
+    uint64_t jitter_us = 0;  //!< Each packet's delay is drawn uniformly from `delay_us` ± `jitter_us`
+    uint64_t rate_bps = 0;   //!< Bottleneck bandwidth, in bits per second (0 for unlimited)
+    size_t queue_limit = 0;  //!< Packets the bottleneck queue holds before it drops arrivals (0 for unlimited)
+    size_t red_min = 0;      //!< Average queue length at which RED starts dropping early (0 for plain drop-tail)
+    size_t red_max = 0;      //!< Average queue length at which RED drops every arrival (more than `red_min`)
+    double red_max_p = 0.1;  //!< RED's drop probability as the average queue length nears `red_max`
+    double loss = 0;         //!< Probability that a packet is lost
+    double reorder = 0;      //!< Probability that a packet skips the propagation delay (and so overtakes others)
+    double duplication = 0;  //!< Probability that a packet is delivered twice
+    double corruption = 0;   //!< Probability that a bit of a packet is flipped on the way
+
+    //! Whether any impairment is set
+    bool impaired() const;
+
+    //! \brief Set the impairment that a command-line option names
+    //! \details D is the delay and J the jitter, in ms; B is the rate, in kbit/s; Q is the queue limit, in
+    //! packets; O, R and C are the reordering, duplication and corruption rates, between 0 and 1.
+    //! \param[in] option is the letter after the dash, as in `-Du` or `-Dd`
+    //! \param[in] arg is the option's argument
+    //! \throws std::runtime_error if `option` isn't one of those letters
+    void set_option(const char option, const std::string &arg);
+
+    //! \brief Check that the settings make sense together
+    //! \throws std::runtime_error if RED is on (`red_min` > 0) and `red_max` isn't more than `red_min`
+    void validate() const;
+};
+
+//! What one direction of an emulated link has done so far
+struct LinkStats {
+    uint64_t sent = 0;             //!< Packets offered to the link
+    uint64_t delivered = 0;        //!< Packets that reached the far end (duplicates included)
+    uint64_t bytes_delivered = 0;  //!< Their size on the wire (with IPv4 and TCP headers)
+    uint64_t lost = 0;             //!< Packets lost at random
+    uint64_t queue_drops = 0;      //!< Packets dropped by the bottleneck queue (full, or by RED)
+    uint64_t reordered = 0;        //!< Packets that skipped the propagation delay
+    uint64_t duplicated = 0;       //!< Packets that were delivered twice
+    uint64_t corrupted = 0;        //!< Packets that were damaged, and so dropped when their checksum failed
+    size_t max_queue = 0;          //!< Most packets that were ever in the bottleneck queue
+};
+
+//! \brief One direction of an emulated link, in virtual time
+//! \details A packet that isn't lost joins the bottleneck queue (unless it is full, or RED drops it
+//! early), is serialized at the link rate once the packets ahead of it have been, and arrives at
+//! the far end one propagation delay later. With jitter, packets sent close together can arrive
+//! out of order. A corrupted packet has one bit of its serialized form flipped and is parsed again
+//! with its checksum checked, as the receiver would, and so is dropped. All randomness comes from a
+//! generator seeded at construction, so the same seed and the same packets give the same result.
+class EmulatedLink {
+  private:
+    //! Weight of the latest queue length in RED's moving average
+    static constexpr double RED_WEIGHT = 0.002;
+
+    LinkConfig _config;
+    std::mt19937 _rng;
+    LinkStats _stats{};
+
+    //! When each packet in the bottleneck queue will have been serialized, earliest first
+    std::deque<uint64_t> _departures{};
+
+    //! RED's moving average of the queue length
+    double _average_queue = 0;
+
+    //! Packets on their way, keyed by {arrival time, order sent}
+    std::map<std::pair<uint64_t, uint64_t>, TCPSegment> _in_flight{};
+
+    //! Number of packets put in flight so far (to keep simultaneous arrivals in order)
+    uint64_t _serial = 0;
+
+    //! Whether the bottleneck queue has room for another packet at time `now`
+    bool _admit(const uint64_t now);
+
+    //! Flip a random bit of `seg` on the wire; \returns whether the result still parses
+    bool _corrupt(TCPSegment &seg);
+
+  public:
+    //! Size of `seg` on the wire, with IPv4 and TCP headers
+    static size_t wire_size(const TCPSegment &seg);
+
+    //! \throws std::runtime_error if `config` isn't valid (see LinkConfig::validate)
+    EmulatedLink(const LinkConfig &config, const unsigned seed);
+
+    //! Offer `seg` to the link at time `now`
+    void send(TCPSegment seg, const uint64_t now);
+
+    //! Hand each packet that has arrived by time `now` to `receive`, in order of arrival
+    void deliver(const uint64_t now, const std::function<void(TCPSegment &)> &receive);
+
+    //! The time at which the next packet arrives, if there are any on the way
+    std::optional<uint64_t> next_arrival() const;
+
+    const LinkConfig &config() const { return _config; }
+    const LinkStats &stats() const { return _stats; }
+};
+
+#endif  // SPONGE_LIBSPONGE_EMULATED_LINK_HH
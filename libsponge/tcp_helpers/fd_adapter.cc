@@ -1,11 +1,21 @@
 #include "fd_adapter.hh"
 
+#include <algorithm>
 #include <iostream>
+#include <iterator>
 #include <stdexcept>
 #include <utility>
 
 using namespace std;
 
+//! \details Offers the socket UDP_GRO and checks for UDP_SEGMENT; without them, the adapter sends
+//! and receives one datagram per segment.
+TCPOverUDPSocketAdapter::TCPOverUDPSocketAdapter(UDPSocket &&sock)
+    : _sock(move(sock))
+    , _rx_batch(MAX_BATCH_SIZE, {{nullptr, 0}, {}, 0})
+    , _gro(_sock.enable_gro())
+    , _gso(_sock.supports_gso()) {}
+
 //! \details This function first attempts to parse a TCP segment from the next UDP
 //! payload recv()d from the socket.
 //!
@@ -17,25 +27,78 @@ using namespace std;
 //! and the TCP segment read from the wire includes a SYN, this function clears the
 //! `_listen` flag and calls calls connect() on the underlying UDP socket, with
 //! the result that future outgoing segments go to the sender of the SYN segment.
+//!
+//! If the payload was a run of datagrams coalesced by UDP_GRO, the rest of its segments are
+//! returned by the following calls to read() or read_batch(), without another recv().
 //! \returns a std::optional<TCPSegment> that is empty if the segment was invalid or unrelated
 optional<TCPSegment> TCPOverUDPSocketAdapter::read() {
-    auto datagram = _sock.recv();
+    if (_rx_pending.empty()) {
+        auto datagram = _sock.recv();
+        vector<TCPSegment> segments;
+        _accept_datagram(datagram, segments);
+        move(segments.begin(), segments.end(), back_inserter(_rx_pending));
+    }
+
+    if (_rx_pending.empty()) {
+        return {};
+    }
+    TCPSegment seg = move(_rx_pending.front());
+    _rx_pending.pop_front();
+    return seg;
+}
+
+//! \details Applies the same checks as read() to each datagram, in the order they arrived, so a SYN
+//! early in a batch sets the destination against which the rest of the batch is checked.
+vector<TCPSegment> TCPOverUDPSocketAdapter::read_batch() {
+    vector<TCPSegment> segments(make_move_iterator(_rx_pending.begin()), make_move_iterator(_rx_pending.end()));
+    _rx_pending.clear();
+
+    const size_t count = _sock.recv_batch(_rx_batch);
+    for (size_t i = 0; i < count; ++i) {
+        _accept_datagram(_rx_batch[i], segments);
+    }
+    return segments;
+}
+
+//! \param[in] datagram is a received datagram; its payload is shared by the segments (not copied)
+//! \param[out] segments receives the segments that are related to the current connection
+void TCPOverUDPSocketAdapter::_accept_datagram(UDPSocket::received_datagram &datagram, vector<TCPSegment> &segments) {
+    if (datagram.segment_size == 0) {
+        auto seg = _accept_payload(datagram.source_address, move(datagram.payload));
+        if (seg) {
+            segments.push_back(move(seg.value()));
+        }
+        return;
+    }
 
+    // a UDP_GRO buffer: every datagram but the last is exactly `segment_size` bytes
+    for (size_t offset = 0; offset < datagram.payload.size(); offset += datagram.segment_size) {
+        auto seg = _accept_payload(datagram.source_address, datagram.payload.substr(offset, datagram.segment_size));
+        if (seg) {
+            segments.push_back(move(seg.value()));
+        }
+    }
+    datagram.payload = {};  // so the slab goes back to its pool once the segments are done with it
+}
+
+//! \param[in] source is the sender of the payload
+//! \param[in] payload is one UDP payload, which the returned segment shares
+optional<TCPSegment> TCPOverUDPSocketAdapter::_accept_payload(const Address &source, Buffer &&payload) {
     // is it for us?
-    if (not listening() and (datagram.source_address != config().destination)) {
+    if (not listening() and (source != config().destination)) {
         return {};
     }
 
     // is the payload a valid TCP segment?
     TCPSegment seg;
-    if (ParseResult::NoError != seg.parse(move(datagram.payload), 0)) {
+    if (ParseResult::NoError != seg.parse(move(payload), 0)) {
         return {};
     }
 
     // should we target this source in all future replies?
     if (listening()) {
         if (seg.header().syn and not seg.header().rst) {
-            config_mutable().destination = datagram.source_address;
+            config_mutable().destination = source;
             set_listening(false);
         } else {
             return {};
@@ -53,5 +116,52 @@ void TCPOverUDPSocketAdapter::write(TCPSegment &seg) {
     _sock.sendto(config().destination, seg.serialize(0));
 }
 
+//! \details With UDP_SEGMENT, each run of equal-sized segments (the last may be shorter) becomes one
+//! message, which the kernel splits into datagrams; the whole queue goes out in one sendmmsg()
+//! unless the kernel refuses a run, in which case the adapter stops using UDP_SEGMENT and sends the
+//! rest one datagram per segment.
+//! \param[in] segments is drained in order
+void TCPOverUDPSocketAdapter::write_batch(queue<TCPSegment> &segments) {
+    vector<BufferList> serialized;
+    serialized.reserve(segments.size());
+    while (not segments.empty()) {
+        TCPSegment &seg = segments.front();
+        seg.header().sport = config().source.port();
+        seg.header().dport = config().destination.port();
+        serialized.push_back(seg.serialize(0));
+        segments.pop();
+    }
+
+    vector<BufferViewList> payloads;
+    vector<uint16_t> segment_sizes;
+    vector<size_t> first_segment;  // index into `serialized` of each message's first segment
+    for (size_t i = 0; i < serialized.size();) {
+        const size_t size = serialized[i].size();
+        BufferViewList payload{serialized[i]};
+        size_t total = size;
+        size_t next = i + 1;
+        while (_gso and next < serialized.size() and next - i < UDPSocket::MAX_GSO_SEGMENTS and
+               serialized[next].size() <= size and total + serialized[next].size() <= UDPSocket::MAX_PAYLOAD_SIZE) {
+            total += serialized[next].size();
+            payload.append(serialized[next]);
+            if (serialized[next++].size() < size) {
+                break;
+            }
+        }
+
+        payloads.push_back(move(payload));
+        segment_sizes.push_back(next - i > 1 ? size : 0);
+        first_segment.push_back(i);
+        i = next;
+    }
+
+    const size_t sent = _sock.sendto_batch(config().destination, payloads, segment_sizes);
+    if (sent < payloads.size()) {
+        _gso = false;
+        const vector<BufferViewList> rest(serialized.begin() + first_segment[sent], serialized.end());
+        _sock.sendto_batch(config().destination, rest);
+    }
+}
+
 //! Specialize LossyFdAdapter to TCPOverUDPSocketAdapter
 template class LossyFdAdapter<TCPOverUDPSocketAdapter>;
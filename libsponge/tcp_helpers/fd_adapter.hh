@@ -8,8 +8,12 @@
 #include "tcp_header.hh"
 #include "tcp_segment.hh"
 
+#include <deque>
 #include <optional>
+#include <queue>
+#include <string>
 #include <utility>
+#include <vector>
 
 //! \brief Basic functionality for file descriptor adaptors
 //! \details See TCPOverUDPSocketAdapter and TCPOverIPv4OverTunFdAdapter for more information.
@@ -40,23 +44,63 @@ class FdAdapterBase {
 
     //! Called periodically when time elapses
     void tick(const size_t) {}
+
+    //! Inbound segments that were held back (see LossyFdAdapter) and are now due; there are none here
+    std::vector<TCPSegment> read_due() { return {}; }
+
+    //! Write the outbound segments that are being held back (see LossyFdAdapter); there are none here
+    void flush() {}
 };
 
 //! \brief A FD adaptor that reads and writes TCP segments in UDP payloads
+//! \details Where the kernel supports it, runs of equal-sized outbound segments are sent as one
+//! [UDP_SEGMENT](\ref man7::udp) message, and inbound runs coalesced by UDP_GRO are split back
+//! into segments, so a full window may cost a single crossing into the kernel in each direction.
 class TCPOverUDPSocketAdapter : public FdAdapterBase {
+  public:
+    static constexpr size_t MAX_BATCH_SIZE = 64;  //!< Most datagrams moved by one read_batch() or write_batch() syscall
+
   private:
     UDPSocket _sock;
 
+    //! Storage for the datagrams received by read_batch()
+    std::vector<UDPSocket::received_datagram> _rx_batch;
+
+    //! Segments split from a coalesced datagram by read() but not yet returned
+    std::deque<TCPSegment> _rx_pending{};
+
+    bool _gro;  //!< Has the kernel agreed to coalesce received datagrams?
+    bool _gso;  //!< Can the kernel split a sent message into datagrams?
+
+    //! Check that a received datagram (possibly several, coalesced) is related to the current
+    //! connection, and append its TCP segments to `segments`
+    void _accept_datagram(UDPSocket::received_datagram &datagram, std::vector<TCPSegment> &segments);
+
+    //! Check that one UDP payload is related to the current connection and parse its TCP segment
+    std::optional<TCPSegment> _accept_payload(const Address &source, Buffer &&payload);
+
   public:
     //! Construct from a UDPSocket sliced into a FileDescriptor
-    explicit TCPOverUDPSocketAdapter(UDPSocket &&sock) : _sock(std::move(sock)) {}
+    explicit TCPOverUDPSocketAdapter(UDPSocket &&sock);
 
     //! Attempts to read and return a TCP segment related to the current connection from a UDP payload
     std::optional<TCPSegment> read();
 
+    //! Reads the waiting UDP payloads (up to MAX_BATCH_SIZE) and returns the TCP segments related to the connection
+    std::vector<TCPSegment> read_batch();
+
     //! Writes a TCP segment into a UDP payload
     void write(TCPSegment &seg);
 
+    //! Writes every segment in `segments` into UDP payloads, emptying the queue
+    void write_batch(std::queue<TCPSegment> &segments);
+
+    //! Is the adapter receiving datagrams coalesced by UDP_GRO?
+    bool gro() const { return _gro; }
+
+    //! Is the adapter sending runs of segments as UDP_SEGMENT messages?
+    bool gso() const { return _gso; }
+
     //! Access the underlying UDP socket
     operator UDPSocket &() { return _sock; }
 
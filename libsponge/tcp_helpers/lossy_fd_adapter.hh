@@ -1,16 +1,28 @@
 #ifndef SPONGE_LIBSPONGE_LOSSY_FD_ADAPTER_HH
 #define SPONGE_LIBSPONGE_LOSSY_FD_ADAPTER_HH
 
+#include "emulated_link.hh"
 #include "file_descriptor.hh"
 #include "tcp_config.hh"
 #include "tcp_segment.hh"
 #include "util.hh"
 
+#include <algorithm>
+#include <cstdint>
+#include <deque>
+#include <limits>
 #include <optional>
+#include <queue>
 #include <random>
 #include <utility>
+#include <vector>
 
-//! An adapter class that adds random dropping behavior to an FD adapter
+//! \brief An adapter class that adds random dropping behavior to an FD adapter
+//! \details If FdAdapterConfig::impairment_up or `impairment_dn` is set, segments in that direction
+//! also go through an EmulatedLink, which can delay, reorder, duplicate, corrupt and rate-limit
+//! them, in the manner of netem. Segments held back by the link wait in its timed queue until tick()
+//! has advanced the clock far enough: outbound ones are then written by tick(), and inbound ones
+//! are returned by read_due() (or by the next read).
 template <typename AdapterT>
 class LossyFdAdapter {
   private:
@@ -20,6 +32,43 @@ class LossyFdAdapter {
     //! The underlying FD adapter
     AdapterT _adapter;
 
+    //! Milliseconds passed to tick() so far, in microseconds (the EmulatedLinks' clock)
+    uint64_t _now_us = 0;
+
+    //! The impaired links in each direction, set up on first use (once the config is final)
+    std::optional<EmulatedLink> _uplink{}, _downlink{};
+
+    //! Inbound segments that the downlink has delivered but no read has returned yet
+    std::deque<TCPSegment> _due{};
+
+    //! The link for one direction, or `nullptr` if that direction isn't impaired
+    EmulatedLink *_link(const bool uplink) {
+        std::optional<EmulatedLink> &link = uplink ? _uplink : _downlink;
+        const LinkConfig &cfg = uplink ? _adapter.config().impairment_up : _adapter.config().impairment_dn;
+        if (not link.has_value() and cfg.impaired()) {
+            link.emplace(cfg, _rand());
+        }
+        return link.has_value() ? &link.value() : nullptr;
+    }
+
+    //! Write the outbound segments that have arrived by `now` (in microseconds)
+    void _write_due(const uint64_t now) {
+        if (_uplink.has_value()) {
+            std::queue<TCPSegment> due;
+            _uplink->deliver(now, [&](TCPSegment &seg) { due.push(std::move(seg)); });
+            if (not due.empty()) {
+                _adapter.write_batch(due);
+            }
+        }
+    }
+
+    //! Move the inbound segments that have arrived to `_due`
+    void _collect_inbound() {
+        if (_downlink.has_value()) {
+            _downlink->deliver(_now_us, [&](TCPSegment &seg) { _due.push_back(std::move(seg)); });
+        }
+    }
+
     //! \brief Determine whether or not to drop a given read or write
     //! \param[in] uplink is `true` to use the uplink loss probability, else use the downlink loss probability
     //! \returns `true` if the segment should be dropped
@@ -42,8 +91,46 @@ class LossyFdAdapter {
     std::optional<TCPSegment> read() {
         auto ret = _adapter.read();
         if (_should_drop(false)) {
-            return {};
+            ret.reset();
+        }
+        EmulatedLink *const link = _link(false);
+        if (link == nullptr) {
+            return ret;
+        }
+        if (ret.has_value()) {
+            link->send(std::move(ret.value()), _now_us);
+            ret.reset();
+        }
+        _collect_inbound();
+        if (not _due.empty()) {
+            ret = std::move(_due.front());
+            _due.pop_front();
+        }
+        return ret;
+    }
+
+    //! \brief Read a batch from the underlying AdapterT instance, potentially dropping each read datagram
+    //! \returns the segments that were neither dropped nor rejected by the underlying AdapterT
+    std::vector<TCPSegment> read_batch() {
+        auto segments = _adapter.read_batch();
+        const auto dropped = [&](const TCPSegment &) { return _should_drop(false); };
+        segments.erase(std::remove_if(segments.begin(), segments.end(), dropped), segments.end());
+        EmulatedLink *const link = _link(false);
+        if (link == nullptr) {
+            return segments;
+        }
+        for (auto &seg : segments) {
+            link->send(std::move(seg), _now_us);
         }
+        return read_due();
+    }
+
+    //! \brief The inbound segments held back by the downlink that have since arrived
+    //! \details Called after tick(), as these don't make the underlying file descriptor readable
+    std::vector<TCPSegment> read_due() {
+        _collect_inbound();
+        std::vector<TCPSegment> ret{std::make_move_iterator(_due.begin()), std::make_move_iterator(_due.end())};
+        _due.clear();
         return ret;
     }
 
@@ -53,9 +140,48 @@ class LossyFdAdapter {
         if (_should_drop(true)) {
             return;
         }
-        return _adapter.write(seg);
+        EmulatedLink *const link = _link(true);
+        if (link == nullptr) {
+            return _adapter.write(seg);
+        }
+        link->send(seg, _now_us);
+        _write_due(_now_us);
     }
 
+    //! \brief Write a batch to the underlying AdapterT instance, potentially dropping each datagram to be written
+    //! \param[in] segments is the queue of packets to either write or drop; it is emptied
+    void write_batch(std::queue<TCPSegment> &segments) {
+        std::queue<TCPSegment> survivors;
+        EmulatedLink *const link = _link(true);
+        while (not segments.empty()) {
+            if (not _should_drop(true)) {
+                if (link != nullptr) {
+                    link->send(std::move(segments.front()), _now_us);
+                } else {
+                    survivors.push(std::move(segments.front()));
+                }
+            }
+            segments.pop();
+        }
+        if (link != nullptr) {
+            _write_due(_now_us);
+        } else {
+            _adapter.write_batch(survivors);
+        }
+    }
+
+    //! \brief Advance the clock, and write the outbound segments held back by the uplink that have since arrived
+    //! \param[in] ms_since_last_tick is also passed to the underlying AdapterT
+    void tick(const size_t ms_since_last_tick) {
+        _now_us += uint64_t{ms_since_last_tick} * 1000;
+        _write_due(_now_us);
+        _adapter.tick(ms_since_last_tick);
+    }
+
+    //! \brief Write every outbound segment that the uplink still holds, without waiting for it to arrive
+    //! \details For a connection that is done, whose clock will no longer advance
+    void flush() { _write_due(std::numeric_limits<uint64_t>::max()); }
+
     //! \name
     //! Passthrough functions to the underlying AdapterT instance
 
@@ -63,9 +189,6 @@ class LossyFdAdapter {
     void set_listening(const bool l) { _adapter.set_listening(l); }      //!< FdAdapterBase::set_listening passthrough
     const FdAdapterConfig &config() const { return _adapter.config(); }  //!< FdAdapterBase::config passthrough
     FdAdapterConfig &config_mut() { return _adapter.config_mut(); }      //!< FdAdapterBase::config_mut passthrough
-    void tick(const size_t ms_since_last_tick) {
-        _adapter.tick(ms_since_last_tick);
-    }  //!< FdAdapterBase::tick passthrough
     //!@}
 };
 
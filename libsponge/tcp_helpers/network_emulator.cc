@@ -0,0 +1,40 @@
+#include "network_emulator.hh"
+
+#include <algorithm>
+
+using namespace std;
+
+NetworkEmulator::NetworkEmulator(TCPConnection &a,
+                                 TCPConnection &b,
+                                 const LinkConfig &a_to_b,
+                                 const LinkConfig &b_to_a,
+                                 const unsigned seed,
+                                 const uint64_t tick_us)
+    : _a(a), _b(b), _a_to_b(a_to_b, seed), _b_to_a(b_to_a, seed + 1), _tick_us(max<uint64_t>(tick_us, 1)) {}
+
+void NetworkEmulator::step() {
+    for (; not _a.segments_out().empty(); _a.segments_out().pop()) {
+        _a_to_b.send(move(_a.segments_out().front()), _now);
+    }
+    for (; not _b.segments_out().empty(); _b.segments_out().pop()) {
+        _b_to_a.send(move(_b.segments_out().front()), _now);
+    }
+
+    uint64_t next = _now + _tick_us;
+    for (const auto &arrival : {_a_to_b.next_arrival(), _b_to_a.next_arrival()}) {
+        if (arrival.has_value()) {
+            next = min(next, arrival.value());
+        }
+    }
+    _unticked += next - _now;
+    _now = next;
+
+    _a_to_b.deliver(_now, [&](TCPSegment &seg) { _b.segment_received(seg); });
+    _b_to_a.deliver(_now, [&](TCPSegment &seg) { _a.segment_received(seg); });
+
+    if (_unticked >= 1000) {
+        _a.tick(_unticked / 1000);
+        _b.tick(_unticked / 1000);
+        _unticked %= 1000;
+    }
+}
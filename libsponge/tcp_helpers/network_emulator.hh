@@ -0,0 +1,48 @@
+#ifndef SPONGE_LIBSPONGE_NETWORK_EMULATOR_HH
+#define SPONGE_LIBSPONGE_NETWORK_EMULATOR_HH
+
+#include "emulated_link.hh"
+#include "tcp_connection.hh"
+
+#include <cstdint>
+
+//! \brief Connects two TCPConnections through a pair of EmulatedLinks, in virtual time
+//! \details Each step() jumps straight to the next packet arrival or timer tick, whichever comes
+//! first, so a transfer over a slow, long link runs as fast as the TCP code allows, and a given
+//! seed always gives the same run.
+class NetworkEmulator {
+  private:
+    TCPConnection &_a;
+    TCPConnection &_b;
+    EmulatedLink _a_to_b;
+    EmulatedLink _b_to_a;
+    uint64_t _tick_us;       //!< Longest that time may advance without ticking the connections
+    uint64_t _now = 0;       //!< Virtual time, in microseconds
+    uint64_t _unticked = 0;  //!< Microseconds that haven't yet been passed to TCPConnection::tick()
+
+  public:
+    static constexpr uint64_t DEFAULT_TICK_US = 1000;  //!< TCPConnection's timers count milliseconds
+
+    //! \param[in] a_to_b and `b_to_a` describe the two directions of the link
+    //! \param[in] seed seeds the links' random choices
+    //! \param[in] tick_us is how often the connections' timers are updated when no packets arrive
+    NetworkEmulator(TCPConnection &a,
+                    TCPConnection &b,
+                    const LinkConfig &a_to_b,
+                    const LinkConfig &b_to_a,
+                    const unsigned seed = 0,
+                    const uint64_t tick_us = DEFAULT_TICK_US);
+
+    //! \brief Send what the connections have queued, then advance time to the next arrival or tick
+    //! \details Packets that arrive are handed to their receivers, and the connections are ticked
+    //! with every whole millisecond that has passed.
+    void step();
+
+    //! Microseconds of virtual time since construction
+    uint64_t now() const { return _now; }
+
+    const EmulatedLink &a_to_b() const { return _a_to_b; }
+    const EmulatedLink &b_to_a() const { return _b_to_a; }
+};
+
+#endif  // SPONGE_LIBSPONGE_NETWORK_EMULATOR_HH
@@ -2,6 +2,7 @@
 #define SPONGE_LIBSPONGE_TCP_CONFIG_HH
 
 #include "address.hh"
+#include "emulated_link.hh"
 #include "wrapping_integers.hh"
 
 #include <cstddef>
@@ -16,9 +17,10 @@ class TCPConfig {
     static constexpr uint16_t TIMEOUT_DFLT = 1000;     //!< Default re-transmit timeout is 1 second
     static constexpr unsigned MAX_RETX_ATTEMPTS = 8;   //!< Maximum re-transmit attempts before giving up
 
-    uint16_t rt_timeout = TIMEOUT_DFLT;       //!< Initial value of the retransmission timeout, in milliseconds
-    size_t recv_capacity = DEFAULT_CAPACITY;  //!< Receive capacity, in bytes
-    size_t send_capacity = DEFAULT_CAPACITY;  //!< Sender capacity, in bytes
+    uint16_t rt_timeout = TIMEOUT_DFLT;          //!< Initial value of the retransmission timeout, in milliseconds
+    size_t recv_capacity = DEFAULT_CAPACITY;     //!< Receive capacity, in bytes
+    size_t send_capacity = DEFAULT_CAPACITY;     //!< Sender capacity, in bytes
+    size_t max_payload_size = MAX_PAYLOAD_SIZE;  //!< Largest payload the sender puts in one segment
     std::optional<WrappingInt32> fixed_isn{};
 };
 
@@ -30,6 +32,9 @@ class FdAdapterConfig {
 
     uint16_t loss_rate_dn = 0;  //!< Downlink loss rate (for LossyFdAdapter)
     uint16_t loss_rate_up = 0;  //!< Uplink loss rate (for LossyFdAdapter)
+
+    LinkConfig impairment_dn{};  //!< Downlink delay, reordering, etc. (for LossyFdAdapter)
+    LinkConfig impairment_up{};  //!< Uplink delay, reordering, etc. (for LossyFdAdapter)
 };
 
 #endif  // SPONGE_LIBSPONGE_TCP_CONFIG_HH
@@ -0,0 +1,18 @@
+#include "tcp_connection_stats.hh"
+
+#include <sstream>
+
+using namespace std;
+
+string TCPConnectionStats::to_string() const {
+    ostringstream ss;
+    ss << "sent " << segments_sent << " segments (" << bytes_sent << " bytes), received " << segments_received
+       << " segments (" << bytes_received << " bytes); retransmitted " << retransmissions << " segments ("
+       << retransmitted_bytes << " bytes: " << retransmission_timeouts << " timeouts, " << zero_window_probes
+       << " zero-window probes); received " << duplicate_segments << " duplicate and " << out_of_order_segments
+       << " out-of-order segments; peer's window closed " << zero_window_events << " times, ours "
+       << zero_windows_advertised << " times; window-limited for " << window_limited_ms << " ms; RTO " << rto_ms
+       << " ms, windows " << peer_window << " (peer) and " << receive_window << " (ours), " << bytes_in_flight
+       << " bytes in flight, " << unassembled_bytes << " unassembled";
+    return ss.str();
+}
@@ -0,0 +1,46 @@
+#ifndef SPONGE_LIBSPONGE_TCP_CONNECTION_STATS_HH
+#define SPONGE_LIBSPONGE_TCP_CONNECTION_STATS_HH
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+//! \brief What a TCPConnection has done so far, and the state of its windows and timer
+//! \details Like Linux's `TCP_INFO`. The counters are bumped by the TCPSender and TCPConnection as
+//! they go (a few integer increments per segment); TCPConnection::stats() fills in the gauges.
+struct TCPConnectionStats {
+    //! \name Counters
+    //!@{
+    uint64_t segments_sent = 0;      //!< Segments queued for sending (retransmissions included)
+    uint64_t bytes_sent = 0;         //!< Payload bytes in those segments
+    uint64_t segments_received = 0;  //!< Segments received
+    uint64_t bytes_received = 0;     //!< Payload bytes in those segments
+
+    uint64_t retransmissions = 0;          //!< Segments sent again
+    uint64_t retransmitted_bytes = 0;      //!< Payload bytes in those segments
+    uint64_t retransmission_timeouts = 0;  //!< Retransmissions because the timer expired (and the RTO backed off)
+    uint64_t zero_window_probes = 0;       //!< Retransmissions that probed a window of zero (with no backoff)
+
+    uint64_t duplicate_segments = 0;     //!< Received segments whose payload had all been received already
+    uint64_t out_of_order_segments = 0;  //!< Received segments that began beyond the next byte expected
+
+    uint64_t zero_window_events = 0;       //!< Times the peer's advertised window closed to zero
+    uint64_t zero_windows_advertised = 0;  //!< Times our own advertised window closed to zero
+    uint64_t window_limited_ms = 0;        //!< Time spent with bytes to send but the peer's window full
+    //!@}
+
+    //! \name Gauges
+    //!@{
+    uint64_t rto_ms = 0;                       //!< Current retransmission timeout
+    uint64_t peer_window = 0;                  //!< Window last advertised by the peer
+    uint64_t receive_window = 0;               //!< Window last advertised to the peer
+    uint64_t bytes_in_flight = 0;              //!< Sequence numbers sent but not yet acknowledged
+    uint64_t unassembled_bytes = 0;            //!< Bytes received out of order, waiting for a gap to fill
+    uint64_t consecutive_retransmissions = 0;  //!< Retransmissions since the last new acknowledgment
+    //!@}
+
+    //! Return a human-readable summary, e.g. "sent 1000 segments (1000000 bytes), received ..."
+    std::string to_string() const;
+};
+
+#endif  // SPONGE_LIBSPONGE_TCP_CONNECTION_STATS_HH
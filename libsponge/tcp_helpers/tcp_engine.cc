@@ -0,0 +1,367 @@
+#include "tcp_engine.hh"
+
+#include "eventloop.hh"
+#include "util.hh"
+
+#include <algorithm>
+#include <exception>
+#include <iostream>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <sys/eventfd.h>
+#include <unistd.h>
+#include <unordered_map>
+#include <utility>
+
+using namespace std;
+
+//! Largest possible IPv4 datagram, with the `virtio_net_hdr` that may precede it
+static constexpr size_t MAX_PACKET_SIZE = 65535 + VirtioNetHeader::LENGTH;
+
+//! Most datagrams that may wait in a worker's inbox; the steering thread drops any more
+static constexpr size_t MAX_INBOX_SIZE = 4096;
+
+//! One shard of the engine: a TCPStack, the thread that runs it, and the queue of work for that thread
+class TCPEngine::Worker {
+  private:
+    //! Bytes that an application has written to a connection but that didn't yet fit in its outbound stream
+    struct PendingWrite {
+        std::string data{};      //!< bytes queued by the application
+        size_t offset = 0;       //!< how many bytes of `data` have been written
+        bool end_input = false;  //!< end the outbound stream once `data` has been written
+    };
+
+    TCPStack _stack;         //!< Owns every connection in this shard
+    FileDescriptor _wakeup;  //!< eventfd signalled when a task or datagram arrives
+
+    std::mutex _mutex{};                          //!< Protects _tasks and _inbox
+    std::vector<std::function<void()>> _tasks{};  //!< Submitted work, not yet run
+    std::vector<Buffer> _inbox{};                 //!< Inbound datagrams, not yet processed
+
+    //! Writes waiting for room in their connections' outbound streams
+    std::unordered_map<TCPFlow, PendingWrite, TCPFlowHash> _pending{};
+
+    //! This worker's own queue of a multi-queue TUN device, if it has one (see read_queue())
+    std::optional<FileDescriptor> _queue{};
+
+    BufferPool _queue_pool{MAX_PACKET_SIZE};  //!< Slabs into which datagrams are read from _queue
+
+    std::thread _thread{};  //!< Runs the stack's event loop (see start())
+
+    //! Signal _wakeup
+    void _wake();
+
+    //! Process every datagram in the inbox and run every submitted task
+    void _run_inbox();
+
+    //! Move as many pending bytes as fit into the connections' outbound streams
+    void _write_pending();
+
+  public:
+    //! Construct a worker whose stack sends datagrams on `tx`
+    Worker(FileDescriptor &&tx, const bool vnet_hdr);
+
+    //! Queue `task` and wake up the worker's thread
+    void submit(std::function<void()> &&task);
+
+    //! Queue bytes for a connection (called on the worker's thread)
+    void write(const TCPFlow &flow, std::string &&data);
+
+    //! Queue the end of a connection's outbound stream (called on the worker's thread)
+    void end_input_stream(const TCPFlow &flow);
+
+    //! \brief Read inbound datagrams from `queue` on the worker's thread, passing each to `steer`
+    //! \note Must be called before start().
+    void read_queue(FileDescriptor &&queue, std::function<void(Buffer &&)> &&steer);
+
+    //! Hand an inbound datagram to this worker
+    //! \returns `false` if the inbox was full and the datagram was dropped
+    bool deliver(Buffer &&datagram);
+
+    //! Start the worker's thread, which runs until `abort` is set
+    void start(const std::atomic_bool &abort);
+
+    //! Join the worker's thread
+    void join();
+
+    //! The worker's stack (only to be used on the worker's thread)
+    TCPStack &stack() { return _stack; }
+};
+
+//! \param[in] tx is the file descriptor to which the worker's stack writes outbound datagrams
+//! \param[in] vnet_hdr is `true` if each datagram is preceded by a `virtio_net_hdr` (see TCPStack)
+TCPEngine::Worker::Worker(FileDescriptor &&tx, const bool vnet_hdr)
+    : _stack(move(tx), vnet_hdr), _wakeup(SystemCall("eventfd", ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC))) {
+    _stack.eventloop().add_rule(_wakeup, Direction::In, [&] {
+        _wakeup.read(sizeof(uint64_t));
+        _run_inbox();
+    });
+}
+
+void TCPEngine::Worker::_wake() {
+    const uint64_t one = 1;
+    SystemCall("write", ::write(_wakeup.fd_num(), &one, sizeof(one)));
+}
+
+void TCPEngine::Worker::submit(function<void()> &&task) {
+    {
+        const lock_guard<mutex> lock(_mutex);
+        _tasks.push_back(move(task));
+    }
+    _wake();
+}
+
+//! \details Only the datagram that makes the inbox non-empty signals the worker, so a busy worker
+//! costs the steering thread no more than one syscall per batch.
+bool TCPEngine::Worker::deliver(Buffer &&datagram) {
+    bool was_empty = false;
+    {
+        const lock_guard<mutex> lock(_mutex);
+        if (_inbox.size() >= MAX_INBOX_SIZE) {
+            return false;
+        }
+        was_empty = _inbox.empty();
+        _inbox.push_back(move(datagram));
+    }
+    if (was_empty) {
+        _wake();
+    }
+    return true;
+}
+
+void TCPEngine::Worker::read_queue(FileDescriptor &&queue, function<void(Buffer &&)> &&steer) {
+    _queue = move(queue);
+    _stack.eventloop().add_rule(
+        *_queue, Direction::In, [this, steer = move(steer)] { steer(_queue->read(_queue_pool)); });
+}
+
+//! \details Tasks run first: a task that was submitted before a datagram arrived (say, a listen()
+//! before the SYN it should accept) must see the datagram after it has run.
+void TCPEngine::Worker::_run_inbox() {
+    vector<Buffer> inbox;
+    vector<function<void()>> tasks;
+    {
+        const lock_guard<mutex> lock(_mutex);
+        swap(inbox, _inbox);
+        swap(tasks, _tasks);
+    }
+    for (auto &task : tasks) {
+        task();
+    }
+    for (const auto &datagram : inbox) {
+        _stack.datagram_received(datagram);
+    }
+}
+
+//! \param[in] flow is the connection to write to
+//! \param[in] data is appended to whatever is already waiting for that connection
+void TCPEngine::Worker::write(const TCPFlow &flow, string &&data) {
+    PendingWrite &pending = _pending[flow];
+    if (pending.offset == pending.data.size()) {
+        pending.data = move(data);
+        pending.offset = 0;
+    } else {
+        pending.data.append(data);
+    }
+    _write_pending();
+}
+
+void TCPEngine::Worker::end_input_stream(const TCPFlow &flow) {
+    _pending[flow].end_input = true;
+    _write_pending();
+}
+
+void TCPEngine::Worker::_write_pending() {
+    for (auto it = _pending.begin(); it != _pending.end();) {
+        TCPHandle handle{_stack, it->first};
+        PendingWrite &pending = it->second;
+
+        if (not handle.valid()) {
+            it = _pending.erase(it);
+            continue;
+        }
+
+        const size_t len = min(handle.connection().remaining_outbound_capacity(), pending.data.size() - pending.offset);
+        if (len > 0) {
+            pending.offset += handle.write(string_view(pending.data).substr(pending.offset, len));
+        }
+
+        if (pending.offset == pending.data.size()) {
+            if (pending.end_input) {
+                handle.end_input_stream();
+            }
+            it = _pending.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+//! \param[in] abort is polled between events; the thread exits once it is set
+void TCPEngine::Worker::start(const atomic_bool &abort) {
+    _thread = thread([this, &abort] {
+        try {
+            while (not abort) {
+                _stack.wait_next_event(10);
+                _write_pending();
+                // established connections were already announced to the handler
+                while (_stack.accept()) {
+                }
+            }
+        } catch (const exception &e) {
+            cerr << "Exception in TCPEngine worker: " << e.what() << endl;
+        }
+    });
+}
+
+void TCPEngine::Worker::join() {
+    if (_thread.joinable()) {
+        _thread.join();
+    }
+}
+
+//! \param[in] rx is the file descriptor from which to read IPv4 datagrams, one per read
+//! \param[in] tx is the file descriptor to which the workers write IPv4 datagrams, one per write
+//! \param[in] nworkers is the number of worker threads (and shards)
+//! \param[in] vnet_hdr is `true` if each datagram, in either direction, is preceded by a `virtio_net_hdr`
+TCPEngine::TCPEngine(FileDescriptor &&rx, FileDescriptor &&tx, const size_t nworkers, const bool vnet_hdr)
+    : _rx(move(rx)), _vnet_hdr(vnet_hdr) {
+    for (size_t i = 0; i < nworkers; ++i) {
+        _workers.push_back(make_unique<Worker>(tx.duplicate(), vnet_hdr));
+    }
+    _start();
+}
+
+//! \param[in] tun is the TUN device to read datagrams from and write them to (with its `virtio_net_hdr`, if any)
+//! \param[in] nworkers is the number of worker threads (and shards)
+TCPEngine::TCPEngine(TunFD &&tun, const size_t nworkers)
+    : TCPEngine(tun.duplicate(), move(tun), nworkers, tun.vnet_hdr()) {}
+
+//! \param[in] queues are the queues of a multi-queue TUN device, one per worker (all opened with or
+//! all without a `virtio_net_hdr`)
+TCPEngine::TCPEngine(vector<TunFD> &&queues) : _vnet_hdr(not queues.empty() and queues.front().vnet_hdr()) {
+    for (size_t i = 0; i < queues.size(); ++i) {
+        if (queues[i].vnet_hdr() != _vnet_hdr) {
+            throw runtime_error("TCPEngine: every queue must be opened with the same vnet_hdr setting");
+        }
+        _workers.push_back(make_unique<Worker>(queues[i].duplicate(), _vnet_hdr));
+        _workers.back()->read_queue(move(queues[i]),
+                                    [this, i](Buffer &&datagram) { _steer_from_queue(i, move(datagram)); });
+    }
+    _start();
+}
+
+void TCPEngine::_start() {
+    if (_workers.empty()) {
+        throw runtime_error("TCPEngine: need at least one worker");
+    }
+
+    for (auto &worker : _workers) {
+        worker->start(_abort);
+    }
+    if (_rx) {
+        _steering_thread = thread([this] { _steering_main(); });
+    }
+}
+
+TCPEngine::~TCPEngine() {
+    _abort = true;
+    if (_steering_thread.joinable()) {
+        _steering_thread.join();
+    }
+    for (auto &worker : _workers) {
+        worker->join();
+    }
+}
+
+void TCPEngine::submit(const size_t worker, const TaskT &task) {
+    Worker &w = *_workers.at(worker);
+    w.submit([&w, task] { task(w.stack()); });
+}
+
+//! \details Connections are accepted by the workers as soon as their handshakes complete, and
+//! announced through the handler.
+void TCPEngine::listen(const TCPConfig &c_tcp, const uint16_t port, const size_t backlog) {
+    // checked here, since a task that throws would stop its worker
+    if (not _listening.insert(port).second) {
+        throw runtime_error("TCPEngine::listen(): port " + to_string(port) + " is already listening");
+    }
+    for (size_t i = 0; i < _workers.size(); ++i) {
+        submit(i, [c_tcp, port, backlog](TCPStack &stack) { stack.listen(c_tcp, port, backlog); });
+    }
+}
+
+void TCPEngine::set_handler(const TCPStack::HandlerT &handler) {
+    for (size_t i = 0; i < _workers.size(); ++i) {
+        submit(i, [handler](TCPStack &stack) { stack.set_handler(handler); });
+    }
+}
+
+TCPFlow TCPEngine::connect(const TCPConfig &c_tcp, const FdAdapterConfig &c_ad) {
+    const TCPFlow flow{c_ad.source.ipv4_numeric(),
+                       c_ad.destination.ipv4_numeric(),
+                       c_ad.source.port(),
+                       c_ad.destination.port()};
+    submit(flow, [c_tcp, c_ad](TCPStack &stack) { stack.connect(c_tcp, c_ad); });
+    return flow;
+}
+
+void TCPEngine::write(const TCPFlow &flow, string &&data) {
+    Worker &w = *_workers[worker_of(flow)];
+    w.submit([&w, flow, data = move(data)]() mutable { w.write(flow, move(data)); });
+}
+
+void TCPEngine::end_input_stream(const TCPFlow &flow) {
+    Worker &w = *_workers[worker_of(flow)];
+    w.submit([&w, flow] { w.end_input_stream(flow); });
+}
+
+void TCPEngine::_steering_main() {
+    try {
+        EventLoop eventloop;
+        BufferPool pool{MAX_PACKET_SIZE};
+        eventloop.add_rule(*_rx, Direction::In, [&] { _steer(_rx->read(pool)); });
+
+        while (not _abort) {
+            if (eventloop.wait_next_event(10) == EventLoop::Result::Exit) {
+                return;
+            }
+        }
+    } catch (const exception &e) {
+        cerr << "Exception in TCPEngine steering thread: " << e.what() << endl;
+    }
+}
+
+void TCPEngine::_steer(Buffer &&datagram) {
+    if (not _workers[_owner_of(datagram)]->deliver(move(datagram))) {
+        ++_steering_drops;
+    }
+}
+
+//! \details Called on worker `reader`'s thread, which may process its own datagrams directly.
+void TCPEngine::_steer_from_queue(const size_t reader, Buffer &&datagram) {
+    const size_t owner = _owner_of(datagram);
+    if (owner == reader) {
+        _workers[reader]->stack().datagram_received(datagram);
+    } else if (not _workers[owner]->deliver(move(datagram))) {
+        ++_steering_drops;
+    }
+}
+
+//! \details Reads just enough of the IPv4 and TCP headers to find the 4-tuple (skipping the
+//! `virtio_net_hdr`, if there is one). Anything that isn't TCP goes to worker 0, whose TCPStack drops it.
+size_t TCPEngine::_owner_of(const Buffer &datagram) const {
+    const size_t start = _vnet_hdr ? VirtioNetHeader::LENGTH : 0;
+    const auto byte = [&](const size_t i) { return static_cast<uint8_t>(datagram.str()[start + i]); };
+    const auto word = [&](const size_t i) { return static_cast<uint16_t>((byte(i) << 8) | byte(i + 1)); };
+    const auto dword = [&](const size_t i) { return (uint32_t{word(i)} << 16) | word(i + 2); };
+
+    if (datagram.size() >= start + 20 and byte(9) == IPv4Header::PROTO_TCP) {
+        const size_t ihl = (byte(0) & 0xf) * 4;
+        if (datagram.size() >= start + ihl + 4) {
+            return worker_of(TCPFlow{dword(16), dword(12), word(ihl + 2), word(ihl)});
+        }
+    }
+    return 0;
+}
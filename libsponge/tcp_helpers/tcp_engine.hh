@@ -0,0 +1,147 @@
+#ifndef SPONGE_LIBSPONGE_TCP_ENGINE_HH
+#define SPONGE_LIBSPONGE_TCP_ENGINE_HH
+
+#include "file_descriptor.hh"
+#include "tcp_config.hh"
+#include "tcp_flow.hh"
+#include "tcp_listener.hh"
+#include "tcp_stack.hh"
+#include "tun.hh"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <string>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+
+//! \brief Many TCPConnections sharded over worker threads, each with its own TCPStack
+//! \details A steering thread reads every inbound datagram and hands it to the worker that owns its
+//! 4-tuple, chosen by TCPFlowHash. Each worker runs a TCPStack (with its own EventLoop, connection
+//! table and listeners) on its own thread, and writes outbound datagrams directly to the shared
+//! device (or, with a multi-queue TUN device, each worker reads and writes its own queue). No
+//! connection state is shared between threads, so nothing but the per-worker inboxes needs a lock.
+class TCPEngine {
+  public:
+    //! Work to run on the thread of the worker that owns a flow
+    using TaskT = std::function<void(TCPStack &)>;
+
+  private:
+    class Worker;
+
+    std::optional<FileDescriptor> _rx{};              //!< Source of inbound datagrams, read by the steering thread
+    bool _vnet_hdr = false;                           //!< Is every datagram preceded by a `virtio_net_hdr`?
+    std::vector<std::unique_ptr<Worker>> _workers{};  //!< One per thread, indexed by worker_of()
+    std::atomic_bool _abort{false};                   //!< Tells every thread to exit
+    std::atomic<uint64_t> _steering_drops{0};         //!< Datagrams dropped because a worker's inbox was full
+    std::thread _steering_thread{};                   //!< Reads _rx and dispatches datagrams to the workers
+    std::unordered_set<uint16_t> _listening{};        //!< Ports passed to listen(), which the workers listen on
+
+    //! Main loop of the steering thread
+    void _steering_main();
+
+    //! Hand one inbound datagram to the worker that owns its flow
+    void _steer(Buffer &&datagram);
+
+    //! Process a datagram read from worker `reader`'s own TUN queue, or hand it to the worker that owns its flow
+    void _steer_from_queue(const size_t reader, Buffer &&datagram);
+
+    //! The index of the worker that owns an inbound IPv4 datagram
+    size_t _owner_of(const Buffer &datagram) const;
+
+    //! Start the worker threads, and the steering thread if there is one
+    void _start();
+
+  public:
+    //! Construct an engine with `nworkers` worker threads that receives datagrams from `rx` and sends them on `tx`
+    TCPEngine(FileDescriptor &&rx, FileDescriptor &&tx, const size_t nworkers, const bool vnet_hdr = false);
+
+    //! Construct an engine with `nworkers` worker threads that sends and receives datagrams on a TUN device
+    TCPEngine(TunFD &&tun, const size_t nworkers);
+
+    //! Construct an engine with one worker thread per queue of a multi-queue TUN device (see TunFD::open_queues)
+    explicit TCPEngine(std::vector<TunFD> &&queues);
+
+    //! Number of worker threads
+    size_t workers() const { return _workers.size(); }
+
+    //! The index of the worker that owns `flow`
+    size_t worker_of(const TCPFlow &flow) const { return TCPFlowHash{}(flow) % _workers.size(); }
+
+    //! Run `task` on the thread of worker `worker`
+    void submit(const size_t worker, const TaskT &task);
+
+    //! Run `task` on the thread of the worker that owns `flow`
+    void submit(const TCPFlow &flow, const TaskT &task) { submit(worker_of(flow), task); }
+
+    //! Accept connections to `port` on every worker (see TCPStack::listen); throws if `port` is already listening
+    void listen(const TCPConfig &c_tcp, const uint16_t port, const size_t backlog = TCPListener::DEFAULT_BACKLOG);
+
+    //! \brief Install the callback invoked when a connection needs the application's attention
+    //! \note The handler runs on the workers' threads, possibly on several of them at once.
+    void set_handler(const TCPStack::HandlerT &handler);
+
+    //! \brief Open a connection from `c_ad.source` to `c_ad.destination` on the worker that owns it
+    //! \returns the new connection's 4-tuple
+    TCPFlow connect(const TCPConfig &c_tcp, const FdAdapterConfig &c_ad);
+
+    //! \brief Queue `data` to be written to a connection's outbound stream
+    //! \details Bytes that don't fit in the outbound stream are held by the worker and written as the
+    //! stream drains; they are discarded if the connection goes away first.
+    void write(const TCPFlow &flow, std::string &&data);
+
+    //! Shut down a connection's outbound stream once everything queued by write() has been written
+    void end_input_stream(const TCPFlow &flow);
+
+    //! Number of inbound datagrams dropped because a worker fell behind
+    uint64_t steering_drops() const { return _steering_drops; }
+
+    //! Stops and joins every thread (active connections are reset by their TCPStack)
+    ~TCPEngine();
+
+    //! \name
+    //! The threads point into the engine, so it cannot be moved or copied
+
+    //!@{
+    TCPEngine(const TCPEngine &) = delete;
+    TCPEngine(TCPEngine &&) = delete;
+    TCPEngine &operator=(const TCPEngine &) = delete;
+    TCPEngine &operator=(TCPEngine &&) = delete;
+    //!@}
+};
+
+//! \class TCPEngine
+//! Each worker has an inbox of datagrams, filled by the steering thread and drained by the worker's
+//! EventLoop, which is woken through an eventfd. When a worker falls behind and its inbox fills,
+//! the steering thread drops datagrams (as a NIC drops packets when its ring is full) rather than
+//! blocking every other worker; TCP recovers them by retransmission.
+//!
+//! A TCPEngine is usually driven entirely through its handler:
+//!
+//! ~~~{.cc}
+//! TCPEngine engine{TunFD("tun144"), std::thread::hardware_concurrency()};
+//! engine.set_handler([&](TCPHandle h) {
+//!     const auto request = h.read();
+//!     // runs on the worker that owns h.flow(), so it may use h directly
+//!     h.write("hello\n");
+//! });
+//! engine.listen(TCPConfig{}, 80);
+//! ~~~
+//!
+//! Threads other than the workers use write(), end_input_stream() and submit() instead of a TCPHandle.
+//!
+//! Given the queues of a multi-queue TUN device, there is no steering thread: each worker reads and
+//! writes its own queue. The kernel delivers a flow to the queue on which it last saw that flow
+//! written, so once a worker has replied on a connection, the connection's datagrams arrive on the
+//! worker's queue and no other thread touches them. Only the first few datagrams of a flow (say, a
+//! SYN) may land on another worker's queue, which passes them on through the owner's inbox.
+//!
+//! ~~~{.cc}
+//! TCPEngine engine{TunFD::open_queues("tun144", std::thread::hardware_concurrency())};
+//! ~~~
+
+#endif  // SPONGE_LIBSPONGE_TCP_ENGINE_HH
@@ -0,0 +1,32 @@
+#include "tcp_flow.hh"
+
+#include "address.hh"
+
+using namespace std;
+
+//! \param[in] ip_header is the header of the IPv4 datagram that carried the segment
+//! \param[in] tcp_header is the header of the inbound segment
+TCPFlow TCPFlow::inbound(const IPv4Header &ip_header, const TCPHeader &tcp_header) {
+    return {ip_header.dst, ip_header.src, tcp_header.dport, tcp_header.sport};
+}
+
+string TCPFlow::to_string() const {
+    return Address::from_ipv4_numeric(local_address).ip() + ":" + std::to_string(local_port) + " <-> " +
+           Address::from_ipv4_numeric(remote_address).ip() + ":" + std::to_string(remote_port);
+}
+
+bool TCPFlow::operator==(const TCPFlow &other) const {
+    return local_address == other.local_address and remote_address == other.remote_address and
+           local_port == other.local_port and remote_port == other.remote_port;
+}
+
+//! \details Packs the 96 bits of the 4-tuple into two words and mixes them with the
+//! [splitmix64](http://xorshift.di.unimi.it/splitmix64.c) finalizer, so that flows that differ
+//! only in their ports still spread evenly over the buckets.
+size_t TCPFlowHash::operator()(const TCPFlow &flow) const {
+    uint64_t x = (uint64_t{flow.local_address} << 32) | flow.remote_address;
+    x ^= ((uint64_t{flow.local_port} << 16) | flow.remote_port) * 0x9e3779b97f4a7c15;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111eb;
+    return x ^ (x >> 31);
+}
@@ -0,0 +1,34 @@
+#ifndef SPONGE_LIBSPONGE_TCP_FLOW_HH
+#define SPONGE_LIBSPONGE_TCP_FLOW_HH
+
+#include "ipv4_header.hh"
+#include "tcp_header.hh"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+//! \brief The 4-tuple that identifies a TCP connection, seen from the local endpoint
+//! \note Addresses and ports are in host byte order, as in IPv4Header and TCPHeader
+struct TCPFlow {
+    uint32_t local_address = 0;   //!< our IPv4 address
+    uint32_t remote_address = 0;  //!< the peer's IPv4 address
+    uint16_t local_port = 0;      //!< our TCP port
+    uint16_t remote_port = 0;     //!< the peer's TCP port
+
+    //! The flow that an inbound segment belongs to (its destination is the local endpoint)
+    static TCPFlow inbound(const IPv4Header &ip_header, const TCPHeader &tcp_header);
+
+    //! Return a human-readable summary, e.g. "169.254.144.9:1234 <-> 169.254.144.1:80"
+    std::string to_string() const;
+
+    bool operator==(const TCPFlow &other) const;
+    bool operator!=(const TCPFlow &other) const { return not operator==(other); }
+};
+
+//! \brief Hash function for TCPFlow, for use as a key in unordered containers
+struct TCPFlowHash {
+    size_t operator()(const TCPFlow &flow) const;
+};
+
+#endif  // SPONGE_LIBSPONGE_TCP_FLOW_HH
@@ -0,0 +1,178 @@
+#include "tcp_listener.hh"
+
+#include <algorithm>
+#include <limits>
+#include <random>
+
+using namespace std;
+
+//! The low 27 bits of a cookie authenticate it; the high 5 bits hold the period it was issued in
+static constexpr uint32_t COOKIE_MAC_MASK = (1u << 27) - 1;
+
+//! \details A passive opener has nothing in flight but its SYN until the application
+//! writes, and the application can't write before the connection has been accepted.
+//! So the handshake has completed as soon as nothing is in flight.
+static bool handshake_complete(const TCPConnection &connection) {
+    return connection.active() and connection.bytes_in_flight() == 0;
+}
+
+//! \param[in] cfg is the TCPConfig for each connection accepted on this port
+//! \param[in] backlog is the maximum number of established connections waiting to be accepted
+//! \param[in] syn_table_max is the maximum number of half-open connections; further SYNs are dropped
+TCPListener::TCPListener(const TCPConfig &cfg, const size_t backlog, const size_t syn_table_max)
+    : _cfg(cfg)
+    , _backlog(backlog)
+    , _syn_table_max(syn_table_max)
+    , _cookie_secret((uint64_t{random_device()()} << 32) | random_device()()) {}
+
+//! \details A SYN for a new flow gets a fresh TCPConnection in the SYN table, which answers it
+//! with a SYN/ACK. Any other segment for a flow in the table is delivered to its connection.
+//! When the table is full (or always, depending on the SynCookies mode), a SYN is instead
+//! answered with a SYN cookie, or silently dropped if cookies are off, and an ACK for a flow
+//! that isn't in the table is checked against the cookie it should be acknowledging.
+bool TCPListener::segment_received(const TCPFlow &flow, const TCPSegment &seg) {
+    auto it = _syn_table.find(flow);
+    if (it == _syn_table.end()) {
+        const TCPHeader &header = seg.header();
+        if (header.ack and not header.syn and not header.rst and _syn_cookies != SynCookies::Never) {
+            return _cookie_ack_received(flow, seg);
+        }
+        if (not header.syn or header.ack or header.rst) {
+            return false;
+        }
+
+        const bool full = _syn_table.size() >= _syn_table_max;
+        if (_syn_cookies == SynCookies::Always or (full and _syn_cookies == SynCookies::WhenFull)) {
+            _send_cookie(flow, seg);
+            return true;
+        }
+        if (full) {
+            return true;
+        }
+        it = _syn_table.try_emplace(flow, _cfg).first;
+    }
+
+    TCPConnection &connection = it->second;
+    const bool was_complete = handshake_complete(connection);
+    connection.segment_received(seg);
+    _collect(flow, connection);
+
+    if (not was_complete and handshake_complete(connection)) {
+        _established.push(flow);
+    }
+    return true;
+}
+
+//! \param[in] ms_since_last_tick the number of milliseconds since the last call to this method
+void TCPListener::tick(const size_t ms_since_last_tick) {
+    _time_ms += ms_since_last_tick;
+
+    for (auto it = _syn_table.begin(); it != _syn_table.end();) {
+        TCPConnection &connection = it->second;
+        connection.tick(ms_since_last_tick);
+        _collect(it->first, connection);
+
+        if (not connection.active()) {
+            it = _syn_table.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+TCPConnectionTable::node_type TCPListener::take_established() {
+    while (_queued < _backlog and not _established.empty()) {
+        const TCPFlow flow = _established.front();
+        _established.pop();
+
+        // the connection may have been reset since its handshake completed
+        auto it = _syn_table.find(flow);
+        if (it != _syn_table.end() and it->second.active()) {
+            ++_queued;
+            return _syn_table.extract(it);
+        }
+    }
+    return {};
+}
+
+void TCPListener::accepted() {
+    if (_queued > 0) {
+        --_queued;
+    }
+}
+
+void TCPListener::reset() {
+    for (auto &[flow, connection] : _syn_table) {
+        if (connection.active()) {
+            connection.send_rst_seg();
+            _collect(flow, connection);
+        }
+    }
+    _syn_table.clear();
+    _established = {};
+}
+
+//! \details The code is a keyed [splitmix64](http://xorshift.di.unimi.it/splitmix64.c) mix of the
+//! 4-tuple, the peer's ISN and the period. It is cheap rather than cryptographically strong, which
+//! is enough to keep an off-path attacker from completing handshakes by guessing.
+uint32_t TCPListener::_cookie_mac(const TCPFlow &flow, const WrappingInt32 peer_isn, const uint32_t epoch) const {
+    uint64_t x = TCPFlowHash{}(flow) ^ _cookie_secret;
+    x ^= ((uint64_t{peer_isn.raw_value()} << 8) | epoch) * 0x9e3779b97f4a7c15;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111eb;
+    return (x ^ (x >> 31)) & COOKIE_MAC_MASK;
+}
+
+//! \details Our ISN is the peer's ISN plus the cookie, so it comes back to us (plus one) in the
+//! ackno of the peer's final ACK. TCP options aren't supported by TCPHeader, so unlike Linux's
+//! cookies there is no MSS to encode; every connection uses TCPConfig::MAX_PAYLOAD_SIZE.
+void TCPListener::_send_cookie(const TCPFlow &flow, const TCPSegment &syn) {
+    const WrappingInt32 peer_isn = syn.header().seqno;
+    const uint32_t epoch = _cookie_epoch();
+
+    TCPSegment syn_ack;
+    TCPHeader &header = syn_ack.header();
+    header.syn = true;
+    header.ack = true;
+    header.seqno = peer_isn + ((epoch << 27) | _cookie_mac(flow, peer_isn, epoch));
+    header.ackno = peer_isn + 1;
+    header.win = min(_cfg.recv_capacity, size_t{numeric_limits<uint16_t>::max()});
+    _segments_out.emplace(flow, move(syn_ack));
+}
+
+//! \details A genuine cookie was issued in the current period or the one before it. The new
+//! connection replays the peer's SYN (discarding the SYN/ACK that it sends in reply, because the
+//! cookie has already been sent) and then receives the ACK, which completes its handshake.
+bool TCPListener::_cookie_ack_received(const TCPFlow &flow, const TCPSegment &seg) {
+    const WrappingInt32 peer_isn = seg.header().seqno - 1;
+    const WrappingInt32 isn = seg.header().ackno - 1;
+    const uint32_t cookie = isn - peer_isn;
+    const uint32_t epoch = cookie >> 27;
+
+    if (((_cookie_epoch() - epoch) % 32) > 1 or (cookie & COOKIE_MAC_MASK) != _cookie_mac(flow, peer_isn, epoch)) {
+        return false;
+    }
+
+    TCPConfig cfg = _cfg;
+    cfg.fixed_isn = isn;
+    TCPConnection &connection = _syn_table.try_emplace(flow, cfg).first->second;
+
+    TCPSegment syn;
+    syn.header().syn = true;
+    syn.header().seqno = peer_isn;
+    connection.segment_received(syn);
+    connection.segments_out() = {};
+
+    connection.segment_received(seg);
+    _collect(flow, connection);
+    _established.push(flow);
+    return true;
+}
+
+void TCPListener::_collect(const TCPFlow &flow, TCPConnection &connection) {
+    auto &segments = connection.segments_out();
+    while (not segments.empty()) {
+        _segments_out.emplace(flow, move(segments.front()));
+        segments.pop();
+    }
+}
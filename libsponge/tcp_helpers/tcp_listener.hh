@@ -0,0 +1,116 @@
+#ifndef SPONGE_LIBSPONGE_TCP_LISTENER_HH
+#define SPONGE_LIBSPONGE_TCP_LISTENER_HH
+
+#include "tcp_config.hh"
+#include "tcp_connection.hh"
+#include "tcp_flow.hh"
+#include "tcp_segment.hh"
+#include "wrapping_integers.hh"
+
+#include <cstddef>
+#include <cstdint>
+#include <queue>
+#include <unordered_map>
+#include <utility>
+
+//! A set of TCPConnections keyed by their 4-tuples
+using TCPConnectionTable = std::unordered_map<TCPFlow, TCPConnection, TCPFlowHash>;
+
+//! \brief The passive-open side of one listening port
+//! \details A TCPListener keeps every half-open connection on its port in a SYN table, so any
+//! number of handshakes can be in progress at once. When a handshake completes, the connection
+//! is handed to the owner (e.g. a TCPStack) through take_established(), as long as fewer than
+//! `backlog` connections are waiting to be accepted; otherwise it stays in the SYN table until
+//! the application catches up.
+//!
+//! To keep memory flat under a flood of SYNs, the listener can answer SYNs statelessly with
+//! SYN cookies (see TCPListener::SynCookies) and build the TCPConnection only when the peer's
+//! final ACK proves that it received the cookie.
+class TCPListener {
+  public:
+    static constexpr size_t DEFAULT_BACKLOG = 128;          //!< Default length of the accept queue
+    static constexpr size_t DEFAULT_SYN_TABLE_SIZE = 1024;  //!< Default limit on half-open connections
+    static constexpr uint64_t COOKIE_PERIOD_MS = 64000;     //!< A SYN cookie expires after one to two periods
+
+    //! When to answer a SYN with a cookie instead of a SYN-table entry
+    enum class SynCookies {
+        Never,     //!< Drop new SYNs while the SYN table is full
+        WhenFull,  //!< Use cookies only while the SYN table is full
+        Always     //!< Never allocate state before the handshake completes
+    };
+
+  private:
+    TCPConfig _cfg;                                 //!< configuration for every connection accepted on this port
+    size_t _backlog;                                //!< maximum number of connections waiting to be accepted
+    size_t _syn_table_max;                          //!< maximum number of half-open connections
+    size_t _queued{0};                              //!< number of connections handed off but not yet accepted
+    SynCookies _syn_cookies{SynCookies::WhenFull};  //!< cookie policy
+    uint64_t _cookie_secret;                        //!< key for the cookies' message authentication code
+    uint64_t _time_ms{0};                           //!< total time passed to tick(), which dates each cookie
+
+    //! Connections whose handshake has not yet been handed off
+    TCPConnectionTable _syn_table{};
+
+    //! Flows in the SYN table whose handshake has completed, oldest first
+    std::queue<TCPFlow> _established{};
+
+    //! Segments sent by half-open connections, waiting to be transmitted by the owner
+    std::queue<std::pair<TCPFlow, TCPSegment>> _segments_out{};
+
+    //! Move a connection's outbound segments onto TCPListener::_segments_out
+    void _collect(const TCPFlow &flow, TCPConnection &connection);
+
+    //! The counter of the current cookie period, modulo 32
+    uint32_t _cookie_epoch() const { return (_time_ms / COOKIE_PERIOD_MS) % 32; }
+
+    //! The 27-bit message authentication code of a cookie issued in `epoch` to `flow`
+    uint32_t _cookie_mac(const TCPFlow &flow, const WrappingInt32 peer_isn, const uint32_t epoch) const;
+
+    //! Answer a SYN with a SYN/ACK whose sequence number is a cookie, without allocating any state
+    void _send_cookie(const TCPFlow &flow, const TCPSegment &syn);
+
+    //! \brief Check the cookie acknowledged by a segment that belongs to no connection
+    //! \returns `true` (after creating an established connection) if the cookie is genuine and fresh
+    bool _cookie_ack_received(const TCPFlow &flow, const TCPSegment &seg);
+
+  public:
+    //! Construct a listener with the given connection configuration and queue limits
+    explicit TCPListener(const TCPConfig &cfg,
+                         const size_t backlog = DEFAULT_BACKLOG,
+                         const size_t syn_table_max = DEFAULT_SYN_TABLE_SIZE);
+
+    //! \brief Handle a segment that belongs to no established connection
+    //! \returns `false` if the segment is unrelated to this listener (the owner should answer it with a RST)
+    bool segment_received(const TCPFlow &flow, const TCPSegment &seg);
+
+    //! Called periodically when time elapses; half-open connections that give up are discarded
+    void tick(const size_t ms_since_last_tick);
+
+    //! \brief Remove a connection whose handshake has completed from the SYN table
+    //! \returns the table node holding the connection (ready to be inserted into another
+    //! TCPConnectionTable without moving the connection), or an empty node if no handshake has
+    //! completed or the accept queue is full
+    TCPConnectionTable::node_type take_established();
+
+    //! The owner has removed a connection from the accept queue
+    void accepted();
+
+    //! Reset every connection in the SYN table (e.g. when the owner is shutting down)
+    void reset();
+
+    //! Choose when to answer SYNs with cookies
+    void set_syn_cookies(const SynCookies mode) { _syn_cookies = mode; }
+
+    //! Segments that the half-open connections want sent
+    std::queue<std::pair<TCPFlow, TCPSegment>> &segments_out() { return _segments_out; }
+
+    //! \name Accessors
+    //!@{
+    const TCPConfig &config() const { return _cfg; }       //!< Configuration of accepted connections
+    size_t backlog() const { return _backlog; }             //!< Limit on the accept queue
+    size_t queued() const { return _queued; }               //!< Connections waiting to be accepted
+    size_t half_open() const { return _syn_table.size(); }  //!< Connections in the SYN table
+    //!@}
+};
+
+#endif  // SPONGE_LIBSPONGE_TCP_LISTENER_HH
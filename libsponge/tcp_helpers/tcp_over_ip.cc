@@ -22,8 +22,11 @@ using namespace std;
 //! and the TCP segment read from the wire includes a SYN, this function clears the
 //! `_listen` flag and records the source and destination addresses and port numbers
 //! from the TCP header; it uses this information to filter future reads.
+//! \param[in] ip_dgram is the datagram to unwrap
+//! \param[in] verify_checksum is `false` to skip the TCP checksum (see TCPSegment::parse)
 //! \returns a std::optional<TCPSegment> that is empty if the segment was invalid or unrelated
-optional<TCPSegment> TCPOverIPv4Adapter::unwrap_tcp_in_ip(const InternetDatagram &ip_dgram) {
+optional<TCPSegment> TCPOverIPv4Adapter::unwrap_tcp_in_ip(const InternetDatagram &ip_dgram,
+                                                          const bool verify_checksum) {
     // is the IPv4 datagram for us?
     // Note: it's valid to bind to address "0" (INADDR_ANY) and reply from actual address contacted
     if (not listening() and (ip_dgram.header().dst != config().source.ipv4_numeric())) {
@@ -42,7 +45,7 @@ optional<TCPSegment> TCPOverIPv4Adapter::unwrap_tcp_in_ip(const InternetDatagram
 
     // is the payload a valid TCP segment?
     TCPSegment tcp_seg;
-    if (ParseResult::NoError != tcp_seg.parse(ip_dgram.payload(), ip_dgram.header().pseudo_cksum())) {
+    if (ParseResult::NoError != tcp_seg.parse(ip_dgram.payload(), ip_dgram.header().pseudo_cksum(), verify_checksum)) {
         return {};
     }
 
@@ -72,19 +75,31 @@ optional<TCPSegment> TCPOverIPv4Adapter::unwrap_tcp_in_ip(const InternetDatagram
 
 //! Takes a TCP segment, sets port numbers as necessary, and wraps it in an IPv4 datagram
 //! \param[in] seg is the TCP segment to convert
-InternetDatagram TCPOverIPv4Adapter::wrap_tcp_in_ip(TCPSegment &seg) {
+//! \param[in] offload_checksum is `true` to leave the TCP checksum for the device (see TCPSegment::serialize)
+InternetDatagram TCPOverIPv4Adapter::wrap_tcp_in_ip(TCPSegment &seg, const bool offload_checksum) {
+    const TCPFlow flow{config().source.ipv4_numeric(),
+                       config().destination.ipv4_numeric(),
+                       config().source.port(),
+                       config().destination.port()};
+    return wrap_tcp_in_ip(seg, flow, offload_checksum);
+}
+
+//! \param[in] seg is the TCP segment to convert
+//! \param[in] flow gives the addresses and port numbers to use
+//! \param[in] offload_checksum is `true` to leave the TCP checksum for the device (see TCPSegment::serialize)
+InternetDatagram TCPOverIPv4Adapter::wrap_tcp_in_ip(TCPSegment &seg, const TCPFlow &flow, const bool offload_checksum) {
     // set the port numbers in the TCP segment
-    seg.header().sport = config().source.port();
-    seg.header().dport = config().destination.port();
+    seg.header().sport = flow.local_port;
+    seg.header().dport = flow.remote_port;
 
     // create an Internet Datagram and set its addresses and length
     InternetDatagram ip_dgram;
-    ip_dgram.header().src = config().source.ipv4_numeric();
-    ip_dgram.header().dst = config().destination.ipv4_numeric();
+    ip_dgram.header().src = flow.local_address;
+    ip_dgram.header().dst = flow.remote_address;
     ip_dgram.header().len = ip_dgram.header().hlen * 4 + seg.header().doff * 4 + seg.payload().size();
 
     // set payload, calculating TCP checksum using information from IP header
-    ip_dgram.payload() = seg.serialize(ip_dgram.header().pseudo_cksum());
+    ip_dgram.payload() = seg.serialize(ip_dgram.header().pseudo_cksum(), offload_checksum);
 
     return ip_dgram;
 }
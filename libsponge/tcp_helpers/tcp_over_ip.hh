@@ -4,6 +4,7 @@
 #include "buffer.hh"
 #include "fd_adapter.hh"
 #include "ipv4_datagram.hh"
+#include "tcp_flow.hh"
 #include "tcp_segment.hh"
 
 #include <optional>
@@ -11,9 +12,12 @@
 //! \brief A converter from TCP segments to serialized IPv4 datagrams
 class TCPOverIPv4Adapter : public FdAdapterBase {
   public:
-    std::optional<TCPSegment> unwrap_tcp_in_ip(const InternetDatagram &ip_dgram);
+    std::optional<TCPSegment> unwrap_tcp_in_ip(const InternetDatagram &ip_dgram, const bool verify_checksum = true);
 
-    InternetDatagram wrap_tcp_in_ip(TCPSegment &seg);
+    InternetDatagram wrap_tcp_in_ip(TCPSegment &seg, const bool offload_checksum = false);
+
+    //! Wrap a TCP segment belonging to `flow`, regardless of the adapter's configured source and destination
+    static InternetDatagram wrap_tcp_in_ip(TCPSegment &seg, const TCPFlow &flow, const bool offload_checksum = false);
 };
 
 #endif  // SPONGE_LIBSPONGE_TCP_OVER_IP_HH
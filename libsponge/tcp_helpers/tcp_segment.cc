@@ -9,11 +9,15 @@ using namespace std;
 
 //! \param[in] buffer string/Buffer to be parsed
 //! \param[in] datagram_layer_checksum pseudo-checksum from the lower-layer protocol
-ParseResult TCPSegment::parse(const Buffer buffer, const uint32_t datagram_layer_checksum) {
-    InternetChecksum check(datagram_layer_checksum);
-    check.add(buffer);
-    if (check.value()) {
-        return ParseResult::BadChecksum;
+//! \param[in] verify_checksum is `false` if the device has verified the checksum already, or if
+//! the checksum was never finished because the segment didn't leave the host (see VirtioNetHeader)
+ParseResult TCPSegment::parse(const Buffer buffer, const uint32_t datagram_layer_checksum, const bool verify_checksum) {
+    if (verify_checksum) {
+        InternetChecksum check(datagram_layer_checksum);
+        check.add(buffer);
+        if (check.value()) {
+            return ParseResult::BadChecksum;
+        }
     }
 
     NetParser p{buffer};
@@ -27,15 +31,21 @@ size_t TCPSegment::length_in_sequence_space() const {
 }
 
 //! \param[in] datagram_layer_checksum pseudo-checksum from the lower-layer protocol
-BufferList TCPSegment::serialize(const uint32_t datagram_layer_checksum) const {
+//! \param[in] offload_checksum is `true` to leave the checksum for the device to finish: the
+//! checksum field then holds just the (uncomplemented) pseudo-header sum (see VirtioNetHeader)
+BufferList TCPSegment::serialize(const uint32_t datagram_layer_checksum, const bool offload_checksum) const {
     TCPHeader header_out = _header;
     header_out.cksum = 0;
 
-    // calculate checksum -- taken over entire segment
-    InternetChecksum check(datagram_layer_checksum);
-    check.add(header_out.serialize());
-    check.add(_payload);
-    header_out.cksum = check.value();
+    if (offload_checksum) {
+        header_out.cksum = ~InternetChecksum(datagram_layer_checksum).value();
+    } else {
+        // calculate checksum -- taken over entire segment
+        InternetChecksum check(datagram_layer_checksum);
+        check.add(header_out.serialize());
+        check.add(_payload);
+        header_out.cksum = check.value();
+    }
 
     BufferList ret;
     ret.append(header_out.serialize());
@@ -1,14 +1,19 @@
 #include "tcp_sponge_socket.hh"
 
+#include "mapped_file.hh"
 #include "parser.hh"
+#include "tracer.hh"
 #include "tun.hh"
 #include "util.hh"
 
 #include <cstddef>
 #include <exception>
 #include <iostream>
+#include <sstream>
 #include <stdexcept>
 #include <string>
+#include <string_view>
+#include <sys/ioctl.h>
 #include <sys/socket.h>
 #include <sys/syscall.h>
 #include <sys/types.h>
@@ -19,34 +24,171 @@ using namespace std;
 
 static constexpr size_t TCP_TICK_MS = 10;
 
+string TCPLatencies::to_string() const {
+    ostringstream ss;
+    ss << "write to send (ns): " << queueing.to_string() << "\nsend to ack (ns): " << ack.to_string();
+    for (const auto &callback : callbacks) {
+        if (callback.duration.count() > 0) {
+            ss << "\ncallback for fd " << callback.fd << (callback.direction == Direction::In ? " in" : " out")
+               << " (ns): " << callback.duration.to_string();
+        }
+    }
+    return ss.str();
+}
+
 //! \param[in] condition is a function returning true if loop should continue
 template <typename AdaptT>
 void TCPSpongeSocket<AdaptT>::_tcp_loop(const function<bool()> &condition) {
     auto base_time = timestamp_ms();
     while (condition()) {
+        if (_outbound_channel) {
+            _pump_channels();
+        }
+        _pump_buffers();
+
         auto ret = _eventloop.wait_next_event(TCP_TICK_MS);
         if (ret == EventLoop::Result::Exit or _abort) {
             break;
         }
 
+        const auto next_time = timestamp_ms();
         if (_tcp.value().active()) {
-            const auto next_time = timestamp_ms();
+            SPONGE_TRACE_SCOPE(Tick, next_time - base_time);
             _tcp.value().tick(next_time - base_time);
-            _datagram_adapter.tick(next_time - base_time);
-            base_time = next_time;
+        }
+        // the adapter's clock keeps running, so that segments it holds back still go out once the connection is done
+        _datagram_adapter.tick(next_time - base_time);
+        base_time = next_time;
+        for (auto &seg : _datagram_adapter.read_due()) {
+            if (_tcp->active()) {
+                _tcp->segment_received(move(seg));
+            }
+        }
+        if (next_time >= _publish_due_ms) {
+            _publish();
         }
     }
+    _publish();
+}
+
+template <typename AdaptT>
+void TCPSpongeSocket<AdaptT>::_publish() {
+    const TCPConnectionStats stats = _tcp->stats();
+    TCPLatencies latencies{_tcp->queueing_latency(), _tcp->ack_latency(), _eventloop.callback_latencies()};
+    _publish_due_ms = timestamp_ms() + PUBLISH_MS;
+    lock_guard<mutex> lock{_stats_mutex};
+    _stats = stats;
+    _latencies = move(latencies);
+}
+
+//! \details Outbound bytes go straight from the owner's channel into the TCPConnection, and inbound
+//! bytes from the TCPConnection into the owner's channel. Whichever channel can't make progress is
+//! armed, so that the EventLoop wakes up when the owner writes or reads.
+template <typename AdaptT>
+void TCPSpongeSocket<AdaptT>::_pump_channels() {
+    if (not _outbound_shutdown) {
+        do {
+            while (_tcp->remaining_outbound_capacity() > 0) {
+                const string_view run = _outbound_channel->peek();
+                if (run.empty()) {
+                    break;
+                }
+                const size_t len = min(run.size(), _tcp->remaining_outbound_capacity());
+                _tcp->write(run.substr(0, len));
+                _outbound_channel->pop(len);
+            }
+            // a full outbound stream is revisited when an ACK arrives; an empty channel sleeps until the owner writes
+        } while (_tcp->remaining_outbound_capacity() > 0 and not _outbound_channel->eof() and
+                 not _outbound_channel->arm_readable());
+
+        if (_outbound_channel->eof()) {
+            _tcp->end_input_stream();
+            _outbound_shutdown = true;
+        }
+    }
+
+    ByteStream &inbound = _tcp->inbound_stream();
+    while (not inbound.buffer_empty()) {
+        const size_t len = min(inbound.buffer_size(), _inbound_channel->remaining_capacity());
+        if (len == 0) {
+            if (_inbound_channel->arm_writable()) {
+                break;
+            }
+            continue;
+        }
+        _inbound_channel->write(inbound.peek_output(len));
+        inbound.pop_output(len);
+    }
+
+    if ((inbound.eof() or inbound.error()) and inbound.buffer_empty() and not _inbound_shutdown) {
+        _inbound_channel->close();
+        _inbound_shutdown = true;
+    }
+}
+
+//! \details Runs on every pass of the loop (so a newly queued Buffer waits at most one tick), and a
+//! full outbound stream is revisited when an ACK arrives. Buffers queued after the connection has
+//! ended or the outbound stream has been shut down are dropped.
+template <typename AdaptT>
+void TCPSpongeSocket<AdaptT>::_pump_buffers() {
+    const lock_guard<mutex> lock{_outbound_buffers_mutex};
+    if (_outbound_buffers.empty()) {
+        return;
+    }
+    if (not _tcp->active() or _outbound_shutdown) {
+        _drop_outbound_buffers();
+        return;
+    }
+
+    // bytes that the owner wrote before queueing the Buffers go first
+    if (_outbound_channel) {
+        if (not _outbound_channel->peek().empty()) {
+            return;
+        }
+    } else {
+        int unread = 0;
+        SystemCall("ioctl", ::ioctl(_thread_data.fd_num(), FIONREAD, &unread));
+        if (unread > 0) {
+            return;
+        }
+    }
+
+    while (not _outbound_buffers.empty() and _tcp->remaining_outbound_capacity() > 0) {
+        Buffer &front = _outbound_buffers.front();
+        front.remove_prefix(_tcp->write(front));
+        if (front.size() == 0) {
+            _outbound_buffers.pop_front();
+        }
+    }
+    if (_outbound_buffers.empty()) {
+        _outbound_buffers_drained.notify_all();
+    }
+}
+
+template <typename AdaptT>
+void TCPSpongeSocket<AdaptT>::_drop_outbound_buffers() {
+    if (not _outbound_buffers.empty()) {
+        _outbound_buffers.clear();
+        _outbound_buffers_dropped = true;
+    }
+    _outbound_buffers_drained.notify_all();
 }
 
 //! \param[in] data_socket_pair is a pair of connected AF_UNIX SOCK_STREAM sockets
 //! \param[in] datagram_interface is the interface for reading and writing datagrams
+//! \param[in] transport selects how application bytes reach the TCPConnection thread
 template <typename AdaptT>
 TCPSpongeSocket<AdaptT>::TCPSpongeSocket(pair<FileDescriptor, FileDescriptor> data_socket_pair,
-                                         AdaptT &&datagram_interface)
+                                         AdaptT &&datagram_interface,
+                                         const Transport transport)
     : LocalStreamSocket(move(data_socket_pair.first))
     , _thread_data(move(data_socket_pair.second))
     , _datagram_adapter(move(datagram_interface)) {
     _thread_data.set_blocking(false);
+    if (transport == Transport::Channel) {
+        _outbound_channel = make_unique<ByteChannel>();
+        _inbound_channel = make_unique<ByteChannel>();
+    }
 }
 
 template <typename AdaptT>
@@ -71,13 +213,12 @@ void TCPSpongeSocket<AdaptT>::_initialize_TCP(const TCPConfig &config) {
     // 4) Outbound segment generated by TCP (needs to be
     //    given to underlying datagram socket)
 
-    // rule 1: read from filtered packet stream and dump into TCPConnection
+    // rule 1: read a batch from filtered packet stream and dump into TCPConnection
     _eventloop.add_rule(_datagram_adapter,
                         Direction::In,
                         [&] {
-                            auto seg = _datagram_adapter.read();
-                            if (seg) {
-                                _tcp->segment_received(move(seg.value()));
+                            for (auto &seg : _datagram_adapter.read_batch()) {
+                                _tcp->segment_received(move(seg));
                             }
 
                             // debugging output:
@@ -90,74 +231,90 @@ void TCPSpongeSocket<AdaptT>::_initialize_TCP(const TCPConfig &config) {
                         },
                         [&] { return _tcp->active(); });
 
-    // rule 2: read from pipe into outbound buffer
-    _eventloop.add_rule(
-        _thread_data,
-        Direction::In,
-        [&] {
-            const auto data = _thread_data.read(_tcp->remaining_outbound_capacity());
-            const auto len = data.size();
-            const auto amount_written = _tcp->write(move(data));
-            if (amount_written != len) {
-                throw runtime_error("TCPConnection::write() accepted less than advertised length");
-            }
+    if (_outbound_channel) {
+        // rules 2 and 3 with Transport::Channel: the owner has written to an empty outbound channel,
+        // or read from a full inbound one (_tcp_loop moves the bytes before it polls again)
+        _eventloop.add_rule(
+            _outbound_channel->readable_fd(),
+            Direction::In,
+            [&] { _outbound_channel->readable_fd().read(sizeof(uint64_t)); },
+            [&] { return _tcp->active() and not _outbound_shutdown; });
+
+        _eventloop.add_rule(
+            _inbound_channel->writable_fd(),
+            Direction::In,
+            [&] { _inbound_channel->writable_fd().read(sizeof(uint64_t)); },
+            [&] {
+                return (not _tcp->inbound_stream().buffer_empty()) or
+                       ((_tcp->inbound_stream().eof() or _tcp->inbound_stream().error()) and not _inbound_shutdown);
+            });
+    } else {
+        // rule 2: read from pipe into outbound buffer
+        _eventloop.add_rule(
+            _thread_data,
+            Direction::In,
+            [&] {
+                auto data = _thread_data.read(_thread_data_pool, _tcp->remaining_outbound_capacity());
+                const auto len = data.size();
+                const auto amount_written = _tcp->write(move(data));
+                if (amount_written != len) {
+                    throw runtime_error("TCPConnection::write() accepted less than advertised length");
+                }
+
+                if (_thread_data.eof()) {
+                    _tcp->end_input_stream();
+                    _outbound_shutdown = true;
 
-            if (_thread_data.eof()) {
+                    // debugging output:
+                    cerr << "DEBUG: Outbound stream to " << _datagram_adapter.config().destination.to_string()
+                         << " finished (" << _tcp.value().bytes_in_flight() << " byte"
+                         << (_tcp.value().bytes_in_flight() == 1 ? "" : "s") << " still in flight).\n";
+                }
+            },
+            [&] {
+                return (_tcp->active()) and (not _outbound_shutdown) and (_tcp->remaining_outbound_capacity() > 0);
+            },
+            [&] {
                 _tcp->end_input_stream();
                 _outbound_shutdown = true;
-
-                // debugging output:
-                cerr << "DEBUG: Outbound stream to " << _datagram_adapter.config().destination.to_string()
-                     << " finished (" << _tcp.value().bytes_in_flight() << " byte"
-                     << (_tcp.value().bytes_in_flight() == 1 ? "" : "s") << " still in flight).\n";
-            }
-        },
-        [&] { return (_tcp->active()) and (not _outbound_shutdown) and (_tcp->remaining_outbound_capacity() > 0); },
-        [&] {
-            _tcp->end_input_stream();
-            _outbound_shutdown = true;
-        });
-
-    // rule 3: read from inbound buffer into pipe
-    _eventloop.add_rule(
-        _thread_data,
-        Direction::Out,
-        [&] {
-            ByteStream &inbound = _tcp->inbound_stream();
-            // Write from the inbound_stream into
-            // the pipe, handling the possibility of a partial
-            // write (i.e., only pop what was actually written).
-            const size_t amount_to_write = min(size_t(65536), inbound.buffer_size());
-            const std::string buffer = inbound.peek_output(amount_to_write);
-            const auto bytes_written = _thread_data.write(move(buffer), false);
-            inbound.pop_output(bytes_written);
-
-            if (inbound.eof() or inbound.error()) {
-                _thread_data.shutdown(SHUT_WR);
-                _inbound_shutdown = true;
-
-                // debugging output:
-                cerr << "DEBUG: Inbound stream from " << _datagram_adapter.config().destination.to_string()
-                     << " finished " << (inbound.error() ? "with an error/reset.\n" : "cleanly.\n");
-                if (_tcp.value().state() == TCPState::State::TIME_WAIT) {
-                    cerr << "DEBUG: Waiting for lingering segments (e.g. retransmissions of FIN) from peer...\n";
+            });
+
+        // rule 3: read from inbound buffer into pipe
+        _eventloop.add_rule(
+            _thread_data,
+            Direction::Out,
+            [&] {
+                ByteStream &inbound = _tcp->inbound_stream();
+                // Write from the inbound_stream into
+                // the pipe, handling the possibility of a partial
+                // write (i.e., only pop what was actually written).
+                const size_t amount_to_write = min(size_t(65536), inbound.buffer_size());
+                const std::string buffer = inbound.peek_output(amount_to_write);
+                const auto bytes_written = _thread_data.write(move(buffer), false);
+                inbound.pop_output(bytes_written);
+
+                if (inbound.eof() or inbound.error()) {
+                    _thread_data.shutdown(SHUT_WR);
+                    _inbound_shutdown = true;
+
+                    // debugging output:
+                    cerr << "DEBUG: Inbound stream from " << _datagram_adapter.config().destination.to_string()
+                         << " finished " << (inbound.error() ? "with an error/reset.\n" : "cleanly.\n");
+                    if (_tcp.value().state() == TCPState::State::TIME_WAIT) {
+                        cerr << "DEBUG: Waiting for lingering segments (e.g. retransmissions of FIN) from peer...\n";
+                    }
                 }
-            }
-        },
-        [&] {
-            return (not _tcp->inbound_stream().buffer_empty()) or
-                   ((_tcp->inbound_stream().eof() or _tcp->inbound_stream().error()) and not _inbound_shutdown);
-        });
+            },
+            [&] {
+                return (not _tcp->inbound_stream().buffer_empty()) or
+                       ((_tcp->inbound_stream().eof() or _tcp->inbound_stream().error()) and not _inbound_shutdown);
+            });
+    }
 
-    // rule 4: read outbound segments from TCPConnection and send as datagrams
+    // rule 4: read outbound segments from TCPConnection and send them as one batch of datagrams
     _eventloop.add_rule(_datagram_adapter,
                         Direction::Out,
-                        [&] {
-                            while (not _tcp->segments_out().empty()) {
-                                _datagram_adapter.write(_tcp->segments_out().front());
-                                _tcp->segments_out().pop();
-                            }
-                        },
+                        [&] { _datagram_adapter.write_batch(_tcp->segments_out()); },
                         [&] { return not _tcp->segments_out().empty(); });
 }
 
@@ -171,9 +328,10 @@ static inline pair<FileDescriptor, FileDescriptor> socket_pair_helper(const int
 }
 
 //! \param[in] datagram_interface is the underlying interface (e.g. to UDP, IP, or Ethernet)
+//! \param[in] transport selects how application bytes reach the TCPConnection thread
 template <typename AdaptT>
-TCPSpongeSocket<AdaptT>::TCPSpongeSocket(AdaptT &&datagram_interface)
-    : TCPSpongeSocket(socket_pair_helper(SOCK_STREAM), move(datagram_interface)) {}
+TCPSpongeSocket<AdaptT>::TCPSpongeSocket(AdaptT &&datagram_interface, const Transport transport)
+    : TCPSpongeSocket(socket_pair_helper(SOCK_STREAM), move(datagram_interface), transport) {}
 
 template <typename AdaptT>
 TCPSpongeSocket<AdaptT>::~TCPSpongeSocket() {
@@ -192,6 +350,9 @@ TCPSpongeSocket<AdaptT>::~TCPSpongeSocket() {
 template <typename AdaptT>
 void TCPSpongeSocket<AdaptT>::wait_until_closed() {
     shutdown(SHUT_RDWR);
+    if (_outbound_channel) {
+        _outbound_channel->close();
+    }
     if (_tcp_thread.joinable()) {
         cerr << "DEBUG: Waiting for clean shutdown... ";
         _tcp_thread.join();
@@ -250,6 +411,77 @@ void TCPSpongeSocket<AdaptT>::listen_and_accept(const TCPConfig &c_tcp, const Fd
     _tcp_thread = thread(&TCPSpongeSocket::_tcp_main, this);
 }
 
+//! \param[in] data is copied into the outbound channel; the TCPConnection thread picks it up from there
+template <typename AdaptT>
+void TCPSpongeSocket<AdaptT>::channel_write(const string_view data) {
+    if (not _outbound_channel) {
+        throw runtime_error("channel_write() on a TCPSpongeSocket without Transport::Channel");
+    }
+    _outbound_channel->write_all(data);
+}
+
+//! \param[in] data is shared with the TCPConnection thread, which hands it to the TCPConnection as
+//! the outbound stream makes room
+//! \throws runtime_error if the connection has ended, or ends before all of `data` is in the outbound stream
+template <typename AdaptT>
+void TCPSpongeSocket<AdaptT>::send_buffer(Buffer data) {
+    if (not _tcp_thread.joinable()) {
+        throw runtime_error("send_buffer() on a TCPSpongeSocket that isn't connected");
+    }
+
+    unique_lock<mutex> lock{_outbound_buffers_mutex};
+    if (_tcp_done) {
+        throw runtime_error("send_buffer(): the connection has ended");
+    }
+    _outbound_buffers.push_back(move(data));
+    _outbound_buffers_drained.wait(lock, [&] { return _outbound_buffers.empty() or _tcp_done; });
+    if (_outbound_buffers_dropped) {
+        throw runtime_error("send_buffer(): the connection ended before all of the data was sent");
+    }
+}
+
+template <typename AdaptT>
+TCPConnectionStats TCPSpongeSocket<AdaptT>::stats() const {
+    lock_guard<mutex> lock{_stats_mutex};
+    return _stats;
+}
+
+template <typename AdaptT>
+TCPLatencies TCPSpongeSocket<AdaptT>::latencies() const {
+    lock_guard<mutex> lock{_stats_mutex};
+    return _latencies;
+}
+
+//! \param[in] path is the file to send
+template <typename AdaptT>
+void TCPSpongeSocket<AdaptT>::send_file(const string &path) {
+    send_buffer(MappedFile::map(path));
+}
+
+template <typename AdaptT>
+void TCPSpongeSocket<AdaptT>::channel_shutdown_write() {
+    if (not _outbound_channel) {
+        throw runtime_error("channel_shutdown_write() on a TCPSpongeSocket without Transport::Channel");
+    }
+    _outbound_channel->close();
+}
+
+//! \param[in] limit is the maximum number of bytes to read
+//! \returns the bytes read, or an empty string at EOF
+template <typename AdaptT>
+string TCPSpongeSocket<AdaptT>::channel_read(const size_t limit) {
+    if (not _inbound_channel) {
+        throw runtime_error("channel_read() on a TCPSpongeSocket without Transport::Channel");
+    }
+    _inbound_channel->wait_readable();
+    return _inbound_channel->read(limit);
+}
+
+template <typename AdaptT>
+bool TCPSpongeSocket<AdaptT>::channel_eof() const {
+    return _inbound_channel and _inbound_channel->eof();
+}
+
 template <typename AdaptT>
 void TCPSpongeSocket<AdaptT>::_tcp_main() {
     try {
@@ -257,13 +489,30 @@ void TCPSpongeSocket<AdaptT>::_tcp_main() {
             throw runtime_error("no TCP");
         }
         _tcp_loop([] { return true; });
+        // once nothing is left to poll, send what an impaired link still holds (e.g. the RST sent after
+        // too many retransmissions)
+        _datagram_adapter.flush();
+        {
+            const lock_guard<mutex> lock{_outbound_buffers_mutex};
+            _tcp_done = true;
+            _drop_outbound_buffers();
+        }
         shutdown(SHUT_RDWR);
+        if (_inbound_channel) {
+            _inbound_channel->close();
+        }
         if (not _tcp.value().active()) {
             cerr << "DEBUG: TCP connection finished "
                  << (_tcp.value().state() == TCPState::State::RESET ? "uncleanly" : "cleanly.\n");
         }
         _tcp.reset();
     } catch (const exception &e) {
+        {
+            // don't leave send_buffer() waiting for a thread that is gone
+            const lock_guard<mutex> lock{_outbound_buffers_mutex};
+            _tcp_done = true;
+            _drop_outbound_buffers();
+        }
         cerr << "Exception in TCPConnection runner thread: " << e.what() << "\n";
         throw e;
     }
@@ -1,28 +1,60 @@
 #ifndef SPONGE_LIBSPONGE_TCP_SPONGE_SOCKET_HH
 #define SPONGE_LIBSPONGE_TCP_SPONGE_SOCKET_HH
 
+#include "byte_channel.hh"
 #include "byte_stream.hh"
 #include "eventloop.hh"
 #include "fd_adapter.hh"
 #include "file_descriptor.hh"
+#include "latency_histogram.hh"
 #include "tcp_config.hh"
 #include "tcp_connection.hh"
 #include "tcp_over_ip.hh"
 #include "tuntap_adapter.hh"
 
 #include <atomic>
+#include <condition_variable>
 #include <cstdint>
+#include <deque>
+#include <limits>
+#include <memory>
+#include <mutex>
 #include <optional>
+#include <string>
+#include <string_view>
 #include <thread>
 #include <vector>
 
+//! Latency histograms of a TCPSpongeSocket's connection and event loop, in nanoseconds
+struct TCPLatencies {
+    LatencyHistogram queueing{};                          //!< Time outbound bytes waited to be sent
+    LatencyHistogram ack{};                               //!< Time from sending a segment to its acknowledgment
+    std::vector<EventLoop::CallbackLatency> callbacks{};  //!< Time taken by each event-loop rule's callbacks
+
+    //! A summary, one line per histogram that has values
+    std::string to_string() const;
+};
+
 //! Multithreaded wrapper around TCPConnection that approximates the Unix sockets API
 template <typename AdaptT>
 class TCPSpongeSocket : public LocalStreamSocket {
+  public:
+    //! How application bytes travel between the owner and the TCPConnection thread
+    enum class Transport {
+        Socket,  //!< Through the AF_UNIX socketpair (use the socket's read() and write())
+        Channel  //!< Through a pair of in-process ByteChannels (use channel_read() and channel_write())
+    };
+
   private:
     //! Stream socket for reads and writes between owner and TCP thread
     LocalStreamSocket _thread_data;
 
+    //! With Transport::Channel, bytes from the owner to the TCP thread
+    std::unique_ptr<ByteChannel> _outbound_channel{};
+
+    //! With Transport::Channel, bytes from the TCP thread to the owner
+    std::unique_ptr<ByteChannel> _inbound_channel{};
+
     //! Adapter to underlying datagram socket (e.g., UDP or IP)
     AdaptT _datagram_adapter;
 
@@ -35,9 +67,51 @@ class TCPSpongeSocket : public LocalStreamSocket {
     //! eventloop that handles all the events (new inbound datagram, new outbound bytes, new inbound bytes)
     EventLoop _eventloop{};
 
+    //! Slabs into which outbound bytes are read from the owner's socket
+    BufferPool _thread_data_pool{};
+
+    //! Buffers queued by send_buffer(), waiting for room in the outbound stream
+    std::deque<Buffer> _outbound_buffers{};
+
+    //! Protects `_outbound_buffers`, `_outbound_buffers_dropped` and `_tcp_done`
+    std::mutex _outbound_buffers_mutex{};
+
+    //! Signaled when `_outbound_buffers` empties, and when the TCPConnection thread exits
+    std::condition_variable _outbound_buffers_drained{};
+
+    //! Set if queued Buffers were dropped because they could no longer be sent
+    bool _outbound_buffers_dropped{false};
+
+    //! Set once the TCPConnection thread has exited (or is about to), so that nothing will drain new Buffers
+    bool _tcp_done{false};
+
+    //! Drop the queued Buffers and wake up send_buffer() (with `_outbound_buffers_mutex` held)
+    void _drop_outbound_buffers();
+
+    //! The TCPConnection's stats as of the last time they were published
+    TCPConnectionStats _stats{};
+
+    //! The latency histograms as of the last time they were published
+    TCPLatencies _latencies{};
+
+    //! When (in timestamp_ms()) the stats and latency histograms should next be published
+    uint64_t _publish_due_ms{0};
+
+    //! Protects `_stats` and `_latencies`
+    mutable std::mutex _stats_mutex{};
+
+    //! Copy the TCPConnection's stats and latency histograms to `_stats` and `_latencies`, for the owner to read
+    void _publish();
+
     //! Process events while specified condition is true
     void _tcp_loop(const std::function<bool()> &condition);
 
+    //! With Transport::Channel, move bytes between the channels and the TCPConnection
+    void _pump_channels();
+
+    //! Move queued Buffers into the TCPConnection, once the bytes the owner wrote before them have gone in
+    void _pump_buffers();
+
     //! Main loop of TCPConnection thread
     void _tcp_main();
 
@@ -45,7 +119,9 @@ class TCPSpongeSocket : public LocalStreamSocket {
     std::thread _tcp_thread{};
 
     //! Construct LocalStreamSocket fds from socket pair, initialize eventloop
-    TCPSpongeSocket(std::pair<FileDescriptor, FileDescriptor> data_socket_pair, AdaptT &&datagram_interface);
+    TCPSpongeSocket(std::pair<FileDescriptor, FileDescriptor> data_socket_pair,
+                    AdaptT &&datagram_interface,
+                    const Transport transport);
 
     std::atomic_bool _abort{false};  //!< Flag used by the owner to force the TCPConnection thread to shut down
 
@@ -57,7 +133,7 @@ class TCPSpongeSocket : public LocalStreamSocket {
 
   public:
     //! Construct from the interface that the TCPConnection thread will use to read and write datagrams
-    explicit TCPSpongeSocket(AdaptT &&datagram_interface);
+    explicit TCPSpongeSocket(AdaptT &&datagram_interface, const Transport transport = Transport::Socket);
 
     //! Close socket, and wait for TCPConnection to finish
     //! \note Calling this function is only advisable if the socket has reached EOF,
@@ -70,6 +146,51 @@ class TCPSpongeSocket : public LocalStreamSocket {
     //! Listen and accept using the specified configurations; blocks until accept succeeds or fails
     void listen_and_accept(const TCPConfig &c_tcp, const FdAdapterConfig &c_ad);
 
+    //! \brief The connection's counters and gauges (see TCPConnectionStats)
+    //! \details A snapshot, published by the TCPConnection thread every PUBLISH_MS while the connection is
+    //! open, and once more when it closes.
+    TCPConnectionStats stats() const;
+
+    //! \brief Latency histograms of the connection and of the TCPConnection thread's event loop
+    //! \details Published along with stats(), rather than on every pass through the event loop, since
+    //! copying them takes longer than the pass itself.
+    TCPLatencies latencies() const;
+
+    //! How often stats() and latencies() are published while the connection is open
+    static constexpr uint64_t PUBLISH_MS = 100;
+
+    //! \name Zero-copy sending
+    //! With either transport, these go into the outbound stream after everything written before them
+
+    //!@{
+
+    //! \brief Send `data` without copying it, blocking until all of it is in the outbound stream
+    //! \details Segments (and their retransmissions) share the Buffer's storage, so e.g. a Buffer from
+    //! a BufferPool or a MappedFile is never copied before it reaches the datagram socket.
+    void send_buffer(Buffer data);
+
+    //! Send the file at `path` from a MappedFile, blocking until all of it is in the outbound stream
+    void send_file(const std::string &path);
+    //!@}
+
+    //! \name In-process transport
+    //! Only for sockets constructed with Transport::Channel
+
+    //!@{
+
+    //! Write all of `data` to the connection, blocking while the channel is full
+    void channel_write(const std::string_view data);
+
+    //! Shut down the outbound direction (like `shutdown(SHUT_WR)`)
+    void channel_shutdown_write();
+
+    //! Read up to `limit` bytes, blocking until at least one byte (or EOF) has arrived
+    std::string channel_read(const size_t limit = std::numeric_limits<size_t>::max());
+
+    //! `true` once the peer has closed its stream and every byte has been read
+    bool channel_eof() const;
+    //!@}
+
     //! When a connected socket is destructed, it will send a RST
     ~TCPSpongeSocket();
 
@@ -118,6 +239,11 @@ using LossyTCPOverIPv4SpongeSocket = TCPSpongeSocket<LossyTCPOverIPv4OverTunFdAd
 //!   and [accept(2)](\ref man2::accept)
 //! - if TCPSpongeSocket is destructed while a TCP connection is open, the connection is
 //!   immediately terminated with a RST (call `wait_until_closed` to avoid this)
+//!
+//! By default, application bytes cross between the threads through an AF_UNIX socketpair, which
+//! costs a syscall and a copy into the kernel on each side. A socket constructed with
+//! Transport::Channel uses two ByteChannels instead; the owner then calls channel_write() and
+//! channel_read() instead of using the socket's file descriptor.
 
 //! Helper class that makes a TCPOverIPv4SpongeSocket behave more like a (kernel) TCPSocket
 class CS144TCPSocket : public TCPOverIPv4SpongeSocket {
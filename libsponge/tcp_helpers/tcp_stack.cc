@@ -0,0 +1,284 @@
+#include "tcp_stack.hh"
+
+#include "ipv4_datagram.hh"
+#include "parser.hh"
+#include "tcp_over_ip.hh"
+#include "util.hh"
+
+#include <exception>
+#include <iostream>
+#include <stdexcept>
+#include <utility>
+
+using namespace std;
+
+bool TCPHandle::valid() const { return _stack->_connections.count(_flow) > 0; }
+
+TCPConnection &TCPHandle::connection() const { return _stack->_connection(_flow); }
+
+//! \param[in] data is the string to write to the outbound stream
+size_t TCPHandle::write(const string_view data) {
+    TCPConnection &conn = connection();
+    const size_t bytes_written = conn.write(data);
+    _stack->_flush(_flow, conn);
+    return bytes_written;
+}
+
+//! \param[in] limit is the maximum number of bytes to read
+string TCPHandle::read(const size_t limit) { return connection().inbound_stream().read(limit); }
+
+void TCPHandle::end_input_stream() {
+    TCPConnection &conn = connection();
+    conn.end_input_stream();
+    _stack->_flush(_flow, conn);
+}
+
+//! \param[in] tun is the TUN device to read datagrams from and write them to
+TCPStack::TCPStack(TunFD &&tun) : TCPStack(tun.duplicate(), move(tun), tun.vnet_hdr()) {}
+
+//! \param[in] rx is the file descriptor from which to read IPv4 datagrams, one per read
+//! \param[in] tx is the file descriptor to which to write IPv4 datagrams, one per write
+//! \param[in] vnet_hdr is `true` if each datagram, in either direction, is preceded by a `virtio_net_hdr`
+//! (as on a TUN device opened with one)
+TCPStack::TCPStack(FileDescriptor &&rx, FileDescriptor &&tx, const bool vnet_hdr) : TCPStack(move(tx), vnet_hdr) {
+    _rx.emplace(move(rx));
+    // an IPv4 datagram is at most 64 KiB, so it always fits in one of _rx_pool's slabs
+    _eventloop.add_rule(*_rx, Direction::In, [&] { datagram_received(_rx->read(_rx_pool)); });
+}
+
+//! \param[in] tx is the file descriptor to which to write IPv4 datagrams, one per write
+//! \param[in] vnet_hdr is `true` if each datagram, in either direction, is preceded by a `virtio_net_hdr`
+TCPStack::TCPStack(FileDescriptor &&tx, const bool vnet_hdr)
+    : _tx(move(tx)), _vnet_hdr(vnet_hdr), _last_tick_ms(timestamp_ms()) {}
+
+TCPStack::~TCPStack() {
+    try {
+        for (auto &[flow, connection] : _connections) {
+            if (connection.active()) {
+                connection.send_rst_seg();
+                _flush(flow, connection);
+            }
+        }
+        for (auto &[port, listener] : _listeners) {
+            listener.reset();
+            _drain(listener);
+        }
+    } catch (const exception &e) {
+        cerr << "Exception destructing TCPStack: " << e.what() << endl;
+    }
+}
+
+//! \param[in] c_tcp is the TCPConfig for the new TCPConnection
+//! \param[in] c_ad gives the local (source) and remote (destination) addresses and ports
+TCPHandle TCPStack::connect(const TCPConfig &c_tcp, const FdAdapterConfig &c_ad) {
+    const TCPFlow flow{c_ad.source.ipv4_numeric(),
+                       c_ad.destination.ipv4_numeric(),
+                       c_ad.source.port(),
+                       c_ad.destination.port()};
+
+    const auto [it, inserted] = _connections.try_emplace(flow, c_tcp);
+    if (not inserted) {
+        throw runtime_error("TCPStack::connect(): " + flow.to_string() + " is already in use");
+    }
+
+    it->second.connect();
+    _flush(flow, it->second);
+    return {*this, flow};
+}
+
+//! \param[in] c_tcp is the TCPConfig for each accepted TCPConnection
+//! \param[in] port is the local port to accept connections on
+//! \param[in] backlog is the maximum number of established connections waiting to be accepted
+TCPListener &TCPStack::listen(const TCPConfig &c_tcp, const uint16_t port, const size_t backlog) {
+    const auto [it, inserted] = _listeners.try_emplace(port, c_tcp, backlog);
+    if (not inserted) {
+        throw runtime_error("TCPStack::listen(): port " + to_string(port) + " is already listening");
+    }
+    return it->second;
+}
+
+//! \returns a handle to the connection, or nothing if no connection is waiting to be accepted
+optional<TCPHandle> TCPStack::accept() {
+    while (not _accept_queue.empty()) {
+        const TCPFlow flow = _accept_queue.front();
+        _accept_queue.pop();
+
+        // make room for the next completed handshake on the same port
+        TCPListener &listener = _listeners.at(flow.local_port);
+        listener.accepted();
+        _drain(listener);
+
+        // skip connections that were reset or reaped before the application got to them
+        if (_connections.count(flow)) {
+            return TCPHandle{*this, flow};
+        }
+    }
+    return {};
+}
+
+size_t TCPStack::half_open() const {
+    size_t ret = 0;
+    for (const auto &[port, listener] : _listeners) {
+        ret += listener.half_open();
+    }
+    return ret;
+}
+
+//! \param[in] timeout_ms is passed to EventLoop::wait_next_event
+EventLoop::Result TCPStack::wait_next_event(const int timeout_ms) {
+    const auto ret = _eventloop.wait_next_event(timeout_ms);
+
+    const auto now = timestamp_ms();
+    if (now != _last_tick_ms) {
+        tick(now - _last_tick_ms);
+        _last_tick_ms = now;
+    }
+
+    return ret;
+}
+
+//! \param[in] ms_since_last_tick is the number of milliseconds since the last call to this method
+//! \details A connection is reaped once it is no longer active and the application has read all
+//! of its inbound bytes (or the connection was reset).
+void TCPStack::tick(const size_t ms_since_last_tick) {
+    for (auto &[port, listener] : _listeners) {
+        listener.tick(ms_since_last_tick);
+        _drain(listener);
+    }
+
+    for (auto it = _connections.begin(); it != _connections.end();) {
+        TCPConnection &connection = it->second;
+        if (connection.active()) {
+            connection.tick(ms_since_last_tick);
+            _flush(it->first, connection);
+        }
+
+        const ByteStream &inbound = connection.inbound_stream();
+        if (not connection.active() and (inbound.buffer_empty() or inbound.error())) {
+            it = _connections.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+//! \details The TCP checksum is checked unless the `virtio_net_hdr` says the kernel left it to be
+//! finished or has already verified it.
+void TCPStack::datagram_received(const Buffer &packet) {
+    if (not _vnet_hdr) {
+        _datagram_received(packet, true);
+        return;
+    }
+
+    VirtioNetHeader vnet;
+    if (vnet.parse(packet) != ParseResult::NoError) {
+        return;
+    }
+    Buffer datagram{packet};
+    datagram.remove_prefix(VirtioNetHeader::LENGTH);
+    _datagram_received(datagram, not(vnet.needs_csum or vnet.data_valid));
+}
+
+//! \details Datagrams that aren't valid TCP-in-IPv4 are dropped. A segment that belongs to no
+//! established connection goes to the listener on its port, if there is one, and is answered with
+//! a RST otherwise.
+void TCPStack::_datagram_received(const Buffer &datagram, const bool verify_checksum) {
+    InternetDatagram ip_dgram;
+    if (ip_dgram.parse(datagram) != ParseResult::NoError or ip_dgram.header().proto != IPv4Header::PROTO_TCP) {
+        return;
+    }
+
+    TCPSegment seg;
+    if (seg.parse(ip_dgram.payload(), ip_dgram.header().pseudo_cksum(), verify_checksum) != ParseResult::NoError) {
+        return;
+    }
+
+    const TCPFlow flow = TCPFlow::inbound(ip_dgram.header(), seg.header());
+    const auto it = _connections.find(flow);
+
+    if (it == _connections.end()) {
+        const auto listener = _listeners.find(flow.local_port);
+        if (listener == _listeners.end() or not listener->second.segment_received(flow, seg)) {
+            _send_reset(flow, seg);
+            return;
+        }
+        _drain(listener->second);
+        return;
+    }
+
+    TCPConnection &connection = it->second;
+    connection.segment_received(seg);
+    _flush(flow, connection);
+
+    const ByteStream &inbound = connection.inbound_stream();
+    if (not inbound.buffer_empty() or inbound.input_ended() or not connection.active()) {
+        _notify(flow);
+    }
+}
+
+//! \details Follows the reset generation rules of [RFC 793](\ref rfc::rfc793), section 3.4.
+void TCPStack::_send_reset(const TCPFlow &flow, const TCPSegment &seg) {
+    if (seg.header().rst) {
+        return;
+    }
+
+    TCPSegment rst_seg;
+    rst_seg.header().rst = true;
+    if (seg.header().ack) {
+        rst_seg.header().seqno = seg.header().ackno;
+    } else {
+        rst_seg.header().ack = true;
+        rst_seg.header().ackno = seg.header().seqno + static_cast<uint32_t>(seg.length_in_sequence_space());
+    }
+    _send_segment(flow, rst_seg);
+}
+
+//! \details With a `virtio_net_hdr`, the header asks for no offloads: the checksum is complete, and
+//! the segment needs no segmentation.
+void TCPStack::_send_segment(const TCPFlow &flow, TCPSegment &seg) {
+    if (not _vnet_hdr) {
+        _tx.write(TCPOverIPv4Adapter::wrap_tcp_in_ip(seg, flow).serialize());
+        return;
+    }
+
+    BufferList packet{VirtioNetHeader{}.serialize()};
+    packet.append(TCPOverIPv4Adapter::wrap_tcp_in_ip(seg, flow).serialize());
+    _tx.write(packet);
+}
+
+void TCPStack::_flush(const TCPFlow &flow, TCPConnection &connection) {
+    auto &segments = connection.segments_out();
+    while (not segments.empty()) {
+        _send_segment(flow, segments.front());
+        segments.pop();
+    }
+}
+
+void TCPStack::_drain(TCPListener &listener) {
+    auto &segments = listener.segments_out();
+    while (not segments.empty()) {
+        _send_segment(segments.front().first, segments.front().second);
+        segments.pop();
+    }
+
+    for (auto node = listener.take_established(); not node.empty(); node = listener.take_established()) {
+        const TCPFlow flow = node.key();
+        _connections.insert(move(node));
+        _accept_queue.push(flow);
+        _notify(flow);
+    }
+}
+
+TCPConnection &TCPStack::_connection(const TCPFlow &flow) {
+    const auto it = _connections.find(flow);
+    if (it == _connections.end()) {
+        throw runtime_error("TCPStack: no connection " + flow.to_string());
+    }
+    return it->second;
+}
+
+void TCPStack::_notify(const TCPFlow &flow) {
+    if (_handler) {
+        _handler(TCPHandle{*this, flow});
+    }
+}
@@ -0,0 +1,201 @@
+#ifndef SPONGE_LIBSPONGE_TCP_STACK_HH
+#define SPONGE_LIBSPONGE_TCP_STACK_HH
+
+#include "buffer.hh"
+#include "eventloop.hh"
+#include "file_descriptor.hh"
+#include "tcp_config.hh"
+#include "tcp_connection.hh"
+#include "tcp_flow.hh"
+#include "tcp_listener.hh"
+#include "tun.hh"
+#include "virtio_net_header.hh"
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <optional>
+#include <queue>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+class TCPStack;
+
+//! \brief An application's reference to one of the connections owned by a TCPStack
+//! \details A TCPHandle is a (stack, flow) pair and is cheap to copy. Each operation looks the
+//! connection up in the stack's table and transmits whatever segments it produced. Once the stack
+//! has reaped the connection, valid() returns `false` and the other methods throw.
+class TCPHandle {
+  private:
+    TCPStack *_stack;
+    TCPFlow _flow;
+
+  public:
+    //! Construct a handle to the connection identified by `flow`
+    TCPHandle(TCPStack &stack, const TCPFlow &flow) : _stack(&stack), _flow(flow) {}
+
+    //! The 4-tuple of the connection
+    const TCPFlow &flow() const { return _flow; }
+
+    //! Is the connection still in the stack's table?
+    bool valid() const;
+
+    //! The underlying TCPConnection (e.g. to inspect its state() or inbound_stream())
+    TCPConnection &connection() const;
+
+    //! \brief Write to the outbound stream and transmit what the connection sends in response
+    //! \returns the number of bytes accepted
+    size_t write(const std::string_view data);
+
+    //! Read (and pop) up to `limit` bytes from the inbound stream
+    std::string read(const size_t limit = std::numeric_limits<size_t>::max());
+
+    //! Shut down the outbound stream
+    void end_input_stream();
+};
+
+//! \brief Many TCPConnections multiplexed over one datagram device, with one EventLoop
+//! \details A TCPStack reads IPv4 datagrams from a single file descriptor (usually a TunFD),
+//! demultiplexes them to TCPConnections through a hash table keyed by the TCPFlow 4-tuple,
+//! and writes every outbound segment back out the same device. All methods, including those
+//! of TCPHandle, must be called from the thread that runs TCPStack::wait_next_event.
+class TCPStack {
+  public:
+    //! Called when a connection has been accepted, has new inbound bytes, or has finished
+    using HandlerT = std::function<void(TCPHandle)>;
+
+  private:
+    friend class TCPHandle;
+
+    std::optional<FileDescriptor> _rx{};  //!< Source of inbound datagrams, unless the owner delivers them
+    FileDescriptor _tx;                   //!< Sink for outbound datagrams
+    bool _vnet_hdr;                       //!< Is every datagram preceded by a `virtio_net_hdr`?
+
+    //! The demultiplexing table: every live connection, keyed by its 4-tuple
+    TCPConnectionTable _connections{};
+
+    //! Listeners (with their SYN tables), keyed by local port
+    std::unordered_map<uint16_t, TCPListener> _listeners{};
+
+    //! Established connections from every listener that have not yet been returned by accept()
+    std::queue<TCPFlow> _accept_queue{};
+
+    //! Called when a connection needs the application's attention
+    HandlerT _handler{};
+
+    EventLoop _eventloop{};  //!< Polls the inbound device
+
+    //! Slabs into which datagrams are read from the inbound device (with room for a `virtio_net_hdr`)
+    BufferPool _rx_pool{BufferPool::DEFAULT_SLAB_SIZE + VirtioNetHeader::LENGTH};
+
+    uint64_t _last_tick_ms;  //!< Time of the last call to tick()
+
+    //! Answer a segment that belongs to no connection with a RST
+    void _send_reset(const TCPFlow &flow, const TCPSegment &seg);
+
+    //! Process an inbound IPv4 datagram, checking its TCP checksum unless `verify_checksum` is `false`
+    void _datagram_received(const Buffer &datagram, const bool verify_checksum);
+
+    //! Wrap one segment in an IPv4 datagram and write it to the device
+    void _send_segment(const TCPFlow &flow, TCPSegment &seg);
+
+    //! Transmit every segment that the connection has queued
+    void _flush(const TCPFlow &flow, TCPConnection &connection);
+
+    //! Transmit a listener's segments and move its established connections to the accept queue
+    void _drain(TCPListener &listener);
+
+    //! Look up a connection, throwing if it has been reaped
+    TCPConnection &_connection(const TCPFlow &flow);
+
+    //! Let the application know that the connection has something for it
+    void _notify(const TCPFlow &flow);
+
+  public:
+    //! Construct a stack that sends and receives datagrams on a TUN device (with its `virtio_net_hdr`, if any)
+    explicit TCPStack(TunFD &&tun);
+
+    //! Construct a stack that receives datagrams from `rx` and sends them on `tx`
+    TCPStack(FileDescriptor &&rx, FileDescriptor &&tx, const bool vnet_hdr = false);
+
+    //! Construct a stack that sends datagrams on `tx` and is handed inbound ones by datagram_received()
+    explicit TCPStack(FileDescriptor &&tx, const bool vnet_hdr = false);
+
+    //! \brief Parse an inbound IPv4 datagram and hand its TCP segment to the connection it belongs to
+    //! \details If the stack was constructed with `vnet_hdr`, the datagram is preceded by a `virtio_net_hdr`.
+    void datagram_received(const Buffer &packet);
+
+    //! \brief Open a connection from `c_ad.source` to `c_ad.destination` and send its SYN
+    //! \returns a handle to the new connection
+    TCPHandle connect(const TCPConfig &c_tcp, const FdAdapterConfig &c_ad);
+
+    //! \brief Accept connections to `port` on any local address, using `c_tcp` for each of them
+    //! \details Up to `backlog` established connections from this port wait in the accept queue;
+    //! beyond that, completed handshakes are held in the listener's SYN table. Throws if `port` is
+    //! already listening, rather than dropping the handshakes and connections its listener holds.
+    //! \returns the port's listener, e.g. to set its SynCookies mode
+    TCPListener &listen(const TCPConfig &c_tcp,
+                        const uint16_t port,
+                        const size_t backlog = TCPListener::DEFAULT_BACKLOG);
+
+    //! Pop the oldest established connection from the accept queue, if any
+    std::optional<TCPHandle> accept();
+
+    //! Install the callback invoked when a connection needs the application's attention
+    void set_handler(const HandlerT &handler) { _handler = handler; }
+
+    //! The stack's EventLoop, so that an owner can poll its own file descriptors on the same thread
+    EventLoop &eventloop() { return _eventloop; }
+
+    //! \brief Wait up to `timeout_ms` for datagrams, process them, and advance the connections' clocks
+    //! \returns the result of the underlying EventLoop::wait_next_event
+    EventLoop::Result wait_next_event(const int timeout_ms);
+
+    //! Advance every connection's clock and reap the ones that are finished
+    void tick(const size_t ms_since_last_tick);
+
+    //! Number of connections in the table (not counting half-open ones)
+    size_t size() const { return _connections.size(); }
+
+    //! Number of half-open connections on every listening port
+    size_t half_open() const;
+
+    //! Resets any connections that are still active
+    ~TCPStack();
+
+    //! \name
+    //! Handles point into the stack, so it cannot be moved or copied
+
+    //!@{
+    TCPStack(const TCPStack &) = delete;
+    TCPStack(TCPStack &&) = delete;
+    TCPStack &operator=(const TCPStack &) = delete;
+    TCPStack &operator=(TCPStack &&) = delete;
+    //!@}
+};
+
+//! \class TCPStack
+//! Unlike TCPSpongeSocket, a TCPStack needs no thread, socketpair, or TUN device of its own for
+//! each connection, so one core can serve many thousands of connections. A server looks like:
+//!
+//! ~~~{.cc}
+//! TCPStack stack{TunFD("tun144")};
+//! stack.listen(TCPConfig{}, 80);
+//! stack.set_handler([&](TCPHandle h) {
+//!     const auto request = h.read();
+//!     // ...
+//! });
+//! while (true) {
+//!     stack.wait_next_event(10);
+//!     while (auto h = stack.accept()) {
+//!         h->write("hello\n");
+//!     }
+//! }
+//! ~~~
+//!
+//! A finished connection stays in the table until the application has read all of its inbound
+//! bytes, so the data that arrived before the FIN is never lost.
+
+#endif  // SPONGE_LIBSPONGE_TCP_STACK_HH
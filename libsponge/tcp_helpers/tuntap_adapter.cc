@@ -1,6 +1,129 @@
 #include "tuntap_adapter.hh"
 
+#include "ipv4_datagram.hh"
+#include "virtio_net_header.hh"
+
+#include <cstddef>
+#include <string>
+
 using namespace std;
 
+//! Largest IPv4 datagram, and so the largest TSO packet
+static constexpr size_t MAX_DATAGRAM_SIZE = 65535;
+
+//! Offset of the checksum field in a TCP header
+static constexpr uint16_t TCP_CHECKSUM_OFFSET = 16;
+
+TCPOverIPv4OverTunFdAdapter::TCPOverIPv4OverTunFdAdapter(TunFD &&tun)
+    : _tun(move(tun)), _rx_pool(MAX_DATAGRAM_SIZE + VirtioNetHeader::LENGTH) {}
+
+//! \details With a `virtio_net_hdr`, the TCP checksum is checked only if the kernel says it was
+//! finished and not yet verified.
+optional<TCPSegment> TCPOverIPv4OverTunFdAdapter::read() {
+    Buffer packet{_tun.read(_rx_pool)};
+    bool verify_checksum = true;
+
+    if (_tun.vnet_hdr()) {
+        VirtioNetHeader vnet;
+        if (vnet.parse(packet) != ParseResult::NoError) {
+            return {};
+        }
+        verify_checksum = not(vnet.needs_csum or vnet.data_valid);
+        packet.remove_prefix(VirtioNetHeader::LENGTH);
+    }
+
+    InternetDatagram ip_dgram;
+    if (ip_dgram.parse(packet) != ParseResult::NoError) {
+        return {};
+    }
+    return unwrap_tcp_in_ip(ip_dgram, verify_checksum);
+}
+
+vector<TCPSegment> TCPOverIPv4OverTunFdAdapter::read_batch() {
+    vector<TCPSegment> segments;
+    auto seg = read();
+    if (seg) {
+        segments.push_back(move(seg.value()));
+    }
+    return segments;
+}
+
+void TCPOverIPv4OverTunFdAdapter::write(TCPSegment &seg) {
+    if (_tun.vnet_hdr()) {
+        _write_offloaded(seg, 0);
+    } else {
+        _tun.write(wrap_tcp_in_ip(seg).serialize());
+    }
+}
+
+void TCPOverIPv4OverTunFdAdapter::_write_offloaded(TCPSegment &seg, const uint16_t gso_size) {
+    const InternetDatagram ip_dgram = wrap_tcp_in_ip(seg, true);
+
+    VirtioNetHeader vnet;
+    vnet.needs_csum = true;
+    vnet.csum_start = ip_dgram.header().hlen * 4;
+    vnet.csum_offset = TCP_CHECKSUM_OFFSET;
+    if (gso_size > 0) {
+        vnet.gso_type = VirtioNetHeader::GSO_TCPV4;
+        vnet.gso_size = gso_size;
+        vnet.hdr_len = vnet.csum_start + seg.header().doff * 4;
+    }
+
+    BufferList packet{vnet.serialize()};
+    packet.append(ip_dgram.serialize());
+    _tun.write(packet);
+}
+
+//! \details Without a `virtio_net_hdr`, each segment is written on its own. With one, consecutive
+//! segments are merged into one TSO packet if they continue one another, carry the same header
+//! (apart from the sequence number, and PSH or FIN on the last), and all but the last are the size
+//! of the first. The kernel's segmentation gives back exactly the original segments.
+//! \param[in] segments is drained in order
+void TCPOverIPv4OverTunFdAdapter::write_batch(queue<TCPSegment> &segments) {
+    while (not segments.empty()) {
+        TCPSegment first = move(segments.front());
+        segments.pop();
+
+        const TCPHeader &head = first.header();
+        const size_t mss = first.payload().size();
+        if (not _tun.vnet_hdr() or mss == 0 or head.syn or head.rst or head.fin or head.psh or head.urg) {
+            write(first);
+            continue;
+        }
+
+        // gather the run of segments that TSO can reproduce
+        const size_t max_payload = MAX_DATAGRAM_SIZE - IPv4Header::LENGTH - head.doff * 4;
+        string payload{first.payload().str()};
+        TCPHeader last = head;
+        size_t count = 1;
+        while (not segments.empty() and not last.fin and not last.psh and payload.size() % mss == 0) {
+            const TCPSegment &next = segments.front();
+            const TCPHeader &h = next.header();
+            const bool continues = h.seqno == head.seqno + payload.size() and h.ackno == head.ackno and
+                                   h.win == head.win and h.ack == head.ack and h.doff == head.doff and
+                                   h.sport == head.sport and h.dport == head.dport;
+            const bool plain = not(h.syn or h.rst or h.urg);
+            const size_t len = next.payload().size();
+            if (not continues or not plain or len == 0 or len > mss or payload.size() + len > max_payload) {
+                break;
+            }
+            payload.append(next.payload().str());
+            last = h;
+            ++count;
+            segments.pop();
+        }
+
+        if (count == 1) {
+            write(first);
+            continue;
+        }
+
+        first.header().psh = last.psh;
+        first.header().fin = last.fin;
+        first.payload() = Buffer{move(payload)};
+        _write_offloaded(first, mss);
+    }
+}
+
 //! Specialize LossyFdAdapter to TCPOverIPv4OverTunFdAdapter
 template class LossyFdAdapter<TCPOverIPv4OverTunFdAdapter>;
@@ -4,30 +4,43 @@
 #include "tcp_over_ip.hh"
 #include "tun.hh"
 
+#include <cstdint>
 #include <optional>
+#include <queue>
 #include <unordered_map>
 #include <utility>
+#include <vector>
 
 //! \brief A FD adapter for IPv4 datagrams read from and written to a TUN device
+//! \details If the device was opened with a `virtio_net_hdr` (see TunTapFD::vnet_hdr), the kernel
+//! finishes the TCP checksums of outbound segments and skips verifying those of inbound ones, and
+//! write_batch() hands runs of full-sized segments to the kernel as single TCP segmentation
+//! offload (TSO) packets of up to 64 KiB. Inbound TSO packets are accepted as single large segments.
 class TCPOverIPv4OverTunFdAdapter : public TCPOverIPv4Adapter {
   private:
     TunFD _tun;
+    BufferPool _rx_pool;  //!< Slabs into which packets are read from the device
+
+    //! Write `seg` after a virtio_net_hdr, asking the kernel to finish its checksum and, if
+    //! `gso_size` isn't zero, to cut it into segments carrying `gso_size` bytes each
+    void _write_offloaded(TCPSegment &seg, const uint16_t gso_size);
 
   public:
     //! Construct from a TunFD
-    explicit TCPOverIPv4OverTunFdAdapter(TunFD &&tun) : _tun(std::move(tun)) {}
+    explicit TCPOverIPv4OverTunFdAdapter(TunFD &&tun);
 
     //! Attempts to read and parse an IPv4 datagram containing a TCP segment related to the current connection
-    std::optional<TCPSegment> read() {
-        InternetDatagram ip_dgram;
-        if (ip_dgram.parse(_tun.read()) != ParseResult::NoError) {
-            return {};
-        }
-        return unwrap_tcp_in_ip(ip_dgram);
-    }
+    std::optional<TCPSegment> read();
+
+    //! \brief Batched read(), for interface parity with TCPOverUDPSocketAdapter
+    //! \details A TUN device yields one datagram per read(2), so the batch holds at most one segment.
+    std::vector<TCPSegment> read_batch();
 
     //! Creates an IPv4 datagram from a TCP segment and writes it to the TUN device
-    void write(TCPSegment &seg) { _tun.write(wrap_tcp_in_ip(seg).serialize()); }
+    void write(TCPSegment &seg);
+
+    //! Writes every segment in `segments` to the TUN device, emptying the queue
+    void write_batch(std::queue<TCPSegment> &segments);
 
     //! Access the underlying TUN device
     operator TunFD &() { return _tun; }
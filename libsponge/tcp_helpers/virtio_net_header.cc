@@ -0,0 +1,63 @@
+#include "virtio_net_header.hh"
+
+#include <cstring>
+
+using namespace std;
+
+// <linux/virtio_net.h> can't be included from C++ (a member is named `class`), so this mirrors
+// the parts of it that a TUN device uses
+namespace {
+constexpr uint8_t VIRTIO_NET_HDR_F_NEEDS_CSUM = 1;
+constexpr uint8_t VIRTIO_NET_HDR_F_DATA_VALID = 2;
+constexpr uint8_t VIRTIO_NET_HDR_GSO_ECN = 0x80;
+
+//! The legacy (host byte order) `struct virtio_net_hdr`
+struct virtio_net_hdr {
+    uint8_t flags;
+    uint8_t gso_type;
+    uint16_t hdr_len;
+    uint16_t gso_size;
+    uint16_t csum_start;
+    uint16_t csum_offset;
+};
+}  // namespace
+
+static_assert(sizeof(virtio_net_hdr) == VirtioNetHeader::LENGTH, "unexpected virtio_net_hdr layout");
+
+//! \param[in] data is a packet read from the device, starting with its `virtio_net_hdr`
+//! \returns a ParseResult indicating success or the reason for failure
+ParseResult VirtioNetHeader::parse(const string_view data) {
+    if (data.size() < LENGTH) {
+        return ParseResult::PacketTooShort;
+    }
+
+    virtio_net_hdr raw{};
+    memcpy(&raw, data.data(), LENGTH);
+
+    needs_csum = raw.flags & VIRTIO_NET_HDR_F_NEEDS_CSUM;
+    data_valid = raw.flags & VIRTIO_NET_HDR_F_DATA_VALID;
+    gso_type = raw.gso_type;
+    hdr_len = raw.hdr_len;
+    gso_size = raw.gso_size;
+    csum_start = raw.csum_start;
+    csum_offset = raw.csum_offset;
+
+    if ((gso_type & ~VIRTIO_NET_HDR_GSO_ECN) != GSO_NONE and (gso_type & ~VIRTIO_NET_HDR_GSO_ECN) != GSO_TCPV4) {
+        return ParseResult::Unsupported;
+    }
+    return ParseResult::NoError;
+}
+
+string VirtioNetHeader::serialize() const {
+    virtio_net_hdr raw{};
+    raw.flags = (needs_csum ? VIRTIO_NET_HDR_F_NEEDS_CSUM : 0) | (data_valid ? VIRTIO_NET_HDR_F_DATA_VALID : 0);
+    raw.gso_type = gso_type;
+    raw.hdr_len = hdr_len;
+    raw.gso_size = gso_size;
+    raw.csum_start = csum_start;
+    raw.csum_offset = csum_offset;
+
+    string ret(LENGTH, 0);
+    memcpy(ret.data(), &raw, LENGTH);
+    return ret;
+}
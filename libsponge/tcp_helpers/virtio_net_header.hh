@@ -0,0 +1,42 @@
+#ifndef SPONGE_LIBSPONGE_VIRTIO_NET_HEADER_HH
+#define SPONGE_LIBSPONGE_VIRTIO_NET_HEADER_HH
+
+#include "parser.hh"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+//! \brief The `virtio_net_hdr` that precedes each packet on a TUN device opened with IFF_VNET_HDR
+//! \details It carries the offloads that the kernel and the device owe each other: a checksum that
+//! still has to be finished, and a TCP packet that still has to be cut into MSS-sized segments.
+//! The fields are in host byte order, unlike those of the packet that follows.
+struct VirtioNetHeader {
+    static constexpr size_t LENGTH = 10;  //!< Size of a `virtio_net_hdr` (without mergeable receive buffers)
+
+    //! Kinds of segmentation offload (values of `gso_type`)
+    enum GSOType : uint8_t {
+        GSO_NONE = 0,   //!< The packet is not to be segmented
+        GSO_TCPV4 = 1,  //!< A TCP/IPv4 packet to be cut into `gso_size`-byte segments
+    };
+
+    //! \name virtio_net_hdr fields
+    //!@{
+    bool needs_csum = false;      //!< The checksum at `csum_start + csum_offset` covers only the pseudo-header
+    bool data_valid = false;      //!< The checksum has already been verified
+    uint8_t gso_type = GSO_NONE;  //!< Segmentation offload (see GSOType)
+    uint16_t hdr_len = 0;         //!< Length of the IP and TCP headers, repeated on each segment
+    uint16_t gso_size = 0;        //!< Payload bytes per segment
+    uint16_t csum_start = 0;      //!< Where the checksummed data starts (i.e. the TCP header)
+    uint16_t csum_offset = 0;     //!< Offset of the checksum field from `csum_start`
+    //!@}
+
+    //! Parse the header from the start of a packet
+    ParseResult parse(std::string_view data);
+
+    //! Serialize the header
+    std::string serialize() const;
+};
+
+#endif  // SPONGE_LIBSPONGE_VIRTIO_NET_HEADER_HH
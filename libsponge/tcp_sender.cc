@@ -1,6 +1,7 @@
 #include "tcp_sender.hh"
 
 #include "tcp_config.hh"
+#include "tracer.hh"
 
 #include <random>
 #include <iostream>
@@ -11,15 +12,25 @@ using namespace std;
 //! \param[in] capacity the capacity of the outgoing byte stream
 //! \param[in] retx_timeout the initial amount of time to wait before retransmitting the oldest outstanding segment
 //! \param[in] fixed_isn the Initial Sequence Number to use, if set (otherwise uses a random ISN)
-TCPSender::TCPSender(const size_t capacity, const uint16_t retx_timeout, const std::optional<WrappingInt32> fixed_isn)
+TCPSender::TCPSender(const size_t capacity,
+                     const uint16_t retx_timeout,
+                     const std::optional<WrappingInt32> fixed_isn,
+                     const size_t max_payload_size)
     : _isn(fixed_isn.value_or(WrappingInt32{random_device()()}))
     , _initial_retransmission_timeout{retx_timeout}
     , _stream(capacity)
+    , _max_payload_size(max_payload_size)
     , timer(retx_timeout) {}
 
 uint64_t TCPSender::bytes_in_flight() const { return _bytes_in_flight; }
 
 void TCPSender::fill_window() {
+    // the TCPConnection calls this as soon as bytes are written, so they were written now
+    const uint64_t now = timestamp_ns();
+    if(stream_in().bytes_written() > _bytes_stamped){
+        _bytes_stamped = stream_in().bytes_written();
+        _write_times.push({_bytes_stamped, now});
+    }
 
     // ! state: "FIN_SENT" --> stream finished (FIN sent) but not fully acknowledged
     // ! state: "FIN_ACKED" --> stream finished and fully acknowledged
@@ -35,7 +46,7 @@ void TCPSender::fill_window() {
         tcp_seg.header().seqno = _isn;
         _next_seqno ++;
         segment_sending(tcp_seg);  
-        outstanding_push(tcp_seg);
+        outstanding_push(tcp_seg, now);
     }
 
     //! state: "SYN_ACKED" --> stream ongoing
@@ -43,7 +54,12 @@ void TCPSender::fill_window() {
         while(_upper_bound > next_seqno_absolute()){
             TCPSegment tcp_seg;
             tcp_seg.header().seqno = next_seqno();
-            tcp_seg.payload() = Buffer(stream_in().read(min(_upper_bound - next_seqno_absolute(), TCPConfig::MAX_PAYLOAD_SIZE)));
+            tcp_seg.payload() = stream_in().read_buffer(min(_upper_bound - next_seqno_absolute(), _max_payload_size));
+            if(tcp_seg.payload().size() > 0 && !_write_times.empty()){
+                // the oldest stamp covers the segment's first byte
+                _queueing_latency.record(now - _write_times.front().second);
+                while(!_write_times.empty() && _write_times.front().first <= stream_in().bytes_read()) _write_times.pop();
+            }
             _next_seqno += tcp_seg.length_in_sequence_space();
             if(stream_in().eof() && _upper_bound > next_seqno_absolute()){
                 tcp_seg.header().fin = true;
@@ -51,7 +67,7 @@ void TCPSender::fill_window() {
             }
             if(tcp_seg.length_in_sequence_space() != 0) {
                 segment_sending(tcp_seg);
-                outstanding_push(tcp_seg);
+                outstanding_push(tcp_seg, now);
             }
             
             if(stream_in().buffer_size() == 0) break;
@@ -67,16 +83,18 @@ void TCPSender::ack_received(const WrappingInt32 ackno, const uint16_t window_si
     uint64_t abs_ackno = unwrap(ackno, _isn, next_seqno_absolute());
     if(abs_ackno > next_seqno_absolute()) return;
     
+    if(window_size == 0 && _window_size != 0) _stats.zero_window_events ++;
     _window_size = window_size;
 
     // remove the acknowledged segments from the _outgoing segment
+    const uint64_t now = timestamp_ns();
     _upper_bound = (window_size == 0) ? abs_ackno + 1 : abs_ackno + window_size;
     while(!_outstanding_segments.empty()){
         uint64_t abs_seqno = unwrap(_outstanding_segments.front().header().seqno, _isn, next_seqno_absolute());
         TCPSegment seg = _outstanding_segments.front();
         if(abs_seqno + _outstanding_segments.front().length_in_sequence_space() - 1 < abs_ackno){
             is_ackno_effective = true;
-            outstanding_pop();
+            outstanding_pop(now);
         } else break;
     }
 
@@ -98,15 +116,24 @@ void TCPSender::ack_received(const WrappingInt32 ackno, const uint16_t window_si
 
 //! \param[in] ms_since_last_tick the number of milliseconds since the last call to this method
 void TCPSender::tick(const size_t ms_since_last_tick) { 
+    // bytes are waiting, but the peer's window is full
+    if(_upper_bound > 0 && next_seqno_absolute() >= _upper_bound && stream_in().buffer_size() > 0)
+        _stats.window_limited_ms += ms_since_last_tick;
     if(timer.is_on()){
         timer.passtime(ms_since_last_tick);
         // cout << "ms since last tick: " << ms_since_last_tick << endl;
         //if the retransmission timer has expired
         if(timer.is_expired()){
+            SPONGE_TRACE(TimerFired, timer.RTO());
             // cout << "is expired!\n";
             //(a) Retransmit the earliest outgoing segment
             if(!_outstanding_segments.empty()){
                 segment_sending(_outstanding_segments.front());
+                SPONGE_TRACE(Retransmission, SPONGE_TRACE_SEGMENT_ARG(_outstanding_segments.front()));
+                _stats.retransmissions ++;
+                _stats.retransmitted_bytes += _outstanding_segments.front().payload().size();
+                if(_window_size != 0) _stats.retransmission_timeouts ++;
+                else _stats.zero_window_probes ++;
             }
             // (b) If the window size is nonzero: increment the number of consecutive retransmissions and exponential backoff
             if(_window_size != 0){
@@ -123,6 +150,15 @@ void TCPSender::tick(const size_t ms_since_last_tick) {
 
 unsigned int TCPSender::consecutive_retransmissions() const { return _consecutive_retransmissions; }
 
+TCPConnectionStats TCPSender::stats() const {
+    TCPConnectionStats stats = _stats;
+    stats.rto_ms = timer.RTO();
+    stats.peer_window = _window_size;
+    stats.bytes_in_flight = bytes_in_flight();
+    stats.consecutive_retransmissions = consecutive_retransmissions();
+    return stats;
+}
+
 void TCPSender::send_empty_segment() {
     // cout << "send empty" << endl;
     TCPSegment tcp_segment;
@@ -2,8 +2,11 @@
 #define SPONGE_LIBSPONGE_TCP_SENDER_HH
 
 #include "byte_stream.hh"
+#include "latency_histogram.hh"
 #include "tcp_config.hh"
+#include "tcp_connection_stats.hh"
 #include "tcp_segment.hh"
+#include "util.hh"
 #include "wrapping_integers.hh"
 
 #include <functional>
@@ -26,6 +29,7 @@ class  RetransmissionTimer{
     void set_RTO_initial() {_RTO = _initial_retransmission_timeout;}
     void half_RTO() {_RTO /= 2;}
     void double_RTO() {_RTO *= 2;}
+    unsigned int RTO() const {return _RTO;}
     bool is_on() {return _on;}
     bool is_expired() {return _expired;}
     void start(){_retransmission_timeout = _RTO; _on = true; _expired = false;}
@@ -64,16 +68,34 @@ class TCPSender {
     //! outgoing stream of bytes that have not yet been sent
     ByteStream _stream;
 
+    //! largest payload to put in one segment
+    size_t _max_payload_size;
+
     //! the (absolute) sequence number for the next byte to be sent
     uint64_t _next_seqno{0};
     //! timer
     RetransmissionTimer timer;
 
+    //! the sender's counters (retransmissions, zero windows and time spent window-limited)
+    TCPConnectionStats _stats{};
+
+    //! when bytes were written to the stream, as (total bytes written, timestamp_ns()), oldest first
+    std::queue<std::pair<uint64_t, uint64_t>> _write_times{};
+    //! bytes written to the stream as of the newest entry in _write_times
+    uint64_t _bytes_stamped{0};
+    //! when each outstanding segment was first sent (timestamp_ns()), in the same order as _outstanding_segments
+    std::queue<uint64_t> _send_times{};
+    //! how long each segment's first byte waited in the stream before the segment was sent, in ns
+    LatencyHistogram _queueing_latency{};
+    //! how long each segment took to be acknowledged, from when it was first sent, in ns
+    LatencyHistogram _ack_latency{};
+
   public:
     //! Initialize a TCPSender
     TCPSender(const size_t capacity = TCPConfig::DEFAULT_CAPACITY,
               const uint16_t retx_timeout = TCPConfig::TIMEOUT_DFLT,
-              const std::optional<WrappingInt32> fixed_isn = {});
+              const std::optional<WrappingInt32> fixed_isn = {},
+              const size_t max_payload_size = TCPConfig::MAX_PAYLOAD_SIZE);
 
     //! \name "Input" interface for the writer
     //!@{
@@ -107,8 +129,8 @@ class TCPSender {
     }
 
     //! \brief everytime pushing or poping an outstanding segment, the number of bytes in flight should be updated
-    void outstanding_push(TCPSegment& tcp_seg){ _outstanding_segments.push(tcp_seg); _bytes_in_flight += tcp_seg.length_in_sequence_space();}
-    void outstanding_pop() { if(!_outstanding_segments.empty()){ _bytes_in_flight -= _outstanding_segments.front().length_in_sequence_space(); _outstanding_segments.pop();}}
+    void outstanding_push(TCPSegment& tcp_seg, const uint64_t now){ _outstanding_segments.push(tcp_seg); _send_times.push(now); _bytes_in_flight += tcp_seg.length_in_sequence_space();}
+    void outstanding_pop(const uint64_t now) { if(!_outstanding_segments.empty()){ _bytes_in_flight -= _outstanding_segments.front().length_in_sequence_space(); _outstanding_segments.pop(); _ack_latency.record(now - _send_times.front()); _send_times.pop();}}
     //! \brief How many sequence numbers are occupied by segments sent but not yet acknowledged?
     //! \note count is in "sequence space," i.e. SYN and FIN each count for one byte
     //! (see TCPSegment::length_in_sequence_space())
@@ -117,6 +139,15 @@ class TCPSender {
     //! \brief Number of consecutive retransmissions that have occurred in a row
     unsigned int consecutive_retransmissions() const;
 
+    //! \brief The sender's counters, and the gauges of its window and timer
+    TCPConnectionStats stats() const;
+
+    //! \brief How long each segment's first byte waited in the stream before the segment was sent, in ns
+    const LatencyHistogram &queueing_latency() const { return _queueing_latency; }
+
+    //! \brief How long each segment took to be cumulatively acknowledged, from when it was first sent, in ns
+    const LatencyHistogram &ack_latency() const { return _ack_latency; }
+
     //! \brief TCPSegments that the TCPSender has enqueued for transmission.
     //! \note These must be dequeued and sent by the TCPConnection,
     //! which will need to fill in the fields that are set by the TCPReceiver
@@ -0,0 +1,85 @@
+//! \file
+//! \brief Replacements for the global operator new and operator delete that count into AllocationTracker
+//! \details Built into the `sponge_alloc_hooks` library, not `sponge`: linking it (ahead of `sponge`) is what
+//! turns on allocation counting for a program.
+
+#include "alloc_tracker.hh"
+
+#include <cstdlib>
+#include <new>
+
+using namespace std;
+
+//! Say so before main() runs, so that AllocationTracker::installed() holds everywhere
+static const bool hooks_installed = (AllocationTracker::mark_installed(), true);
+
+//! malloc `size` bytes (aligned to `alignment`, if more than malloc's), retrying through the new-handler
+//! \returns the allocation, or nullptr if it failed and there's no new-handler
+static void *allocate(size_t size, const size_t alignment) noexcept {
+    size = size > 0 ? size : 1;
+    while (true) {
+        void *ptr = nullptr;
+        if (alignment <= __STDCPP_DEFAULT_NEW_ALIGNMENT__) {
+            ptr = malloc(size);
+        } else if (posix_memalign(&ptr, alignment, size) != 0) {
+            ptr = nullptr;
+        }
+        if (ptr) {
+            AllocationTracker::allocated(size);
+            return ptr;
+        }
+        const new_handler handler = get_new_handler();
+        if (not handler) {
+            return nullptr;
+        }
+        try {
+            handler();
+        } catch (...) {
+            return nullptr;
+        }
+    }
+}
+
+static void *allocate_or_throw(const size_t size, const size_t alignment) {
+    void *ptr = allocate(size, alignment);
+    if (not ptr) {
+        throw bad_alloc();
+    }
+    return ptr;
+}
+
+static void deallocate(void *ptr) noexcept {
+    if (ptr) {
+        AllocationTracker::deallocated();
+        free(ptr);
+    }
+}
+
+static constexpr size_t DEFAULT_ALIGNMENT = __STDCPP_DEFAULT_NEW_ALIGNMENT__;
+
+void *operator new(size_t size) { return allocate_or_throw(size, DEFAULT_ALIGNMENT); }
+void *operator new[](size_t size) { return allocate_or_throw(size, DEFAULT_ALIGNMENT); }
+void *operator new(size_t size, align_val_t al) { return allocate_or_throw(size, static_cast<size_t>(al)); }
+void *operator new[](size_t size, align_val_t al) { return allocate_or_throw(size, static_cast<size_t>(al)); }
+
+void *operator new(size_t size, const nothrow_t &) noexcept { return allocate(size, DEFAULT_ALIGNMENT); }
+void *operator new[](size_t size, const nothrow_t &) noexcept { return allocate(size, DEFAULT_ALIGNMENT); }
+void *operator new(size_t size, align_val_t al, const nothrow_t &) noexcept {
+    return allocate(size, static_cast<size_t>(al));
+}
+void *operator new[](size_t size, align_val_t al, const nothrow_t &) noexcept {
+    return allocate(size, static_cast<size_t>(al));
+}
+
+void operator delete(void *ptr) noexcept { deallocate(ptr); }
+void operator delete[](void *ptr) noexcept { deallocate(ptr); }
+void operator delete(void *ptr, size_t) noexcept { deallocate(ptr); }
+void operator delete[](void *ptr, size_t) noexcept { deallocate(ptr); }
+void operator delete(void *ptr, align_val_t) noexcept { deallocate(ptr); }
+void operator delete[](void *ptr, align_val_t) noexcept { deallocate(ptr); }
+void operator delete(void *ptr, size_t, align_val_t) noexcept { deallocate(ptr); }
+void operator delete[](void *ptr, size_t, align_val_t) noexcept { deallocate(ptr); }
+void operator delete(void *ptr, const nothrow_t &) noexcept { deallocate(ptr); }
+void operator delete[](void *ptr, const nothrow_t &) noexcept { deallocate(ptr); }
+void operator delete(void *ptr, align_val_t, const nothrow_t &) noexcept { deallocate(ptr); }
+void operator delete[](void *ptr, align_val_t, const nothrow_t &) noexcept { deallocate(ptr); }
@@ -0,0 +1,14 @@
+#include "alloc_tracker.hh"
+
+#include <sstream>
+
+using namespace std;
+
+thread_local AllocationCounts AllocationTracker::_counts{};
+bool AllocationTracker::_installed = false;
+
+string AllocationCounts::to_string() const {
+    ostringstream ss;
+    ss << "allocations=" << allocations << " deallocations=" << deallocations << " bytes=" << bytes;
+    return ss.str();
+}
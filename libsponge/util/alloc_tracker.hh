@@ -0,0 +1,62 @@
+#ifndef SPONGE_LIBSPONGE_ALLOC_TRACKER_HH
+#define SPONGE_LIBSPONGE_ALLOC_TRACKER_HH
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+//! Heap allocations made by a thread through operator new
+struct AllocationCounts {
+    uint64_t allocations = 0;    //!< Calls to operator new (of every form)
+    uint64_t deallocations = 0;  //!< Calls to operator delete with a non-null pointer
+    uint64_t bytes = 0;          //!< Bytes requested by the allocations
+
+    //! The allocations made since `earlier` was taken
+    AllocationCounts operator-(const AllocationCounts &earlier) const {
+        return {allocations - earlier.allocations, deallocations - earlier.deallocations, bytes - earlier.bytes};
+    }
+
+    //! A one-line summary, e.g. "allocations=12 deallocations=12 bytes=4096"
+    std::string to_string() const;
+};
+
+//! \brief Counts each thread's heap allocations, for tests and benchmarks that hold code to an allocation budget
+//! \details The counting is done by replacements for the global operator new and operator delete, which live
+//! in their own library (`sponge_alloc_hooks`) so that only the programs that link it pay for them. Counting
+//! costs an increment of a thread-local counter per call. In a program without the hooks, installed() is false
+//! and the counts stay at zero.
+//!
+//! Allocations that bypass operator new (malloc, or the C library's own buffers) aren't counted.
+class AllocationTracker {
+    static thread_local AllocationCounts _counts;
+    static bool _installed;
+
+  public:
+    //! Are the replacement operators linked into this program?
+    static bool installed() { return _installed; }
+
+    //! The calling thread's allocations since it started
+    static AllocationCounts counts() { return _counts; }
+
+    //! \name Called by the replacement operators
+    //!@{
+    static void mark_installed() { _installed = true; }
+    static void allocated(const size_t bytes) noexcept {
+        _counts.allocations++;
+        _counts.bytes += bytes;
+    }
+    static void deallocated() noexcept { _counts.deallocations++; }
+    //!@}
+};
+
+//! \brief The calling thread's allocations since the AllocationScope was constructed
+//! \details For example, `AllocationScope scope; do_work(); scope.counts().allocations` is how many times
+//! `do_work()` called operator new.
+class AllocationScope {
+    AllocationCounts _start = AllocationTracker::counts();
+
+  public:
+    AllocationCounts counts() const { return AllocationTracker::counts() - _start; }
+};
+
+#endif  // SPONGE_LIBSPONGE_ALLOC_TRACKER_HH
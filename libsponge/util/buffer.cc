@@ -1,19 +1,163 @@
 #include "buffer.hh"
 
+#include <array>
+#include <cstring>
+#include <mutex>
+#include <new>
+
 using namespace std;
 
+namespace {
+
+//! Number of BufferArena free lists: blocks of 64 B, 128 B, ..., 64 KiB
+constexpr uint32_t NUM_SIZE_CLASSES = 11;
+
+//! Size class of blocks that are never kept on a free list
+constexpr uint32_t UNCACHED = NUM_SIZE_CLASSES;
+
+static_assert((BufferArena::MIN_BLOCK_SIZE << (NUM_SIZE_CLASSES - 1)) == BufferArena::MAX_BLOCK_SIZE);
+
+//! The size class of a block of `size` bytes
+uint32_t size_class(const size_t size) {
+    if (size > BufferArena::MAX_BLOCK_SIZE) {
+        return UNCACHED;
+    }
+    uint32_t cls = 0;
+    while ((BufferArena::MIN_BLOCK_SIZE << cls) < size) {
+        ++cls;
+    }
+    return cls;
+}
+
+//! One thread's free lists
+class ThreadCache {
+  public:
+    std::array<std::vector<BufferStorage *>, NUM_SIZE_CLASSES> free_lists{};  //!< Idle blocks, by size class
+    size_t cached_bytes = 0;                                                 //!< Total size of the idle blocks
+    BufferArena::Stats stats{};                                              //!< The thread's counts
+
+    ThreadCache() = default;
+    ~ThreadCache();
+
+    ThreadCache(const ThreadCache &other) = delete;
+    ThreadCache &operator=(const ThreadCache &other) = delete;
+};
+
+thread_local ThreadCache cache;
+
+//! Set once the thread's cache has been destroyed (at thread exit), after which blocks go straight to the heap
+thread_local bool cache_destroyed = false;
+
+ThreadCache::~ThreadCache() {
+    cache_destroyed = true;
+    for (auto &list : free_lists) {
+        for (auto *storage : list) {
+            BufferArena::destroy(storage);
+        }
+    }
+}
+
+}  // namespace
+
+//! \param[in] capacity is rounded up to fill the block (unless `recycler` is set: storage with its
+//!                     own recycler never goes on a free list, so it is allocated at exactly `capacity`)
+BufferStorage *BufferArena::allocate(const size_t capacity, BufferRecycler *recycler) {
+    const size_t needed = sizeof(BufferStorage) + capacity;
+    const uint32_t cls = recycler ? UNCACHED : size_class(needed);
+
+    if (cls != UNCACHED and not cache_destroyed and not cache.free_lists[cls].empty()) {
+        BufferStorage *storage = cache.free_lists[cls].back();
+        cache.free_lists[cls].pop_back();
+        cache.cached_bytes -= sizeof(BufferStorage) + storage->_capacity;
+        ++cache.stats.reuses;
+        return storage;
+    }
+
+    const size_t block_size = cls == UNCACHED ? needed : MIN_BLOCK_SIZE << cls;
+    void *block = ::operator new(block_size);
+    if (not cache_destroyed) {
+        ++cache.stats.heap_allocations;
+    }
+    return new (block) BufferStorage(cls, block_size - sizeof(BufferStorage), recycler);
+}
+
+void BufferArena::free(BufferStorage *storage) {
+    const size_t block_size = sizeof(BufferStorage) + storage->_capacity;
+    if (storage->_size_class == UNCACHED or cache_destroyed or cache.cached_bytes + block_size > MAX_CACHED_BYTES) {
+        destroy(storage);
+        return;
+    }
+    cache.free_lists[storage->_size_class].push_back(storage);
+    cache.cached_bytes += block_size;
+}
+
+void BufferArena::destroy(BufferStorage *storage) {
+    storage->~BufferStorage();
+    ::operator delete(storage);
+    if (not cache_destroyed) {
+        ++cache.stats.heap_frees;
+    }
+}
+
+BufferArena::Stats BufferArena::stats() { return cache_destroyed ? Stats{} : cache.stats; }
+
+namespace {
+
+//! A std::string adopted by a Buffer, and freed with the last reference to it
+class AdoptedString : public BufferRecycler {
+  private:
+    string _str;
+
+  public:
+    BufferStorage storage;  //!< Header for the bytes of `_str`
+
+    explicit AdoptedString(string &&str) : _str(move(str)), storage(_str.data(), _str.size(), *this) {}
+
+    void recycle(BufferStorage *) override { delete this; }
+};
+
+}  // namespace
+
+Buffer::Buffer(string &&str) noexcept {
+    if (str.size() < BufferArena::MAX_BLOCK_SIZE) {
+        *this = Buffer(string_view(str));
+        return;
+    }
+    _storage = &(new AdoptedString(move(str)))->storage;
+    _ending_offset = _storage->capacity();
+}
+
+Buffer::Buffer(const string_view str) noexcept {
+    if (str.empty()) {
+        return;
+    }
+    _storage = BufferArena::allocate(str.size());
+    memcpy(_storage->data(), str.data(), str.size());
+    _ending_offset = str.size();
+}
+
 void Buffer::remove_prefix(const size_t n) {
     if (n > str().size()) {
         throw out_of_range("Buffer::remove_prefix");
     }
     _starting_offset += n;
-    if (_storage and _starting_offset == _storage->size()) {
-        _storage.reset();
+    if (_storage and _starting_offset == _ending_offset) {
+        _storage->release();
+        _storage = nullptr;
+    }
+}
+
+Buffer Buffer::substr(const size_t pos, const size_t len) const {
+    if (pos > size()) {
+        throw out_of_range("Buffer::substr");
     }
+    Buffer ret{*this};
+    ret._starting_offset += pos;
+    ret._ending_offset = ret._starting_offset + min(len, size() - pos);
+    return ret;
 }
 string Buffer::peak_out(size_t n) const{
-    n = min(n, str().size());
-    return move(copy().substr(0, n));
+    return string(str().substr(0, n));
 }
 string Buffer::read_prefix(size_t n) {
     n = min(n, str().size());
@@ -21,14 +165,104 @@ string Buffer::read_prefix(size_t n) {
     remove_prefix(n);
     return move(ret);
 }
+//! The idle slabs of a BufferPool
+class BufferPool::Freelist : public BufferRecycler {
+  public:
+    const size_t max_idle;            //!< Most slabs to keep
+    mutex lock{};                     //!< Protects `slabs`
+    vector<BufferStorage *> slabs{};  //!< The idle slabs
+    atomic<size_t> refs{1};           //!< One for the pool, plus one for each slab that is checked out
+
+    explicit Freelist(const size_t max) : max_idle(max) {}
+
+    //! Take back a slab whose last reference is gone (on any thread)
+    void recycle(BufferStorage *storage) override {
+        {
+            lock_guard<mutex> guard{lock};
+            if (slabs.size() < max_idle) {
+                slabs.push_back(exchange(storage, nullptr));
+            }
+        }
+        if (storage) {
+            BufferArena::destroy(storage);
+        }
+        unref();
+    }
+
+    //! Drop a reference, deleting the free list (and its idle slabs) if it was the last one
+    void unref() {
+        if (refs.fetch_sub(1, memory_order_acq_rel) == 1) {
+            delete this;
+        }
+    }
+
+    ~Freelist() override {
+        for (auto *slab : slabs) {
+            BufferArena::destroy(slab);
+        }
+    }
+
+    Freelist(const Freelist &other) = delete;
+    Freelist &operator=(const Freelist &other) = delete;
+};
+
+BufferPool::BufferPool(const size_t slab_size, const size_t max_idle)
+    : _slab_size(slab_size), _idle(new Freelist(max_idle)) {}
+
+BufferPool::~BufferPool() {
+    if (_idle) {
+        _idle->unref();
+    }
+}
+
+BufferPool::BufferPool(BufferPool &&other) noexcept
+    : _slab_size(other._slab_size), _idle(exchange(other._idle, nullptr)) {}
+
+BufferPool &BufferPool::operator=(BufferPool &&other) noexcept {
+    swap(_slab_size, other._slab_size);
+    swap(_idle, other._idle);
+    return *this;
+}
+
+BufferPool::Slab BufferPool::acquire(const size_t min_size) {
+    if (min_size > _slab_size) {
+        return Slab{BufferArena::allocate(min_size)};
+    }
+
+    BufferStorage *slab = nullptr;
+    {
+        lock_guard<mutex> guard{_idle->lock};
+        if (not _idle->slabs.empty()) {
+            slab = _idle->slabs.back();
+            _idle->slabs.pop_back();
+        }
+    }
+    if (not slab) {
+        slab = BufferArena::allocate(_slab_size, _idle);
+    }
+
+    // instead of going back to the arena with its last reference, the slab goes back on the free list
+    _idle->refs.fetch_add(1, memory_order_relaxed);
+    return Slab{slab};
+}
+
+size_t BufferPool::idle() const {
+    lock_guard<mutex> guard{_idle->lock};
+    return _idle->slabs.size();
+}
+
 void BufferList::append(const BufferList &other) {
     for (const auto &buf : other._buffers) {
-        _buffers.push_back(buf);
+        push_back(buf);
     }
 }
 
-void BufferList::push_back(const Buffer& buf) {
-    _buffers.push_back(buf);
+void BufferList::push_back(Buffer buf) {
+    if (buf.size() == 0) {
+        return;
+    }
+    _size += buf.size();
+    _buffers.push_back(move(buf));
 }
 
 BufferList::operator Buffer() const {
@@ -43,6 +277,7 @@ BufferList::operator Buffer() const {
         }
     }
 }
+
 string BufferList::concatenate() const {
     std::string ret;
     ret.reserve(size());
@@ -51,100 +286,80 @@ string BufferList::concatenate() const {
     }
     return ret;
 }
-string BufferList::peak_out(size_t len) const{
+
+string BufferList::peak_out(size_t len) const {
     std::string ret;
-    ret.reserve(len);
-    for (auto &buf : _buffers) {
-        if(buf.size() <= len)
-        {
-            ret.append(buf);
-            len -= buf.size();
-            
-        } else{
-            ret.append(buf.peak_out(len));
+    ret.reserve(min(len, size()));
+    for (const auto &buf : _buffers) {
+        if (buf.size() >= len) {
+            ret.append(buf.str().substr(0, len));
             break;
         }
+        ret.append(buf);
+        len -= buf.size();
     }
-    return move(ret);
+    return ret;
 }
+
 string BufferList::read_prefix(size_t len) {
     len = min(len, size());
-    std::string ret;
-    ret.reserve(len);
-    while(len){
-        Buffer buf = _buffers.front();
-        if(buf.size() <= len){
-            len -= buf.size();
-            ret.append(buf.str());
-            _buffers.pop_front();
-            
-        } else{
-            ret.append(buf.peak_out(len));
-            break;
-        }
-    }
-    return move(ret);
-}
-
-size_t BufferList::size() const {
-    size_t ret = 0;
-    for (const auto &buf : _buffers) {
-        ret += buf.size();
-    }
+    std::string ret = peak_out(len);
+    remove_prefix(len);
     return ret;
 }
 
 void BufferList::remove_prefix(size_t n) {
-    while (n > 0) {
-        if (_buffers.empty()) {
-            throw std::out_of_range("BufferList::remove_prefix");
-        }
+    if (n > _size) {
+        throw std::out_of_range("BufferList::remove_prefix");
+    }
+    _size -= n;
 
-        if (n < _buffers.front().str().size()) {
+    while (n > 0) {
+        if (n < _buffers.front().size()) {
             _buffers.front().remove_prefix(n);
             n = 0;
         } else {
-            n -= _buffers.front().str().size();
+            n -= _buffers.front().size();
             _buffers.pop_front();
         }
     }
 }
 
-BufferViewList::BufferViewList(const BufferList &buffers) {
-    for (const auto &x : buffers.buffers()) {
-        _views.push_back(x);
+void BufferViewList::_push_back(const string_view str) {
+    if (not str.empty()) {
+        _iovecs.push_back({const_cast<char *>(str.data()), str.size()});
+        _size += str.size();
     }
 }
 
-void BufferViewList::remove_prefix(size_t n) {
-    while (n > 0) {
-        if (_views.empty()) {
-            throw std::out_of_range("BufferListView::remove_prefix");
-        }
-
-        if (n < _views.front().size()) {
-            _views.front().remove_prefix(n);
-            n = 0;
-        } else {
-            n -= _views.front().size();
-            _views.pop_front();
-        }
+void BufferViewList::append(const BufferViewList &other) {
+    for (const auto &x : other._iovecs) {
+        _iovecs.push_back(x);
     }
+    _size += other._size;
 }
 
-size_t BufferViewList::size() const {
-    size_t ret = 0;
-    for (const auto &buf : _views) {
-        ret += buf.size();
+void BufferViewList::append(const BufferList &buffers) {
+    for (const auto &x : buffers.buffers()) {
+        _push_back(x);
     }
-    return ret;
 }
 
-vector<iovec> BufferViewList::as_iovecs() const {
-    vector<iovec> ret;
-    ret.reserve(_views.size());
-    for (const auto &x : _views) {
-        ret.push_back({const_cast<char *>(x.data()), x.size()});
+void BufferViewList::remove_prefix(size_t n) {
+    if (n > _size) {
+        throw std::out_of_range("BufferListView::remove_prefix");
+    }
+    _size -= n;
+
+    while (n > 0) {
+        iovec &front = _iovecs.front();
+        if (n < front.iov_len) {
+            front.iov_base = static_cast<char *>(front.iov_base) + n;
+            front.iov_len -= n;
+            n = 0;
+        } else {
+            n -= front.iov_len;
+            _iovecs.pop_front();
+        }
     }
-    return ret;
 }
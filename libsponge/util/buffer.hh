@@ -1,27 +1,189 @@
 #ifndef SPONGE_LIBSPONGE_BUFFER_HH
 #define SPONGE_LIBSPONGE_BUFFER_HH
 
+#include "small_deque.hh"
+
 #include <algorithm>
-#include <deque>
+#include <atomic>
+#include <cstdint>
 #include <memory>
 #include <numeric>
 #include <stdexcept>
 #include <string>
 #include <string_view>
 #include <sys/uio.h>
+#include <utility>
 #include <vector>
 
+class BufferStorage;
+
+//! Takes back BufferStorage once its last reference is gone, instead of the thread's BufferArena
+class BufferRecycler {
+  public:
+    //! Take back `storage`, whose reference count is zero
+    virtual void recycle(BufferStorage *storage) = 0;
+
+    virtual ~BufferRecycler() = default;
+};
+
+//! \brief Bytes shared by Buffers, with an intrusive reference count, allocated in one block with its header
+//! \details Allocated by BufferArena::allocate() (or by a BufferPool), never with `new`.
+class BufferStorage {
+  private:
+    std::atomic<uint32_t> _refs{1};  //!< Number of owners (Buffers, or a BufferPool::Slab)
+    uint32_t _size_class;            //!< BufferArena free list to which the block belongs
+    size_t _capacity;                //!< Number of bytes
+    BufferRecycler *_recycler;       //!< Takes the storage back when `_refs` drops to zero (or nullptr)
+    char *_data;                     //!< The bytes: just after the header, unless they are external
+
+    friend class BufferArena;
+
+  public:
+    //! Construct the header of a block with room for `capacity` bytes
+    BufferStorage(const uint32_t size_class, const size_t capacity, BufferRecycler *recycler)
+        : _size_class(size_class)
+        , _capacity(capacity)
+        , _recycler(recycler)
+        , _data(reinterpret_cast<char *>(this + 1)) {}
+
+    //! \brief Construct a header for `capacity` bytes at `data` that belong to `owner`
+    //! \details The header may live anywhere (e.g. inside `owner`); `owner` gets it back once
+    //! the last reference is gone.
+    BufferStorage(char *data, const size_t capacity, BufferRecycler &owner)
+        : _size_class(UINT32_MAX), _capacity(capacity), _recycler(&owner), _data(data) {}
+
+    //! The bytes
+    char *data() { return _data; }
+
+    //! Number of bytes
+    size_t capacity() const { return _capacity; }
+
+    //! Add a reference
+    void retain() { _refs.fetch_add(1, std::memory_order_relaxed); }
+
+    //! Drop a reference, and recycle the storage if it was the last one
+    void release() {
+        if (_refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            _refs.store(1, std::memory_order_relaxed);  // ready to be handed out again
+            if (_recycler) {
+                _recycler->recycle(this);
+            } else {
+                free(this);
+            }
+        }
+    }
+
+    //! Hand an unreferenced block back to the BufferArena of the calling thread
+    static void free(BufferStorage *storage);
+
+    //! \name
+    //! BufferStorage lives in raw blocks, so it cannot be copied or moved
+
+    //!@{
+    BufferStorage(const BufferStorage &other) = delete;
+    BufferStorage &operator=(const BufferStorage &other) = delete;
+    BufferStorage(BufferStorage &&other) = delete;
+    BufferStorage &operator=(BufferStorage &&other) = delete;
+    ~BufferStorage() = default;
+    //!@}
+};
+
+//! \brief Per-thread free lists of BufferStorage blocks, by power-of-two size class
+//! \details A block whose last reference is dropped goes onto the free list of the thread that dropped
+//! it (up to MAX_CACHED_BYTES per thread), so once a thread has warmed up, making and copying Buffers
+//! costs no calls to the heap.
+class BufferArena {
+  public:
+    static constexpr size_t MIN_BLOCK_SIZE = 64;                 //!< Smallest block, including the header
+    static constexpr size_t MAX_BLOCK_SIZE = 64 * 1024;          //!< Largest block kept on a free list
+    static constexpr size_t MAX_CACHED_BYTES = 4 * 1024 * 1024;  //!< Most bytes kept on one thread's free lists
+
+    //! Counts of the calling thread's BufferStorage allocations
+    struct Stats {
+        uint64_t heap_allocations = 0;  //!< Blocks that came from the heap
+        uint64_t reuses = 0;            //!< Blocks that came from a free list
+        uint64_t heap_frees = 0;        //!< Blocks that went back to the heap
+    };
+
+    //! \brief Storage for at least `capacity` bytes, with one reference
+    //! \param[in] recycler takes the storage back when the last reference is gone (nullptr for the arena)
+    static BufferStorage *allocate(const size_t capacity, BufferRecycler *recycler = nullptr);
+
+    //! Give `storage` (with no references left) back to the calling thread's free lists, or to the heap
+    static void free(BufferStorage *storage);
+
+    //! Give `storage` back to the heap
+    static void destroy(BufferStorage *storage);
+
+    //! The calling thread's counts
+    static Stats stats();
+};
+
+inline void BufferStorage::free(BufferStorage *storage) { BufferArena::free(storage); }
+
 //! \brief A reference-counted read-only string that can discard bytes from the front
 class Buffer {
   private:
-    std::shared_ptr<std::string> _storage{};
+    BufferStorage *_storage = nullptr;
     size_t _starting_offset{};
+    size_t _ending_offset{};  //!< One past the last byte of _storage in the Buffer
 
   public:
     Buffer() = default;
 
-    //! \brief Construct by taking ownership of a string
-    Buffer(std::string &&str) noexcept : _storage(std::make_shared<std::string>(std::move(str))) {}
+    //! \brief Construct from the first `length` bytes of `storage`, taking over its reference
+    Buffer(BufferStorage *storage, const size_t length) : _storage(storage), _ending_offset(length) {}
+
+    //! \brief Construct from a string
+    //! \details A string of at least BufferArena::MAX_BLOCK_SIZE bytes is adopted without a copy;
+    //! anything shorter is copied into storage from the calling thread's BufferArena, which (once
+    //! warm) is cheaper than keeping the string's own heap block alive.
+    Buffer(std::string &&str) noexcept;
+
+    //! \brief Construct from a copy of `str`
+    explicit Buffer(const std::string_view str) noexcept;
+
+    //! \name Copies share the storage (no bytes are copied)
+    //!@{
+    Buffer(const Buffer &other) noexcept
+        : _storage(other._storage), _starting_offset(other._starting_offset), _ending_offset(other._ending_offset) {
+        if (_storage) {
+            _storage->retain();
+        }
+    }
+
+    //! A moved-from Buffer is left empty
+    Buffer(Buffer &&other) noexcept
+        : _storage(other._storage), _starting_offset(other._starting_offset), _ending_offset(other._ending_offset) {
+        other._storage = nullptr;
+        other._starting_offset = other._ending_offset = 0;
+    }
+
+    Buffer &operator=(const Buffer &other) noexcept {
+        Buffer copy{other};
+        return *this = std::move(copy);
+    }
+
+    Buffer &operator=(Buffer &&other) noexcept {
+        if (this != &other) {
+            if (_storage) {
+                _storage->release();
+            }
+            _storage = other._storage;
+            _starting_offset = other._starting_offset;
+            _ending_offset = other._ending_offset;
+            other._storage = nullptr;
+            other._starting_offset = other._ending_offset = 0;
+        }
+        return *this;
+    }
+
+    ~Buffer() {
+        if (_storage) {
+            _storage->release();
+        }
+    }
+    //!@}
 
     //! \name Expose contents as a std::string_view
     //!@{
@@ -29,7 +191,7 @@ class Buffer {
         if (not _storage) {
             return {};
         }
-        return {_storage->data() + _starting_offset, _storage->size() - _starting_offset};
+        return {_storage->data() + _starting_offset, _ending_offset - _starting_offset};
     }
 
     operator std::string_view() const { return str(); }
@@ -48,20 +210,115 @@ class Buffer {
     //! \note Doesn't free any memory until the whole string has been discarded in all copies of the Buffer.
     void remove_prefix(const size_t n);
 
+    //! \brief A Buffer of (at most) `len` bytes starting at `pos`, sharing this Buffer's storage (no copy)
+    Buffer substr(const size_t pos, const size_t len = std::string::npos) const;
+
     //! \brief make a copy of the prefix substring of 'n' bytes, without changing the buffer
     std::string peak_out(const size_t n) const;
     //! \brief read and discard the prefix substring with len of n
     std::string read_prefix(const size_t n);
 };
 
+//! \brief A pool of equal-sized slabs of storage that are recycled rather than freed
+//! \details Reading a packet into a fresh std::string costs an allocation, and zero-filling the
+//! string up to the largest possible packet size, every time. Reading into a slab from a BufferPool
+//! costs neither once the pool has warmed up: a slab is allocated (and zeroed) once, frozen into a
+//! Buffer holding just the bytes read, and handed back to the pool when the last copy of that Buffer
+//! (or of any Buffer that shares its storage, e.g. the payload of a TCPSegment parsed from it) is gone.
+//! Slabs may be released on any thread.
+class BufferPool {
+  public:
+    static constexpr size_t DEFAULT_SLAB_SIZE = 65536;  //!< Room for any UDP payload or IPv4 datagram
+    static constexpr size_t DEFAULT_MAX_IDLE = 64;      //!< Number of idle slabs kept for reuse
+
+  private:
+    class Freelist;
+
+    size_t _slab_size;  //!< Size of every pooled slab
+    Freelist *_idle;    //!< Idle slabs (kept alive by the slabs in use, which may outlive the pool)
+
+  public:
+    //! Storage checked out of a BufferPool, to be filled and then frozen into a Buffer
+    class Slab {
+      private:
+        BufferStorage *_storage;
+
+      public:
+        //! Take over the reference to `storage`
+        explicit Slab(BufferStorage *storage) : _storage(storage) {}
+
+        //! The writable storage
+        char *data() { return _storage->data(); }
+
+        //! Size of the storage
+        size_t size() const { return _storage->capacity(); }
+
+        //! \brief A Buffer holding the first `length` bytes of the slab
+        //! \details The slab goes back to its pool when the last copy of the Buffer is gone.
+        Buffer freeze(const size_t length) && { return {std::exchange(_storage, nullptr), length}; }
+
+        //! Returns an unfrozen slab to its pool
+        ~Slab() {
+            if (_storage) {
+                _storage->release();
+            }
+        }
+
+        //! \name
+        //! A Slab can be moved but not copied
+
+        //!@{
+        Slab(Slab &&other) noexcept : _storage(std::exchange(other._storage, nullptr)) {}
+        Slab &operator=(Slab &&other) noexcept {
+            std::swap(_storage, other._storage);
+            return *this;
+        }
+        Slab(const Slab &other) = delete;
+        Slab &operator=(const Slab &other) = delete;
+        //!@}
+    };
+
+    //! Construct a pool of slabs of `slab_size` bytes that keeps up to `max_idle` of them for reuse
+    explicit BufferPool(const size_t slab_size = DEFAULT_SLAB_SIZE, const size_t max_idle = DEFAULT_MAX_IDLE);
+
+    //! \brief Check out a slab of at least `min_size` bytes
+    //! \note A request larger than slab_size() gets a one-off allocation that isn't recycled.
+    Slab acquire(const size_t min_size = 0);
+
+    //! Size of every pooled slab
+    size_t slab_size() const { return _slab_size; }
+
+    //! Number of idle slabs waiting to be reused
+    size_t idle() const;
+
+    //! Idle slabs are freed once the pool and every slab it handed out are gone
+    ~BufferPool();
+
+    //! \name
+    //! A BufferPool can be moved but not copied
+
+    //!@{
+    BufferPool(BufferPool &&other) noexcept;
+    BufferPool &operator=(BufferPool &&other) noexcept;
+    BufferPool(const BufferPool &other) = delete;
+    BufferPool &operator=(const BufferPool &other) = delete;
+    //!@}
+};
+
 //! \brief A reference-counted discontiguous string that can discard bytes from the front
 //! \note Used to model packets that contain multiple sets of headers
 //! + a payload. This allows us to prepend headers (e.g., to
 //! encapsulate a TCP payload in a TCPSegment, and then encapsulate
 //! the TCPSegment in an IPv4Datagram) without copying the payload.
+//! \details A packet is a handful of Buffers, so they are kept inline (see SmallDeque), and the total
+//! size is kept up to date rather than summed on demand.
 class BufferList {
+  public:
+    static constexpr size_t INLINE_BUFFERS = 4;  //!< Buffers held without allocating (headers + payload)
+
   private:
-    std::deque<Buffer> _buffers{};
+    SmallDeque<Buffer, INLINE_BUFFERS> _buffers{};
+    size_t _size = 0;  //!< Total size of `_buffers`
 
   public:
     //! \name Constructors
@@ -70,23 +327,21 @@ class BufferList {
     BufferList() = default;
 
     //! \brief Construct from a Buffer
-    BufferList(Buffer buffer) : _buffers{buffer} {}
+    BufferList(Buffer buffer) { push_back(std::move(buffer)); }
 
     //! \brief Construct by taking ownership of a std::string
-    BufferList(std::string &&str) noexcept {
-        Buffer buf{std::move(str)};
-        append(buf);
-    }
+    BufferList(std::string &&str) noexcept : BufferList(Buffer{std::move(str)}) {}
     //!@}
 
     //! \brief Access the underlying queue of Buffers
-    const std::deque<Buffer> &buffers() const { return _buffers; }
+    const SmallDeque<Buffer, INLINE_BUFFERS> &buffers() const { return _buffers; }
 
     //! \brief Append a BufferList
     void append(const BufferList &other);
 
-    // //! \brief Append a Buffer
-    void push_back(const Buffer& buf);
+    //! \brief Append a Buffer
+    void push_back(Buffer buf);
+
     //! \brief Transform to a Buffer
     //! \note Throws an exception unless BufferList is contiguous
     operator Buffer() const;
@@ -95,21 +350,27 @@ class BufferList {
     void remove_prefix(size_t n);
 
     //! \brief Size of the string
-    size_t size() const;
+    size_t size() const { return _size; }
 
     //! \brief Make a copy to a new std::string
     std::string concatenate() const;
 
     //! \brief read and discard the first 'n' length of prefix
     std::string read_prefix(size_t n);
-    
+
     //! \brief make a copy of the prefix substring of 'n' bytes, without changing the buffer
     std::string peak_out(const size_t n) const;
 };
 
 //! \brief A non-owning temporary view (similar to std::string_view) of a discontiguous string
+//! \details The views are kept as `iovec` structures, ready for [writev(2)](\ref man2::writev) and
+//! [sendmsg(2)](\ref man2::sendmsg).
 class BufferViewList {
-    std::deque<std::string_view> _views{};
+    SmallDeque<iovec, BufferList::INLINE_BUFFERS> _iovecs{};
+    size_t _size = 0;  //!< Total size of `_iovecs`
+
+    //! Append a view of `str`, unless it is empty
+    void _push_back(const std::string_view str);
 
   public:
     //! \name Constructors
@@ -122,22 +383,31 @@ class BufferViewList {
     BufferViewList(const char *s) : BufferViewList(std::string_view(s)) {}
 
     //! \brief Construct from a BufferList
-    BufferViewList(const BufferList &buffers);
+    BufferViewList(const BufferList &buffers) { append(buffers); }
 
     //! \brief Construct from a std::string_view
-    BufferViewList(std::string_view str) { _views.push_back({const_cast<char *>(str.data()), str.size()}); }
+    BufferViewList(std::string_view str) { _push_back(str); }
     //!@}
 
     //! \brief Discard the first `n` bytes of the string (does not require a copy or move)
     void remove_prefix(size_t n);
 
+    //! \brief Append the views in `other` (does not copy the underlying bytes)
+    void append(const BufferViewList &other);
+
+    //! \brief Append views of the Buffers in `buffers` (does not copy the underlying bytes)
+    void append(const BufferList &buffers);
+
     //! \brief Size of the string
-    size_t size() const;
+    size_t size() const { return _size; }
 
-    //! \brief Convert to a vector of `iovec` structures
+    //! \name The views, as `iovec` structures
     //! \note used for system calls that write discontiguous buffers,
     //! e.g. [writev(2)](\ref man2::writev) and [sendmsg(2)](\ref man2::sendmsg)
-    std::vector<iovec> as_iovecs() const;
+    //!@{
+    const iovec *iovecs() const { return _iovecs.data(); }
+    size_t iovec_count() const { return _iovecs.size(); }
+    //!@}
 };
 
 #endif  // SPONGE_LIBSPONGE_BUFFER_HH
@@ -0,0 +1,140 @@
+#include "byte_channel.hh"
+
+#include "util.hh"
+
+#include <algorithm>
+#include <cstring>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+using namespace std;
+
+//! Round up to a power of two, so that positions in the ring are just masked indices
+static size_t ring_size(const size_t capacity) {
+    size_t size = 1;
+    while (size < capacity) {
+        size <<= 1;
+    }
+    return size;
+}
+
+static void signal_eventfd(const FileDescriptor &fd) {
+    const uint64_t one = 1;
+    SystemCall("write", ::write(fd.fd_num(), &one, sizeof(one)));
+}
+
+//! Block until the eventfd is signalled, and reset it
+static void wait_eventfd(const FileDescriptor &fd) {
+    pollfd pfd{fd.fd_num(), POLLIN, 0};
+    SystemCall("poll", ::poll(&pfd, 1, -1));
+    uint64_t count = 0;
+    SystemCall("read", ::read(fd.fd_num(), &count, sizeof(count)), EAGAIN);
+}
+
+//! \param[in] capacity is rounded up to the next power of two
+ByteChannel::ByteChannel(const size_t capacity)
+    : _capacity(ring_size(capacity))
+    , _ring(make_unique<char[]>(_capacity))
+    , _readable(SystemCall("eventfd", ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)))
+    , _writable(SystemCall("eventfd", ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC))) {}
+
+//! \details The stores and loads of the indices and the `waiting` flags are sequentially
+//! consistent, so either the producer sees that the consumer is waiting (and signals it), or the
+//! consumer sees the new bytes before it goes to sleep.
+size_t ByteChannel::write(const string_view data) {
+    const uint64_t write_index = _write_index.load(memory_order_relaxed);
+    const size_t len = min(data.size(), _capacity - static_cast<size_t>(write_index - _read_index.load()));
+    if (len == 0) {
+        return 0;
+    }
+
+    const size_t offset = write_index & (_capacity - 1);
+    const size_t first = min(len, _capacity - offset);
+    memcpy(&_ring[offset], data.data(), first);
+    memcpy(&_ring[0], data.data() + first, len - first);
+    _write_index.store(write_index + len);
+
+    if (_reader_waiting.load() and _reader_waiting.exchange(false)) {
+        signal_eventfd(_readable);
+    }
+    return len;
+}
+
+void ByteChannel::write_all(string_view data) {
+    while (not data.empty()) {
+        data.remove_prefix(write(data));
+        if (not data.empty()) {
+            wait_writable();
+        }
+    }
+}
+
+void ByteChannel::close() {
+    _closed = true;
+    if (_reader_waiting.exchange(false)) {
+        signal_eventfd(_readable);
+    }
+}
+
+bool ByteChannel::arm_writable() {
+    _writer_waiting = true;
+    return remaining_capacity() == 0;
+}
+
+void ByteChannel::wait_writable() {
+    while (arm_writable()) {
+        wait_eventfd(_writable);
+    }
+    _writer_waiting = false;
+}
+
+size_t ByteChannel::remaining_capacity() const { return _capacity - buffer_size(); }
+
+string_view ByteChannel::peek() const {
+    const uint64_t read_index = _read_index.load(memory_order_relaxed);
+    const size_t len = _write_index.load() - read_index;
+    const size_t offset = read_index & (_capacity - 1);
+    return {&_ring[offset], min(len, _capacity - offset)};
+}
+
+//! \param[in] n must be no more than buffer_size()
+void ByteChannel::pop(const size_t n) {
+    _read_index.store(_read_index.load(memory_order_relaxed) + n);
+
+    if (_writer_waiting.load() and _writer_waiting.exchange(false)) {
+        signal_eventfd(_writable);
+    }
+}
+
+//! \param[in] limit is the maximum number of bytes to read
+string ByteChannel::read(const size_t limit) {
+    string ret;
+    ret.reserve(min(limit, buffer_size()));
+    while (ret.size() < limit) {
+        const string_view run = peek();
+        if (run.empty()) {
+            break;
+        }
+        const size_t len = min(run.size(), limit - ret.size());
+        ret.append(run.substr(0, len));
+        pop(len);
+    }
+    return ret;
+}
+
+bool ByteChannel::arm_readable() {
+    _reader_waiting = true;
+    return buffer_size() == 0 and not _closed;
+}
+
+void ByteChannel::wait_readable() {
+    while (arm_readable()) {
+        wait_eventfd(_readable);
+    }
+    _reader_waiting = false;
+}
+
+size_t ByteChannel::buffer_size() const { return _write_index.load() - _read_index.load(); }
+
+bool ByteChannel::eof() const { return _closed and buffer_size() == 0; }
@@ -0,0 +1,103 @@
+#ifndef SPONGE_LIBSPONGE_BYTE_CHANNEL_HH
+#define SPONGE_LIBSPONGE_BYTE_CHANNEL_HH
+
+#include "file_descriptor.hh"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+
+//! \brief A lock-free single-producer, single-consumer byte ring between two threads
+//! \details One thread writes and close()s; the other reads. Bytes are copied into the ring and
+//! out of it, with no syscalls unless one side has to sleep. A side that wants to sleep first
+//! arms the channel (arm_readable() or arm_writable()) and then polls the corresponding
+//! eventfd, so a ByteChannel can be serviced by an EventLoop like any other file descriptor.
+class ByteChannel {
+  public:
+    static constexpr size_t DEFAULT_CAPACITY = 256 * 1024;  //!< Default size of the ring, in bytes
+
+  private:
+    size_t _capacity;               //!< Size of the ring (a power of two)
+    std::unique_ptr<char[]> _ring;  //!< The bytes in flight
+
+    //! Total number of bytes ever read (only stored by the consumer)
+    alignas(64) std::atomic<uint64_t> _read_index{0};
+
+    //! Total number of bytes ever written (only stored by the producer)
+    alignas(64) std::atomic<uint64_t> _write_index{0};
+
+    std::atomic_bool _closed{false};          //!< Has the producer finished?
+    std::atomic_bool _reader_waiting{false};  //!< Does the consumer want a signal when bytes arrive?
+    std::atomic_bool _writer_waiting{false};  //!< Does the producer want a signal when space frees up?
+
+    FileDescriptor _readable;  //!< eventfd signalled for a waiting consumer
+    FileDescriptor _writable;  //!< eventfd signalled for a waiting producer
+
+  public:
+    //! Construct a channel whose ring holds at least `capacity` bytes
+    explicit ByteChannel(const size_t capacity = DEFAULT_CAPACITY);
+
+    //! \name Producer interface
+    //!@{
+
+    //! \brief Copy as much of `data` as fits into the ring, without blocking
+    //! \returns the number of bytes written
+    size_t write(std::string_view data);
+
+    //! Copy all of `data` into the ring, sleeping while it is full
+    void write_all(std::string_view data);
+
+    //! Signal that nothing more will be written
+    void close();
+
+    //! \brief Ask for writable_fd() to be signalled once there is space in the ring
+    //! \returns `false` if there is space already (so the caller shouldn't sleep)
+    bool arm_writable();
+
+    //! Sleep until there is space in the ring
+    void wait_writable();
+
+    //! Number of bytes that can be written without blocking
+    size_t remaining_capacity() const;
+
+    //! eventfd that becomes readable when a waiting producer should try again
+    FileDescriptor &writable_fd() { return _writable; }
+    //!@}
+
+    //! \name Consumer interface
+    //!@{
+
+    //! The longest run of unread bytes that is contiguous in the ring (possibly not all of them)
+    std::string_view peek() const;
+
+    //! Discard `n` bytes from the front of the ring
+    void pop(const size_t n);
+
+    //! Copy (and pop) up to `limit` bytes, without blocking
+    std::string read(const size_t limit);
+
+    //! \brief Ask for readable_fd() to be signalled once there are bytes (or EOF) to read
+    //! \returns `false` if there is something to read already (so the caller shouldn't sleep)
+    bool arm_readable();
+
+    //! Sleep until there are bytes (or EOF) to read
+    void wait_readable();
+
+    //! Number of bytes waiting to be read
+    size_t buffer_size() const;
+
+    //! `true` if the producer has closed the channel and every byte has been read
+    bool eof() const;
+
+    //! eventfd that becomes readable when a waiting consumer should try again
+    FileDescriptor &readable_fd() { return _readable; }
+    //!@}
+
+    //! Total size of the ring
+    size_t capacity() const { return _capacity; }
+};
+
+#endif  // SPONGE_LIBSPONGE_BYTE_CHANNEL_HH
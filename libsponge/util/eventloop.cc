@@ -1,8 +1,11 @@
 #include "eventloop.hh"
 
+#include "io_uring.hh"
+#include "tracer.hh"
 #include "util.hh"
 
 #include <cerrno>
+#include <cstdlib>
 #include <stdexcept>
 #include <system_error>
 #include <utility>
@@ -10,10 +13,46 @@
 
 using namespace std;
 
+//! Number of entries in the submission queue of an EventLoop's io_uring (more are submitted in batches)
+static constexpr unsigned IO_URING_ENTRIES = 256;
+
+//! `user_data` of io_uring requests whose completions are ignored
+static constexpr uint64_t IGNORED_REQUEST = 0;
+
 unsigned int EventLoop::Rule::service_count() const {
     return direction == Direction::In ? fd.read_count() : fd.write_count();
 }
 
+//! \param[in] backend is Backend::IOUring to wait with an io_uring; if the kernel doesn't support
+//!                    io_uring (or lacks the features the EventLoop needs), the EventLoop uses poll(2).
+EventLoop::EventLoop(const Backend backend) : _ring() {
+    if (backend != Backend::IOUring) {
+        return;
+    }
+
+    try {
+        _ring = make_unique<IOUring>(IO_URING_ENTRIES);
+    } catch (const unix_error &) {
+        return;  // e.g., ENOSYS, or EPERM where io_uring is disabled
+    }
+
+    // waiting with a timeout needs IORING_FEAT_EXT_ARG, and no completion may be lost if the
+    // completion queue overflows
+    const uint32_t needed = IORING_FEAT_EXT_ARG | IORING_FEAT_NODROP;
+    if ((_ring->features() & needed) != needed) {
+        _ring.reset();
+    }
+}
+
+EventLoop::Backend EventLoop::default_backend() {
+    const char *const name = getenv("SPONGE_EVENTLOOP");
+    return (name and string(name) == "io_uring") ? Backend::IOUring : Backend::Poll;
+}
+
+EventLoop::~EventLoop() = default;
+EventLoop::EventLoop(EventLoop &&other) noexcept = default;
+EventLoop &EventLoop::operator=(EventLoop &&other) noexcept = default;
+
 //! \param[in] fd is the FileDescriptor to be polled
 //! \param[in] direction indicates whether to poll for reading (Direction::In) or writing (Direction::Out)
 //! \param[in] callback is called when `fd` is ready.
@@ -26,10 +65,79 @@ void EventLoop::add_rule(const FileDescriptor &fd,
                          const InterestT &interest,
                          const CallbackT &cancel) {
     _rules.push_back({fd.duplicate(), direction, callback, interest, cancel});
+    _rules.back().id = _next_rule_id++;
+    _callback_latencies.push_back({fd.fd_num(), direction, {}});
+}
+
+//! \details If a poll request for the rule is outstanding, it is removed from the io_uring.
+list<EventLoop::Rule>::iterator EventLoop::_cancel_rule(list<Rule>::iterator it) {
+    it->cancel();
+    if (it->armed) {
+        io_uring_sqe &sqe = _ring->next_sqe();
+        sqe.opcode = IORING_OP_POLL_REMOVE;
+        sqe.fd = -1;
+        sqe.addr = it->id;
+        sqe.user_data = IGNORED_REQUEST;
+        _armed.erase(it->id);
+    }
+    return _rules.erase(it);
+}
+
+bool EventLoop::_wait_poll(const int timeout_ms) {
+    vector<pollfd> pollfds{};
+    pollfds.reserve(_rules.size());
+    for (const auto &rule : _rules) {
+        pollfds.push_back({rule.fd.fd_num(), rule.events, 0});  // events == 0 is a placeholder: we still want errors
+    }
+
+    if (0 == SystemCall("poll", ::poll(pollfds.data(), pollfds.size(), timeout_ms))) {
+        return false;
+    }
+
+    auto pfd = pollfds.cbegin();
+    for (auto &rule : _rules) {
+        rule.revents = (pfd++)->revents;
+    }
+    return true;
+}
+
+//! \details Arms a one-shot poll request for each interested rule that doesn't have one outstanding,
+//! then submits the requests and waits for completions with one call to io_uring_enter(2). Requests
+//! stay armed across waits (even if their rule loses interest), so an fd that isn't ready costs
+//! nothing until its state changes.
+bool EventLoop::_wait_io_uring(const int timeout_ms) {
+    for (auto &rule : _rules) {
+        if (rule.events and not rule.armed) {
+            io_uring_sqe &sqe = _ring->next_sqe();
+            sqe.opcode = IORING_OP_POLL_ADD;
+            sqe.fd = rule.fd.fd_num();
+            sqe.poll32_events = static_cast<uint16_t>(rule.events);
+            sqe.user_data = rule.id;
+            rule.armed = true;
+            _armed.emplace(rule.id, &rule);
+        }
+    }
+
+    _ring->enter(timeout_ms == 0 ? 0 : 1, timeout_ms);
+
+    bool ready = false;
+    _ring->for_each_completion([&](const io_uring_cqe &cqe) {
+        const auto armed = _armed.find(cqe.user_data);
+        if (armed == _armed.end()) {
+            return;  // the rule was canceled, or this is the result of removing its request
+        }
+
+        Rule &rule = *armed->second;
+        _armed.erase(armed);
+        rule.armed = false;
+        rule.revents = cqe.res >= 0 ? static_cast<short>(cqe.res) : POLLNVAL;
+        ready = true;
+    });
+    return ready;
 }
 
-//! \param[in] timeout_ms is the timeout value passed to [poll(2)](\ref man2::poll); `wait_next_event`
-//!                       returns Result::Timeout if no fd is ready after the timeout expires.
+//! \param[in] timeout_ms is the timeout value passed to [poll(2)](\ref man2::poll) (or used by the io_uring);
+//!                       `wait_next_event` returns Result::Timeout if no fd is ready after the timeout expires.
 //! \returns Eventloop::Result indicating success, timeout, or no more Rule objects to poll.
 //!
 //! For each Rule, this function first calls Rule::interest; if `true`, Rule::fd is added to the
@@ -37,7 +145,8 @@ void EventLoop::add_rule(const FileDescriptor &fd,
 //! writability (if Rule::direction == Direction::Out) unless Rule::fd has reached EOF, in which case
 //! the Rule is canceled (i.e., deleted from EventLoop::_rules).
 //!
-//! Next, this function calls [poll(2)](\ref man2::poll) with timeout value `timeout_ms`.
+//! Next, this function calls [poll(2)](\ref man2::poll) with timeout value `timeout_ms` (or, with
+//! Backend::IOUring, arms poll requests and waits for their completions).
 //!
 //! Then, for each ready file descriptor, this function calls Rule::callback. If fd reaches EOF or
 //! if the Rule was registered using EventLoop::add_cancelable_rule and Rule::callback returns true,
@@ -59,32 +168,25 @@ void EventLoop::add_rule(const FileDescriptor &fd,
 //! will result in a busy loop (poll returns on a ready file descriptor; file descriptor is not read or
 //! written, so it is still ready; the next call to poll will immediately return).
 EventLoop::Result EventLoop::wait_next_event(const int timeout_ms) {
-    vector<pollfd> pollfds{};
-    pollfds.reserve(_rules.size());
     bool something_to_poll = false;
 
-    // set up the pollfd for each rule
-    for (auto it = _rules.cbegin(); it != _rules.cend();) {  // NOTE: it gets erased or incremented in loop body
-        const auto &this_rule = *it;
+    // decide which events to wait for on each rule
+    for (auto it = _rules.begin(); it != _rules.end();) {  // NOTE: it gets erased or incremented in loop body
+        auto &this_rule = *it;
         if (this_rule.direction == Direction::In && this_rule.fd.eof()) {
             // no more reading on this rule, it's reached eof
-            this_rule.cancel();
-            it = _rules.erase(it);
+            it = _cancel_rule(it);
             continue;
         }
 
         if (this_rule.fd.closed()) {
-            this_rule.cancel();
-            it = _rules.erase(it);
+            it = _cancel_rule(it);
             continue;
         }
 
-        if (this_rule.interest()) {
-            pollfds.push_back({this_rule.fd.fd_num(), static_cast<short>(this_rule.direction), 0});
-            something_to_poll = true;
-        } else {
-            pollfds.push_back({this_rule.fd.fd_num(), 0, 0});  // placeholder --- we still want errors
-        }
+        this_rule.events = this_rule.interest() ? static_cast<short>(this_rule.direction) : 0;
+        this_rule.revents = 0;
+        something_to_poll |= this_rule.events != 0;
         ++it;
     }
 
@@ -93,9 +195,9 @@ EventLoop::Result EventLoop::wait_next_event(const int timeout_ms) {
         return Result::Exit;
     }
 
-    // call poll -- wait until one of the fds satisfies one of the rules (writeable/readable)
+    // wait until one of the fds satisfies one of the rules (writeable/readable)
     try {
-        if (0 == SystemCall("poll", ::poll(pollfds.data(), pollfds.size(), timeout_ms))) {
+        if (not(_ring ? _wait_io_uring(timeout_ms) : _wait_poll(timeout_ms))) {
             return Result::Timeout;
         }
     } catch (unix_error const &e) {
@@ -106,30 +208,33 @@ EventLoop::Result EventLoop::wait_next_event(const int timeout_ms) {
 
     // go through the poll results
 
-    for (auto [it, idx] = make_pair(_rules.begin(), size_t(0)); it != _rules.end(); ++idx) {
-        const auto &this_pollfd = pollfds[idx];
+    for (auto it = _rules.begin(); it != _rules.end();) {
+        const auto &this_rule = *it;
 
-        const auto poll_error = static_cast<bool>(this_pollfd.revents & (POLLERR | POLLNVAL));
+        const auto poll_error = static_cast<bool>(this_rule.revents & (POLLERR | POLLNVAL));
         if (poll_error) {
             throw runtime_error("EventLoop: error on polled file descriptor");
         }
 
-        const auto &this_rule = *it;
-        const auto poll_ready = static_cast<bool>(this_pollfd.revents & this_pollfd.events);
-        const auto poll_hup = static_cast<bool>(this_pollfd.revents & POLLHUP);
-        if (poll_hup && this_pollfd.events && !poll_ready) {
+        const auto poll_ready = static_cast<bool>(this_rule.revents & this_rule.events);
+        const auto poll_hup = static_cast<bool>(this_rule.revents & POLLHUP);
+        if (poll_hup && this_rule.events && !poll_ready) {
             // if we asked for the status, and the _only_ condition was a hangup, this FD is defunct:
             //   - if it was POLLIN and nothing is readable, no more will ever be readable
             //   - if it was POLLOUT, it will not be writable again
-            this_rule.cancel();
-            it = _rules.erase(it);
+            it = _cancel_rule(it);
             continue;
         }
 
         if (poll_ready) {
             // we only want to call callback if revents includes the event we asked for
             const auto count_before = this_rule.service_count();
-            this_rule.callback();
+            const uint64_t start = timestamp_ns();
+            {
+                SPONGE_TRACE_SCOPE(Callback, this_rule.fd.fd_num());
+                this_rule.callback();
+            }
+            _callback_latencies[this_rule.id - 1].duration.record(timestamp_ns() - start);
 
             // only check for busy wait if we're not canceling or exiting
             if (count_before == this_rule.service_count() and this_rule.interest()) {
@@ -138,7 +243,7 @@ EventLoop::Result EventLoop::wait_next_event(const int timeout_ms) {
             }
         }
 
-        ++it;  // if we got here, it means we didn't call _rules.erase()
+        ++it;  // if we got here, it means we didn't call _cancel_rule()
     }
 
     return Result::Success;
@@ -2,11 +2,18 @@
 #define SPONGE_LIBSPONGE_EVENTLOOP_HH
 
 #include "file_descriptor.hh"
+#include "latency_histogram.hh"
 
+#include <cstdint>
 #include <cstdlib>
 #include <functional>
 #include <list>
+#include <memory>
 #include <poll.h>
+#include <unordered_map>
+#include <vector>
+
+class IOUring;
 
 //! Waits for events on file descriptors and executes corresponding callbacks.
 class EventLoop {
@@ -17,6 +24,19 @@ class EventLoop {
         Out = POLLOUT  //!< Callback will be triggered when Rule::fd is writable.
     };
 
+    //! How the EventLoop waits for its file descriptors
+    enum class Backend {
+        Poll,    //!< Pass every rule's fd to [poll(2)](\ref man2::poll) on each wait
+        IOUring  //!< Keep a poll request armed in an [io_uring(7)](\ref man7::io_uring) for each rule
+    };
+
+    //! How long the callbacks of one rule have taken
+    struct CallbackLatency {
+        int fd;                       //!< The fd that was passed to EventLoop::add_rule
+        Direction direction;          //!< The rule's Direction
+        LatencyHistogram duration{};  //!< Time taken by each call of the callback, in ns
+    };
+
   private:
     using CallbackT = std::function<void(void)>;  //!< Callback for ready Rule::fd
     using InterestT = std::function<bool(void)>;  //!< `true` return indicates Rule::fd should be polled.
@@ -30,6 +50,10 @@ class EventLoop {
         CallbackT callback;   //!< A callback that reads or writes fd.
         InterestT interest;   //!< A callback that returns `true` whenever fd should be polled.
         CallbackT cancel;     //!< A callback that is called when the rule is cancelled (e.g. on hangup)
+        uint64_t id = 0;      //!< Identifies the rule's poll requests in the io_uring
+        short events = 0;     //!< Events polled for in the current wait (0 if the rule is not interested)
+        short revents = 0;    //!< Events that occurred in the current wait
+        bool armed = false;   //!< Is a poll request for this rule outstanding in the io_uring?
 
         //! Returns the number of times fd has been read or written, depending on the value of Rule::direction.
         //! \details This function is used internally by EventLoop; you will not need to call it
@@ -38,7 +62,34 @@ class EventLoop {
 
     std::list<Rule> _rules{};  //!< All rules that have been added and not canceled.
 
+    std::unique_ptr<IOUring> _ring;                 //!< The io_uring, if Backend::IOUring is in use
+    std::unordered_map<uint64_t, Rule *> _armed{};  //!< Rules with an outstanding poll request, by Rule::id
+    uint64_t _next_rule_id = 1;                     //!< Rule::id of the next rule to be added
+
+    std::vector<CallbackLatency> _callback_latencies{};  //!< Every rule's, by Rule::id - 1 (canceled rules too)
+
+    //! Call Rule::cancel and delete the rule
+    std::list<Rule>::iterator _cancel_rule(std::list<Rule>::iterator it);
+
+    //! \brief Wait for events with [poll(2)](\ref man2::poll)
+    //! \returns `false` on timeout
+    bool _wait_poll(const int timeout_ms);
+
+    //! \brief Wait for events by arming a poll request in the io_uring for each interested rule
+    //! \returns `false` on timeout
+    bool _wait_io_uring(const int timeout_ms);
+
   public:
+    //! Construct an EventLoop that waits with `backend`, or with poll(2) if the kernel can't provide it
+    explicit EventLoop(const Backend backend = default_backend());
+
+    //! \brief The backend used by default
+    //! \details Backend::IOUring if the environment variable `SPONGE_EVENTLOOP` is `io_uring`, otherwise Backend::Poll
+    static Backend default_backend();
+
+    //! The backend actually in use
+    Backend backend() const { return _ring ? Backend::IOUring : Backend::Poll; }
+
     //! Returned by each call to EventLoop::wait_next_event.
     enum class Result {
         Success,  //!< At least one Rule was triggered.
@@ -53,8 +104,24 @@ class EventLoop {
                   const InterestT &interest = [] { return true; },
                   const CallbackT &cancel = [] {});
 
-    //! Calls [poll(2)](\ref man2::poll) and then executes callback for each ready fd.
+    //! Waits for the rules' fds (see EventLoop::Backend) and then executes callback for each ready fd.
     Result wait_next_event(const int timeout_ms);
+
+    //! How long each rule's callback has taken, in the order the rules were added (canceled rules too)
+    const std::vector<CallbackLatency> &callback_latencies() const { return _callback_latencies; }
+
+    //! Destroying the io_uring (with Backend::IOUring) drops its outstanding poll requests
+    ~EventLoop();
+
+    //! \name
+    //! An EventLoop can be moved but not copied
+
+    //!@{
+    EventLoop(EventLoop &&other) noexcept;
+    EventLoop &operator=(EventLoop &&other) noexcept;
+    EventLoop(const EventLoop &other) = delete;
+    EventLoop &operator=(const EventLoop &other) = delete;
+    //!@}
 };
 
 using Direction = EventLoop::Direction;
@@ -72,5 +139,15 @@ using Direction = EventLoop::Direction;
 //! A Rule installed using EventLoop::add_cancelable_rule will be polled and canceled under the
 //! same conditions, with the additional condition that if Rule::callback returns `true`, the
 //! Rule will be canceled.
+//!
+//! With Backend::IOUring, the EventLoop doesn't hand every fd to the kernel on each wait. Instead it
+//! keeps a one-shot poll request armed in an io_uring for each interested Rule, and each wait submits
+//! requests only for the rules whose previous request has completed, and collects the completions, in
+//! a single [io_uring_enter(2)](\ref man2::io_uring_enter). The kernel's work per wait is proportional
+//! to the number of ready fds rather than to the number of rules. A one-shot request completes at once
+//! if its fd is already ready, so events are level-triggered just as with poll(2), and callbacks behave
+//! the same with either backend. The backend is chosen when the EventLoop is constructed (by default
+//! from the `SPONGE_EVENTLOOP` environment variable); if io_uring is unavailable (an old kernel, or
+//! one with io_uring disabled), the EventLoop falls back to poll(2).
 
 #endif  // SPONGE_LIBSPONGE_EVENTLOOP_HH
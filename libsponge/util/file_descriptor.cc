@@ -63,6 +63,25 @@ void FileDescriptor::read(std::string &str, const size_t limit) {
     register_read();
 }
 
+//! \param[in] pool supplies the storage, so nothing is allocated or zero-filled per read
+//! \param[in] limit is the maximum number of bytes to read; fewer bytes may be returned
+//! \returns a Buffer holding the bytes read, which returns its slab to `pool` when it is gone
+Buffer FileDescriptor::read(BufferPool &pool, const size_t limit) {
+    BufferPool::Slab slab = pool.acquire();
+    const size_t size_to_read = min(slab.size(), limit);
+
+    ssize_t bytes_read = SystemCall("read", ::read(fd_num(), slab.data(), size_to_read));
+    if (limit > 0 && bytes_read == 0) {
+        _internal_fd->_eof = true;
+    }
+    if (bytes_read > static_cast<ssize_t>(size_to_read)) {
+        throw runtime_error("read() read more than requested");
+    }
+
+    register_read();
+    return move(slab).freeze(bytes_read);
+}
+
 //! \param[in] limit is the maximum number of bytes to read; fewer bytes may be returned
 //! \returns a vector of bytes read
 string FileDescriptor::read(const size_t limit) {
@@ -77,9 +96,8 @@ size_t FileDescriptor::write(BufferViewList buffer, const bool write_all) {
     size_t total_bytes_written = 0;
 
     do {
-        auto iovecs = buffer.as_iovecs();
-
-        const ssize_t bytes_written = SystemCall("writev", ::writev(fd_num(), iovecs.data(), iovecs.size()));
+        const ssize_t bytes_written =
+            SystemCall("writev", ::writev(fd_num(), buffer.iovecs(), static_cast<int>(buffer.iovec_count())));
         if (bytes_written == 0 and buffer.size() != 0) {
             throw runtime_error("write returned 0 given non-empty input buffer");
         }
@@ -0,0 +1,88 @@
+#include "io_uring.hh"
+
+#include "util.hh"
+
+#include <cstring>
+#include <ctime>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+using namespace std;
+
+IOUring::Mapping::Mapping(const FileDescriptor &fd, const size_t len, const uint64_t offset)
+    : addr(::mmap(nullptr, len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd.fd_num(), offset))
+    , length(len) {
+    if (addr == MAP_FAILED) {
+        addr = nullptr;
+        throw unix_error("mmap");
+    }
+}
+
+IOUring::Mapping::~Mapping() {
+    if (addr) {
+        ::munmap(addr, length);
+    }
+}
+
+//! Call [io_uring_setup(2)](\ref man2::io_uring_setup), filling in `params`
+static int setup_ring(const unsigned entries, io_uring_params &params) {
+    return SystemCall("io_uring_setup", static_cast<int>(::syscall(__NR_io_uring_setup, entries, &params)));
+}
+
+//! \param[in] entries is rounded up to a power of two by the kernel
+//! \throws unix_error if the kernel doesn't support io_uring (or it has been disabled)
+IOUring::IOUring(const unsigned entries)
+    : _params()
+    , _fd(setup_ring(entries, _params))
+    , _sq_ring(_fd, _params.sq_off.array + _params.sq_entries * sizeof(unsigned), IORING_OFF_SQ_RING)
+    , _cq_ring(_fd, _params.cq_off.cqes + _params.cq_entries * sizeof(io_uring_cqe), IORING_OFF_CQ_RING)
+    , _sqes(_fd, _params.sq_entries * sizeof(io_uring_sqe), IORING_OFF_SQES)
+    , _sq_flags(_sq_ring.at<unsigned>(_params.sq_off.flags))
+    , _sq_head(_sq_ring.at<unsigned>(_params.sq_off.head))
+    , _sq_tail(_sq_ring.at<unsigned>(_params.sq_off.tail))
+    , _sq_array(_sq_ring.at<unsigned>(_params.sq_off.array))
+    , _sqe(_sqes.at<io_uring_sqe>(0))
+    , _cq_head(_cq_ring.at<unsigned>(_params.cq_off.head))
+    , _cq_tail(_cq_ring.at<unsigned>(_params.cq_off.tail))
+    , _cqes(_cq_ring.at<io_uring_cqe>(_params.cq_off.cqes))
+    , _next_tail(*_sq_tail) {}
+
+unsigned IOUring::_sq_space() const {
+    return _params.sq_entries - (_next_tail - __atomic_load_n(_sq_head, __ATOMIC_ACQUIRE));
+}
+
+io_uring_sqe &IOUring::next_sqe() {
+    if (_sq_space() == 0) {
+        enter(0);
+    }
+
+    const unsigned index = _next_tail & (_params.sq_entries - 1);
+    _sq_array[index] = index;
+    ++_next_tail;
+
+    io_uring_sqe &sqe = _sqe[index];
+    memset(&sqe, 0, sizeof(sqe));
+    return sqe;
+}
+
+//! \details Calls [io_uring_enter(2)](\ref man2::io_uring_enter), which also flushes any completions
+//! that overflowed the completion queue. A wait that times out (`ETIME`) is not an error; the caller
+//! sees it as an empty completion queue.
+void IOUring::enter(const unsigned min_complete, const int timeout_ms) {
+    __atomic_store_n(_sq_tail, _next_tail, __ATOMIC_RELEASE);
+    const unsigned to_submit = _next_tail - __atomic_load_n(_sq_head, __ATOMIC_ACQUIRE);
+
+    unsigned flags = IORING_ENTER_GETEVENTS;
+    __kernel_timespec timeout{timeout_ms / 1000, (timeout_ms % 1000) * 1000000LL};
+    io_uring_getevents_arg arg{};
+    if (min_complete > 0 and timeout_ms >= 0) {
+        flags |= IORING_ENTER_EXT_ARG;
+        arg.ts = reinterpret_cast<uint64_t>(&timeout);
+    }
+
+    const void *argp = (flags & IORING_ENTER_EXT_ARG) ? &arg : nullptr;
+    const size_t argsz = argp ? sizeof(arg) : 0;
+    const long ret = ::syscall(__NR_io_uring_enter, _fd.fd_num(), to_submit, min_complete, flags, argp, argsz);
+    SystemCall("io_uring_enter", static_cast<int>(ret), ETIME);
+}
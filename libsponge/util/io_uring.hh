@@ -0,0 +1,117 @@
+#ifndef SPONGE_LIBSPONGE_IO_URING_HH
+#define SPONGE_LIBSPONGE_IO_URING_HH
+
+#include "file_descriptor.hh"
+
+#include <cstddef>
+#include <cstdint>
+#include <linux/io_uring.h>
+
+//! \brief A minimal [io_uring(7)](\ref man7::io_uring) instance: a submission queue and a completion queue
+//! shared with the kernel
+//! \details Entries are queued with next_sqe(), handed to the kernel (and waited for) with enter(), and
+//! their results are consumed with for_each_completion(). Only the raw system calls are used, so there
+//! is no dependency on liburing.
+class IOUring {
+  private:
+    //! A region of memory shared with the kernel by [mmap(2)](\ref man2::mmap)
+    class Mapping {
+      public:
+        void *addr = nullptr;  //!< Start of the region
+        size_t length = 0;     //!< Size of the region, in bytes
+
+        //! Map `len` bytes of `fd` at `offset`
+        Mapping(const FileDescriptor &fd, const size_t len, const uint64_t offset);
+        //! Unmaps the region
+        ~Mapping();
+
+        //! The byte at `offset` in the region, as a `T`
+        template <typename T>
+        T *at(const uint32_t offset) const {
+            return reinterpret_cast<T *>(static_cast<char *>(addr) + offset);
+        }
+
+        //! \name
+        //! A Mapping cannot be copied or moved
+
+        //!@{
+        Mapping(const Mapping &other) = delete;
+        Mapping &operator=(const Mapping &other) = delete;
+        Mapping(Mapping &&other) = delete;
+        Mapping &operator=(Mapping &&other) = delete;
+        //!@}
+    };
+
+    io_uring_params _params;  //!< Parameters (including the supported features) returned by the kernel
+    FileDescriptor _fd;       //!< The ring itself
+    Mapping _sq_ring;         //!< Head, tail and index array of the submission queue
+    Mapping _cq_ring;         //!< Head, tail and entries of the completion queue
+    Mapping _sqes;            //!< The submission queue entries
+
+    unsigned *_sq_flags;  //!< `IORING_SQ_*` flags set by the kernel
+    unsigned *_sq_head;   //!< Next submission to be consumed by the kernel
+    unsigned *_sq_tail;   //!< One past the newest submission published to the kernel (written only by us)
+    unsigned *_sq_array;  //!< Indices into _sqes, in submission order
+    io_uring_sqe *_sqe;   //!< The submission queue entries
+    unsigned *_cq_head;   //!< Next completion to be consumed (written only by us)
+    unsigned *_cq_tail;   //!< One past the newest completion posted by the kernel
+    io_uring_cqe *_cqes;  //!< The completion queue entries
+    unsigned _next_tail;  //!< One past the newest submission handed out by next_sqe(), published by enter()
+
+    //! Number of free slots in the submission queue
+    unsigned _sq_space() const;
+
+  public:
+    //! Set up a ring with room for (at least) `entries` submissions
+    explicit IOUring(const unsigned entries);
+
+    //! The `IORING_FEAT_*` flags supported by the kernel
+    uint32_t features() const { return _params.features; }
+
+    //! \brief A cleared submission queue entry, to be filled in by the caller
+    //! \details If the submission queue is full, the queued entries are first handed to the kernel.
+    io_uring_sqe &next_sqe();
+
+    //! \brief Submit the queued entries, and wait for at least `min_complete` completions
+    //! \param[in] min_complete is the number of completions to wait for (possibly 0)
+    //! \param[in] timeout_ms is the most time to wait, in milliseconds (negative for no limit)
+    //! \note Waiting with a timeout requires `IORING_FEAT_EXT_ARG`.
+    void enter(const unsigned min_complete, const int timeout_ms = -1);
+
+    //! \brief Call `f(const io_uring_cqe &)` on every posted completion, oldest first, and consume them
+    //! \details Completions that overflowed the completion queue are included.
+    template <typename F>
+    size_t for_each_completion(F &&f);
+
+    //! \name
+    //! An IOUring points into its own mappings, so it cannot be copied or moved
+
+    //!@{
+    IOUring(const IOUring &other) = delete;
+    IOUring &operator=(const IOUring &other) = delete;
+    IOUring(IOUring &&other) = delete;
+    IOUring &operator=(IOUring &&other) = delete;
+    //!@}
+};
+
+template <typename F>
+size_t IOUring::for_each_completion(F &&f) {
+    size_t count = 0;
+    while (true) {
+        const unsigned tail = __atomic_load_n(_cq_tail, __ATOMIC_ACQUIRE);
+        for (unsigned head = *_cq_head; head != tail; ++head, ++count) {
+            // consume the entry before calling `f`, so that it isn't seen twice if `f` throws
+            const io_uring_cqe cqe = _cqes[head & (_params.cq_entries - 1)];
+            __atomic_store_n(_cq_head, head + 1, __ATOMIC_RELEASE);
+            f(cqe);
+        }
+
+        // the kernel holds on to completions that didn't fit, until it is entered again
+        if (not(__atomic_load_n(_sq_flags, __ATOMIC_ACQUIRE) & IORING_SQ_CQ_OVERFLOW)) {
+            return count;
+        }
+        enter(0);
+    }
+}
+
+#endif  // SPONGE_LIBSPONGE_IO_URING_HH
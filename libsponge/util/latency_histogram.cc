@@ -0,0 +1,55 @@
+#include "latency_histogram.hh"
+
+#include <algorithm>
+#include <cmath>
+#include <sstream>
+
+using namespace std;
+
+uint64_t LatencyHistogram::_highest_in(const size_t bucket) {
+    if (bucket < SUB_BUCKETS) {
+        return bucket;
+    }
+    const size_t shift = (bucket - SUB_BUCKETS) / HALF_SUB_BUCKETS + 1;
+    const uint64_t mantissa = HALF_SUB_BUCKETS + (bucket - SUB_BUCKETS) % HALF_SUB_BUCKETS;
+    return ((mantissa + 1) << shift) - 1;
+}
+
+void LatencyHistogram::merge(const LatencyHistogram &other) {
+    if (other._count == 0) {
+        return;
+    }
+    _counts.resize(BUCKETS);
+    for (size_t i = 0; i < BUCKETS; ++i) {
+        _counts[i] += other._counts[i];
+    }
+    _count += other._count;
+    _sum += other._sum;
+    _min = std::min(_min, other._min);
+    _max = std::max(_max, other._max);
+}
+
+//! \param[in] percentile is between 0 and 100
+uint64_t LatencyHistogram::percentile(const double percentile) const {
+    if (_count == 0) {
+        return 0;
+    }
+    const auto rank =
+        std::max<uint64_t>(1, static_cast<uint64_t>(ceil(percentile / 100 * static_cast<double>(_count))));
+    uint64_t seen = 0;
+    for (size_t i = 0; i < BUCKETS; ++i) {
+        seen += _counts[i];
+        if (seen >= rank) {
+            // the last bucket also holds the values too large to track
+            return i == BUCKETS - 1 ? _max : std::min(_highest_in(i), _max);
+        }
+    }
+    return _max;
+}
+
+string LatencyHistogram::to_string() const {
+    ostringstream ss;
+    ss << "n=" << count() << " min=" << min() << " p50=" << percentile(50) << " p90=" << percentile(90)
+       << " p99=" << percentile(99) << " p99.9=" << percentile(99.9) << " max=" << max();
+    return ss.str();
+}
@@ -0,0 +1,85 @@
+#ifndef SPONGE_LIBSPONGE_LATENCY_HISTOGRAM_HH
+#define SPONGE_LIBSPONGE_LATENCY_HISTOGRAM_HH
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+//! \brief A histogram of latencies (or any non-negative integers) with a bounded relative error, in the style of
+//! HdrHistogram
+//! \details Values below 2^SUB_BUCKET_BITS are counted exactly. Above that, each power of two is split into
+//! 2^(SUB_BUCKET_BITS - 1) equal buckets, so a value is reported to within 1 part in 2^(SUB_BUCKET_BITS - 1)
+//! (about 3%). Values up to 2^MAX_VALUE_BITS - 1 are tracked (nanoseconds up to about a minute); larger
+//! values are counted in the last bucket, and still reflected in max(). The buckets (8 KiB) are allocated
+//! when the first value is recorded; after that, recording a value is a few instructions.
+class LatencyHistogram {
+  public:
+    static constexpr unsigned SUB_BUCKET_BITS = 6;
+    static constexpr unsigned MAX_VALUE_BITS = 36;
+
+  private:
+    static constexpr size_t SUB_BUCKETS = size_t{1} << SUB_BUCKET_BITS;
+    static constexpr size_t HALF_SUB_BUCKETS = SUB_BUCKETS / 2;
+    static constexpr size_t BUCKETS = SUB_BUCKETS + (MAX_VALUE_BITS - SUB_BUCKET_BITS) * HALF_SUB_BUCKETS;
+
+    std::vector<uint64_t> _counts{};  //!< Count of each bucket (empty until a value is recorded)
+    uint64_t _count = 0;
+    uint64_t _sum = 0;
+    uint64_t _min = UINT64_MAX;
+    uint64_t _max = 0;
+
+    //! The bucket that counts `value`
+    static size_t _bucket(const uint64_t value) {
+        if (value < SUB_BUCKETS) {
+            return value;
+        }
+        const unsigned msb = 63 - __builtin_clzll(value);
+        if (msb >= MAX_VALUE_BITS) {
+            return BUCKETS - 1;
+        }
+        // the top SUB_BUCKET_BITS - 1 bits below the most significant one pick the bucket within its power of two
+        const unsigned shift = msb - (SUB_BUCKET_BITS - 1);
+        return SUB_BUCKETS + (shift - 1) * HALF_SUB_BUCKETS + ((value >> shift) - HALF_SUB_BUCKETS);
+    }
+
+    //! The largest value counted by `bucket`
+    static uint64_t _highest_in(const size_t bucket);
+
+  public:
+    //! Count one occurrence of `value`
+    void record(const uint64_t value) {
+        if (_counts.empty()) {
+            _counts.resize(BUCKETS);
+        }
+        _counts[_bucket(value)]++;
+        _count++;
+        _sum += value;
+        _min = value < _min ? value : _min;
+        _max = value > _max ? value : _max;
+    }
+
+    //! Add the counts of `other`
+    void merge(const LatencyHistogram &other);
+
+    //! Forget every value recorded
+    void reset() { *this = {}; }
+
+    //! \name Summaries
+    //!@{
+    uint64_t count() const { return _count; }
+    uint64_t min() const { return _count ? _min : 0; }
+    uint64_t max() const { return _max; }
+    double mean() const { return _count ? static_cast<double>(_sum) / static_cast<double>(_count) : 0; }
+
+    //! \brief The value that `percentile` percent of the recorded values are at most (e.g. 99.9 for p999)
+    //! \returns the highest value of the bucket that holds that value (but no more than max()), or 0 if nothing
+    //! was recorded
+    uint64_t percentile(const double percentile) const;
+
+    //! A one-line summary, e.g. "n=1000 min=812 p50=1567 p90=2431 p99=5119 p99.9=10239 max=12003"
+    std::string to_string() const;
+    //!@}
+};
+
+#endif  // SPONGE_LIBSPONGE_LATENCY_HISTOGRAM_HH
@@ -0,0 +1,42 @@
+#include "mapped_file.hh"
+
+#include "util.hh"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+using namespace std;
+
+MappedFile::MappedFile(const FileDescriptor &fd, const size_t length)
+    : _addr(::mmap(nullptr, length, PROT_READ, MAP_SHARED, fd.fd_num(), 0))
+    , _length(length)
+    , _storage(static_cast<char *>(_addr), length, *this) {
+    if (_addr == MAP_FAILED) {
+        throw unix_error("mmap");
+    }
+    // a file is usually sent front to back, so let the kernel read ahead aggressively
+    ::madvise(_addr, _length, MADV_SEQUENTIAL);
+}
+
+void MappedFile::recycle(BufferStorage *) {
+    ::munmap(_addr, _length);
+    delete this;
+}
+
+//! \param[in] path is the file to map
+Buffer MappedFile::map(const string &path) {
+    const FileDescriptor fd{SystemCall("open", ::open(path.c_str(), O_RDONLY | O_CLOEXEC))};
+    struct stat st {};
+    SystemCall("fstat", ::fstat(fd.fd_num(), &st));
+    if (not S_ISREG(st.st_mode)) {
+        throw runtime_error("MappedFile: " + path + " is not a regular file");
+    }
+    if (st.st_size == 0) {
+        return {};
+    }
+
+    // the mapping outlives `fd`
+    auto *file = new MappedFile(fd, st.st_size);
+    return {&file->_storage, file->_length};
+}
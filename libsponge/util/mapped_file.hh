@@ -0,0 +1,44 @@
+#ifndef SPONGE_LIBSPONGE_MAPPED_FILE_HH
+#define SPONGE_LIBSPONGE_MAPPED_FILE_HH
+
+#include "buffer.hh"
+#include "file_descriptor.hh"
+
+#include <cstddef>
+#include <string>
+
+//! \brief A read-only [mmap(2)](\ref man2::mmap) of a whole file, whose bytes are shared as Buffers
+//! \details Nothing is read up front: the kernel pages the file in as the bytes are first touched
+//! (e.g. when a segment holding them is checksummed and sent), and any segment that is retransmitted
+//! reads them from the mapping again. The mapping lasts until the last Buffer sharing it is gone.
+//! \note The file should not be truncated while it is mapped.
+class MappedFile : public BufferRecycler {
+  private:
+    void *_addr;             //!< Start of the mapping
+    size_t _length;          //!< Size of the mapping (and the file)
+    BufferStorage _storage;  //!< Header shared by the Buffers that refer to the mapping
+
+    //! Map the first `length` bytes of `fd`
+    MappedFile(const FileDescriptor &fd, const size_t length);
+
+    //! Unmaps the file once the last Buffer is gone
+    void recycle(BufferStorage *storage) override;
+
+  public:
+    //! \brief A Buffer holding the whole of the file at `path`
+    //! \returns an empty Buffer for an empty file
+    static Buffer map(const std::string &path);
+
+    //! \name
+    //! A MappedFile cannot be copied or moved
+
+    //!@{
+    MappedFile(const MappedFile &other) = delete;
+    MappedFile &operator=(const MappedFile &other) = delete;
+    MappedFile(MappedFile &&other) = delete;
+    MappedFile &operator=(MappedFile &&other) = delete;
+    ~MappedFile() override = default;
+    //!@}
+};
+
+#endif  // SPONGE_LIBSPONGE_MAPPED_FILE_HH
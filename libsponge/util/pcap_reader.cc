@@ -0,0 +1,126 @@
+#include "pcap_reader.hh"
+
+#include "mapped_file.hh"
+
+#include <cstring>
+#include <stdexcept>
+
+using namespace std;
+
+//! \name The magic numbers that start a capture
+//!@{
+static constexpr uint32_t MAGIC_MICROSECONDS = 0xa1b2c3d4;
+static constexpr uint32_t MAGIC_NANOSECONDS = 0xa1b23c4d;
+static constexpr uint32_t MAGIC_PCAPNG = 0x0a0d0d0a;  //!< a pcapng Section Header Block (the same either way round)
+//!@}
+
+static constexpr size_t FILE_HEADER_LENGTH = 24;
+static constexpr size_t RECORD_HEADER_LENGTH = 16;
+
+static constexpr uint16_t ETHERTYPE_IPV4 = 0x0800;
+static constexpr uint16_t ETHERTYPE_VLAN = 0x8100;
+
+//! The 16-bit field at `offset` in `bytes`, in network byte order
+static uint16_t be16(const string_view bytes, const size_t offset) {
+    return static_cast<uint16_t>((static_cast<uint8_t>(bytes[offset]) << 8) | static_cast<uint8_t>(bytes[offset + 1]));
+}
+
+uint32_t PcapReader::_u32(const Buffer &bytes, const size_t offset) const {
+    uint32_t value = 0;
+    memcpy(&value, bytes.str().data() + offset, sizeof(value));
+    return _swapped ? __builtin_bswap32(value) : value;
+}
+
+PcapReader::PcapReader(Buffer capture)
+    : _remaining(move(capture)), _swapped(false), _nanoseconds(false), _link_type(0) {
+    if (_remaining.size() < FILE_HEADER_LENGTH) {
+        throw runtime_error("PcapReader: too short to be a pcap file");
+    }
+    const uint32_t magic = _u32(_remaining, 0);
+    if (magic == MAGIC_PCAPNG) {
+        throw runtime_error("PcapReader: pcapng isn't supported (convert it with `editcap -F pcap`)");
+    } else if (magic == MAGIC_MICROSECONDS or magic == MAGIC_NANOSECONDS) {
+        _nanoseconds = magic == MAGIC_NANOSECONDS;
+    } else if (magic == __builtin_bswap32(MAGIC_MICROSECONDS) or magic == __builtin_bswap32(MAGIC_NANOSECONDS)) {
+        _swapped = true;
+        _nanoseconds = magic == __builtin_bswap32(MAGIC_NANOSECONDS);
+    } else {
+        throw runtime_error("PcapReader: not a pcap file");
+    }
+    // the upper bits hold FCS details, which don't matter here
+    _link_type = _u32(_remaining, 20) & 0xffff;
+    _remaining.remove_prefix(FILE_HEADER_LENGTH);
+}
+
+PcapReader PcapReader::open(const string &path) { return PcapReader{MappedFile::map(path)}; }
+
+optional<PcapPacket> PcapReader::next() {
+    if (_remaining.size() == 0) {
+        return {};
+    }
+    if (_remaining.size() < RECORD_HEADER_LENGTH) {
+        throw runtime_error("PcapReader: capture ends in a packet header");
+    }
+    const uint64_t seconds = _u32(_remaining, 0);
+    const uint64_t fraction = _u32(_remaining, 4);
+    const uint32_t captured_length = _u32(_remaining, 8);
+    PcapPacket packet;
+    packet.timestamp_ns = seconds * 1'000'000'000 + (_nanoseconds ? fraction : fraction * 1000);
+    packet.original_length = _u32(_remaining, 12);
+    if (_remaining.size() - RECORD_HEADER_LENGTH < captured_length) {
+        throw runtime_error("PcapReader: capture ends in a packet");
+    }
+    packet.data = _remaining.substr(RECORD_HEADER_LENGTH, captured_length);
+    _remaining.remove_prefix(RECORD_HEADER_LENGTH + captured_length);
+    return packet;
+}
+
+optional<Buffer> PcapReader::ipv4_datagram(const PcapPacket &packet) const {
+    const string_view bytes = packet.data.str();
+    size_t offset = 0;
+    switch (_link_type) {
+        case Null: {
+            // AF_INET is 2 everywhere, whichever byte order the capturing host wrote it in
+            if (bytes.size() < 4 or (bytes[0] != 2 and bytes[3] != 2)) {
+                return {};
+            }
+            offset = 4;
+        } break;
+        case Ethernet: {
+            offset = 14;
+            if (bytes.size() >= 18 and be16(bytes, 12) == ETHERTYPE_VLAN) {
+                offset = 18;
+            }
+            if (bytes.size() < offset or be16(bytes, offset - 2) != ETHERTYPE_IPV4) {
+                return {};
+            }
+        } break;
+        case LinuxSLL: {
+            if (bytes.size() < 16 or be16(bytes, 14) != ETHERTYPE_IPV4) {
+                return {};
+            }
+            offset = 16;
+        } break;
+        case LinuxSLL2: {
+            if (bytes.size() < 20 or be16(bytes, 0) != ETHERTYPE_IPV4) {
+                return {};
+            }
+            offset = 20;
+        } break;
+        case Raw:
+        case IPv4:
+            break;
+        default:
+            return {};
+    }
+
+    // drop any link-layer padding (e.g. of a short Ethernet frame) after the datagram
+    if (bytes.size() < offset + 4 or (static_cast<uint8_t>(bytes[offset]) >> 4) != 4) {
+        return {};
+    }
+    const size_t total_length = be16(bytes, offset + 2);
+    if (bytes.size() - offset < total_length) {
+        return {};
+    }
+    return packet.data.substr(offset, total_length);
+}
@@ -0,0 +1,64 @@
+#ifndef SPONGE_LIBSPONGE_PCAP_READER_HH
+#define SPONGE_LIBSPONGE_PCAP_READER_HH
+
+#include "buffer.hh"
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string>
+
+//! One packet of a capture
+struct PcapPacket {
+    uint64_t timestamp_ns = 0;     //!< When it was captured, in nanoseconds since the epoch
+    uint32_t original_length = 0;  //!< Its length on the wire (more than `data.size()` if the capture cut it short)
+    Buffer data{};                 //!< The bytes captured, starting with the link-layer header
+};
+
+//! \brief Reads the packets of a capture in the classic [pcap](https://www.tcpdump.org/manpages/pcap-savefile.5.txt)
+//! file format, as saved by tcpdump or Wireshark
+//! \details Both byte orders and both microsecond and nanosecond timestamps are understood; pcapng is not (convert
+//! with `editcap -F pcap`). The packets share the capture's Buffer, so reading one copies nothing.
+class PcapReader {
+  public:
+    //! The link-layer header types that ipv4_datagram() understands
+    enum LinkType : uint32_t {
+        Null = 0,         //!< BSD loopback: the address family, in the capturing host's byte order
+        Ethernet = 1,     //!< Ethernet II, possibly with one 802.1Q tag
+        Raw = 101,        //!< No link-layer header
+        LinuxSLL = 113,   //!< Linux "cooked" capture (`tcpdump -i any`)
+        IPv4 = 228,       //!< No link-layer header, and only IPv4
+        LinuxSLL2 = 276,  //!< Linux "cooked" capture, version 2
+    };
+
+  private:
+    Buffer _remaining;  //!< The records not yet read
+    bool _swapped;      //!< The capture's byte order isn't ours
+    bool _nanoseconds;  //!< Timestamps' fractions are nanoseconds (not microseconds)
+    uint32_t _link_type;
+
+    //! The 32-bit field at `offset` in `bytes`, in the capture's byte order
+    uint32_t _u32(const Buffer &bytes, const size_t offset) const;
+
+  public:
+    //! \brief Read the file header of `capture`
+    //! \throws std::runtime_error if it isn't a pcap file
+    explicit PcapReader(Buffer capture);
+
+    //! A PcapReader of the file at `path`, which is mapped rather than read
+    static PcapReader open(const std::string &path);
+
+    //! The link-layer header type of every packet
+    uint32_t link_type() const { return _link_type; }
+
+    //! \brief The next packet
+    //! \returns std::nullopt at the end of the capture
+    //! \throws std::runtime_error if the capture ends in the middle of a packet
+    std::optional<PcapPacket> next();
+
+    //! \brief The IPv4 datagram that `packet` carries, without its link-layer header or padding
+    //! \returns std::nullopt if the packet doesn't carry IPv4, or the capture cut the datagram short
+    std::optional<Buffer> ipv4_datagram(const PcapPacket &packet) const;
+};
+
+#endif  // SPONGE_LIBSPONGE_PCAP_READER_HH
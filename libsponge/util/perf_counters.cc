@@ -0,0 +1,102 @@
+#include "perf_counters.hh"
+
+#include "util.hh"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+using namespace std;
+
+//! The perf_event `config` of each PerfCounters::Counter (all of type PERF_TYPE_HARDWARE)
+static constexpr array<uint64_t, PerfCounters::COUNT> EVENTS = {
+    PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS, PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES};
+
+PerfCounters::PerfCounters() {
+    for (size_t i = 0; i < COUNT; ++i) {
+        perf_event_attr attr{};
+        attr.size = sizeof(attr);
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.config = EVENTS[i];
+        attr.disabled = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+        // the calling thread, on any CPU
+        const auto fd = static_cast<int>(::syscall(SYS_perf_event_open, &attr, 0, -1, -1, PERF_FLAG_FD_CLOEXEC));
+        if (fd >= 0) {
+            _fds[i].emplace(fd);
+        } else if (_error.empty()) {
+            _error = string("perf_event_open (") + name(static_cast<Counter>(i)) + "): " + strerror(errno);
+        }
+    }
+}
+
+bool PerfCounters::available() const {
+    return any_of(_fds.begin(), _fds.end(), [](const auto &fd) { return fd.has_value(); });
+}
+
+void PerfCounters::start() {
+    for (const auto &fd : _fds) {
+        if (fd.has_value()) {
+            SystemCall("ioctl(PERF_EVENT_IOC_ENABLE)", ::ioctl(fd->fd_num(), PERF_EVENT_IOC_ENABLE, 0));
+        }
+    }
+}
+
+void PerfCounters::stop() {
+    for (const auto &fd : _fds) {
+        if (fd.has_value()) {
+            SystemCall("ioctl(PERF_EVENT_IOC_DISABLE)", ::ioctl(fd->fd_num(), PERF_EVENT_IOC_DISABLE, 0));
+        }
+    }
+}
+
+void PerfCounters::reset() {
+    for (const auto &fd : _fds) {
+        if (fd.has_value()) {
+            SystemCall("ioctl(PERF_EVENT_IOC_RESET)", ::ioctl(fd->fd_num(), PERF_EVENT_IOC_RESET, 0));
+        }
+    }
+}
+
+//! \details A counter that was never scheduled onto the CPU (e.g. because others took all the
+//! hardware counters) reads as std::nullopt.
+PerfCounters::Values PerfCounters::read() const {
+    Values values{};
+    for (size_t i = 0; i < COUNT; ++i) {
+        if (not _fds[i].has_value()) {
+            continue;
+        }
+        // the value, the time enabled and the time running
+        array<uint64_t, 3> data{};
+        SystemCall("read", ::read(_fds[i]->fd_num(), data.data(), sizeof(data)));
+        if (data[2] > 0) {
+            values[i] = static_cast<double>(data[0]) * static_cast<double>(data[1]) / static_cast<double>(data[2]);
+        } else if (data[1] == 0) {
+            values[i] = 0;  // never enabled
+        }
+    }
+    return values;
+}
+
+const char *PerfCounters::name(const Counter counter) {
+    switch (counter) {
+        case Cycles:
+            return "cycles";
+        case Instructions:
+            return "instructions";
+        case LLCMisses:
+            return "llc_misses";
+        case BranchMisses:
+            return "branch_misses";
+        case COUNT:
+            break;
+    }
+    return "unknown";
+}
@@ -0,0 +1,61 @@
+#ifndef SPONGE_LIBSPONGE_PERF_COUNTERS_HH
+#define SPONGE_LIBSPONGE_PERF_COUNTERS_HH
+
+#include "file_descriptor.hh"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string>
+
+//! \brief The calling thread's hardware performance counters, read via [perf_event_open(2)](\ref man2::perf_event_open)
+//! \details Counts user-space events only (so it works with `perf_event_paranoid` up to 2). Counters
+//! that can't be opened (perf events aren't permitted, or the CPU or hypervisor lacks the event) are
+//! left out, and read as std::nullopt; the rest still work. If the kernel has to multiplex the counters,
+//! their values are scaled up to the whole time they were enabled.
+class PerfCounters {
+  public:
+    //! The events counted
+    enum Counter : size_t {
+        Cycles,        //!< CPU cycles
+        Instructions,  //!< Instructions retired
+        LLCMisses,     //!< Last-level cache misses
+        BranchMisses,  //!< Mispredicted branches
+        COUNT
+    };
+
+    //! A value for each Counter (std::nullopt for those that aren't available)
+    using Values = std::array<std::optional<double>, COUNT>;
+
+  private:
+    std::array<std::optional<FileDescriptor>, COUNT> _fds{};
+    std::string _error{};  //!< Why the first counter that couldn't be opened wasn't
+
+  public:
+    //! Open the counters, stopped and at zero
+    PerfCounters();
+
+    //! Could any counter be opened?
+    bool available() const;
+
+    //! Why counters are missing (empty if they're all available)
+    const std::string &error() const { return _error; }
+
+    //! Start (or resume) counting
+    void start();
+
+    //! Stop counting
+    void stop();
+
+    //! Set the counters to zero
+    void reset();
+
+    //! The counts so far
+    Values read() const;
+
+    //! The name of `counter`, e.g. "llc_misses"
+    static const char *name(const Counter counter);
+};
+
+#endif  // SPONGE_LIBSPONGE_PERF_COUNTERS_HH
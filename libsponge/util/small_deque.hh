@@ -0,0 +1,100 @@
+#ifndef SPONGE_LIBSPONGE_SMALL_DEQUE_HH
+#define SPONGE_LIBSPONGE_SMALL_DEQUE_HH
+
+#include <array>
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+//! \brief A contiguous queue that holds up to `N` elements without allocating
+//! \details Elements are appended at the back and removed from the front, both in O(1). The first `N`
+//! live in an inline array; only a longer queue spills to the heap, and the heap block is kept (for
+//! the next spill) once the queue drains. Removed elements are reset to `T{}` right away, so that
+//! whatever they held is released. The elements are always contiguous, so data() can be handed to
+//! system calls directly.
+template <typename T, size_t N>
+class SmallDeque {
+  private:
+    std::array<T, N> _inline{};  //!< Storage while the queue fits
+    std::vector<T> _spilled{};   //!< Storage once it hasn't (empty until then)
+    size_t _head = 0;            //!< Index of the front element in the storage in use
+    size_t _tail = 0;            //!< One past the index of the back element
+
+    T *_storage() { return _spilled.empty() ? _inline.data() : _spilled.data(); }
+    const T *_storage() const { return _spilled.empty() ? _inline.data() : _spilled.data(); }
+
+  public:
+    //! Append `value`
+    void push_back(T value) {
+        if (_spilled.empty()) {
+            if (_tail == N and _head > 0) {
+                // make room by sliding the elements to the front of the array
+                std::move(_inline.begin() + _head, _inline.begin() + _tail, _inline.begin());
+                std::fill(_inline.begin() + (_tail - _head), _inline.begin() + _tail, T{});
+                _tail -= _head;
+                _head = 0;
+            }
+            if (_tail < N) {
+                _inline[_tail++] = std::move(value);
+                return;
+            }
+
+            _spilled.reserve(2 * N);
+            for (T &element : _inline) {
+                _spilled.push_back(std::exchange(element, T{}));
+            }
+        } else if (_head >= N and _head * 2 >= _tail) {
+            // the removed half of the heap block is wasted; reclaim it
+            _spilled.erase(_spilled.begin(), _spilled.begin() + _head);
+            _tail -= _head;
+            _head = 0;
+        }
+        _spilled.push_back(std::move(value));
+        ++_tail;
+    }
+
+    //! Remove the front element
+    void pop_front() {
+        _storage()[_head++] = T{};
+        if (_head == _tail) {
+            clear();
+        }
+    }
+
+    //! Remove every element
+    void clear() {
+        if (_spilled.empty()) {
+            std::fill(_inline.begin() + _head, _inline.begin() + _tail, T{});
+        }
+        _spilled.clear();
+        _head = _tail = 0;
+    }
+
+    //! \name Element access
+    //!@{
+    T &front() { return data()[0]; }
+    const T &front() const { return data()[0]; }
+    T &back() { return data()[size() - 1]; }
+    const T &back() const { return data()[size() - 1]; }
+    T &operator[](const size_t i) { return data()[i]; }
+    const T &operator[](const size_t i) const { return data()[i]; }
+    T *data() { return _storage() + _head; }
+    const T *data() const { return _storage() + _head; }
+    //!@}
+
+    //! \name Iteration from front to back
+    //!@{
+    T *begin() { return data(); }
+    T *end() { return data() + size(); }
+    const T *begin() const { return data(); }
+    const T *end() const { return data() + size(); }
+    //!@}
+
+    //! Number of elements
+    size_t size() const { return _tail - _head; }
+
+    //! `true` if there are no elements
+    bool empty() const { return _head == _tail; }
+};
+
+#endif  // SPONGE_LIBSPONGE_SMALL_DEQUE_HH
@@ -2,7 +2,10 @@
 
 #include "util.hh"
 
+#include <cerrno>
 #include <cstddef>
+#include <cstring>
+#include <netinet/udp.h>
 #include <stdexcept>
 #include <unistd.h>
 
@@ -84,45 +87,139 @@ void Socket::shutdown(const int how) {
     }
 }
 
-//! \note If `mtu` is too small to hold the received datagram, this method throws a std::runtime_error
-void UDPSocket::recv(received_datagram &datagram, const size_t mtu) {
-    // receive source address and payload
-    Address::Raw datagram_source_address;
-    datagram.payload.resize(mtu);
+//! Room for the ancillary data that UDP_GRO attaches to a received message
+union GROControl {
+    char buf[CMSG_SPACE(sizeof(int))];  //!< The cmsghdr and its `int` payload
+    cmsghdr align;                      //!< Forces the alignment of a cmsghdr
+};
 
-    socklen_t fromlen = sizeof(datagram_source_address);
+//! Room for the ancillary data that tells UDP_SEGMENT how to split a sent message
+union GSOControl {
+    char buf[CMSG_SPACE(sizeof(uint16_t))];  //!< The cmsghdr and its `uint16_t` payload
+    cmsghdr align;                           //!< Forces the alignment of a cmsghdr
+};
+
+//! Point `message` at `mtu` bytes of `slab`, `source` and `control`
+static void prepare_recvmsg(msghdr &message,
+                            iovec &iov,
+                            BufferPool::Slab &slab,
+                            Address::Raw &source,
+                            GROControl &control,
+                            const size_t mtu) {
+    iov = {slab.data(), mtu};
+    message.msg_name = static_cast<sockaddr *>(source);
+    message.msg_namelen = sizeof(source.storage);
+    message.msg_iov = &iov;
+    message.msg_iovlen = 1;
+    message.msg_control = control.buf;
+    message.msg_controllen = sizeof(control.buf);
+}
 
-    const ssize_t recv_len = SystemCall(
-        "recvfrom",
-        ::recvfrom(
-            fd_num(), datagram.payload.data(), datagram.payload.size(), MSG_TRUNC, datagram_source_address, &fromlen));
+//! Fill in `datagram` from a message that recvmsg() or recvmmsg() has received into `slab`
+static void finish_recvmsg(msghdr &message,
+                           const size_t len,
+                           BufferPool::Slab &&slab,
+                           UDPSocket::received_datagram &datagram,
+                           const Address::Raw &source,
+                           const size_t mtu) {
+    if (len > mtu or (message.msg_flags & MSG_TRUNC)) {
+        throw runtime_error("recvmsg (oversized datagram)");
+    }
 
-    if (recv_len > ssize_t(mtu)) {
-        throw runtime_error("recvfrom (oversized datagram)");
+    datagram.source_address = {source, message.msg_namelen};
+    datagram.payload = move(slab).freeze(len);
+    datagram.segment_size = 0;
+    for (cmsghdr *cmsg = CMSG_FIRSTHDR(&message); cmsg; cmsg = CMSG_NXTHDR(&message, cmsg)) {
+        if (cmsg->cmsg_level == SOL_UDP and cmsg->cmsg_type == UDP_GRO) {
+            int segment_size = 0;
+            memcpy(&segment_size, CMSG_DATA(cmsg), sizeof(segment_size));
+            datagram.segment_size = segment_size < int(len) ? segment_size : 0;
+        }
     }
+}
+
+//! \note If `mtu` is too small to hold the received datagram, this method throws a std::runtime_error
+void UDPSocket::recv(received_datagram &datagram, const size_t mtu) {
+    // receive source address, payload, and (with UDP_GRO) the size of the coalesced datagrams
+    Address::Raw datagram_source_address;
+    GROControl control;
+    iovec iov{};
+    msghdr message{};
+    BufferPool::Slab slab = _rx_pool.acquire(mtu);
+    prepare_recvmsg(message, iov, slab, datagram_source_address, control, mtu);
+
+    const ssize_t recv_len = SystemCall("recvmsg", ::recvmsg(fd_num(), &message, MSG_TRUNC));
 
     register_read();
-    datagram.source_address = {datagram_source_address, fromlen};
-    datagram.payload.resize(recv_len);
+    finish_recvmsg(message, recv_len, move(slab), datagram, datagram_source_address, mtu);
 }
 
 UDPSocket::received_datagram UDPSocket::recv(const size_t mtu) {
-    received_datagram ret{{nullptr, 0}, ""};
+    received_datagram ret{{nullptr, 0}, {}, 0};
     recv(ret, mtu);
     return ret;
 }
 
+//! \details Never blocks: the call is meant for an EventLoop rule that has just seen the socket
+//! become readable, and it takes whatever has queued up since (at most `datagrams.size()`).
+//! \note If `mtu` is too small to hold a received datagram, this method throws a std::runtime_error
+size_t UDPSocket::recv_batch(vector<received_datagram> &datagrams, const size_t mtu) {
+    vector<Address::Raw> source_addresses(datagrams.size());
+    vector<GROControl> controls(datagrams.size());
+    vector<iovec> iovecs(datagrams.size());
+    vector<mmsghdr> messages(datagrams.size());
+
+    // slabs left unfilled are kept for the next call, so each call checks out only as many as it fills
+    while (_rx_slabs.size() < datagrams.size()) {
+        _rx_slabs.push_back(_rx_pool.acquire(mtu));
+    }
+
+    for (size_t i = 0; i < datagrams.size(); ++i) {
+        if (_rx_slabs[i].size() < mtu) {
+            _rx_slabs[i] = _rx_pool.acquire(mtu);
+        }
+        prepare_recvmsg(messages[i].msg_hdr, iovecs[i], _rx_slabs[i], source_addresses[i], controls[i], mtu);
+    }
+
+    const int count = SystemCall(
+        "recvmmsg", ::recvmmsg(fd_num(), messages.data(), messages.size(), MSG_DONTWAIT | MSG_TRUNC, nullptr), EAGAIN);
+
+    register_read();
+    const size_t received = count < 0 ? 0 : count;
+
+    for (size_t i = 0; i < received; ++i) {
+        finish_recvmsg(
+            messages[i].msg_hdr, messages[i].msg_len, move(_rx_slabs[i]), datagrams[i], source_addresses[i], mtu);
+    }
+    _rx_slabs.erase(_rx_slabs.begin(), _rx_slabs.begin() + received);
+
+    return received;
+}
+
+//! \details Once enabled, runs of datagrams from the same sender may arrive as one received_datagram,
+//! whose `segment_size` says where to split it.
+bool UDPSocket::enable_gro() {
+    const int one = 1;
+    return SystemCall("setsockopt", ::setsockopt(fd_num(), SOL_UDP, UDP_GRO, &one, sizeof(one)), ENOPROTOOPT) == 0;
+}
+
+//! \details Setting a default segment size of zero leaves the socket as it was, so this only
+//! probes whether the kernel knows the option.
+bool UDPSocket::supports_gso() {
+    const int zero = 0;
+    return SystemCall("setsockopt", ::setsockopt(fd_num(), SOL_UDP, UDP_SEGMENT, &zero, sizeof(zero)), ENOPROTOOPT) ==
+           0;
+}
+
 void sendmsg_helper(const int fd_num,
                     const sockaddr *destination_address,
                     const socklen_t destination_address_len,
                     const BufferViewList &payload) {
-    auto iovecs = payload.as_iovecs();
-
     msghdr message{};
     message.msg_name = const_cast<sockaddr *>(destination_address);
     message.msg_namelen = destination_address_len;
-    message.msg_iov = iovecs.data();
-    message.msg_iovlen = iovecs.size();
+    message.msg_iov = const_cast<iovec *>(payload.iovecs());
+    message.msg_iovlen = payload.iovec_count();
 
     const ssize_t bytes_sent = SystemCall("sendmsg", ::sendmsg(fd_num, &message, 0));
 
@@ -136,6 +233,57 @@ void UDPSocket::sendto(const Address &destination, const BufferViewList &payload
     register_write();
 }
 
+//! \details sendmmsg(2) may stop short of the whole batch, in which case it is called again with the rest.
+//! \param[in] destination is where every datagram goes
+//! \param[in] payloads holds one message each
+//! \param[in] segment_sizes is empty, or holds for each message the size of the datagrams into
+//! which the kernel should split it with [UDP_SEGMENT](\ref man7::udp) (zero to send it whole)
+//! \returns the number of messages sent, which is less than `payloads.size()` only if the kernel
+//! refused to split the next one (with EIO, when the route can't offload UDP checksums, or EINVAL,
+//! when a segment exceeds the path MTU); the caller may then resend it unsplit
+size_t UDPSocket::sendto_batch(const Address &destination,
+                               const vector<BufferViewList> &payloads,
+                               const vector<uint16_t> &segment_sizes) {
+    vector<GSOControl> controls(segment_sizes.size());
+    vector<mmsghdr> messages(payloads.size());
+
+    for (size_t i = 0; i < payloads.size(); ++i) {
+        messages[i].msg_hdr.msg_name = const_cast<sockaddr *>(static_cast<const sockaddr *>(destination));
+        messages[i].msg_hdr.msg_namelen = destination.size();
+        messages[i].msg_hdr.msg_iov = const_cast<iovec *>(payloads[i].iovecs());
+        messages[i].msg_hdr.msg_iovlen = payloads[i].iovec_count();
+
+        if (i < segment_sizes.size() and segment_sizes[i] > 0) {
+            messages[i].msg_hdr.msg_control = controls[i].buf;
+            messages[i].msg_hdr.msg_controllen = sizeof(controls[i].buf);
+            cmsghdr *cmsg = CMSG_FIRSTHDR(&messages[i].msg_hdr);
+            cmsg->cmsg_level = SOL_UDP;
+            cmsg->cmsg_type = UDP_SEGMENT;
+            cmsg->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+            memcpy(CMSG_DATA(cmsg), &segment_sizes[i], sizeof(uint16_t));
+        }
+    }
+
+    size_t sent = 0;
+    while (sent < messages.size()) {
+        const int count = ::sendmmsg(fd_num(), &messages[sent], messages.size() - sent, 0);
+        if (count < 0) {
+            if ((errno == EIO or errno == EINVAL) and messages[sent].msg_hdr.msg_control) {
+                break;
+            }
+            throw unix_error("sendmmsg");
+        }
+        for (int i = 0; i < count; ++i, ++sent) {
+            if (messages[sent].msg_len != payloads[sent].size()) {
+                throw runtime_error("datagram payload too big for sendmmsg()");
+            }
+        }
+    }
+
+    register_write();
+    return sent;
+}
+
 void UDPSocket::send(const BufferViewList &payload) {
     sendmsg_helper(fd_num(), nullptr, 0, payload);
     register_write();
@@ -8,6 +8,7 @@
 #include <functional>
 #include <string>
 #include <sys/socket.h>
+#include <vector>
 
 //! \brief Base class for network sockets (TCP, UDP, etc.)
 //! \details Socket is generally used via a subclass. See TCPSocket and UDPSocket for usage examples.
@@ -49,6 +50,10 @@ class Socket : public FileDescriptor {
 
 //! A wrapper around [UDP sockets](\ref man7::udp)
 class UDPSocket : public Socket {
+  private:
+    BufferPool _rx_pool{};                      //!< Slabs into which datagrams are received
+    std::vector<BufferPool::Slab> _rx_slabs{};  //!< Slabs checked out by recv_batch() but not yet filled
+
   protected:
     //! \brief Construct from FileDescriptor (used by TCPOverUDPSocketAdapter)
     //! \param[in] fd is the FileDescriptor from which to construct
@@ -58,21 +63,47 @@ class UDPSocket : public Socket {
     //! Default: construct an unbound, unconnected UDP socket
     UDPSocket() : Socket(AF_INET, SOCK_DGRAM) {}
 
+    //! Most datagrams the kernel will send from one UDP_SEGMENT message
+    static constexpr size_t MAX_GSO_SEGMENTS = 64;
+
+    //! Largest UDP payload (over IPv4), which bounds a UDP_SEGMENT message or a UDP_GRO buffer
+    static constexpr size_t MAX_PAYLOAD_SIZE = 65507;
+
     //! Returned by UDPSocket::recv; carries received data and information about the sender
     struct received_datagram {
         Address source_address;  //!< Address from which this datagram was received
-        std::string payload;     //!< UDP datagram payload
+        Buffer payload;          //!< UDP datagram payload (in a slab from the socket's BufferPool)
+        //! With UDP_GRO, the size of each of the datagrams coalesced into `payload` (the last may be
+        //! shorter); zero if `payload` is a single datagram
+        size_t segment_size = 0;
     };
 
+    //! \brief Ask the kernel to coalesce runs of received datagrams into one buffer ([UDP_GRO](\ref man7::udp))
+    //! \returns `false` if the kernel doesn't support it
+    bool enable_gro();
+
+    //! \brief Check whether the kernel can split one message into several datagrams ([UDP_SEGMENT](\ref man7::udp))
+    //! \returns `false` if the kernel doesn't support it
+    bool supports_gso();
+
     //! Receive a datagram and the Address of its sender
     received_datagram recv(const size_t mtu = 65536);
 
-    //! Receive a datagram and the Address of its sender (caller can allocate storage)
+    //! Receive a datagram and the Address of its sender (reusing `datagram`)
     void recv(received_datagram &datagram, const size_t mtu = 65536);
 
+    //! \brief Receive up to `datagrams.size()` waiting datagrams with one [recvmmsg(2)](\ref man2::recvmmsg)
+    //! \returns the number of datagrams received (filling the front of `datagrams`), which is zero if none are waiting
+    size_t recv_batch(std::vector<received_datagram> &datagrams, const size_t mtu = 65536);
+
     //! Send a datagram to specified Address
     void sendto(const Address &destination, const BufferViewList &payload);
 
+    //! Send several datagrams to specified Address with as few [sendmmsg(2)](\ref man2::sendmmsg) calls as possible
+    size_t sendto_batch(const Address &destination,
+                        const std::vector<BufferViewList> &payloads,
+                        const std::vector<uint16_t> &segment_sizes = {});
+
     //! Send datagram to the socket's connected address (must call connect() first)
     void send(const BufferViewList &payload);
 };
@@ -0,0 +1,212 @@
+#include "tracer.hh"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <stdexcept>
+
+using namespace std;
+
+//! First bytes of a trace file
+static constexpr char TRACE_MAGIC[8] = {'S', 'P', 'N', 'G', 'T', 'R', 'C', '1'};
+
+//! Size of a TraceEvent in a trace file: time, argument, thread, point, phase, and padding
+static constexpr size_t TRACE_RECORD_SIZE = 8 + 8 + 4 + 2 + 1 + 1;
+
+atomic<bool> Tracer::_enabled{getenv("SPONGE_TRACE") != nullptr};
+thread_local Tracer::Ring *Tracer::_ring = nullptr;
+
+//! The clocks when the tracer started, to turn ticks into nanoseconds
+static const uint64_t start_ticks = Tracer::ticks();
+static const chrono::steady_clock::time_point start_time = chrono::steady_clock::now();
+
+//! Saves the trace to the file named by SPONGE_TRACE
+static void save_at_exit() {
+    try {
+        Tracer::save(getenv("SPONGE_TRACE"), Tracer::snapshot());
+    } catch (const exception &e) {
+        cerr << "Tracer: " << e.what() << endl;
+    }
+}
+
+vector<unique_ptr<Tracer::Ring>> &Tracer::_rings() {
+    static vector<unique_ptr<Ring>> rings;
+    return rings;
+}
+
+mutex &Tracer::_rings_mutex() {
+    static mutex m;
+    return m;
+}
+
+Tracer::Ring &Tracer::_register() {
+    lock_guard<mutex> lock{_rings_mutex()};
+    if (_rings().empty() and getenv("SPONGE_TRACE")) {
+        atexit(save_at_exit);
+    }
+    _rings().push_back(make_unique<Ring>());
+    _ring = _rings().back().get();
+    _ring->thread = static_cast<uint32_t>(_rings().size());
+    return *_ring;
+}
+
+//! \details A ring is copied without stopping its thread, so a record may be overwritten as it is
+//! copied; comparing the ring's head before and after tells which records can be trusted.
+vector<TraceEvent> Tracer::snapshot() {
+    const uint64_t now_ticks = ticks();
+    const auto now_ns = chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - start_time).count();
+    const double ns_per_tick =
+        now_ticks > start_ticks ? static_cast<double>(now_ns) / static_cast<double>(now_ticks - start_ticks) : 1.0;
+
+    vector<TraceEvent> events;
+    lock_guard<mutex> lock{_rings_mutex()};
+    for (const auto &ring : _rings()) {
+        const uint64_t head = ring->head.load(memory_order_acquire);
+        const uint64_t first = head > RING_SIZE ? head - RING_SIZE : 0;
+        vector<Record> copy;
+        copy.reserve(head - first);
+        for (uint64_t i = first; i < head; ++i) {
+            copy.push_back(ring->records[i % RING_SIZE]);
+        }
+
+        // records the thread has made since (and the one it may be making) went into the slots of the
+        // oldest ones copied
+        const uint64_t reused = ring->head.load(memory_order_acquire) + 1;
+        const uint64_t lost = reused > first + RING_SIZE ? reused - first - RING_SIZE : 0;
+        for (uint64_t i = min<uint64_t>(lost, copy.size()); i < copy.size(); ++i) {
+            const Record &r = copy[i];
+            const auto since_start = static_cast<double>(static_cast<int64_t>(r.ticks - start_ticks));
+            const uint64_t time_ns = since_start > 0 ? static_cast<uint64_t>(since_start * ns_per_tick) : 0;
+            events.push_back({time_ns, r.arg, ring->thread, r.point, r.phase});
+        }
+    }
+
+    stable_sort(events.begin(), events.end(), [](const TraceEvent &a, const TraceEvent &b) {
+        return a.time_ns < b.time_ns;
+    });
+    return events;
+}
+
+void Tracer::clear() {
+    lock_guard<mutex> lock{_rings_mutex()};
+    for (const auto &ring : _rings()) {
+        ring->head.store(0, memory_order_release);
+    }
+}
+
+//! \details The file is the 8-byte magic number, then one 24-byte record per event, in host byte order.
+void Tracer::save(const string &path, const vector<TraceEvent> &events) {
+    ofstream out{path, ios::binary | ios::trunc};
+    if (not out) {
+        throw runtime_error("Tracer: cannot write " + path);
+    }
+    out.write(TRACE_MAGIC, sizeof(TRACE_MAGIC));
+    for (const auto &event : events) {
+        char record[TRACE_RECORD_SIZE]{};
+        memcpy(record, &event.time_ns, 8);
+        memcpy(record + 8, &event.arg, 8);
+        memcpy(record + 16, &event.thread, 4);
+        memcpy(record + 20, &event.point, 2);
+        memcpy(record + 22, &event.phase, 1);
+        out.write(record, sizeof(record));
+    }
+    if (not out.flush()) {
+        throw runtime_error("Tracer: error writing " + path);
+    }
+}
+
+vector<TraceEvent> Tracer::load(const string &path) {
+    ifstream in{path, ios::binary};
+    if (not in) {
+        throw runtime_error("Tracer: cannot read " + path);
+    }
+    char magic[sizeof(TRACE_MAGIC)]{};
+    if (not in.read(magic, sizeof(magic)) or memcmp(magic, TRACE_MAGIC, sizeof(magic)) != 0) {
+        throw runtime_error("Tracer: " + path + " is not a trace file");
+    }
+
+    vector<TraceEvent> events;
+    for (char record[TRACE_RECORD_SIZE]; in.read(record, sizeof(record));) {
+        TraceEvent event{};
+        memcpy(&event.time_ns, record, 8);
+        memcpy(&event.arg, record + 8, 8);
+        memcpy(&event.thread, record + 16, 4);
+        memcpy(&event.point, record + 20, 2);
+        memcpy(&event.phase, record + 22, 1);
+        if (static_cast<uint16_t>(event.point) > static_cast<uint16_t>(TracePoint::Tick)) {
+            throw runtime_error("Tracer: " + path + " has an unknown trace point");
+        }
+        events.push_back(event);
+    }
+    if (in.gcount() != 0) {
+        throw runtime_error("Tracer: " + path + " is truncated");
+    }
+    return events;
+}
+
+const char *Tracer::name(const TracePoint point) {
+    switch (point) {
+        case TracePoint::SegmentSent:
+            return "segment_sent";
+        case TracePoint::SegmentReceived:
+            return "segment_received";
+        case TracePoint::Retransmission:
+            return "retransmission";
+        case TracePoint::TimerFired:
+            return "timer_fired";
+        case TracePoint::Callback:
+            return "callback";
+        case TracePoint::ReassemblerInsert:
+            return "reassembler_insert";
+        case TracePoint::Tick:
+            return "tick";
+    }
+    return "unknown";
+}
+
+//! The `args` object of an event in Chrome's format
+static void write_args(ostream &out, const TraceEvent &event) {
+    switch (event.point) {
+        case TracePoint::SegmentSent:
+        case TracePoint::SegmentReceived:
+        case TracePoint::Retransmission:
+            out << R"({"seqno":)" << (event.arg >> 32) << R"(,"length":)" << (event.arg & 0xffffffff) << "}";
+            break;
+        case TracePoint::TimerFired:
+            out << R"({"rto_ms":)" << event.arg << "}";
+            break;
+        case TracePoint::Callback:
+            out << R"({"fd":)" << event.arg << "}";
+            break;
+        case TracePoint::ReassemblerInsert:
+            out << R"({"index":)" << event.arg << "}";
+            break;
+        case TracePoint::Tick:
+            out << R"({"ms":)" << event.arg << "}";
+            break;
+    }
+}
+
+//! \details Timestamps are in microseconds, with nanosecond precision; each thread is a track.
+void Tracer::write_chrome_json(ostream &out, const vector<TraceEvent> &events) {
+    const auto flags = out.flags();
+    out << R"({"displayTimeUnit":"ns","traceEvents":[)";
+    bool first = true;
+    for (const auto &event : events) {
+        out << (first ? "\n" : ",\n") << R"({"name":")" << name(event.point) << R"(","cat":"sponge","ph":")"
+            << static_cast<char>(event.phase) << R"(","ts":)" << event.time_ns / 1000 << "." << setfill('0')
+            << setw(3) << event.time_ns % 1000 << R"(,"pid":1,"tid":)" << event.thread;
+        if (event.phase == TracePhase::Instant) {
+            out << R"(,"s":"t")";
+        }
+        out << R"(,"args":)";
+        write_args(out, event);
+        out << "}";
+        first = false;
+    }
+    out << "\n]}\n";
+    out.flags(flags);
+}
@@ -0,0 +1,163 @@
+#ifndef SPONGE_LIBSPONGE_TRACER_HH
+#define SPONGE_LIBSPONGE_TRACER_HH
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+//! Where in the code a trace record was made
+enum class TracePoint : uint16_t {
+    SegmentSent,        //!< TCPConnection queued a segment (argument: seqno and payload length)
+    SegmentReceived,    //!< TCPConnection received a segment (argument: seqno and payload length)
+    Retransmission,     //!< TCPSender resent its earliest outstanding segment (argument: seqno and payload length)
+    TimerFired,         //!< TCPSender's retransmission timer expired (argument: the RTO, in ms)
+    Callback,           //!< An EventLoop callback ran (argument: the fd)
+    ReassemblerInsert,  //!< StreamReassembler::push_substring ran (argument: the substring's index)
+    Tick,               //!< TCPSpongeSocket ticked its TCPConnection (argument: ms since the last tick)
+};
+
+//! Whether a trace record marks a moment or the beginning or end of a span (as in Chrome's trace format)
+enum class TracePhase : char { Instant = 'i', Begin = 'B', End = 'E' };
+
+//! A trace record, as read back from the tracer
+struct TraceEvent {
+    uint64_t time_ns;  //!< Nanoseconds since the tracer started
+    uint64_t arg;      //!< Argument, whose meaning depends on the TracePoint
+    uint32_t thread;   //!< Number of the thread that made the record (1 for the first to make one, ...)
+    TracePoint point;
+    TracePhase phase;
+};
+
+//! \brief A per-thread, lock-free ring-buffer tracer for the TCP hot paths
+//! \details Each thread records into a ring of its own (its last RING_SIZE - 1 records can be read), so a
+//! record is a timestamp (the TSC, on x86) and a few stores, with no locks or atomic read-modify-writes.
+//! Code is instrumented with the SPONGE_TRACE and SPONGE_TRACE_SCOPE macros, which compile to nothing
+//! unless the build defines SPONGE_TRACING (`cmake -DTRACING=ON`).
+//!
+//! Recording is off until Tracer::set_enabled(true), or from the start if the SPONGE_TRACE environment
+//! variable is set; in that case, the trace is saved to the file it names when the program exits.
+//! Tracer::save() writes a binary file that `trace_dump` converts to Chrome/Perfetto trace JSON.
+class Tracer {
+  public:
+    //! Slots in each thread's ring
+    static constexpr size_t RING_SIZE = 1 << 16;
+
+  private:
+    //! A record as it is kept in a ring
+    struct Record {
+        uint64_t ticks;
+        uint64_t arg;
+        TracePoint point;
+        TracePhase phase;
+    };
+
+    //! One thread's records
+    struct Ring {
+        std::array<Record, RING_SIZE> records{};
+        std::atomic<uint64_t> head{0};  //!< Number of records ever made (the next goes at `head % RING_SIZE`)
+        uint32_t thread = 0;
+    };
+
+    static std::atomic<bool> _enabled;
+    static thread_local Ring *_ring;  //!< The calling thread's ring, once it has recorded something
+
+    //! Every ring made so far (a thread's ring outlives it, so its records can still be read)
+    static std::vector<std::unique_ptr<Ring>> &_rings();
+    static std::mutex &_rings_mutex();
+
+    //! Create and register the calling thread's ring
+    static Ring &_register();
+
+  public:
+    //! The clock that timestamps records
+    static uint64_t ticks() {
+#if defined(__x86_64__) || defined(__i386__)
+        return __rdtsc();
+#else
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                   std::chrono::steady_clock::now().time_since_epoch())
+            .count();
+#endif
+    }
+
+    //! Record `point` on the calling thread's ring, if recording is enabled
+    static void record(const TracePoint point, const TracePhase phase, const uint64_t arg) {
+        if (not _enabled.load(std::memory_order_relaxed)) {
+            return;
+        }
+        Ring &ring = _ring ? *_ring : _register();
+        const uint64_t head = ring.head.load(std::memory_order_relaxed);
+        ring.records[head % RING_SIZE] = {ticks(), arg, point, phase};
+        ring.head.store(head + 1, std::memory_order_release);
+    }
+
+    static void set_enabled(const bool enabled) { _enabled.store(enabled, std::memory_order_relaxed); }
+    static bool enabled() { return _enabled.load(std::memory_order_relaxed); }
+
+    //! \brief Every thread's records, oldest first
+    //! \note Threads may keep recording; records they overwrite while the rings are copied are left out.
+    static std::vector<TraceEvent> snapshot();
+
+    //! \brief Forget every record made so far
+    //! \note No thread should be recording meanwhile.
+    static void clear();
+
+    //! \name Trace files
+    //!@{
+
+    //! Write `events` to `path`, in the tracer's binary format
+    static void save(const std::string &path, const std::vector<TraceEvent> &events);
+
+    //! Read a file written by Tracer::save()
+    static std::vector<TraceEvent> load(const std::string &path);
+
+    //! Write `events` as Chrome/Perfetto trace JSON (the format chrome://tracing and ui.perfetto.dev load)
+    static void write_chrome_json(std::ostream &out, const std::vector<TraceEvent> &events);
+    //!@}
+
+    //! The name of `point` in exported traces, e.g. "segment_sent"
+    static const char *name(const TracePoint point);
+};
+
+//! Records a TracePhase::Begin when constructed, and the matching TracePhase::End when destroyed
+class TraceScope {
+    TracePoint _point;
+    uint64_t _arg;
+
+  public:
+    TraceScope(const TracePoint point, const uint64_t arg) : _point(point), _arg(arg) {
+        Tracer::record(_point, TracePhase::Begin, _arg);
+    }
+    ~TraceScope() { Tracer::record(_point, TracePhase::End, _arg); }
+
+    TraceScope(const TraceScope &other) = delete;
+    TraceScope &operator=(const TraceScope &other) = delete;
+};
+
+//! The argument of a segment's trace records: its seqno, and the length of its payload
+#define SPONGE_TRACE_SEGMENT_ARG(seg) \
+    ((uint64_t{(seg).header().seqno.raw_value()} << 32) | static_cast<uint32_t>((seg).payload().size()))
+
+#ifdef SPONGE_TRACING
+//! Record a TracePhase::Instant at TracePoint::`point`
+#define SPONGE_TRACE(point, arg) Tracer::record(TracePoint::point, TracePhase::Instant, static_cast<uint64_t>(arg))
+//! Record a span at TracePoint::`point` from here to the end of the enclosing scope
+#define SPONGE_TRACE_SCOPE(point, arg) \
+    const TraceScope sponge_trace_scope_{TracePoint::point, static_cast<uint64_t>(arg)}
+#else
+#define SPONGE_TRACE(point, arg) static_cast<void>(0)
+#define SPONGE_TRACE_SCOPE(point, arg) static_cast<void>(0)
+#endif
+
+#endif  // SPONGE_LIBSPONGE_TRACER_HH
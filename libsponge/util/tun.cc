@@ -14,6 +14,10 @@ using namespace std;
 
 //! \param[in] devname is the name of the TUN or TAP device, specified at its creation.
 //! \param[in] is_tun is `true` for a TUN device (expects IP datagrams), or `false` for a TAP device (expects Ethernet frames)
+//! \param[in] multi_queue is `true` to attach a new queue of a multi-queue device (see TunFD::open_queues)
+//! \param[in] vnet_hdr is `true` to exchange a `virtio_net_hdr` with each packet, which lets the
+//! kernel pass TCP packets whose checksums are unfinished or that still need to be segmented
+//! (see TCPOverIPv4OverTunFdAdapter and TCPStack)
 //!
 //! To create a TUN device, you should already have run
 //!
@@ -21,11 +25,17 @@ using namespace std;
 //!
 //! as root before calling this function.
 
-TunTapFD::TunTapFD(const string &devname, const bool is_tun)
-    : FileDescriptor(SystemCall("open", open(CLONEDEV, O_RDWR))) {
+TunTapFD::TunTapFD(const string &devname, const bool is_tun, const bool multi_queue, const bool vnet_hdr)
+    : FileDescriptor(SystemCall("open", open(CLONEDEV, O_RDWR))), _vnet_hdr(vnet_hdr) {
     struct ifreq tun_req {};
 
     tun_req.ifr_flags = (is_tun ? IFF_TUN : IFF_TAP) | IFF_NO_PI;  // tun device with no packetinfo
+    if (multi_queue) {
+        tun_req.ifr_flags |= IFF_MULTI_QUEUE;
+    }
+    if (vnet_hdr) {
+        tun_req.ifr_flags |= IFF_VNET_HDR;
+    }
 
     // copy devname to ifr_name, making sure to null terminate
 
@@ -33,4 +43,31 @@ TunTapFD::TunTapFD(const string &devname, const bool is_tun)
     tun_req.ifr_name[IFNAMSIZ - 1] = '\0';
 
     SystemCall("ioctl", ioctl(fd_num(), TUNSETIFF, static_cast<void *>(&tun_req)));
+
+    if (vnet_hdr) {
+        // accept packets with partial checksums and TCP/IPv4 packets larger than the MTU
+        SystemCall("ioctl", ioctl(fd_num(), TUNSETOFFLOAD, TUN_F_CSUM | TUN_F_TSO4));
+    } else if (is_tun) {
+        // a persistent device keeps the offloads of an earlier user that had a virtio_net_hdr, and
+        // would go on handing us packets with partial checksums; clear them if we may (best effort)
+        ioctl(fd_num(), TUNSETOFFLOAD, 0);
+    }
+}
+
+//! \param[in] devname is the name of the TUN device, which must have been created with
+//!
+//!     ip tuntap add mode tun multi_queue user `username` name `devname`
+//!
+//! \param[in] nqueues is the number of queues to open
+//! \param[in] vnet_hdr is `true` to exchange a `virtio_net_hdr` with each packet (see TunTapFD::TunTapFD)
+//! \returns one TunFD per queue. The kernel hands each inbound flow to one queue, preferring the
+//! queue on which that flow's packets were last written, so a thread that both reads and writes a
+//! flow on its own queue keeps the flow to itself.
+vector<TunFD> TunFD::open_queues(const string &devname, const size_t nqueues, const bool vnet_hdr) {
+    vector<TunFD> queues;
+    queues.reserve(nqueues);
+    for (size_t i = 0; i < nqueues; ++i) {
+        queues.emplace_back(devname, true, vnet_hdr);
+    }
+    return queues;
 }
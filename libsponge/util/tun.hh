@@ -3,20 +3,37 @@
 
 #include "file_descriptor.hh"
 
+#include <cstddef>
 #include <string>
+#include <vector>
 
 //! A FileDescriptor to a [Linux TUN/TAP](https://www.kernel.org/doc/Documentation/networking/tuntap.txt) device
 class TunTapFD : public FileDescriptor {
+  private:
+    bool _vnet_hdr;  //!< Does every packet carry a virtio_net_hdr?
+
   public:
     //! Open an existing persistent [TUN or TAP device](https://www.kernel.org/doc/Documentation/networking/tuntap.txt).
-    explicit TunTapFD(const std::string &devname, const bool is_tun);
+    explicit TunTapFD(const std::string &devname,
+                      const bool is_tun,
+                      const bool multi_queue = false,
+                      const bool vnet_hdr = false);
+
+    //! \brief Whether every packet read or written is preceded by a `virtio_net_hdr` (see VirtioNetHeader)
+    bool vnet_hdr() const { return _vnet_hdr; }
 };
 
 //! A FileDescriptor to a [Linux TUN](https://www.kernel.org/doc/Documentation/networking/tuntap.txt) device
 class TunFD : public TunTapFD {
   public:
     //! Open an existing persistent [TUN device](https://www.kernel.org/doc/Documentation/networking/tuntap.txt).
-    explicit TunFD(const std::string &devname) : TunTapFD(devname, true) {}
+    explicit TunFD(const std::string &devname, const bool multi_queue = false, const bool vnet_hdr = false)
+        : TunTapFD(devname, true, multi_queue, vnet_hdr) {}
+
+    //! Open `nqueues` queues of an existing persistent multi-queue TUN device
+    static std::vector<TunFD> open_queues(const std::string &devname,
+                                          const size_t nqueues,
+                                          const bool vnet_hdr = false);
 };
 
 //! A FileDescriptor to a [Linux TAP](https://www.kernel.org/doc/Documentation/networking/tuntap.txt) device
@@ -18,6 +18,14 @@ uint64_t timestamp_ms() {
     return std::chrono::duration_cast<std::chrono::milliseconds>(now - program_start).count();
 }
 
+//! \returns the number of nanoseconds since the program started
+uint64_t timestamp_ns() {
+    using time_point = std::chrono::steady_clock::time_point;
+    static const time_point program_start = std::chrono::steady_clock::now();
+    const time_point now = std::chrono::steady_clock::now();
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(now - program_start).count();
+}
+
 //! \param[in] attempt is the name of the syscall to try (for error reporting)
 //! \param[in] return_value is the return value of the syscall
 //! \param[in] errno_mask is any errno value that is acceptable, e.g., `EAGAIN` when reading a non-blocking fd
@@ -51,6 +51,9 @@ std::mt19937 get_random_generator();
 //! Get the time in milliseconds since the program began.
 uint64_t timestamp_ms();
 
+//! Get the time in nanoseconds since the program began (for measuring latencies).
+uint64_t timestamp_ns();
+
 //! The internet checksum algorithm
 class InternetChecksum {
   private:
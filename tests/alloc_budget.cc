@@ -0,0 +1,118 @@
+#include "alloc_tracker.hh"
+#include "tcp_config.hh"
+#include "tcp_connection.hh"
+#include "test_err_if.hh"
+#include "test_should_be.hh"
+
+#include <cstdlib>
+#include <exception>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+//! \brief Allocations allowed per data segment on the path from TCPConnection::write, through segments_out and
+//! segment_received, to the receiver's inbound_stream().read()
+//! \details These are ceilings just above what the data path does today (about 9.6 allocations and 6.4 KB),
+//! not targets: lower them as the path stops copying strings and allocating control blocks, rather than
+//! raising them to get a change through.
+static constexpr double ALLOCATIONS_PER_SEGMENT = 10;
+static constexpr double BYTES_PER_SEGMENT = 7 * 1024;
+
+//! Where allocations escape to, so the compiler can't elide them
+static void *volatile escape = nullptr;
+
+//! the tracker counts each form of operator new and delete, on the calling thread
+static void tracker() {
+    test_err_if(not AllocationTracker::installed(), "the allocation hooks aren't linked in");
+
+    AllocationScope scope;
+    auto *one = new uint64_t{1};
+    auto *many = new uint64_t[8];
+    escape = one;
+    escape = many;
+    delete one;
+    delete[] many;
+    const AllocationCounts counts = scope.counts();
+    test_err_if(counts.allocations != 2 or counts.deallocations != 2 or counts.bytes < 9 * sizeof(uint64_t),
+                "wrong counts: " + counts.to_string());
+
+    // a nothrow new, and an over-aligned one
+    struct alignas(64) Line {
+        char bytes[64];
+    };
+    AllocationScope more;
+    unique_ptr<Line> line{new Line{}};
+    unique_ptr<int> number{new (nothrow) int{}};
+    escape = line.get();
+    escape = number.get();
+    line.reset();
+    number.reset();
+    const AllocationCounts more_counts = more.counts();
+    test_err_if(more_counts.allocations != 2 or more_counts.deallocations != 2,
+                "wrong counts: " + more_counts.to_string());
+}
+
+//! the data path between two TCPConnections stays within its budget once they're in a steady state
+static void data_path() {
+    TCPConnection client{TCPConfig{}}, server{TCPConfig{}};
+    const auto shuttle = [](TCPConnection &from, TCPConnection &to) {
+        for (; not from.segments_out().empty(); from.segments_out().pop()) {
+            to.segment_received(from.segments_out().front());
+        }
+    };
+    client.connect();
+    shuttle(client, server);
+    shuttle(server, client);
+    shuttle(client, server);
+
+    const string chunk(TCPConfig::MAX_PAYLOAD_SIZE, 'x');
+    size_t segments = 0;
+    const auto round = [&] {
+        client.write(chunk);
+        client.tick(1);  // a TCPConnection fills the window it's offered on its next tick
+        for (; not client.segments_out().empty(); client.segments_out().pop()) {
+            server.segment_received(client.segments_out().front());
+            segments++;
+        }
+        shuttle(server, client);
+        const string received = server.inbound_stream().read(server.inbound_stream().buffer_size());
+        test_should_be(received.size(), chunk.size());
+    };
+
+    // warm up, so that the buffers have grown to their steady-state sizes
+    for (unsigned i = 0; i < 100; ++i) {
+        round();
+    }
+
+    segments = 0;
+    AllocationScope scope;
+    for (unsigned i = 0; i < 1000; ++i) {
+        round();
+    }
+    const AllocationCounts counts = scope.counts();
+    test_should_be(segments, size_t{1000});
+
+    const double allocations = static_cast<double>(counts.allocations) / segments;
+    const double bytes = static_cast<double>(counts.bytes) / segments;
+    cerr << "per segment: " << allocations << " allocations, " << bytes << " bytes\n";
+    test_err_if(allocations > ALLOCATIONS_PER_SEGMENT,
+                to_string(allocations) + " allocations per segment, over the budget of " +
+                    to_string(ALLOCATIONS_PER_SEGMENT));
+    test_err_if(bytes > BYTES_PER_SEGMENT,
+                to_string(bytes) + " bytes allocated per segment, over the budget of " + to_string(BYTES_PER_SEGMENT));
+}
+
+int main() {
+    try {
+        tracker();
+        data_path();
+    } catch (const exception &e) {
+        cerr << e.what() << endl;
+        return err_num;
+    }
+
+    return EXIT_SUCCESS;
+}
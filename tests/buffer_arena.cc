@@ -0,0 +1,135 @@
+#include "buffer.hh"
+#include "tcp_config.hh"
+#include "tcp_connection.hh"
+#include "tcp_segment.hh"
+#include "test_err_if.hh"
+#include "test_should_be.hh"
+
+#include <cstdlib>
+#include <exception>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+//! copies share storage, and storage goes back to the thread's free lists when the last copy is gone
+static void sharing_and_reuse() {
+    const auto before = BufferArena::stats();
+    const char *storage = nullptr;
+    {
+        Buffer a{string(80, 'a')};
+        storage = a.str().data();
+        Buffer b = a;
+        Buffer c = b.substr(10, 5);
+        test_err_if(b.str().data() != storage or c.str().data() != storage + 10, "copies did not share storage");
+        a = Buffer{};
+        b.remove_prefix(80);
+        test_err_if(c.str() != "aaaaa", "storage was released while a copy still used it");
+    }
+
+    test_err_if(Buffer{string(70, 'b')}.str().data() != storage, "freed storage was not reused");
+    const auto after = BufferArena::stats();
+    test_err_if(after.heap_allocations - before.heap_allocations > 1, "reuse went to the heap");
+    test_err_if(after.reuses <= before.reuses, "reuse was not counted");
+
+    // storage released on another thread goes to that thread's free lists, not back to this one
+    Buffer moved{string(200, 'c')};
+    thread([b = move(moved)]() mutable { b = Buffer{}; }).join();
+}
+
+//! a moved-from Buffer is empty, and the storage a Buffer is moved over is released
+static void moves() {
+    Buffer big{string(1000, 'b')};
+    Buffer small{string(10, 's')};
+    const char *small_storage = small.str().data();
+    small = move(big);
+    test_err_if(small.size() != 1000 or small.str() != string(1000, 'b'), "move-assignment lost the bytes");
+    test_err_if(big.size() != 0 or not big.str().empty(), "a moved-from Buffer isn't empty");
+    test_err_if(Buffer{string(10, 't')}.str().data() != small_storage, "the overwritten storage wasn't released");
+
+    Buffer constructed{move(small)};
+    test_err_if(constructed.size() != 1000 or small.size() != 0, "move construction didn't empty the source");
+    Buffer &same = constructed;  // self-move leaves the Buffer as it was
+    constructed = move(same);
+    test_err_if(constructed.size() != 1000, "self-move lost the bytes");
+}
+
+//! Move `from`'s outbound segments to `to`, through serialize() and parse() as an adapter would
+static size_t shuttle(TCPConnection &from, TCPConnection &to) {
+    size_t count = 0;
+    for (; not from.segments_out().empty(); from.segments_out().pop(), ++count) {
+        TCPSegment seg;
+        test_err_if(seg.parse(from.segments_out().front().serialize().concatenate()) != ParseResult::NoError,
+                    "segment did not parse");
+        to.segment_received(seg);
+    }
+    return count;
+}
+
+//! once two connections have exchanged some data, Buffers never come from the heap again
+static void steady_state() {
+    TCPConfig cfg{};
+    TCPConnection client{cfg}, server{cfg};
+    client.connect();
+
+    const string block(TCPConfig::MAX_PAYLOAD_SIZE * 8, 'x');
+    size_t segments = 0;
+    const auto transfer = [&](const unsigned rounds) {
+        for (unsigned i = 0; i < rounds; ++i) {
+            client.write(block);
+            segments += shuttle(client, server) + shuttle(server, client);
+            server.inbound_stream().pop_output(server.inbound_stream().buffer_size());
+            client.tick(1);
+            server.tick(1);
+        }
+    };
+
+    transfer(100);  // warm up
+    const auto before = BufferArena::stats();
+    const size_t segments_before = segments;
+    transfer(100);
+    const auto after = BufferArena::stats();
+
+    test_err_if(segments - segments_before < 800, "only " + to_string(segments - segments_before) + " segments sent");
+    test_err_if(after.heap_allocations != before.heap_allocations,
+                to_string(after.heap_allocations - before.heap_allocations) + " heap allocations for " +
+                    to_string(segments - segments_before) + " segments in the steady state");
+    test_err_if(after.reuses <= before.reuses, "Buffers did not come from the arena");
+}
+
+//! written Buffers (and long strings) reach the outbound segments without being copied
+static void zero_copy_writes() {
+    TCPConfig cfg{};
+    TCPConnection client{cfg}, server{cfg};
+    client.connect();
+    shuttle(client, server);
+    shuttle(server, client);
+    shuttle(client, server);
+
+    string long_string(BufferArena::MAX_BLOCK_SIZE, 'y');
+    const char *const original = long_string.data();
+    const Buffer adopted{move(long_string)};
+    test_err_if(adopted.str().data() != original, "a long string was copied");
+
+    const Buffer written{string(1000, 'z')};
+    test_err_if(client.write(written) != 1000, "write() of a Buffer was refused");
+    test_should_be(client.segments_out().size(), size_t{1});
+    test_err_if(client.segments_out().front().payload().str().data() != written.str().data(),
+                "the written Buffer was copied into the segment");
+}
+
+int main() {
+    try {
+        sharing_and_reuse();
+        moves();
+        steady_state();
+        zero_copy_writes();
+    } catch (const exception &e) {
+        cerr << e.what() << endl;
+        return err_num;
+    }
+
+    return EXIT_SUCCESS;
+}
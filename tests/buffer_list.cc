@@ -0,0 +1,94 @@
+#include "buffer.hh"
+#include "test_err_if.hh"
+#include "test_should_be.hh"
+
+#include <cstdlib>
+#include <exception>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+
+using namespace std;
+
+//! a SmallDeque stays contiguous and in order as it slides, spills to the heap and drains
+static void small_deque() {
+    SmallDeque<int, 4> q;
+    int next_in = 0, next_out = 0;
+    const auto check = [&] {
+        test_should_be(q.size(), size_t(next_in - next_out));
+        for (size_t i = 0; i < q.size(); ++i) {
+            test_err_if(q.data()[i] != next_out + int(i), "element " + to_string(i) + " is " + to_string(q[i]));
+        }
+    };
+
+    // a steady queue of 1 to 3 elements never leaves the inline array
+    for (int round = 0; round < 10; ++round) {
+        q.push_back(next_in++);
+        q.push_back(next_in++);
+        q.pop_front(), ++next_out;
+        check();
+    }
+
+    // grow well past the inline capacity, then drain and start over
+    for (int i = 0; i < 100; ++i) {
+        q.push_back(next_in++);
+        if (i % 3 == 0) {
+            q.pop_front(), ++next_out;
+        }
+        check();
+    }
+    while (not q.empty()) {
+        q.pop_front(), ++next_out;
+        check();
+    }
+    q.push_back(next_in++);
+    check();
+}
+
+//! sizes are tracked as Buffers come and go, and the views match the bytes
+static void lists_and_views() {
+    BufferList list{string("header")};
+    list.append(BufferList{string("payload")});
+    list.push_back(Buffer{});  // empty Buffers are not kept
+    test_err_if(list.size() != 13 or list.buffers().size() != 2, "size() is " + to_string(list.size()));
+    test_err_if(list.concatenate() != "headerpayload", "concatenate() returned " + list.concatenate());
+    test_err_if(list.peak_out(8) != "headerpa", "peak_out() returned " + list.peak_out(8));
+
+    BufferList many;
+    for (int i = 0; i < 10; ++i) {
+        many.append(list);
+    }
+    test_err_if(many.size() != 130 or many.buffers().size() != 20, "appending spilled Buffers were lost");
+    test_err_if(many.read_prefix(9) != "headerpay", "read_prefix() returned the wrong bytes");
+    many.remove_prefix(4 + 13 * 8);
+    test_err_if(many.size() != 13 or many.concatenate() != "headerpayload", "remove_prefix() left the wrong bytes");
+
+    BufferViewList views{list};
+    views.append(BufferViewList{"!"});
+    test_err_if(views.size() != 14 or views.iovec_count() != 3, "views have the wrong size");
+    views.remove_prefix(7);
+    string viewed;
+    for (size_t i = 0; i < views.iovec_count(); ++i) {
+        viewed.append(static_cast<const char *>(views.iovecs()[i].iov_base), views.iovecs()[i].iov_len);
+    }
+    test_err_if(viewed != "ayload!" or views.size() != 7, "iovecs hold \"" + viewed + "\"");
+
+    try {
+        views.remove_prefix(8);
+    } catch (const out_of_range &) {
+        return;
+    }
+    throw runtime_error("removing more than size() did not throw");
+}
+
+int main() {
+    try {
+        small_deque();
+        lists_and_views();
+    } catch (const exception &e) {
+        cerr << e.what() << endl;
+        return err_num;
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,99 @@
+#include "buffer.hh"
+#include "file_descriptor.hh"
+#include "test_err_if.hh"
+#include "test_should_be.hh"
+#include "util.hh"
+
+#include <cstdlib>
+#include <exception>
+#include <iostream>
+#include <string>
+#include <sys/socket.h>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+//! a slab comes back to the pool once the last Buffer sharing it is gone, and is handed out again
+static void recycling() {
+    BufferPool pool{4096, 2};
+    test_err_if(pool.idle() != 0, "a new pool has idle slabs");
+
+    BufferPool::Slab slab = pool.acquire();
+    test_err_if(slab.size() != 4096, "slab has the wrong size");
+    const char *const storage = slab.data();
+    string("hello, world").copy(slab.data(), 12);
+
+    Buffer buffer = move(slab).freeze(12);
+    test_err_if(buffer.str() != "hello, world", "frozen slab holds \"" + buffer.copy() + "\"");
+
+    Buffer world = buffer.substr(7);
+    test_err_if(world.str() != "world", "substr() returned \"" + world.copy() + "\"");
+    test_err_if(buffer.substr(7, 2).str() != "wo", "substr() with a length returned the wrong bytes");
+
+    buffer = {};
+    test_err_if(pool.idle() != 0, "slab was recycled while a substr() still used it");
+    world.remove_prefix(5);
+    test_err_if(pool.idle() != 1, "slab was not recycled");
+
+    test_err_if(pool.acquire().data() != storage, "idle slab was not reused");
+    test_err_if(pool.idle() != 1, "unused slab was not recycled");
+
+    // oversized requests aren't pooled, and the pool keeps at most `max_idle` slabs
+    test_err_if(pool.acquire(10000).size() < 10000, "oversized slab is too small");
+    {
+        vector<BufferPool::Slab> slabs;
+        for (int i = 0; i < 5; ++i) {
+            slabs.push_back(pool.acquire());
+        }
+    }
+    test_should_be(pool.idle(), size_t{2});
+}
+
+//! slabs may be released on another thread, and may outlive their pool
+static void lifetimes() {
+    Buffer survivor;
+    {
+        BufferPool pool{1024};
+        vector<Buffer> buffers;
+        for (int i = 0; i < 100; ++i) {
+            buffers.push_back(pool.acquire().freeze(i));
+        }
+        thread([moved = move(buffers)]() mutable { moved.clear(); }).join();
+        test_err_if(pool.idle() != BufferPool::DEFAULT_MAX_IDLE, "slabs released on another thread were lost");
+
+        BufferPool::Slab slab = pool.acquire();
+        slab.data()[0] = 'x';
+        survivor = move(slab).freeze(1);
+    }
+    test_err_if(survivor.str() != "x", "slab did not outlive its pool");
+}
+
+//! FileDescriptor::read() into a pooled slab, limited by the slab size and by `limit`
+static void fd_read() {
+    int fds[2];
+    SystemCall("socketpair", ::socketpair(AF_UNIX, SOCK_STREAM, 0, static_cast<int *>(fds)));
+    FileDescriptor reader{fds[0]}, writer{fds[1]};
+    BufferPool pool{8};
+
+    writer.write("0123456789abcdef");
+    test_err_if(reader.read(pool).str() != "01234567", "read was not limited to the slab size");
+    test_err_if(reader.read(pool, 3).str() != "89a", "read was not limited by `limit`");
+    test_err_if(reader.read(pool).str() != "bcdef", "read returned the wrong bytes");
+
+    writer.close();
+    test_err_if(reader.read(pool).size() != 0 or not reader.eof(), "EOF was not seen");
+}
+
+int main() {
+    try {
+        recycling();
+        lifetimes();
+        fd_read();
+    } catch (const exception &e) {
+        cerr << e.what() << endl;
+        return err_num;
+    }
+
+    return EXIT_SUCCESS;
+}
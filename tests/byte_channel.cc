@@ -0,0 +1,112 @@
+#include "byte_channel.hh"
+#include "tcp_config.hh"
+#include "tcp_sponge_socket.hh"
+
+#include <cstdlib>
+#include <exception>
+#include <iostream>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <utility>
+
+using namespace std;
+
+static string pattern(const size_t len) {
+    string ret(len, 0);
+    for (size_t i = 0; i < len; ++i) {
+        ret[i] = static_cast<char>(i * 7 + i / 251);
+    }
+    return ret;
+}
+
+//! one thread writes a long pattern in random-sized pieces through a small ring; another reads it back
+static void ring_transfer() {
+    constexpr size_t LEN = 8 * 1024 * 1024;
+    const string data = pattern(LEN);
+    ByteChannel channel{4000};
+    if (channel.capacity() != 4096) {
+        throw runtime_error("capacity was not rounded up to a power of two");
+    }
+
+    thread producer([&] {
+        mt19937 rd{1};
+        size_t offset = 0;
+        while (offset < LEN) {
+            const size_t len = min<size_t>(LEN - offset, uniform_int_distribution<size_t>{1, 10000}(rd));
+            channel.write_all(string_view(data).substr(offset, len));
+            offset += len;
+        }
+        channel.close();
+    });
+
+    mt19937 rd{2};
+    string received;
+    while (not channel.eof()) {
+        channel.wait_readable();
+        received.append(channel.read(uniform_int_distribution<size_t>{1, 6000}(rd)));
+    }
+    producer.join();
+
+    if (received != data) {
+        throw runtime_error("ring corrupted the data (" + to_string(received.size()) + " bytes received)");
+    }
+}
+
+//! a pair of TCPSpongeSockets over loopback UDP, using the in-process transport
+static void socket_transfer() {
+    constexpr size_t LEN = 512 * 1024;
+    const string data = pattern(LEN);
+
+    TCPConfig c_tcp{};
+    c_tcp.rt_timeout = 10;
+
+    UDPSocket server_udp;
+    server_udp.bind({"127.0.0.1", 0});
+    FdAdapterConfig c_server{};
+    c_server.source = server_udp.local_address();
+    FdAdapterConfig c_client{};
+    c_client.destination = server_udp.local_address();
+
+    using TransportT = TCPOverUDPSpongeSocket::Transport;
+    TCPOverUDPSpongeSocket server{TCPOverUDPSocketAdapter{move(server_udp)}, TransportT::Channel};
+    TCPOverUDPSpongeSocket client{TCPOverUDPSocketAdapter{UDPSocket{}}, TransportT::Channel};
+
+    thread server_thread([&] {
+        server.listen_and_accept(c_tcp, c_server);
+        string received;
+        while (not server.channel_eof()) {
+            received.append(server.channel_read());
+        }
+        server.channel_write(received == data ? "ok" : "mismatch");
+        server.channel_shutdown_write();
+        server.wait_until_closed();
+    });
+
+    client.connect(c_tcp, c_client);
+    client.channel_write(data);
+    client.channel_shutdown_write();
+    string reply;
+    while (not client.channel_eof()) {
+        reply.append(client.channel_read());
+    }
+    client.wait_until_closed();
+    server_thread.join();
+
+    if (reply != "ok") {
+        throw runtime_error("server replied \"" + reply + "\"");
+    }
+}
+
+int main() {
+    try {
+        ring_transfer();
+        socket_transfer();
+    } catch (const exception &e) {
+        cerr << "Exception: " << e.what() << endl;
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
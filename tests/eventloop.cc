@@ -0,0 +1,114 @@
+#include "eventloop.hh"
+#include "socket.hh"
+#include "test_err_if.hh"
+#include "util.hh"
+
+#include <cstdlib>
+#include <exception>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <sys/socket.h>
+#include <utility>
+#include <vector>
+
+using namespace std;
+
+static pair<FileDescriptor, FileDescriptor> make_pair_of_fds() {
+    int fds[2];
+    SystemCall("socketpair", ::socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, static_cast<int *>(fds)));
+    return {FileDescriptor{fds[0]}, FileDescriptor{fds[1]}};
+}
+
+//! readiness, timeouts, loss and regain of interest, and cancellation on EOF
+static void read_rules(const EventLoop::Backend backend) {
+    EventLoop loop{backend};
+    auto [ours, theirs] = make_pair_of_fds();
+
+    string received;
+    bool interested = true;
+    bool canceled = false;
+    loop.add_rule(
+        ours,
+        Direction::In,
+        [&] { received.append(ours.read()); },
+        [&] { return interested; },
+        [&] { canceled = true; });
+
+    test_err_if(loop.wait_next_event(10) != EventLoop::Result::Timeout, "wait on an idle fd didn't time out");
+
+    theirs.write("hello");
+    test_err_if(loop.wait_next_event(1000) != EventLoop::Result::Success, "wait on a readable fd failed");
+    test_err_if(received != "hello", "callback read \"" + received + "\"");
+
+    // readable while uninterested: the event must not be lost once interest returns
+    interested = false;
+    theirs.write(" world");
+    test_err_if(loop.wait_next_event(10) != EventLoop::Result::Exit, "wait with nothing of interest didn't exit");
+    interested = true;
+    test_err_if(loop.wait_next_event(1000) != EventLoop::Result::Success, "event lost while uninterested");
+    test_err_if(received != "hello world", "callback read \"" + received + "\"");
+
+    theirs.close();
+    while (not canceled) {
+        test_err_if(loop.wait_next_event(1000) == EventLoop::Result::Timeout, "EOF was never seen");
+    }
+    test_err_if(loop.wait_next_event(0) != EventLoop::Result::Exit, "canceled rule was still polled");
+}
+
+//! more rules than there are entries in the io_uring's submission queue, all ready at once
+static void many_rules(const EventLoop::Backend backend) {
+    constexpr size_t N = 1000;
+    EventLoop loop{backend};
+    vector<pair<FileDescriptor, FileDescriptor>> fds;
+    fds.reserve(N);  // the callbacks refer to the elements
+    vector<unsigned> calls(N);
+    for (size_t i = 0; i < N; ++i) {
+        fds.push_back(make_pair_of_fds());
+        FileDescriptor &fd = fds.back().first;
+        loop.add_rule(fd, Direction::Out, [&, i] {
+            fd.write("x");
+            ++calls[i];
+        });
+    }
+
+    for (unsigned round = 1; round <= 3; ++round) {
+        test_err_if(loop.wait_next_event(1000) != EventLoop::Result::Success, "wait on writable fds failed");
+        for (size_t i = 0; i < N; ++i) {
+            test_err_if(calls[i] != round, "rule " + to_string(i) + " ran " + to_string(calls[i]) + " times");
+        }
+    }
+}
+
+//! a callback that neither reads nor loses interest is a bug
+static void busy_wait(const EventLoop::Backend backend) {
+    EventLoop loop{backend};
+    auto [ours, theirs] = make_pair_of_fds();
+    loop.add_rule(ours, Direction::In, [] {});
+    theirs.write("x");
+
+    try {
+        loop.wait_next_event(1000);
+    } catch (const runtime_error &) {
+        return;
+    }
+    throw runtime_error("busy wait was not detected");
+}
+
+int main() {
+    try {
+        for (const auto backend : {EventLoop::Backend::Poll, EventLoop::Backend::IOUring}) {
+            if (EventLoop{backend}.backend() != backend) {
+                cerr << "Note: io_uring is unavailable; EventLoop falls back to poll(2).\n";
+            }
+            read_rules(backend);
+            many_rules(backend);
+            busy_wait(backend);
+        }
+    } catch (const exception &e) {
+        cerr << e.what() << endl;
+        return err_num;
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,143 @@
+#include "eventloop.hh"
+#include "latency_histogram.hh"
+#include "tcp_config.hh"
+#include "tcp_connection.hh"
+#include "test_err_if.hh"
+#include "test_should_be.hh"
+#include "util.hh"
+
+#include <algorithm>
+#include <cstdlib>
+#include <exception>
+#include <iostream>
+#include <random>
+#include <string>
+#include <sys/socket.h>
+#include <vector>
+
+using namespace std;
+
+static pair<FileDescriptor, FileDescriptor> make_pair_of_fds() {
+    int fds[2];
+    SystemCall("socketpair", ::socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, static_cast<int *>(fds)));
+    return {FileDescriptor{fds[0]}, FileDescriptor{fds[1]}};
+}
+
+//! percentiles of small values are exact, and of large ones within the histogram's precision
+static void percentiles() {
+    LatencyHistogram small;
+    for (uint64_t i = 1; i <= 50; ++i) {
+        small.record(i);
+    }
+    test_err_if(small.count() != 50 or small.min() != 1 or small.max() != 50 or small.mean() != 25.5,
+                "wrong summary: " + small.to_string());
+    test_err_if(small.percentile(50) != 25 or small.percentile(99) != 50 or small.percentile(0) != 1,
+                "wrong percentiles: " + small.to_string());
+
+    LatencyHistogram large;
+    vector<uint64_t> values;
+    mt19937 rng{12345};
+    exponential_distribution<double> dist{1e-6};  // a mean of 1 ms, in ns
+    for (unsigned i = 0; i < 100000; ++i) {
+        values.push_back(static_cast<uint64_t>(dist(rng)));
+        large.record(values.back());
+    }
+    sort(values.begin(), values.end());
+    for (const double p : {50.0, 90.0, 99.0, 99.9}) {
+        const uint64_t exact = values.at(static_cast<size_t>(p / 100 * values.size()) - 1);
+        const uint64_t reported = large.percentile(p);
+        test_err_if(reported < exact or reported > exact + exact / 32 + 1,
+                    "p" + to_string(p) + " is " + to_string(reported) + " instead of about " + to_string(exact));
+    }
+    test_err_if(large.percentile(100) != values.back(), "p100 isn't the maximum");
+
+    // values past the histogram's range are counted, and reported no higher than the maximum
+    LatencyHistogram huge;
+    huge.record(uint64_t{1} << 50);
+    test_err_if(huge.percentile(50) != uint64_t{1} << 50, "a huge value was misreported");
+}
+
+//! merged histograms summarize both sets of values; reset forgets them
+static void merge_and_reset() {
+    LatencyHistogram a, b;
+    for (uint64_t i = 0; i < 100; ++i) {
+        a.record(1000 + i);
+        b.record(100000 + i);
+    }
+    a.merge(b);
+    a.merge(LatencyHistogram{});
+    test_err_if(a.count() != 200 or a.min() != 1000 or a.max() != 100099, "wrong merge: " + a.to_string());
+    test_err_if(a.percentile(50) >= 2000 or a.percentile(51) < 100000, "wrong merged percentiles: " + a.to_string());
+    a.reset();
+    test_err_if(a.count() != 0 or a.max() != 0 or a.percentile(99) != 0, "reset didn't forget");
+}
+
+//! a TCPConnection times each data segment's wait in the outbound stream and each segment's acknowledgment
+static void tcp_connection() {
+    TCPConfig cfg{};
+    cfg.recv_capacity = 10 * TCPConfig::MAX_PAYLOAD_SIZE;
+    TCPConnection client{TCPConfig{}}, server{cfg};
+    const auto shuttle = [](TCPConnection &from, TCPConnection &to) {
+        for (; not from.segments_out().empty(); from.segments_out().pop()) {
+            to.segment_received(from.segments_out().front());
+        }
+    };
+    client.connect();
+    shuttle(client, server);
+    shuttle(server, client);
+    shuttle(client, server);
+
+    // a window's worth of segments goes at once, and the rest wait for acknowledgments
+    client.write(string(TCPConfig::DEFAULT_CAPACITY, 'x'));
+    for (unsigned round = 0; round < 100 and client.outbound_stream().bytes_read() < TCPConfig::DEFAULT_CAPACITY;
+         ++round) {
+        // the server reads as it goes, so its acknowledgments keep the window open
+        for (; not client.segments_out().empty(); client.segments_out().pop()) {
+            server.segment_received(client.segments_out().front());
+            server.inbound_stream().pop_output(server.inbound_stream().buffer_size());
+        }
+        shuttle(server, client);
+        client.tick(1);  // a TCPConnection fills the window it's offered on its next tick
+    }
+    shuttle(client, server);
+    shuttle(server, client);
+
+    const size_t data_segments = TCPConfig::DEFAULT_CAPACITY / TCPConfig::MAX_PAYLOAD_SIZE;
+    test_should_be(client.queueing_latency().count(), uint64_t{data_segments});
+    test_should_be(client.ack_latency().count(), uint64_t{data_segments + 1});  // and the SYN
+    test_err_if(server.queueing_latency().count() != 0, "the server sent data");
+}
+
+//! an EventLoop times each rule's callbacks
+static void eventloop() {
+    EventLoop loop{EventLoop::Backend::Poll};
+    auto [a, b] = make_pair_of_fds();
+    unsigned calls = 0;
+    loop.add_rule(b, Direction::In, [&] {
+        b.read();
+        calls++;
+    });
+    for (unsigned i = 0; i < 5; ++i) {
+        a.write("x");
+        loop.wait_next_event(0);
+    }
+
+    const auto &latencies = loop.callback_latencies();
+    test_err_if(latencies.size() != 1 or latencies.front().fd != b.fd_num(), "wrong rules");
+    test_err_if(latencies.front().direction != Direction::In, "wrong direction");
+    test_err_if(latencies.front().duration.count() != calls or calls != 5, "wrong number of callbacks");
+}
+
+int main() {
+    try {
+        percentiles();
+        merge_and_reset();
+        tcp_connection();
+        eventloop();
+    } catch (const exception &e) {
+        cerr << e.what() << endl;
+        return err_num;
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,128 @@
+#include "fd_adapter.hh"
+#include "socket.hh"
+#include "tcp_segment.hh"
+#include "test_err_if.hh"
+#include "test_should_be.hh"
+
+#include <cstdlib>
+#include <exception>
+#include <iostream>
+#include <queue>
+#include <string>
+#include <utility>
+#include <vector>
+
+using namespace std;
+
+static UDPSocket loopback_socket() {
+    UDPSocket sock;
+    sock.bind({"127.0.0.1", 0});
+    return sock;
+}
+
+//! A LossyTCPOverUDPSocketAdapter on `sock`, sending to `destination`
+static LossyTCPOverUDPSocketAdapter make_adapter(UDPSocket &&sock, const Address &destination) {
+    LossyTCPOverUDPSocketAdapter adapter{TCPOverUDPSocketAdapter{move(sock)}};
+    adapter.config_mut().destination = destination;
+    return adapter;
+}
+
+static TCPSegment segment(const string &payload) {
+    TCPSegment seg;
+    seg.payload() = Buffer{string(payload)};
+    return seg;
+}
+
+//! delayed segments are held until tick() has advanced the clock far enough, in both directions
+static void delay() {
+    UDPSocket a_sock = loopback_socket(), b_sock = loopback_socket();
+    const Address a_address = a_sock.local_address(), b_address = b_sock.local_address();
+    auto a = make_adapter(move(a_sock), b_address);
+    auto b = make_adapter(move(b_sock), a_address);
+    a.config_mut().impairment_up.delay_us = 30'000;
+    b.config_mut().impairment_dn.delay_us = 20'000;
+
+    TCPSegment hello = segment("hello");
+    a.write(hello);
+    test_err_if(not b.read_batch().empty() or not b.read_due().empty(), "the uplink did not delay the segment");
+    a.tick(29);
+    test_err_if(not b.read_batch().empty(), "the uplink delivered the segment early");
+    a.tick(1);
+
+    test_err_if(not b.read_batch().empty(), "the downlink did not delay the segment");
+    b.tick(19);
+    test_err_if(not b.read_due().empty(), "the downlink delivered the segment early");
+    b.tick(1);
+    const vector<TCPSegment> due = b.read_due();
+    test_err_if(due.size() != 1 or due.front().payload().str() != "hello", "the delayed segment did not arrive intact");
+
+    // without impairments, the other direction is immediate
+    TCPSegment reply = segment("reply");
+    b.write(reply);
+    test_err_if(a.read_batch().size() != 1, "an unimpaired segment was held back");
+}
+
+//! duplicated segments arrive twice, and corrupted ones (caught by their checksum) not at all
+static void duplication_and_corruption() {
+    UDPSocket a_sock = loopback_socket(), b_sock = loopback_socket();
+    const Address a_address = a_sock.local_address(), b_address = b_sock.local_address();
+    auto a = make_adapter(move(a_sock), b_address);
+    auto b = make_adapter(move(b_sock), a_address);
+    a.config_mut().impairment_up.duplication = 1;
+
+    queue<TCPSegment> segments;
+    for (unsigned i = 0; i < 10; ++i) {
+        segments.push(segment(to_string(i)));
+    }
+    a.write_batch(segments);
+    size_t received = 0;
+    for (vector<TCPSegment> batch; not(batch = b.read_batch()).empty();) {
+        received += batch.size();
+    }
+    test_should_be(received, size_t{20});
+
+    a.config_mut().impairment_dn.corruption = 1;
+    for (unsigned i = 0; i < 10; ++i) {
+        segments.push(segment(to_string(i)));
+    }
+    b.write_batch(segments);
+    test_err_if(not a.read_batch().empty(), "a corrupted segment arrived");
+}
+
+//! flush() writes what the uplink holds at once, e.g. a final RST once the connection's clock has stopped
+static void flush() {
+    UDPSocket a_sock = loopback_socket(), b_sock = loopback_socket();
+    const Address a_address = a_sock.local_address(), b_address = b_sock.local_address();
+    auto a = make_adapter(move(a_sock), b_address);
+    auto b = make_adapter(move(b_sock), a_address);
+    a.config_mut().impairment_up.delay_us = 1'000'000;
+    a.config_mut().impairment_up.rate_bps = 8'000;
+
+    queue<TCPSegment> segments;
+    for (unsigned i = 0; i < 3; ++i) {
+        segments.push(segment(to_string(i)));
+    }
+    a.write_batch(segments);
+    a.tick(10);
+    test_err_if(not b.read_batch().empty(), "the uplink did not hold back the segments");
+
+    a.flush();
+    size_t received = 0;
+    for (vector<TCPSegment> batch; not(batch = b.read_batch()).empty();) {
+        received += batch.size();
+    }
+    test_should_be(received, size_t{3});
+}
+
+int main() {
+    try {
+        delay();
+        duplication_and_corruption();
+        flush();
+    } catch (const exception &e) {
+        cerr << e.what() << endl;
+        return err_num;
+    }
+
+    return EXIT_SUCCESS;
+}
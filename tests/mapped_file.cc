@@ -0,0 +1,154 @@
+#include "mapped_file.hh"
+#include "tcp_config.hh"
+#include "tcp_sponge_socket.hh"
+#include "test_err_if.hh"
+#include "util.hh"
+
+#include <cstdlib>
+#include <exception>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <unistd.h>
+#include <utility>
+
+using namespace std;
+
+//! A temporary file holding `contents`, removed when it goes out of scope
+class TempFile {
+    string _path{"/tmp/sponge_mapped_file_XXXXXX"};
+
+  public:
+    explicit TempFile(const string &contents) {
+        FileDescriptor fd{SystemCall("mkstemp", ::mkstemp(_path.data()))};
+        fd.write(contents);
+    }
+    ~TempFile() { ::unlink(_path.c_str()); }
+    const string &path() const { return _path; }
+
+    TempFile(const TempFile &other) = delete;
+    TempFile &operator=(const TempFile &other) = delete;
+};
+
+static string pattern(const size_t len) {
+    string ret(len, 0);
+    for (size_t i = 0; i < len; ++i) {
+        ret[i] = static_cast<char>(i * 7 + i / 251);
+    }
+    return ret;
+}
+
+//! a mapping holds the file's bytes, and outlives the Buffer it came from
+static void mapping() {
+    const TempFile file{"hello, mapped world"};
+    Buffer world;
+    {
+        const Buffer whole = MappedFile::map(file.path());
+        test_err_if(whole.str() != "hello, mapped world", "mapping holds \"" + whole.copy() + "\"");
+        world = whole.substr(14);
+    }
+    test_err_if(world.str() != "world", "mapping did not outlive the Buffer it came from");
+
+    const TempFile empty{""};
+    test_err_if(MappedFile::map(empty.path()).size() != 0, "an empty file mapped to a non-empty Buffer");
+
+    try {
+        MappedFile::map("/");
+    } catch (const runtime_error &) {
+        return;
+    }
+    throw runtime_error("a directory was mapped");
+}
+
+//! a file sent between bytes written to the channel arrives in order, over loopback UDP
+static void send_file() {
+    const string data = pattern(1024 * 1024);
+    const TempFile file{data};
+
+    TCPConfig c_tcp{};
+    c_tcp.rt_timeout = 10;
+
+    UDPSocket server_udp;
+    server_udp.bind({"127.0.0.1", 0});
+    FdAdapterConfig c_server{};
+    c_server.source = server_udp.local_address();
+    FdAdapterConfig c_client{};
+    c_client.destination = server_udp.local_address();
+
+    using TransportT = TCPOverUDPSpongeSocket::Transport;
+    TCPOverUDPSpongeSocket server{TCPOverUDPSocketAdapter{move(server_udp)}, TransportT::Channel};
+    TCPOverUDPSpongeSocket client{TCPOverUDPSocketAdapter{UDPSocket{}}, TransportT::Channel};
+
+    string received;
+    thread server_thread([&] {
+        server.listen_and_accept(c_tcp, c_server);
+        while (not server.channel_eof()) {
+            received.append(server.channel_read());
+        }
+        server.channel_shutdown_write();
+        server.wait_until_closed();
+    });
+
+    client.connect(c_tcp, c_client);
+    client.channel_write("before ");
+    client.send_file(file.path());
+    client.channel_write(" after");
+    client.channel_shutdown_write();
+    while (not client.channel_eof()) {
+        client.channel_read();
+    }
+    client.wait_until_closed();
+    server_thread.join();
+
+    test_err_if(received != "before " + data + " after",
+                "received " + to_string(received.size()) + " bytes out of order");
+}
+
+//! once the peer has gone, send_file() fails rather than waiting forever, however many times it is called
+static void send_file_after_peer_gone() {
+    const TempFile file{pattern(1024 * 1024)};
+
+    TCPConfig c_tcp{};
+    c_tcp.rt_timeout = 1;
+
+    UDPSocket server_udp;
+    server_udp.bind({"127.0.0.1", 0});
+    FdAdapterConfig c_server{};
+    c_server.source = server_udp.local_address();
+    FdAdapterConfig c_client{};
+    c_client.destination = server_udp.local_address();
+
+    TCPOverUDPSpongeSocket client{TCPOverUDPSocketAdapter{UDPSocket{}}};
+    {
+        // the server vanishes without a FIN or RST, so the client gives up after its retransmissions
+        TCPOverUDPSpongeSocket server{TCPOverUDPSocketAdapter{move(server_udp)}};
+        thread server_thread([&] { server.listen_and_accept(c_tcp, c_server); });
+        client.connect(c_tcp, c_client);
+        server_thread.join();
+    }
+
+    for (int attempt = 0; attempt < 2; ++attempt) {
+        bool failed = false;
+        try {
+            client.send_file(file.path());
+        } catch (const runtime_error &) {
+            failed = true;
+        }
+        test_err_if(not failed, "send_file() to a peer that is gone succeeded on attempt " + to_string(attempt));
+    }
+    client.wait_until_closed();
+}
+
+int main() {
+    try {
+        mapping();
+        send_file();
+        send_file_after_peer_gone();
+    } catch (const exception &e) {
+        cerr << e.what() << endl;
+        return err_num;
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,167 @@
+#include "network_emulator.hh"
+#include "tcp_config.hh"
+#include "tcp_connection.hh"
+#include "test_err_if.hh"
+#include "test_should_be.hh"
+
+#include <algorithm>
+#include <cstdlib>
+#include <exception>
+#include <iostream>
+#include <random>
+#include <stdexcept>
+#include <string>
+
+using namespace std;
+
+//! What a transfer through the emulator measured
+struct Transfer {
+    uint64_t finished_us = 0;  //!< Virtual time at which the receiver had the whole stream
+    LinkStats forward{};       //!< Stats of the link that carried the data
+};
+
+//! Send `size` random bytes from one TCPConnection to another over `link` (the same in both directions)
+static Transfer transfer(const size_t size, const LinkConfig &link, const unsigned seed) {
+    string data(size, 0);
+    mt19937 rng{seed};
+    generate(data.begin(), data.end(), [&] { return static_cast<char>(rng()); });
+
+    TCPConfig cfg{};
+    TCPConnection sender{cfg}, receiver{cfg};
+    NetworkEmulator emulator{sender, receiver, link, link, seed};
+    sender.connect();
+    receiver.end_input_stream();
+
+    string received;
+    size_t written = 0;
+    while (not receiver.inbound_stream().eof()) {
+        test_err_if(not sender.active(), "the connection died");
+        test_err_if(emulator.now() >= 600'000'000, "the transfer took more than 10 minutes");
+        if (written < size) {
+            written += sender.write(string_view(data).substr(written));
+            if (written == size) {
+                sender.end_input_stream();
+            }
+        }
+        emulator.step();
+        received += receiver.inbound_stream().read(receiver.inbound_stream().buffer_size());
+    }
+    test_err_if(received != data, "the bytes received don't match the bytes sent");
+    const Transfer result{emulator.now(), emulator.a_to_b().stats()};
+
+    // let both ends finish closing, which takes 10 retransmission timeouts
+    while ((sender.active() or receiver.active()) and emulator.now() < result.finished_us + 60'000'000) {
+        emulator.step();
+    }
+    test_err_if(sender.active() or receiver.active(), "the connection did not close");
+    return result;
+}
+
+//! a bandwidth-limited link takes (in virtual time) about as long as its rate says
+static void rate_and_delay() {
+    LinkConfig link{};
+    link.delay_us = 10'000;
+    link.rate_bps = 10'000'000;
+    const size_t size = 1 << 20;
+    const Transfer t = transfer(size, link, 1);
+
+    const uint64_t ideal = size * 8 * 1'000'000 / link.rate_bps;
+    test_err_if(t.finished_us <= ideal, "finished in " + to_string(t.finished_us) + " us, faster than the link allows");
+    test_err_if(t.finished_us >= 2 * ideal, "finished in " + to_string(t.finished_us) + " us, over twice the ideal");
+    test_err_if(t.forward.max_queue <= 1, "the bottleneck queue never filled");
+    test_err_if(t.forward.lost != 0 or t.forward.queue_drops != 0, "packets were dropped on a clean link");
+}
+
+//! the same seed gives the same run, however impaired the link
+static void deterministic() {
+    LinkConfig link{};
+    link.delay_us = 5'000;
+    link.jitter_us = 2'000;
+    link.rate_bps = 50'000'000;
+    link.loss = 0.01;
+    link.reorder = 0.05;
+    link.duplication = 0.02;
+    link.corruption = 0.01;
+    const Transfer first = transfer(256 << 10, link, 7), second = transfer(256 << 10, link, 7);
+
+    test_err_if(first.finished_us != second.finished_us, "two runs with the same seed took different times");
+    test_err_if(first.forward.delivered != second.forward.delivered,
+                "two runs with the same seed delivered differently");
+    test_err_if(first.forward.lost == 0 or first.forward.reordered == 0 or first.forward.duplicated == 0 or
+                first.forward.corrupted == 0,
+                "the impairments were never applied");
+}
+
+//! a full bottleneck queue drops arrivals, and RED drops before it is full
+static void queue_drops() {
+    LinkConfig link{};
+    link.rate_bps = 1'000'000;
+    link.queue_limit = 20;
+
+    TCPConfig cfg{};
+    TCPConnection sender{cfg}, receiver{cfg};
+    NetworkEmulator emulator{sender, receiver, link, link};
+    sender.connect();
+    sender.write(string(TCPConfig::DEFAULT_CAPACITY, 'x'));
+    while (emulator.now() < 100'000) {
+        emulator.step();
+    }
+    const LinkStats &stats = emulator.a_to_b().stats();
+    test_err_if(stats.queue_drops == 0, "a full queue dropped nothing");
+    test_should_be(stats.max_queue, link.queue_limit);
+
+    // RED drops before the queue is full (and with no limit on its length)
+    LinkConfig red_config = link;
+    red_config.queue_limit = 0;
+    red_config.red_min = 2;
+    red_config.red_max = 10;
+    red_config.red_max_p = 0.5;
+    EmulatedLink red{red_config, 3};
+    TCPSegment seg;
+    seg.payload() = Buffer{string(1000, 'y')};
+    for (unsigned i = 0; i < 10000; ++i) {
+        red.send(seg, 0);
+    }
+    test_err_if(red.stats().queue_drops == 0, "RED dropped nothing");
+    test_err_if(red.stats().max_queue >= 10000, "RED let every packet into the queue");
+
+    // RED with no room between its thresholds would drop every packet, so it's refused
+    red_config.red_max = red_config.red_min;
+    bool refused = false;
+    try {
+        EmulatedLink bad{red_config, 3};
+    } catch (const runtime_error &) {
+        refused = true;
+    }
+    test_err_if(not refused, "a RED config with red_max <= red_min was accepted");
+}
+
+//! command-line options set the impairments they name, and unknown ones are refused
+static void options() {
+    LinkConfig link{};
+    link.set_option('D', "20");
+    link.set_option('B', "1000");
+    link.set_option('O', "0.25");
+    test_err_if(link.delay_us != 20'000 or link.rate_bps != 1'000'000 or link.reorder != 0.25, "options misread");
+    bool refused = false;
+    try {
+        link.set_option('X', "1");
+    } catch (const runtime_error &) {
+        refused = true;
+    }
+    test_err_if(not refused, "an unknown option was accepted");
+}
+
+int main() {
+    try {
+        options();
+        rate_and_delay();
+        deterministic();
+        queue_drops();
+    } catch (const exception &e) {
+        cerr << e.what() << endl;
+        return err_num;
+    }
+
+    return EXIT_SUCCESS;
+}
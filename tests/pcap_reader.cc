@@ -0,0 +1,141 @@
+#include "ipv4_datagram.hh"
+#include "pcap_reader.hh"
+#include "tcp_segment.hh"
+#include "test_err_if.hh"
+
+#include <cstdint>
+#include <cstdlib>
+#include <exception>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+
+using namespace std;
+
+//! `value` as 4 bytes, in our byte order or (if `swapped`) the other one
+static string u32(uint32_t value, const bool swapped) {
+    if (swapped) {
+        value = __builtin_bswap32(value);
+    }
+    return string(reinterpret_cast<const char *>(&value), sizeof(value));
+}
+
+static string file_header(const uint32_t magic, const uint32_t link_type, const bool swapped) {
+    const string version = swapped ? string{0, 2, 0, 4} : string{2, 0, 4, 0};
+    return u32(magic, swapped) + version + u32(0, swapped) + u32(0, swapped) + u32(65535, swapped) +
+           u32(link_type, swapped);
+}
+
+static string record(const uint32_t seconds, const uint32_t fraction, const string &data, const bool swapped) {
+    return u32(seconds, swapped) + u32(fraction, swapped) + u32(data.size(), swapped) + u32(data.size(), swapped) +
+           data;
+}
+
+//! An IPv4 datagram carrying a TCP segment with `payload`
+static string tcp_datagram(const string &payload) {
+    TCPSegment seg;
+    seg.header().sport = 1234;
+    seg.header().dport = 80;
+    seg.header().seqno = WrappingInt32{1000};
+    seg.header().ack = true;
+    seg.payload() = Buffer{string(payload)};
+
+    IPv4Datagram dgram;
+    dgram.header().src = 0x0a000001;
+    dgram.header().dst = 0x0a000002;
+    dgram.payload() = seg.serialize(dgram.header().pseudo_cksum());
+    dgram.header().len = IPv4Header::LENGTH + dgram.payload().size();
+    dgram.payload() = seg.serialize(dgram.header().pseudo_cksum());
+    return dgram.serialize().concatenate();
+}
+
+//! Ethernet frames, microsecond timestamps, in our byte order
+static void ethernet() {
+    const string datagram = tcp_datagram("hello");
+    const string macs(12, '\x11');
+    const string ipv4_frame = macs + "\x08\x00"s + datagram + string(64 - 14 - datagram.size(), '\0');  // padded
+    const string vlan_frame = macs + "\x81\x00\x00\x07\x08\x00"s + datagram;
+    const string arp_frame = macs + "\x08\x06"s + string(28, '\0');
+    const string capture = file_header(0xa1b2c3d4, PcapReader::Ethernet, false) + record(10, 500, ipv4_frame, false) +
+                           record(11, 0, arp_frame, false) + record(12, 999999, vlan_frame, false);
+
+    PcapReader reader{Buffer{string(capture)}};
+    test_err_if(reader.link_type() != PcapReader::Ethernet, "wrong link type");
+
+    const auto first = reader.next();
+    test_err_if(not first.has_value() or first->timestamp_ns != 10'000'500'000, "wrong first timestamp");
+    test_err_if(first->data.str() != ipv4_frame or first->original_length != ipv4_frame.size(), "wrong first packet");
+    const auto first_datagram = reader.ipv4_datagram(first.value());
+    test_err_if(not first_datagram.has_value() or first_datagram->str() != datagram, "padding wasn't trimmed");
+
+    IPv4Datagram dgram;
+    TCPSegment seg;
+    test_err_if(dgram.parse(first_datagram.value()) != ParseResult::NoError, "the datagram doesn't parse");
+    test_err_if(seg.parse(Buffer(dgram.payload()), dgram.header().pseudo_cksum()) != ParseResult::NoError or
+                seg.payload().str() != "hello",
+                "the segment doesn't parse");
+
+    const auto arp = reader.next();
+    test_err_if(not arp.has_value() or reader.ipv4_datagram(arp.value()).has_value(), "ARP was taken for IPv4");
+
+    const auto tagged = reader.next();
+    test_err_if(not tagged.has_value() or tagged->timestamp_ns != 12'999'999'000, "wrong last timestamp");
+    const auto tagged_datagram = reader.ipv4_datagram(tagged.value());
+    test_err_if(not tagged_datagram.has_value() or tagged_datagram->str() != datagram, "the VLAN tag wasn't skipped");
+
+    test_err_if(reader.next().has_value(), "read past the end");
+}
+
+//! raw IPv4, nanosecond timestamps, in the other byte order; and a capture cut off in a packet
+static void swapped() {
+    const string datagram = tcp_datagram("world");
+    const string capture = file_header(0xa1b23c4d, PcapReader::Raw, true) + record(1, 2, datagram, true) +
+                           record(3, 4, datagram.substr(0, 30), true);
+
+    PcapReader reader{Buffer{string(capture)}};
+    test_err_if(reader.link_type() != PcapReader::Raw, "wrong link type");
+    const auto first = reader.next();
+    test_err_if(not first.has_value() or first->timestamp_ns != 1'000'000'002, "wrong nanosecond timestamp");
+    const auto first_datagram = reader.ipv4_datagram(first.value());
+    test_err_if(not first_datagram.has_value() or first_datagram->str() != datagram, "wrong raw datagram");
+
+    // the datagram claims more bytes than were captured
+    const auto cut = reader.next();
+    test_err_if(not cut.has_value() or reader.ipv4_datagram(cut.value()).has_value(), "a cut datagram was returned");
+
+    PcapReader truncated{Buffer{capture.substr(0, capture.size() - 10)}};
+    truncated.next();
+    bool threw = false;
+    try {
+        truncated.next();
+    } catch (const runtime_error &) {
+        threw = true;
+    }
+    test_err_if(not threw, "a truncated capture wasn't noticed");
+}
+
+//! files that aren't classic pcap are refused
+static void not_pcap() {
+    for (const string &bytes : {string(24, 'x'), u32(0x0a0d0d0a, false) + string(28, '\0'), string("short")}) {
+        bool threw = false;
+        try {
+            PcapReader reader{Buffer{string(bytes)}};
+        } catch (const runtime_error &) {
+            threw = true;
+        }
+        test_err_if(not threw, "accepted a file that isn't pcap");
+    }
+}
+
+int main() {
+    try {
+        ethernet();
+        swapped();
+        not_pcap();
+    } catch (const exception &e) {
+        cerr << e.what() << endl;
+        return err_num;
+    }
+
+    return EXIT_SUCCESS;
+}
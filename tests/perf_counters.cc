@@ -0,0 +1,59 @@
+#include "perf_counters.hh"
+#include "test_err_if.hh"
+
+#include <cstdint>
+#include <cstdlib>
+#include <exception>
+#include <iostream>
+#include <string>
+
+using namespace std;
+
+//! a loop of `n` iterations the compiler can't remove
+static uint64_t spin(const uint64_t n) {
+    volatile uint64_t sum = 0;
+    for (uint64_t i = 0; i < n; ++i) {
+        sum = sum + i;
+    }
+    return sum;
+}
+
+int main() {
+    try {
+        // wherever perf events aren't permitted (or there's no PMU, as in many VMs), every counter
+        // reads as nullopt and nothing throws
+        PerfCounters counters;
+        test_err_if(not counters.available() and counters.error().empty(), "no counters, and no reason why");
+
+        counters.start();
+        spin(1000000);
+        counters.stop();
+        const PerfCounters::Values during = counters.read();
+        spin(1000000);
+        const PerfCounters::Values after = counters.read();
+
+        for (size_t c = 0; c < PerfCounters::COUNT; ++c) {
+            const string name = PerfCounters::name(static_cast<PerfCounters::Counter>(c));
+            test_err_if(during[c].has_value() != after[c].has_value(), name + " came and went");
+            if (during[c].has_value()) {
+                test_err_if(during[c].value() != after[c].value(), name + " counted while stopped");
+            }
+        }
+        if (during[PerfCounters::Instructions].has_value()) {
+            test_err_if(during[PerfCounters::Instructions].value() < 1000000, "too few instructions");
+        }
+
+        counters.reset();
+        for (const auto &value : counters.read()) {
+            test_err_if(value.has_value() and value.value() != 0, "reset didn't zero the counters");
+        }
+        if (not counters.available()) {
+            cerr << "(hardware counters unavailable: " << counters.error() << ")\n";
+        }
+    } catch (const exception &e) {
+        cerr << e.what() << endl;
+        return err_num;
+    }
+
+    return EXIT_SUCCESS;
+}
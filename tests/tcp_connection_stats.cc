@@ -0,0 +1,135 @@
+#include "tcp_config.hh"
+#include "tcp_connection.hh"
+#include "tcp_connection_stats.hh"
+#include "test_err_if.hh"
+#include "test_should_be.hh"
+
+#include <cstdlib>
+#include <exception>
+#include <iostream>
+#include <queue>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+//! Move `from`'s outbound segments to `to`
+static void shuttle(TCPConnection &from, TCPConnection &to) {
+    for (; not from.segments_out().empty(); from.segments_out().pop()) {
+        to.segment_received(from.segments_out().front());
+    }
+}
+
+//! `from`'s outbound segments, taken off its queue
+static vector<TCPSegment> take(TCPConnection &from) {
+    vector<TCPSegment> ret;
+    for (; not from.segments_out().empty(); from.segments_out().pop()) {
+        ret.push_back(from.segments_out().front());
+    }
+    return ret;
+}
+
+//! both ends of a connection agree on what was sent, and the gauges match the accessors
+static void clean_transfer() {
+    TCPConfig cfg{};
+    TCPConnection client{cfg}, server{cfg};
+    client.connect();
+    shuttle(client, server);
+    shuttle(server, client);
+
+    for (unsigned i = 0; i < 10; ++i) {
+        client.write(string(5000, 'x'));
+        shuttle(client, server);
+        shuttle(server, client);
+        server.inbound_stream().pop_output(server.inbound_stream().buffer_size());
+    }
+
+    const TCPConnectionStats c = client.stats(), s = server.stats();
+    test_err_if(c.bytes_sent != 50000 or s.bytes_received != 50000, "payload bytes were miscounted");
+    test_err_if(c.segments_sent != s.segments_received or s.segments_sent != c.segments_received,
+                "the two ends disagree on the segments exchanged");
+    test_err_if(c.segments_sent < 50000 / TCPConfig::MAX_PAYLOAD_SIZE, "too few segments were counted");
+    test_err_if(c.retransmissions != 0 or s.duplicate_segments != 0 or s.out_of_order_segments != 0,
+                "a clean transfer counted retransmissions, duplicates or reordering");
+    test_err_if(c.rto_ms != TCPConfig::TIMEOUT_DFLT, "wrong RTO " + to_string(c.rto_ms));
+    test_err_if(c.peer_window != s.receive_window or s.receive_window != TCPConfig::DEFAULT_CAPACITY - 5000,
+                "wrong windows " + to_string(c.peer_window) + " and " + to_string(s.receive_window));
+    test_err_if(c.bytes_in_flight != client.bytes_in_flight(), "bytes_in_flight doesn't match");
+}
+
+//! a lost segment is retransmitted when the timer expires, and the RTO backs off; reordered and
+//! duplicated segments are told apart
+static void loss_and_reordering() {
+    TCPConfig cfg{};
+    TCPConnection client{cfg}, server{cfg};
+    client.connect();
+    shuttle(client, server);
+    shuttle(server, client);
+    shuttle(client, server);
+
+    client.write(string(3 * TCPConfig::MAX_PAYLOAD_SIZE, 'y'));
+    vector<TCPSegment> segments = take(client);
+    test_should_be(segments.size(), size_t{3});
+
+    // the first is delayed past its retransmission; the third arrives before the second, which arrives
+    // twice; out of order every time, since the first is still missing
+    server.segment_received(segments[2]);
+    server.segment_received(segments[1]);
+    server.segment_received(segments[1]);
+    take(server);
+    client.tick(TCPConfig::TIMEOUT_DFLT);
+    const vector<TCPSegment> retransmitted = take(client);
+    test_err_if(retransmitted.size() != 1 or retransmitted.front().header().seqno != segments[0].header().seqno,
+                "the lost segment was not retransmitted");
+    server.segment_received(retransmitted.front());
+    server.segment_received(segments[0]);
+
+    const TCPConnectionStats c = client.stats(), s = server.stats();
+    test_err_if(c.retransmissions != 1 or c.retransmission_timeouts != 1 or c.zero_window_probes != 0,
+                "the retransmission was miscounted");
+    test_err_if(c.retransmitted_bytes != TCPConfig::MAX_PAYLOAD_SIZE, "retransmitted bytes were miscounted");
+    test_err_if(c.rto_ms != 2 * TCPConfig::TIMEOUT_DFLT, "the RTO did not back off");
+    test_err_if(c.consecutive_retransmissions != 1, "consecutive retransmissions were miscounted");
+    test_should_be(s.out_of_order_segments, uint64_t{3});
+    test_should_be(s.duplicate_segments, uint64_t{1});
+}
+
+//! a receiver that doesn't read closes its window; the sender counts the zero window, probes it,
+//! and counts the time it spends window-limited
+static void zero_window() {
+    TCPConfig cfg{};
+    cfg.recv_capacity = 4000;
+    TCPConnection client{TCPConfig{}}, server{cfg};
+    client.connect();
+    shuttle(client, server);
+    shuttle(server, client);
+    shuttle(client, server);
+
+    client.write(string(10000, 'z'));
+    for (unsigned i = 0; i < 5; ++i) {
+        shuttle(client, server);
+        shuttle(server, client);
+        client.tick(TCPConfig::TIMEOUT_DFLT);
+    }
+
+    const TCPConnectionStats c = client.stats(), s = server.stats();
+    test_should_be(c.zero_window_events, uint64_t{1});
+    test_should_be(s.zero_windows_advertised, uint64_t{1});
+    test_err_if(c.peer_window != 0 or s.receive_window != 0, "the windows aren't zero");
+    test_err_if(c.zero_window_probes == 0 or c.retransmission_timeouts != 0, "the probes were miscounted");
+    test_err_if(c.window_limited_ms < 4 * TCPConfig::TIMEOUT_DFLT,
+                "window-limited for only " + to_string(c.window_limited_ms) + " ms");
+}
+
+int main() {
+    try {
+        clean_transfer();
+        loss_and_reordering();
+        zero_window();
+    } catch (const exception &e) {
+        cerr << e.what() << endl;
+        return err_num;
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,106 @@
+#include "tcp_config.hh"
+#include "tcp_engine.hh"
+#include "tcp_stack_harness.hh"
+#include "util.hh"
+
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <exception>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <utility>
+
+using namespace std;
+
+static constexpr unsigned NCONNS = 40;
+static constexpr size_t NWORKERS = 3;
+static constexpr uint16_t SERVER_PORT = 80;
+
+//! echo on many connections at once, with or without a `virtio_net_hdr` on each datagram
+static void echo(const bool vnet_hdr) {
+    // the handlers use these until the engines' threads have been joined, so they are declared first
+    atomic<unsigned> wrong_worker{0};
+    mutex replies_mutex;
+    map<uint16_t, pair<string, thread::id>> replies;
+    set<string> finished;
+
+    auto [client_end, server_end] = datagram_pair();
+    TCPEngine server{server_end.duplicate(), server_end.duplicate(), NWORKERS, vnet_hdr};
+    TCPEngine client{client_end.duplicate(), client_end.duplicate(), NWORKERS, vnet_hdr};
+
+    TCPConfig cfg{};
+    cfg.rt_timeout = 10;
+
+    // the server echoes everything back, and closes once the client has
+    server.set_handler([&](TCPHandle h) {
+        const string data = h.read();
+        if (not data.empty()) {
+            h.write(data);
+        }
+        if (h.connection().inbound_stream().eof() and not h.connection().outbound_stream().input_ended()) {
+            h.end_input_stream();
+        }
+    });
+    server.listen(cfg, SERVER_PORT);
+
+    // the client collects the replies; each connection's handler must always run on the same thread
+    client.set_handler([&](TCPHandle h) {
+        const lock_guard<mutex> lock(replies_mutex);
+        auto &[reply, owner] = replies.try_emplace(h.flow().local_port, "", this_thread::get_id()).first->second;
+        if (owner != this_thread::get_id()) {
+            ++wrong_worker;
+        }
+        reply.append(h.read());
+        if (h.connection().inbound_stream().eof()) {
+            finished.insert(reply);
+        }
+    });
+
+    set<string> expected;
+    for (unsigned i = 0; i < NCONNS; ++i) {
+        FdAdapterConfig c_ad{};
+        c_ad.source = {"10.0.0.2", static_cast<uint16_t>(10000 + i)};
+        c_ad.destination = {"10.0.0.1", SERVER_PORT};
+        const TCPFlow flow = client.connect(cfg, c_ad);
+        client.write(flow, "hello from connection " + to_string(i));
+        client.end_input_stream(flow);
+        expected.insert("hello from connection " + to_string(i));
+    }
+
+    const auto deadline = timestamp_ms() + 10000;
+    while (timestamp_ms() < deadline) {
+        {
+            const lock_guard<mutex> lock(replies_mutex);
+            if (finished.size() == NCONNS) {
+                break;
+            }
+        }
+        this_thread::sleep_for(chrono::milliseconds(1));
+    }
+
+    const lock_guard<mutex> lock(replies_mutex);
+    if (finished != expected) {
+        throw runtime_error("got " + to_string(finished.size()) + " of " + to_string(NCONNS) + " replies");
+    }
+    if (wrong_worker) {
+        throw runtime_error("a handler ran on a worker that doesn't own its connection");
+    }
+}
+
+int main() {
+    try {
+        echo(false);
+        echo(true);
+    } catch (const exception &e) {
+        cerr << "Exception: " << e.what() << endl;
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
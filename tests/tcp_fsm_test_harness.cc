@@ -27,11 +27,9 @@ TestFD::TestFD(pair<FileDescriptor, TestRFD> fd_pair)
 
 //! \param[in] buffer is the content to write to the TestFD
 void TestFD::write(const BufferViewList &buffer) {
-    auto iovecs = buffer.as_iovecs();
-
     msghdr message{};
-    message.msg_iov = iovecs.data();
-    message.msg_iovlen = iovecs.size();
+    message.msg_iov = const_cast<iovec *>(buffer.iovecs());
+    message.msg_iovlen = buffer.iovec_count();
 
     SystemCall("sendmsg", ::sendmsg(fd_num(), &message, MSG_EOR));
 }
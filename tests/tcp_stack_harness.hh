@@ -0,0 +1,29 @@
+#ifndef SPONGE_TESTS_TCP_STACK_HARNESS_HH
+#define SPONGE_TESTS_TCP_STACK_HARNESS_HH
+
+#include "eventloop.hh"
+#include "file_descriptor.hh"
+#include "tcp_stack.hh"
+#include "util.hh"
+
+#include <sys/socket.h>
+#include <utility>
+
+//! a pair of connected sockets that preserve datagram boundaries, standing in for the network
+static inline std::pair<FileDescriptor, FileDescriptor> datagram_pair() {
+    int fds[2];
+    SystemCall("socketpair", ::socketpair(AF_UNIX, SOCK_SEQPACKET, 0, static_cast<int *>(fds)));
+    return {FileDescriptor(fds[0]), FileDescriptor(fds[1])};
+}
+
+//! process datagrams on both stacks until neither has any left to read
+static inline void exchange(TCPStack &a, TCPStack &b) {
+    bool progress = true;
+    while (progress) {
+        progress = false;
+        progress |= a.wait_next_event(0) == EventLoop::Result::Success;
+        progress |= b.wait_next_event(0) == EventLoop::Result::Success;
+    }
+}
+
+#endif  // SPONGE_TESTS_TCP_STACK_HARNESS_HH
@@ -0,0 +1,98 @@
+#include "tcp_config.hh"
+#include "tcp_stack.hh"
+#include "tcp_stack_harness.hh"
+
+#include <algorithm>
+#include <cstdlib>
+#include <exception>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+using namespace std;
+
+static constexpr unsigned NCONNS = 10;
+static constexpr size_t BACKLOG = 4;
+static constexpr uint16_t SERVER_PORT = 80;
+
+static void expect_sizes(const TCPStack &server, const size_t established, const size_t half_open) {
+    if (server.size() != established or server.half_open() != half_open) {
+        throw runtime_error("expected " + to_string(established) + " established and " + to_string(half_open) +
+                            " half-open connections, got " + to_string(server.size()) + " and " +
+                            to_string(server.half_open()));
+    }
+}
+
+int main() {
+    try {
+        auto [client_end, server_end] = datagram_pair();
+        FileDescriptor client_tx = client_end.duplicate();
+        FileDescriptor server_tx = server_end.duplicate();
+        TCPStack client{move(client_end), move(client_tx)};
+        TCPStack server{move(server_end), move(server_tx)};
+
+        TCPConfig cfg{};
+        cfg.rt_timeout = 10;
+        server.listen(cfg, SERVER_PORT, BACKLOG);
+
+        // every handshake is in progress at once
+        vector<TCPHandle> handles;
+        for (unsigned i = 0; i < NCONNS; ++i) {
+            FdAdapterConfig c_ad{};
+            c_ad.source = {"10.0.0.2", static_cast<uint16_t>(20000 + i)};
+            c_ad.destination = {"10.0.0.1", SERVER_PORT};
+            handles.push_back(client.connect(cfg, c_ad));
+        }
+        exchange(client, server);
+
+        // only `BACKLOG` of them leave the SYN table before the application accepts anything
+        expect_sizes(server, BACKLOG, NCONNS - BACKLOG);
+        for (const auto &h : handles) {
+            if (not h.connection().active() or h.connection().bytes_in_flight() != 0) {
+                throw runtime_error("client handshake did not complete");
+            }
+        }
+
+        // listening on the port again is refused, and leaves its SYN table and accept queue alone
+        bool refused = false;
+        try {
+            server.listen(cfg, SERVER_PORT, BACKLOG);
+        } catch (const runtime_error &) {
+            refused = true;
+        }
+        if (not refused) {
+            throw runtime_error("listening twice on a port was accepted");
+        }
+        expect_sizes(server, BACKLOG, NCONNS - BACKLOG);
+
+        // each accept() makes room for one more
+        vector<TCPHandle> accepted;
+        while (auto h = server.accept()) {
+            accepted.push_back(*h);
+            const size_t handed_off = min<size_t>(NCONNS, BACKLOG + accepted.size());
+            expect_sizes(server, handed_off, NCONNS - handed_off);
+        }
+        if (accepted.size() != NCONNS) {
+            throw runtime_error("server accepted " + to_string(accepted.size()) + " connections");
+        }
+
+        // connections that waited in the SYN table still carry data
+        for (unsigned i = 0; i < NCONNS; ++i) {
+            handles[i].write("ping " + to_string(i));
+        }
+        exchange(client, server);
+        for (auto &h : accepted) {
+            const string data = h.read();
+            if (data != "ping " + to_string(h.flow().remote_port - 20000)) {
+                throw runtime_error("server got the wrong data: " + data);
+            }
+        }
+    } catch (const exception &e) {
+        cerr << "Exception: " << e.what() << endl;
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
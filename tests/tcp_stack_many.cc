@@ -0,0 +1,118 @@
+#include "tcp_config.hh"
+#include "tcp_stack.hh"
+#include "tcp_stack_harness.hh"
+#include "util.hh"
+
+#include <cstdlib>
+#include <exception>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+using namespace std;
+
+static constexpr unsigned NCONNS = 200;
+static constexpr uint16_t SERVER_PORT = 80;
+
+int main() {
+    try {
+        auto [client_end, server_end] = datagram_pair();
+        FileDescriptor client_tx = client_end.duplicate();
+        FileDescriptor server_tx = server_end.duplicate();
+        TCPStack client{move(client_end), move(client_tx)};
+        TCPStack server{move(server_end), move(server_tx)};
+
+        TCPConfig cfg{};
+        cfg.rt_timeout = 10;
+
+        // the server echoes everything back, and closes once the client has
+        server.listen(cfg, SERVER_PORT, NCONNS);
+        server.set_handler([&](TCPHandle h) {
+            const string data = h.read();
+            if (not data.empty()) {
+                h.write(data);
+            }
+            if (h.connection().inbound_stream().eof() and not h.connection().outbound_stream().input_ended()) {
+                h.end_input_stream();
+            }
+        });
+
+        vector<TCPHandle> handles;
+        for (unsigned i = 0; i < NCONNS; ++i) {
+            FdAdapterConfig c_ad{};
+            c_ad.source = {"10.0.0.2", static_cast<uint16_t>(10000 + i)};
+            c_ad.destination = {"10.0.0.1", SERVER_PORT};
+            handles.push_back(client.connect(cfg, c_ad));
+            exchange(client, server);
+        }
+
+        if (server.size() != NCONNS or client.size() != NCONNS) {
+            throw runtime_error("expected " + to_string(NCONNS) + " connections on each side, got " +
+                                to_string(client.size()) + " and " + to_string(server.size()));
+        }
+
+        unsigned accepted = 0;
+        while (server.accept()) {
+            ++accepted;
+        }
+        if (accepted != NCONNS) {
+            throw runtime_error("server accepted " + to_string(accepted) + " connections");
+        }
+
+        for (unsigned i = 0; i < NCONNS; ++i) {
+            handles[i].write("hello from connection " + to_string(i));
+            handles[i].end_input_stream();
+            exchange(client, server);
+        }
+
+        for (unsigned i = 0; i < NCONNS; ++i) {
+            if (not handles[i].connection().inbound_stream().input_ended()) {
+                throw runtime_error("connection " + to_string(i) + " did not receive the server's FIN");
+            }
+            const string reply = handles[i].read();
+            if (reply != "hello from connection " + to_string(i)) {
+                throw runtime_error("connection " + to_string(i) + " got the wrong reply: " + reply);
+            }
+        }
+
+        // a SYN to a port nobody listens on is refused. The stack may reap the reset connection on
+        // the first tick after the RST, so the reset is seen from the handler, which runs as it arrives.
+        FdAdapterConfig refused{};
+        refused.source = {"10.0.0.2", 9999};
+        refused.destination = {"10.0.0.1", SERVER_PORT + 1};
+        TCPHandle h = client.connect(cfg, refused);
+        unsigned resets = 0;
+        client.set_handler([&](TCPHandle handle) {
+            if (handle.flow() == h.flow() and handle.connection().inbound_stream().error()) {
+                ++resets;
+            }
+        });
+        exchange(client, server);
+        if (resets != 1) {
+            throw runtime_error("connection to a closed port was reset " + to_string(resets) + " times");
+        }
+        if (h.valid() and not h.connection().inbound_stream().error()) {
+            throw runtime_error("connection to a closed port is still in the table, but not reset");
+        }
+
+        // once the client's connections stop lingering, both tables drain
+        const auto deadline = timestamp_ms() + 5000;
+        while ((client.size() or server.size()) and timestamp_ms() < deadline) {
+            client.wait_next_event(1);
+            server.wait_next_event(1);
+        }
+        if (client.size() or server.size()) {
+            throw runtime_error("connections were not reaped after closing");
+        }
+        if (h.valid()) {
+            throw runtime_error("handle to a reaped connection is still valid");
+        }
+    } catch (const exception &e) {
+        cerr << "Exception: " << e.what() << endl;
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,146 @@
+#include "tcp_config.hh"
+#include "tcp_listener.hh"
+#include "tcp_stack.hh"
+#include "tcp_stack_harness.hh"
+
+#include <cstdlib>
+#include <exception>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+using namespace std;
+
+static constexpr unsigned NCONNS = 50;
+static constexpr uint16_t SERVER_PORT = 80;
+
+//! the SYN/ACK that a listener sends in reply to a SYN from `flow`
+static TCPSegment cookie_for(TCPListener &listener, const TCPFlow &flow, const WrappingInt32 peer_isn) {
+    TCPSegment syn;
+    syn.header().syn = true;
+    syn.header().seqno = peer_isn;
+    if (not listener.segment_received(flow, syn) or listener.segments_out().size() != 1) {
+        throw runtime_error("listener did not answer the SYN");
+    }
+    TCPSegment syn_ack = listener.segments_out().front().second;
+    listener.segments_out().pop();
+    if (not syn_ack.header().syn or not syn_ack.header().ack or syn_ack.header().ackno != peer_isn + 1) {
+        throw runtime_error("bad SYN/ACK");
+    }
+    return syn_ack;
+}
+
+//! the peer's final ACK of a SYN/ACK
+static TCPSegment ack_of(const TCPSegment &syn_ack, const WrappingInt32 peer_isn) {
+    TCPSegment ack;
+    ack.header().ack = true;
+    ack.header().seqno = peer_isn + 1;
+    ack.header().ackno = syn_ack.header().seqno + 1;
+    ack.header().win = 1000;
+    return ack;
+}
+
+//! stack-level handshakes and data transfer with every SYN answered by a cookie
+static void cookie_handshakes() {
+    auto [client_end, server_end] = datagram_pair();
+    FileDescriptor client_tx = client_end.duplicate();
+    FileDescriptor server_tx = server_end.duplicate();
+    TCPStack client{move(client_end), move(client_tx)};
+    TCPStack server{move(server_end), move(server_tx)};
+
+    TCPConfig cfg{};
+    cfg.rt_timeout = 10;
+    server.listen(cfg, SERVER_PORT).set_syn_cookies(TCPListener::SynCookies::Always);
+
+    vector<TCPHandle> handles;
+    for (unsigned i = 0; i < NCONNS; ++i) {
+        FdAdapterConfig c_ad{};
+        c_ad.source = {"10.0.0.2", static_cast<uint16_t>(30000 + i)};
+        c_ad.destination = {"10.0.0.1", SERVER_PORT};
+        handles.push_back(client.connect(cfg, c_ad));
+    }
+
+    // the server answers every SYN without allocating a connection
+    while (server.wait_next_event(0) == EventLoop::Result::Success) {
+    }
+    if (server.size() != 0 or server.half_open() != 0) {
+        throw runtime_error("server allocated state before the handshakes completed");
+    }
+
+    exchange(client, server);
+    if (server.size() != NCONNS) {
+        throw runtime_error("expected " + to_string(NCONNS) + " connections, got " + to_string(server.size()));
+    }
+
+    for (unsigned i = 0; i < NCONNS; ++i) {
+        handles[i].write("data " + to_string(i));
+    }
+    exchange(client, server);
+    unsigned accepted = 0;
+    while (auto h = server.accept()) {
+        const string data = h->read();
+        if (data != "data " + to_string(h->flow().remote_port - 30000)) {
+            throw runtime_error("server got the wrong data: " + data);
+        }
+        ++accepted;
+    }
+    if (accepted != NCONNS) {
+        throw runtime_error("server accepted " + to_string(accepted) + " connections");
+    }
+}
+
+//! cookies are checked against the 4-tuple, the peer's ISN and the time
+static void cookie_validation() {
+    const TCPFlow flow{0x0a000001, 0x0a000002, SERVER_PORT, 40000};
+    const WrappingInt32 peer_isn{12345};
+
+    TCPListener listener{TCPConfig{}};
+    listener.set_syn_cookies(TCPListener::SynCookies::Always);
+
+    // a forged ACK is refused
+    TCPSegment syn_ack = cookie_for(listener, flow, peer_isn);
+    TCPSegment forged = ack_of(syn_ack, peer_isn);
+    forged.header().ackno = forged.header().ackno + 1;
+    if (listener.segment_received(flow, forged)) {
+        throw runtime_error("forged cookie was accepted");
+    }
+
+    // so is a genuine one from another flow
+    TCPFlow other = flow;
+    other.remote_port++;
+    if (listener.segment_received(other, ack_of(syn_ack, peer_isn))) {
+        throw runtime_error("cookie was accepted from the wrong flow");
+    }
+
+    // and an expired one
+    listener.tick(2 * TCPListener::COOKIE_PERIOD_MS);
+    if (listener.segment_received(flow, ack_of(syn_ack, peer_isn))) {
+        throw runtime_error("expired cookie was accepted");
+    }
+
+    // a fresh one establishes the connection
+    syn_ack = cookie_for(listener, flow, peer_isn);
+    listener.tick(TCPListener::COOKIE_PERIOD_MS);
+    if (not listener.segment_received(flow, ack_of(syn_ack, peer_isn))) {
+        throw runtime_error("genuine cookie was refused");
+    }
+    auto node = listener.take_established();
+    if (node.empty() or node.key() != flow or not node.mapped().active()) {
+        throw runtime_error("cookie did not establish a connection");
+    }
+    node.mapped().send_rst_seg();
+}
+
+int main() {
+    try {
+        cookie_handshakes();
+        cookie_validation();
+    } catch (const exception &e) {
+        cerr << "Exception: " << e.what() << endl;
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,102 @@
+#include "ipv4_datagram.hh"
+#include "tcp_config.hh"
+#include "tcp_over_ip.hh"
+#include "tcp_stack.hh"
+#include "tcp_stack_harness.hh"
+#include "test_err_if.hh"
+#include "virtio_net_header.hh"
+
+#include <cstdlib>
+#include <exception>
+#include <iostream>
+#include <string>
+#include <utility>
+
+using namespace std;
+
+static constexpr uint16_t SERVER_PORT = 80;
+
+//! two stacks whose datagrams both carry a virtio_net_hdr can talk to each other
+static void stack_to_stack() {
+    auto [client_end, server_end] = datagram_pair();
+    FileDescriptor client_tx = client_end.duplicate();
+    FileDescriptor server_tx = server_end.duplicate();
+    TCPStack client{move(client_end), move(client_tx), true};
+    TCPStack server{move(server_end), move(server_tx), true};
+
+    TCPConfig cfg{};
+    server.listen(cfg, SERVER_PORT);
+
+    FdAdapterConfig c_ad{};
+    c_ad.source = {"10.0.0.2", 20000};
+    c_ad.destination = {"10.0.0.1", SERVER_PORT};
+    TCPHandle h = client.connect(cfg, c_ad);
+    exchange(client, server);
+
+    auto accepted = server.accept();
+    test_err_if(not accepted.has_value(), "server accepted nothing");
+    h.write("ping");
+    accepted->write("pong");
+    exchange(client, server);
+    test_err_if(accepted->read() != "ping", "server got the wrong data");
+    test_err_if(h.read() != "pong", "client got the wrong data");
+}
+
+//! the header is stripped on the way in (honoring a partial checksum) and a zeroed one is prepended on the way out
+static void frame_format() {
+    auto [raw, server_end] = datagram_pair();
+    FileDescriptor server_tx = server_end.duplicate();
+    TCPStack server{move(server_end), move(server_tx), true};
+    server.listen(TCPConfig{}, SERVER_PORT);
+
+    // a SYN whose checksum covers only the pseudo-header, as the kernel sends with TUN_F_CSUM
+    FdAdapterConfig c_ad{};
+    c_ad.source = {"10.0.0.2", 20000};
+    c_ad.destination = {"10.0.0.1", SERVER_PORT};
+    const TCPFlow flow{c_ad.source.ipv4_numeric(),
+                       c_ad.destination.ipv4_numeric(),
+                       c_ad.source.port(),
+                       c_ad.destination.port()};
+    TCPSegment syn;
+    syn.header().syn = true;
+    syn.header().seqno = WrappingInt32{1000};
+    syn.header().win = 1000;
+    const InternetDatagram ip_dgram = TCPOverIPv4Adapter::wrap_tcp_in_ip(syn, flow, true);
+
+    VirtioNetHeader vnet;
+    vnet.needs_csum = true;
+    vnet.csum_start = ip_dgram.header().hlen * 4;
+    vnet.csum_offset = 16;
+    BufferList packet{vnet.serialize()};
+    packet.append(ip_dgram.serialize());
+    raw.write(packet);
+    server.wait_next_event(0);
+
+    Buffer reply{raw.read()};
+    test_err_if(reply.size() <= VirtioNetHeader::LENGTH, "reply is too short to carry a virtio_net_hdr");
+    VirtioNetHeader reply_vnet;
+    test_err_if(reply_vnet.parse(reply) != ParseResult::NoError, "reply's virtio_net_hdr didn't parse");
+    test_err_if(reply_vnet.needs_csum or reply_vnet.gso_type != VirtioNetHeader::GSO_NONE,
+                "reply's virtio_net_hdr asks for an offload");
+
+    reply.remove_prefix(VirtioNetHeader::LENGTH);
+    InternetDatagram reply_dgram;
+    test_err_if(reply_dgram.parse(reply) != ParseResult::NoError, "reply isn't an IPv4 datagram");
+    TCPSegment syn_ack;
+    test_err_if(syn_ack.parse(reply_dgram.payload(), reply_dgram.header().pseudo_cksum()) != ParseResult::NoError,
+                "reply isn't a TCP segment with a valid checksum");
+    test_err_if(not syn_ack.header().syn or not syn_ack.header().ack or syn_ack.header().ackno != WrappingInt32{1001},
+                "reply isn't a SYN/ACK for the SYN");
+}
+
+int main() {
+    try {
+        stack_to_stack();
+        frame_format();
+    } catch (const exception &e) {
+        cerr << e.what() << endl;
+        return err_num;
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,117 @@
+#include "test_err_if.hh"
+#include "test_should_be.hh"
+#include "tracer.hh"
+
+#include <cstdio>
+#include <cstdlib>
+#include <exception>
+#include <iostream>
+#include <set>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+using namespace std;
+
+//! records from two threads come back in time order, each tagged with its thread; spans nest
+static void threads_and_scopes() {
+    Tracer::clear();
+    Tracer::set_enabled(true);
+    thread other{[] {
+        for (uint64_t i = 0; i < 100; ++i) {
+            Tracer::record(TracePoint::SegmentSent, TracePhase::Instant, i);
+        }
+    }};
+    for (uint64_t i = 0; i < 100; ++i) {
+        const TraceScope scope{TracePoint::Callback, i};
+        Tracer::record(TracePoint::ReassemblerInsert, TracePhase::Instant, i);
+    }
+    other.join();
+    Tracer::set_enabled(false);
+    Tracer::record(TracePoint::Tick, TracePhase::Instant, 0);  // not recorded
+
+    const auto events = Tracer::snapshot();
+    test_should_be(events.size(), size_t{400});
+    uint64_t previous = 0, sent = 0, depth = 0;
+    set<uint32_t> threads;
+    for (const auto &event : events) {
+        threads.insert(event.thread);
+        test_err_if(event.time_ns < previous, "events are out of order");
+        previous = event.time_ns;
+        if (event.point == TracePoint::SegmentSent) {
+            test_err_if(event.arg != sent++, "a thread's events are out of order");
+        } else {
+            depth += event.phase == TracePhase::Begin;
+            test_err_if(event.point == TracePoint::ReassemblerInsert and depth != 1,
+                        "an instant fell outside its span");
+            depth -= event.phase == TracePhase::End;
+        }
+    }
+    test_err_if(threads.size() != 2, "the threads don't have a number each");
+}
+
+//! a ring keeps only its newest records (less one: a snapshot skips the slot a thread may be writing)
+static void wraparound() {
+    Tracer::clear();
+    Tracer::set_enabled(true);
+    for (uint64_t i = 0; i < Tracer::RING_SIZE + 10; ++i) {
+        Tracer::record(TracePoint::SegmentReceived, TracePhase::Instant, i);
+    }
+    Tracer::set_enabled(false);
+
+    const auto events = Tracer::snapshot();
+    test_should_be(events.size(), Tracer::RING_SIZE - 1);
+    test_err_if(events.front().arg != 11 or events.back().arg != Tracer::RING_SIZE + 9, "the wrong events were kept");
+}
+
+//! a saved trace loads back unchanged, and converts to JSON
+static void files() {
+    Tracer::clear();
+    Tracer::set_enabled(true);
+    Tracer::record(TracePoint::SegmentSent, TracePhase::Instant, (uint64_t{12345} << 32) | 1000);
+    {
+        const TraceScope scope{TracePoint::Callback, 7};
+    }
+    Tracer::set_enabled(false);
+
+    const auto events = Tracer::snapshot();
+    char path[] = "/tmp/sponge_trace_XXXXXX";
+    const int fd = mkstemp(path);
+    test_err_if(fd < 0, "mkstemp failed");
+    close(fd);
+    Tracer::save(path, events);
+    const auto loaded = Tracer::load(path);
+    remove(path);
+    test_err_if(loaded.size() != 3, "the trace did not load back");
+    for (size_t i = 0; i < loaded.size(); ++i) {
+        test_err_if(loaded[i].time_ns != events[i].time_ns or loaded[i].arg != events[i].arg or
+                    loaded[i].thread != events[i].thread or loaded[i].point != events[i].point or
+                    loaded[i].phase != events[i].phase,
+                    "an event changed");
+    }
+
+    ostringstream json;
+    Tracer::write_chrome_json(json, loaded);
+    for (const char *expected : {R"("name":"segment_sent")",
+                                 R"("args":{"seqno":12345,"length":1000})",
+                                 R"("name":"callback","cat":"sponge","ph":"B")",
+                                 R"("ph":"E")",
+                                 R"("args":{"fd":7})"}) {
+        test_err_if(json.str().find(expected) == string::npos, string("the JSON lacks ") + expected);
+    }
+}
+
+int main() {
+    try {
+        threads_and_scopes();
+        wraparound();
+        files();
+    } catch (const exception &e) {
+        cerr << e.what() << endl;
+        return err_num;
+    }
+
+    return EXIT_SUCCESS;
+}
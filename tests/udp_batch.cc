@@ -0,0 +1,111 @@
+#include "socket.hh"
+
+#include <cstdlib>
+#include <exception>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+//! send 50 datagrams of different sizes in one sendto_batch() and check that recv_batch() returns them in order
+static void batch_roundtrip() {
+    constexpr size_t COUNT = 50;
+
+    UDPSocket receiver;
+    receiver.bind({"127.0.0.1", 0});
+    UDPSocket sender;
+    sender.bind({"127.0.0.1", 0});
+
+    vector<string> sent;
+    for (size_t i = 0; i < COUNT; ++i) {
+        sent.push_back(string(i * 7 % 1500, static_cast<char>('a' + i % 26)) + to_string(i));
+    }
+    const vector<BufferViewList> payloads(sent.begin(), sent.end());
+    sender.sendto_batch(receiver.local_address(), payloads);
+
+    vector<UDPSocket::received_datagram> batch(32, {{nullptr, 0}, {}, 0});
+    size_t received = 0;
+    while (received < COUNT) {
+        const size_t count = receiver.recv_batch(batch, 2048);
+        if (count == 0) {
+            throw runtime_error("recv_batch() found nothing after " + to_string(received) + " datagrams");
+        }
+        for (size_t i = 0; i < count; ++i, ++received) {
+            if (batch[i].payload.str() != sent[received]) {
+                throw runtime_error("datagram " + to_string(received) + " was corrupted or reordered");
+            }
+            if (batch[i].source_address != sender.local_address()) {
+                throw runtime_error("wrong source address " + batch[i].source_address.to_string());
+            }
+        }
+    }
+
+    if (receiver.recv_batch(batch) != 0) {
+        throw runtime_error("recv_batch() returned datagrams that were never sent");
+    }
+}
+
+//! send a run of equal-sized datagrams as one UDP_SEGMENT message, then check that they arrive intact
+//! whether or not the receiver lets UDP_GRO coalesce them
+static void segmented_roundtrip(const bool gro) {
+    constexpr size_t SEGMENT_SIZE = 1000;
+    constexpr size_t COUNT = 20;
+
+    UDPSocket receiver;
+    receiver.bind({"127.0.0.1", 0});
+    UDPSocket sender;
+    sender.bind({"127.0.0.1", 0});
+    if (not sender.supports_gso() or (gro and not receiver.enable_gro())) {
+        cerr << "Skipping: kernel lacks UDP_SEGMENT or UDP_GRO\n";
+        return;
+    }
+
+    vector<string> sent;
+    string train;
+    for (size_t i = 0; i < COUNT; ++i) {
+        // the last datagram of a train may be shorter than the rest
+        sent.push_back(string(i == COUNT - 1 ? SEGMENT_SIZE / 3 : SEGMENT_SIZE, static_cast<char>('A' + i)));
+        train += sent.back();
+    }
+    if (sender.sendto_batch(receiver.local_address(), {train}, {SEGMENT_SIZE}) != 1) {
+        throw runtime_error("kernel refused a UDP_SEGMENT message on loopback");
+    }
+
+    vector<UDPSocket::received_datagram> batch(COUNT, {{nullptr, 0}, {}, 0});
+    vector<string> received;
+    while (received.size() < COUNT) {
+        const size_t count = receiver.recv_batch(batch);
+        if (count == 0) {
+            throw runtime_error("recv_batch() found nothing after " + to_string(received.size()) + " datagrams");
+        }
+        for (size_t i = 0; i < count; ++i) {
+            const auto &datagram = batch[i];
+            if (not gro and datagram.segment_size != 0) {
+                throw runtime_error("coalesced datagrams arrived without UDP_GRO");
+            }
+            const size_t step = datagram.segment_size ? datagram.segment_size : datagram.payload.size();
+            for (size_t offset = 0; offset < datagram.payload.size(); offset += step) {
+                received.push_back(datagram.payload.substr(offset, step).copy());
+            }
+        }
+    }
+
+    if (received != sent) {
+        throw runtime_error("segmented datagrams were corrupted or split in the wrong places");
+    }
+}
+
+int main() {
+    try {
+        batch_roundtrip();
+        segmented_roundtrip(false);
+        segmented_roundtrip(true);
+    } catch (const exception &e) {
+        cerr << "Exception: " << e.what() << endl;
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}